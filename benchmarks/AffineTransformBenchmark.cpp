@@ -0,0 +1,78 @@
+// Micro-benchmarks of AffineTransform against the generic glm::mat4 operations:
+// composition vs operator*, inverse vs glm::inverse, and point transformation.
+#include <AffineTransform.h>
+#include <glm/ext/matrix_transform.hpp>
+#include <Benchmark.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+void print(std::string const &name, double matrixTime, double affineTime, std::size_t count)
+{
+    std::cout << std::setw(22) << name << std::fixed << std::setprecision(2)
+              << std::setw(14) << matrixTime * 1e6 / count << std::setw(14) << affineTime * 1e6 / count
+              << std::setw(10) << matrixTime / affineTime << "x" << std::endl;
+}
+
+int main()
+{
+    constexpr std::size_t count = 1 << 20;
+    std::mt19937 random(7);
+    std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+
+    // Rotation, uniform scale and translation, like the transformations of the samples
+    std::vector<glm::mat4> matrices(count);
+    std::vector<AffineTransform> affines(count);
+    std::vector<glm::vec3> points(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 axis = glm::normalize(glm::vec3(value(random), value(random), value(random)));
+        glm::quat rotation = glm::angleAxis(value(random), axis);
+        glm::vec3 translation(value(random), value(random), value(random));
+        affines[i] = AffineTransform::fromTranslationRotationScale(translation, rotation, glm::vec3(scale(random)));
+        matrices[i] = affines[i].toMat4();
+        points[i] = glm::vec3(value(random), value(random), value(random));
+    }
+
+    std::vector<glm::mat4> matrixResults(count);
+    std::vector<AffineTransform> affineResults(count);
+    std::vector<glm::vec3> pointResults(count);
+
+    std::cout << std::setw(22) << "operation" << std::setw(14) << "mat4 ns/op" << std::setw(14) << "affine ns/op" << std::setw(11) << "speedup" << std::endl;
+
+    print("compose", measure([&]
+                             { for (std::size_t i = 0; i + 1 < count; ++i) matrixResults[i] = matrices[i] * matrices[i + 1]; }),
+          measure([&]
+                  { for (std::size_t i = 0; i + 1 < count; ++i) affineResults[i] = affines[i] * affines[i + 1]; }),
+          count);
+
+    auto matrixInverseTime = measure([&]
+                                     { for (std::size_t i = 0; i < count; ++i) matrixResults[i] = glm::inverse(matrices[i]); });
+    print("inverse", matrixInverseTime, measure([&]
+                                                { for (std::size_t i = 0; i < count; ++i) affineResults[i] = affines[i].inverse(); }),
+          count);
+    print("rigid inverse", matrixInverseTime, measure([&]
+                                                      { for (std::size_t i = 0; i < count; ++i) affineResults[i] = affines[i].rigidInverse(); }),
+          count);
+
+    print("transform point", measure([&]
+                                     { for (std::size_t i = 0; i < count; ++i) pointResults[i] = glm::vec3(matrices[i] * glm::vec4(points[i], 1.0f)); }),
+          measure([&]
+                  { for (std::size_t i = 0; i < count; ++i) pointResults[i] = affines[i].transformPoint(points[i]); }),
+          count);
+
+    // Both inverses must undo the transformation
+    float maxError = 0.0f;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 roundTrip = affines[i].rigidInverse().transformPoint(affines[i].transformPoint(points[i]));
+        glm::vec3 generalRoundTrip = affines[i].inverse().transformPoint(affines[i].transformPoint(points[i]));
+        maxError = std::max({maxError, glm::length(roundTrip - points[i]), glm::length(generalRoundTrip - points[i])});
+    }
+    std::cout << "Max inverse round trip error: " << std::scientific << maxError << std::endl;
+    return 0;
+}
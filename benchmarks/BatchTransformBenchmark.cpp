@@ -0,0 +1,112 @@
+// Throughput of the batched coordinate transforms on the positions of a large sphere:
+// a plain loop over glm::mat4 * glm::vec4 against the structure of arrays kernels, the
+// strided path that reads MeshVertex positions in place, and both split across threads.
+#include <SphereMesh.h>
+#include <BatchTransform.h>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <Benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+void print(std::string const &name, double time, std::size_t count, double baseline)
+{
+    std::cout << std::setw(28) << name << std::fixed << std::setprecision(2) << std::setw(12) << time
+              << std::setw(14) << count / (time * 1e3) << std::setw(10) << baseline / time << "x" << std::defaultfloat << std::endl;
+}
+
+int main()
+{
+    Mesh sphere = createSphere(2.0f, 1000, 1000);
+    std::size_t count = sphere.vertices.size();
+    std::cout << "Vertices: " << count << std::endl;
+
+    std::vector<float> x(count), y(count), z(count);
+    std::vector<glm::vec3> positions(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        x[i] = sphere.vertices[i].position[0];
+        y[i] = sphere.vertices[i].position[1];
+        z[i] = sphere.vertices[i].position[2];
+        positions[i] = glm::vec3(x[i], y[i], z[i]);
+    }
+
+    glm::mat4 model = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, -2.0f, -8.0f)), 0.7f, glm::vec3(0.3f, 1.0f, 0.2f));
+    glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 100.0f) * model;
+
+    std::vector<float> outX(count), outY(count), outZ(count);
+    std::vector<glm::vec3> reference(count), results(count);
+    SoaSpan out{outX.data(), outY.data(), outZ.data()};
+    ConstSoaSpan in(x.data(), y.data(), z.data());
+
+    // Every kernel must match the plain glm loop
+    float maxError = 0.0f;
+    for (TransformMode mode : {TransformMode::Point, TransformMode::Direction, TransformMode::Projective})
+    {
+        glm::mat4 const &matrix = mode == TransformMode::Projective ? viewProjection : model;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            glm::vec4 result = matrix * glm::vec4(positions[i], mode == TransformMode::Direction ? 0.0f : 1.0f);
+            reference[i] = mode == TransformMode::Projective ? glm::vec3(result) / result.w : glm::vec3(result);
+        }
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+        {
+            BatchTransformOptions options;
+            options.maxLevel = level;
+            options.threadCount = 0;
+            transformCoordinates(mode, matrix, in, out, count, options);
+            transformCoordinates(mode, matrix, sphere.vertices[0].position, sizeof(MeshVertex), &results[0].x, sizeof(glm::vec3), count, options);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                maxError = std::max({maxError, glm::length(glm::vec3(outX[i], outY[i], outZ[i]) - reference[i]), glm::length(results[i] - reference[i])});
+            }
+        }
+    }
+    std::cout << "Max error against glm: " << std::scientific << maxError << std::defaultfloat << std::endl
+              << std::endl;
+
+    std::cout << std::setw(28) << "method" << std::setw(12) << "ms" << std::setw(14) << "M points/s" << std::setw(11) << "speedup" << std::endl;
+    double baseline = measure([&]
+                              { for (std::size_t i = 0; i < count; ++i) results[i] = glm::vec3(model * glm::vec4(positions[i], 1.0f)); });
+    print("glm loop", baseline, count, baseline);
+
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+    {
+        if (!cpuFeatures().supports(level))
+        {
+            continue;
+        }
+        BatchTransformOptions options;
+        options.maxLevel = level;
+        print(std::string("SoA ") + simdLevelName(level), measure([&]
+                                                                   { transformCoordinates(TransformMode::Point, model, in, out, count, options); }),
+              count, baseline);
+        print(std::string("MeshVertex stride ") + simdLevelName(level), measure([&]
+                                                                                 { transformCoordinates(TransformMode::Point, model, sphere.vertices[0].position, sizeof(MeshVertex), &results[0].x, sizeof(glm::vec3), count, options); }),
+              count, baseline);
+    }
+
+    BatchTransformOptions projective;
+    print("projective SoA", measure([&]
+                                    { transformCoordinates(TransformMode::Projective, viewProjection, in, out, count, projective); }),
+          count, baseline);
+
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 2; threads <= hardwareThreads; threads *= 2)
+    {
+        BatchTransformOptions options;
+        options.threadCount = threads;
+        print("SoA " + std::to_string(threads) + " threads", measure([&]
+                                                                      { transformCoordinates(TransformMode::Point, model, in, out, count, options); }),
+              count, baseline);
+        print("MeshVertex " + std::to_string(threads) + " threads", measure([&]
+                                                                             { transformCoordinates(TransformMode::Point, model, sphere.vertices[0].position, sizeof(MeshVertex), &results[0].x, sizeof(glm::vec3), count, options); }),
+              count, baseline);
+    }
+    return 0;
+}
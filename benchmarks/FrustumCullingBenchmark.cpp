@@ -0,0 +1,193 @@
+// Frustum culling and ray picking over 10,000 to 1,000,000 moving bounding spheres:
+//  - brute force sphere tests with the scalar, SSE2 (4 wide) and AVX2 (8 wide) kernels
+//  - BVH build, refit, incremental rebuild, culling and ray casts
+// The BVH results are checked against the brute force ones, also for axis-aligned rays grazing the
+// boxes of a grid of spheres, the program returns 1 on a mismatch.
+#include <SphereBvh.h>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <Benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Closest sphere hit by the ray, -1 when it misses them all
+int bruteForceRaycast(Ray const &ray, std::vector<BoundingSphere> const &spheres)
+{
+    int closestSphere = -1;
+    float closest = 1e30f;
+    for (std::size_t s = 0; s < spheres.size(); ++s)
+    {
+        float distance = intersectRaySphere(ray, spheres[s]);
+        if (distance >= 0.0f && distance < closest)
+        {
+            closest = distance;
+            closestSphere = static_cast<int>(s);
+        }
+    }
+    return closestSphere;
+}
+
+// Unit spheres on a grid of integer coordinates, so every box plane is exact. Rays along each axis
+// start on those planes and graze the spheres, which is where the slab test meets 0 * inf.
+bool checkAxisAlignedRays()
+{
+    std::vector<BoundingSphere> spheres;
+    for (int x = 0; x < 4; ++x)
+    {
+        for (int y = 0; y < 4; ++y)
+        {
+            for (int z = 0; z < 4; ++z)
+            {
+                spheres.push_back(BoundingSphere{glm::vec3(4.0f * x, 4.0f * y, 4.0f * z), 1.0f});
+            }
+        }
+    }
+    SphereBvh bvh;
+    bvh.build(spheres);
+
+    std::vector<Ray> rays;
+    for (auto const &sphere : spheres)
+    {
+        glm::vec3 c = sphere.center;
+        rays.push_back(Ray{glm::vec3(c.x + 1.0f, c.y, -100.0f), glm::vec3(0.0f, 0.0f, 1.0f)});
+        rays.push_back(Ray{glm::vec3(c.x, c.y - 1.0f, 100.0f), glm::vec3(0.0f, 0.0f, -1.0f)});
+        rays.push_back(Ray{glm::vec3(-100.0f, c.y, c.z + 1.0f), glm::vec3(1.0f, 0.0f, 0.0f)});
+        rays.push_back(Ray{glm::vec3(c.x - 1.0f, -100.0f, c.z), glm::vec3(0.0f, 1.0f, 0.0f)});
+        rays.push_back(Ray{glm::vec3(c.x + 1.0f, c.y + 1.0f, -100.0f), glm::vec3(0.0f, 0.0f, 1.0f)});
+    }
+    std::size_t hits = 0, mismatches = 0;
+    for (auto const &ray : rays)
+    {
+        BvhRayHit hit;
+        int bvhHit = bvh.raycast(ray, hit) ? static_cast<int>(hit.sphere) : -1;
+        int expected = bruteForceRaycast(ray, spheres);
+        hits += expected >= 0 ? 1 : 0;
+        mismatches += bvhHit != expected ? 1 : 0;
+    }
+    std::cout << "Axis-aligned rays: " << rays.size() << " cast, " << hits << " hits, " << mismatches << " BVH mismatches" << std::endl;
+    return 0 == mismatches;
+}
+
+int main()
+{
+    bool passed = true;
+    std::mt19937 random(9);
+    std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 3.0f);
+    std::uniform_real_distribution<float> velocity(-1.0f, 1.0f);
+
+    // Camera in the middle of the field looking down -z, about a sixth of the spheres are visible
+    glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 400.0f) *
+                               glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum = Frustum::fromViewProjection(viewProjection);
+
+    std::cout << std::setw(9) << "spheres" << std::setw(11) << "scalar" << std::setw(9) << "SSE2" << std::setw(9) << "AVX2"
+              << std::setw(9) << "build" << std::setw(9) << "refit" << std::setw(11) << "rebuild" << std::setw(10) << "BVH cull"
+              << std::setw(10) << "visible" << std::setw(12) << "ray brute" << std::setw(10) << "ray BVH" << std::endl;
+    std::cout << std::setw(9) << "" << std::setw(29) << "(brute force cull, ms)" << std::setw(39) << "(ms)" << std::setw(32) << "(us per ray)" << std::endl;
+
+    for (std::size_t count : {10000u, 100000u, 1000000u})
+    {
+        std::vector<BoundingSphere> spheres(count);
+        std::vector<glm::vec3> velocities(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            spheres[i] = BoundingSphere{glm::vec3(position(random), position(random), position(random)), radius(random)};
+            velocities[i] = glm::vec3(velocity(random), velocity(random), velocity(random));
+        }
+        std::vector<float> x(count), y(count), z(count), r(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            x[i] = spheres[i].center.x;
+            y[i] = spheres[i].center.y;
+            z[i] = spheres[i].center.z;
+            r[i] = spheres[i].radius;
+        }
+
+        // Brute force with each kernel, they must agree with the scalar one
+        std::vector<unsigned char> reference(count), visible(count);
+        std::size_t referenceCount = selectCullSpheresKernel(SimdLevel::Scalar)(frustum, x.data(), y.data(), z.data(), r.data(), count, reference.data());
+        double bruteForce[3] = {0.0, 0.0, 0.0};
+        SimdLevel levels[3] = {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2};
+        for (int level = 0; level < 3; ++level)
+        {
+            CullSpheresKernel kernel = selectCullSpheresKernel(levels[level]);
+            bruteForce[level] = measure([&]
+                                        { kernel(frustum, x.data(), y.data(), z.data(), r.data(), count, visible.data()); });
+            passed &= visible == reference;
+        }
+
+        SphereBvh bvh;
+        double buildTime = measure([&]
+                                   { bvh.build(spheres); });
+
+        // A few frames of motion so the refit has something to do and the tree degrades
+        double refitTime = 1e30, rebuildTime = 1e30;
+        for (int frame = 0; frame < 10; ++frame)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                spheres[i].center += velocities[i];
+            }
+            auto start = Clock::now();
+            bvh.refit(spheres);
+            auto refitted = Clock::now();
+            bvh.rebuildIncrementally(4096);
+            auto rebuilt = Clock::now();
+            refitTime = std::min(refitTime, std::chrono::duration<double, std::milli>(refitted - start).count());
+            rebuildTime = std::min(rebuildTime, std::chrono::duration<double, std::milli>(rebuilt - refitted).count());
+        }
+
+        std::vector<unsigned int> visibleSpheres;
+        BvhQueryStatistics cullStatistics;
+        double cullTime = measure([&]
+                                  {
+            visibleSpheres.clear();
+            cullStatistics = bvh.cull(frustum, visibleSpheres); });
+        std::size_t bruteForceVisible = 0;
+        for (auto const &sphere : spheres)
+        {
+            bruteForceVisible += frustum.intersects(sphere) ? 1 : 0;
+        }
+        passed &= visibleSpheres.size() == bruteForceVisible && referenceCount > 0;
+
+        // Rays from the camera through random pixels
+        constexpr int rayCount = 200;
+        std::vector<Ray> rays(rayCount);
+        std::uniform_real_distribution<float> pixel(0.0f, 1.0f);
+        for (auto &ray : rays)
+        {
+            ray = rayFromScreen(glm::vec2(pixel(random) * 1920.0f, pixel(random) * 1080.0f), glm::vec2(1920.0f, 1080.0f), viewProjection);
+        }
+        std::vector<int> bruteForceHits(rayCount, -1);
+        double bruteRayTime = measure([&]
+                                      {
+            for (int i = 0; i < rayCount; ++i)
+            {
+                bruteForceHits[i] = bruteForceRaycast(rays[i], spheres);
+            } },
+                                      1);
+        std::vector<int> bvhHits(rayCount, -1);
+        double bvhRayTime = measure([&]
+                                    {
+            for (int i = 0; i < rayCount; ++i)
+            {
+                BvhRayHit hit;
+                bvhHits[i] = bvh.raycast(rays[i], hit) ? static_cast<int>(hit.sphere) : -1;
+            } });
+        passed &= bvhHits == bruteForceHits;
+
+        std::cout << std::setw(9) << count << std::fixed << std::setprecision(3) << std::setw(11) << bruteForce[0] << std::setw(9) << bruteForce[1]
+                  << std::setw(9) << bruteForce[2] << std::setw(9) << buildTime << std::setw(9) << refitTime << std::setw(11) << rebuildTime
+                  << std::setw(10) << cullTime << std::setw(10) << cullStatistics.visible << std::setprecision(2)
+                  << std::setw(12) << bruteRayTime * 1e3 / rayCount << std::setw(10) << bvhRayTime * 1e3 / rayCount << std::defaultfloat << std::endl;
+    }
+
+    passed &= checkAxisAlignedRays();
+    std::cout << (passed ? "BVH and SIMD results match the brute force ones" : "MISMATCH against the brute force results") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+// GL state cache against a stub GL loader, no GPU or window needed.
+// glad is loaded with stub entry points that record the state they are given and count the calls.
+//  - a random sequence of state changes must leave the stub in the state the application asked for,
+//    with exactly the calls the cache reports
+//  - the draw loops of the samples (one program and vertex array for every object, two textures
+//    alternating) show the calls made and skipped per frame, and the cost of the cache itself
+// The program returns 1 when the stub state or the call counts disagree with the cache.
+#include <GlStateCache.h>
+#include <Benchmark.h>
+#include <StubGl.h>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+
+// State seen by the stub driver
+struct StubState
+{
+    std::size_t calls = 0;
+    GLuint program = 0;
+    GLuint vertexArray = 0;
+    std::map<GLenum, GLuint> buffers;
+    GLenum activeTexture = GL_TEXTURE0;
+    std::map<std::pair<GLenum, GLenum>, GLuint> textures;
+    std::map<GLenum, bool> capabilities;
+    GLenum blendSource = GL_ONE, blendDestination = GL_ZERO;
+    GLenum polygonMode = GL_FILL;
+} stub;
+
+void APIENTRY stubUseProgram(GLuint program)
+{
+    stub.calls++;
+    stub.program = program;
+}
+void APIENTRY stubBindVertexArray(GLuint vertexArray)
+{
+    stub.calls++;
+    stub.vertexArray = vertexArray;
+    // Each vertex array has its own element buffer, a fresh one has none
+    stub.buffers[GL_ELEMENT_ARRAY_BUFFER] = 1000 + vertexArray;
+}
+void APIENTRY stubBindBuffer(GLenum target, GLuint buffer)
+{
+    stub.calls++;
+    stub.buffers[target] = buffer;
+}
+void APIENTRY stubActiveTexture(GLenum unit)
+{
+    stub.calls++;
+    stub.activeTexture = unit;
+}
+void APIENTRY stubBindTexture(GLenum target, GLuint texture)
+{
+    stub.calls++;
+    stub.textures[{stub.activeTexture, target}] = texture;
+}
+void APIENTRY stubEnable(GLenum capability)
+{
+    stub.calls++;
+    stub.capabilities[capability] = true;
+}
+void APIENTRY stubDisable(GLenum capability)
+{
+    stub.calls++;
+    stub.capabilities[capability] = false;
+}
+void APIENTRY stubBlendFunc(GLenum source, GLenum destination)
+{
+    stub.calls++;
+    stub.blendSource = source;
+    stub.blendDestination = destination;
+}
+void APIENTRY stubPolygonMode(GLenum, GLenum mode)
+{
+    stub.calls++;
+    stub.polygonMode = mode;
+}
+
+int main()
+{
+    bool passed = true;
+    if (!loadStubGl({{"glUseProgram", (void *)stubUseProgram}, {"glBindVertexArray", (void *)stubBindVertexArray}, {"glBindBuffer", (void *)stubBindBuffer},
+                     {"glActiveTexture", (void *)stubActiveTexture}, {"glBindTexture", (void *)stubBindTexture}, {"glEnable", (void *)stubEnable},
+                     {"glDisable", (void *)stubDisable}, {"glBlendFunc", (void *)stubBlendFunc}, {"glPolygonMode", (void *)stubPolygonMode}}))
+    {
+        std::cout << "Failed to load the stub GL" << std::endl;
+        return 1;
+    }
+
+    // Random state changes, the stub must always end up in the requested state
+    {
+        GlStateCache cache;
+        std::mt19937 random(3);
+        std::uniform_int_distribution<int> operation(0, 8), name(0, 3), unit(0, 3);
+        const GLenum bufferTargets[] = {GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_COPY_WRITE_BUFFER};
+        const GLenum textureTargets[] = {GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP};
+        const GLenum capabilities[] = {GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE};
+        const GLenum blendFactors[] = {GL_ONE, GL_ZERO, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA};
+        const GLenum polygonModes[] = {GL_FILL, GL_LINE, GL_POINT, GL_FILL};
+        std::size_t callsBefore = stub.calls;
+        for (int step = 0; step < 200000 && passed; ++step)
+        {
+            GLuint value = (GLuint)name(random);
+            switch (operation(random))
+            {
+            case 0:
+                cache.useProgram(value);
+                passed &= stub.program == value;
+                break;
+            case 1:
+                cache.bindVertexArray(value);
+                passed &= stub.vertexArray == value;
+                break;
+            case 2:
+            {
+                GLenum target = bufferTargets[value % 3];
+                cache.bindBuffer(target, value);
+                passed &= stub.buffers[target] == value;
+                break;
+            }
+            case 3:
+            {
+                // The element buffer must follow the vertex array it belongs to
+                cache.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, value);
+                passed &= stub.buffers[GL_ELEMENT_ARRAY_BUFFER] == value;
+                break;
+            }
+            case 4:
+            {
+                GLuint textureUnit = (GLuint)unit(random);
+                GLenum target = textureTargets[value % 2];
+                cache.bindTexture(textureUnit, target, value);
+                passed &= stub.textures[{GL_TEXTURE0 + textureUnit, target}] == value;
+                break;
+            }
+            case 5:
+            {
+                GLenum capability = capabilities[value % 3];
+                bool enabled = (value & 2) != 0;
+                cache.setEnabled(capability, enabled);
+                passed &= stub.capabilities[capability] == enabled;
+                break;
+            }
+            case 6:
+                cache.blendFunc(blendFactors[value], blendFactors[(value + 2) % 4]);
+                passed &= stub.blendSource == blendFactors[value] && stub.blendDestination == blendFactors[(value + 2) % 4];
+                break;
+            case 7:
+                cache.polygonMode(polygonModes[value]);
+                passed &= stub.polygonMode == polygonModes[value];
+                break;
+            case 8:
+                // A deleted object is unbound by GL
+                if (stub.program == value)
+                {
+                    stub.program = 0;
+                }
+                cache.forgetProgram(value);
+                cache.useProgram(value);
+                passed &= stub.program == value;
+                break;
+            }
+        }
+        passed &= stub.calls - callsBefore == cache.frameStatistics().calls;
+        std::cout << "Random state changes: " << cache.frameStatistics().calls << " calls made, " << cache.frameStatistics().skipped
+                  << " skipped, stub state " << (passed ? "matches" : "DIFFERS") << std::endl;
+    }
+
+    // Draw loops of the samples, per frame
+    std::cout << std::setw(34) << "draw loop" << std::setw(9) << "draws" << std::setw(12) << "GL calls" << std::setw(10) << "cached"
+              << std::setw(10) << "skipped" << std::setw(14) << "ns/draw raw" << std::setw(16) << "ns/draw cached" << std::endl;
+    struct Scenario
+    {
+        const char *name;
+        int draws;
+        int textures;
+    };
+    for (auto scenario : {Scenario{"solar system (program + VAO)", 100000, 0}, Scenario{"texture mapping (+ texture)", 2, 2},
+                          Scenario{"textured objects (+ texture)", 100000, 2}})
+    {
+        // As the samples do it: everything bound for each draw, the vertex array unbound after it
+        std::size_t callsBefore = stub.calls;
+        auto rawFrame = [&]
+        {
+            for (int draw = 0; draw < scenario.draws; ++draw)
+            {
+                glUseProgram(1);
+                if (scenario.textures > 0)
+                {
+                    glActiveTexture(GL_TEXTURE0);
+                    glBindTexture(GL_TEXTURE_2D, 1 + draw % scenario.textures);
+                }
+                glBindVertexArray(1);
+                glBindVertexArray(0);
+            }
+        };
+        rawFrame();
+        std::size_t rawCalls = stub.calls - callsBefore;
+
+        GlStateCache cache;
+        auto cachedFrame = [&]
+        {
+            cache.beginFrame();
+            for (int draw = 0; draw < scenario.draws; ++draw)
+            {
+                cache.useProgram(1);
+                if (scenario.textures > 0)
+                {
+                    cache.bindTexture(0, GL_TEXTURE_2D, 1 + draw % scenario.textures);
+                }
+                cache.bindVertexArray(1);
+            }
+        };
+        cachedFrame();
+        callsBefore = stub.calls;
+        cachedFrame();
+        std::size_t cachedCalls = stub.calls - callsBefore;
+        passed &= cachedCalls == cache.frameStatistics().calls;
+
+        double rawTime = measure(rawFrame);
+        double cachedTime = measure(cachedFrame);
+        std::cout << std::setw(34) << scenario.name << std::setw(9) << scenario.draws << std::setw(12) << rawCalls << std::setw(10) << cachedCalls
+                  << std::setw(10) << cache.frameStatistics().skipped << std::fixed << std::setprecision(2) << std::setw(14)
+                  << rawTime * 1e6 / scenario.draws << std::setw(16) << cachedTime * 1e6 / scenario.draws << std::defaultfloat << std::endl;
+    }
+
+    std::cout << (passed ? "Stub GL state and call counts match the cache" : "MISMATCH between the stub GL and the cache") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+// Decoding the sample images into a destination with its own row stride, bottom row first, as a texture
+// upload wants them:
+//  - load + copy: stbi_load_from_memory with the flip flag, which flips in a second pass, then a copy
+//    of the rows into the destination
+//  - into:        stbi_load_from_memory_into, rows written to the destination in the decode (JPEG) or
+//    in one copy that also flips (other formats)
+// with the time and the peak of the memory stb_image allocates, counted through stbi_set_allocator.
+// Checks that both give the same rows, that the padding between rows is left alone and that unflipped
+// output is the same rows in the other order. The program returns 1 otherwise.
+// Run from the repository root, or pass the directory of the images.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Counts the bytes stb_image holds, each block is prefixed with its size
+struct CountingAllocator
+{
+    std::size_t current = 0;
+    std::size_t peak = 0;
+    std::size_t allocations = 0;
+
+    static void *allocate(void *user, std::size_t size)
+    {
+        auto *self = static_cast<CountingAllocator *>(user);
+        auto *block = static_cast<std::size_t *>(std::malloc(size + sizeof(std::max_align_t)));
+        if (!block)
+        {
+            return nullptr;
+        }
+        *block = size;
+        self->current += size;
+        self->peak = std::max(self->peak, self->current);
+        self->allocations++;
+        return reinterpret_cast<unsigned char *>(block) + sizeof(std::max_align_t);
+    }
+
+    static void deallocate(void *user, void *p)
+    {
+        auto *self = static_cast<CountingAllocator *>(user);
+        auto *block = reinterpret_cast<std::size_t *>(static_cast<unsigned char *>(p) - sizeof(std::max_align_t));
+        self->current -= *block;
+        std::free(block);
+    }
+
+    static void *reallocate(void *user, void *p, std::size_t oldSize, std::size_t newSize)
+    {
+        void *moved = allocate(user, newSize);
+        if (moved && p)
+        {
+            std::memcpy(moved, p, std::min(oldSize, newSize));
+            deallocate(user, p);
+        }
+        return moved;
+    }
+
+    void reset()
+    {
+        peak = current;
+        allocations = 0;
+    }
+};
+
+std::vector<unsigned char> readFile(std::string const &filePath)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char **argv)
+{
+    bool passed = true;
+    std::string directory = argc > 1 ? argv[1] : "bin/images";
+    CountingAllocator counter;
+    stbi_allocator allocator{CountingAllocator::allocate, CountingAllocator::reallocate, CountingAllocator::deallocate, &counter};
+    stbi_set_allocator(&allocator);
+
+    for (const char *name : {"wall.jpg", "face.png"})
+    {
+        auto file = readFile(directory + "/" + name);
+        int width = 0, height = 0, components = 0;
+        if (!stbi_info_from_memory(file.data(), (int)file.size(), &width, &height, &components))
+        {
+            std::cout << "Failed to read " << directory << "/" << name << std::endl;
+            return 1;
+        }
+        int channels = 3 == components ? 3 : 4;
+        std::size_t rowBytes = (std::size_t)width * channels;
+        // Rows padded to 256 bytes, as a pitched upload buffer would be
+        int stride = (int)((rowBytes + 255) / 256 * 256);
+        std::size_t size = (std::size_t)stride * height;
+        std::vector<unsigned char> copied(size, 0xCD), into(size, 0xCD), unflipped(size, 0xCD);
+
+        counter.reset();
+        double copyTime = measure([&]
+                                  {
+            stbi_set_flip_vertically_on_load(1);
+            int x, y, n;
+            unsigned char *pixels = stbi_load_from_memory(file.data(), (int)file.size(), &x, &y, &n, channels);
+            stbi_set_flip_vertically_on_load(0);
+            if (!pixels)
+            {
+                return;
+            }
+            for (int row = 0; row < y; row++)
+            {
+                std::memcpy(&copied[(std::size_t)row * stride], pixels + row * rowBytes, rowBytes);
+            }
+            stbi_image_free(pixels); });
+        std::size_t copyPeak = counter.peak, copyAllocations = counter.allocations;
+
+        counter.reset();
+        double intoTime = measure([&]
+                                  {
+            int x, y, n;
+            passed &= 1 == stbi_load_from_memory_into(file.data(), (int)file.size(), into.data(), into.size(), stride, 1, &x, &y, &n, channels); });
+        std::size_t intoPeak = counter.peak, intoAllocations = counter.allocations;
+
+        int x, y, n;
+        passed &= 1 == stbi_load_from_memory_into(file.data(), (int)file.size(), unflipped.data(), unflipped.size(), stride, 0, &x, &y, &n, channels);
+        // Too small an output or stride fails instead of writing past it, the last row needs no padding
+        passed &= 0 == stbi_load_from_memory_into(file.data(), (int)file.size(), unflipped.data(), size - stride + rowBytes - 1, stride, 0, &x, &y, &n, channels);
+        passed &= 0 == stbi_load_from_memory_into(file.data(), (int)file.size(), unflipped.data(), size, (int)rowBytes - 1, 0, &x, &y, &n, channels);
+
+        for (int row = 0; row < height; row++)
+        {
+            const unsigned char *copiedRow = &copied[(std::size_t)row * stride];
+            const unsigned char *intoRow = &into[(std::size_t)row * stride];
+            passed &= 0 == std::memcmp(copiedRow, intoRow, rowBytes);
+            passed &= 0 == std::memcmp(intoRow, &unflipped[(std::size_t)(height - 1 - row) * stride], rowBytes);
+            passed &= std::all_of(intoRow + rowBytes, intoRow + stride, [](unsigned char value)
+                                  { return 0xCD == value; });
+        }
+
+        double megabytes = (double)rowBytes * height / (1024.0 * 1024.0);
+        std::cout << name << " (" << width << "x" << height << "x" << channels << "): " << std::fixed << std::setprecision(2) << "load + copy "
+                  << copyTime << " ms, " << megabytes / copyTime * 1000.0 << " MB/s, " << copyPeak / 1024 << " KB peak in "
+                  << copyAllocations / 5 << " allocations; into " << intoTime << " ms, " << megabytes / intoTime * 1000.0 << " MB/s, "
+                  << intoPeak / 1024 << " KB peak in " << intoAllocations / 5 << " allocations" << std::defaultfloat << std::endl;
+    }
+    passed &= 0 == counter.current;
+    stbi_set_allocator(nullptr);
+
+    std::cout << (passed ? "Decoded rows match" : "MISMATCH in the decoded rows") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,173 @@
+// Scaling of the work-stealing job system from 1 thread to every hardware thread:
+// per-job overhead, a compute bound parallel-for, the depth parallel world transform update
+// of a 1,000,000 node hierarchy and the batched transform of 4,000,000 points.
+// Results are checked against single threaded runs, the program returns 1 on a mismatch.
+#include <JobSystem.h>
+#include <SceneGraph.h>
+#include <BatchTransform.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Enough arithmetic per element to be compute bound
+float work(std::size_t i)
+{
+    float x = static_cast<float>(i % 1000) * 0.001f;
+    for (int k = 0; k < 32; ++k)
+    {
+        x = std::sqrt(x * x + 0.5f) * 0.9f;
+    }
+    return x;
+}
+
+int main()
+{
+    bool passed = true;
+    volatile float sink = 0.0f;
+
+    // Hierarchy and points shared by every thread count
+    constexpr std::size_t nodeCount = 1000000;
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+    TransformHierarchy hierarchy;
+    std::vector<TransformNode> handles;
+    for (std::size_t i = 0; i < nodeCount; ++i)
+    {
+        std::size_t parent = i > 0 ? std::uniform_int_distribution<std::size_t>(0, i - 1)(random) : 0;
+        handles.push_back(hierarchy.addNode(i > 0 ? handles[parent] : noParentNode, glm::vec3(offset(random), offset(random), offset(random)),
+                                            glm::angleAxis(offset(random), glm::vec3(0.0f, 0.0f, 1.0f))));
+    }
+    hierarchy.updateWorldTransforms();
+    std::vector<glm::mat4> serialWorld(nodeCount);
+    for (std::size_t i = 0; i < nodeCount; ++i)
+    {
+        serialWorld[i] = hierarchy.worldTransform(handles[i]);
+    }
+
+    constexpr std::size_t pointCount = 4000000;
+    std::vector<float> x(pointCount), y(pointCount), z(pointCount), outX(pointCount), outY(pointCount), outZ(pointCount);
+    for (std::size_t i = 0; i < pointCount; ++i)
+    {
+        x[i] = offset(random);
+        y[i] = offset(random);
+        z[i] = offset(random);
+    }
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 2.0f, 3.0f)) * glm::mat4_cast(glm::angleAxis(0.5f, glm::vec3(0.0f, 1.0f, 0.0f)));
+
+    constexpr std::size_t workCount = 4000000;
+    double serialSum = 0.0;
+    for (std::size_t i = 0; i < workCount; ++i)
+    {
+        serialSum += work(i);
+    }
+
+    std::vector<unsigned int> threadCounts;
+    unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardwareThreads);
+
+    std::cout << std::setw(8) << "threads" << std::setw(14) << "ns/job" << std::setw(16) << "parallelFor ms" << std::setw(18) << "hierarchy ms"
+              << std::setw(16) << "points ms" << std::setw(10) << "steals" << std::endl;
+
+    double baseline[3] = {0.0, 0.0, 0.0};
+    for (unsigned int threads : threadCounts)
+    {
+        JobSystem jobs(threads - 1);
+
+        // Many empty jobs: the cost of scheduling, stealing and counting
+        constexpr int emptyJobs = 100000;
+        std::atomic<int> executed{0};
+        double emptyTime = measure([&]
+                                   {
+            JobCounter counter;
+            for (int i = 0; i < emptyJobs; ++i)
+            {
+                jobs.run([&executed]
+                         { executed.fetch_add(1, std::memory_order_relaxed); },
+                         &counter);
+            }
+            jobs.wait(counter); });
+        passed &= executed == emptyJobs * 5;
+
+        std::vector<double> partialSums;
+        std::mutex sumMutex;
+        double parallelForTime = measure([&]
+                                         {
+            partialSums.clear();
+            jobs.parallelFor(0, workCount, 4096, [&](std::size_t begin, std::size_t end)
+                             {
+                double sum = 0.0;
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    sum += work(i);
+                }
+                std::lock_guard<std::mutex> lock(sumMutex);
+                partialSums.push_back(sum); }); });
+        double parallelSum = 0.0;
+        for (double sum : partialSums)
+        {
+            parallelSum += sum;
+        }
+        passed &= std::abs(parallelSum - serialSum) <= 1e-6 * std::abs(serialSum);
+
+        double hierarchyTime = measure([&]
+                                       {
+            hierarchy.invalidate();
+            hierarchy.updateWorldTransforms(jobs);
+            sink = sink + hierarchy.worldAffine(handles.back()).translation.x; });
+        for (std::size_t i = 0; i < nodeCount; i += 997)
+        {
+            passed &= hierarchy.worldTransform(handles[i]) == serialWorld[i];
+        }
+
+        BatchTransformOptions options;
+        options.jobs = &jobs;
+        double pointsTime = measure([&]
+                                    { transformCoordinates(TransformMode::Point, model, ConstSoaSpan(x.data(), y.data(), z.data()), SoaSpan{outX.data(), outY.data(), outZ.data()}, pointCount, options); });
+
+        if (1 == threads)
+        {
+            baseline[0] = parallelForTime;
+            baseline[1] = hierarchyTime;
+            baseline[2] = pointsTime;
+        }
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(1) << std::setw(14) << emptyTime * 1e6 / emptyJobs
+                  << std::setprecision(2) << std::setw(10) << parallelForTime << " (" << std::setprecision(1) << baseline[0] / parallelForTime << "x)"
+                  << std::setprecision(2) << std::setw(12) << hierarchyTime << " (" << std::setprecision(1) << baseline[1] / hierarchyTime << "x)"
+                  << std::setprecision(2) << std::setw(10) << pointsTime << " (" << std::setprecision(1) << baseline[2] / pointsTime << "x)"
+                  << std::setw(10) << jobs.statistics().jobsStolen << std::defaultfloat << std::endl;
+    }
+
+    // Dependencies: every job of the second group must see the whole first group done
+    {
+        JobSystem jobs;
+        JobCounter first, second;
+        std::atomic<int> firstDone{0};
+        std::atomic<bool> orderRespected{true};
+        for (int i = 0; i < 64; ++i)
+        {
+            jobs.run([&firstDone]
+                     { firstDone.fetch_add(1); },
+                     &first);
+        }
+        for (int i = 0; i < 64; ++i)
+        {
+            jobs.run([&]
+                     { if (firstDone.load() != 64) orderRespected = false; },
+                     &second, &first);
+        }
+        jobs.wait(second);
+        passed &= orderRespected.load();
+    }
+
+    std::cout << (passed ? "All results match the single threaded runs" : "MISMATCH against the single threaded runs") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+// JPEG decode throughput of stb_image, in MB/s of decoded pixels, with its kernels (IDCT, YCbCr to RGB,
+// 2x2 chroma upsampling) capped by stbi_set_simd_level:
+//  - C:    the generic kernels
+//  - SSE2: the SSE2 ones
+//  - AVX2: the AVX2 ones, when the CPU has it
+// for RGB and RGBA output of every .jpg in the image directory. Levels the build or the CPU lacks are skipped.
+// Checks that every level decodes the pixels of the C kernels, and that each kernel gives the results of the
+// C one on random rows and blocks, 2x2 upsampling included, which 4:2:2 images such as wall.jpg do not use.
+// The program returns 1 otherwise.
+// Run from the repository root, or pass the directory of the images.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+struct Level
+{
+    int level;
+    const char *name;
+};
+const Level levels[] = {{STBI_SIMD_NONE, "C"}, {STBI_SIMD_SSE2, "SSE2"}, {STBI_SIMD_AVX2, "AVX2"}};
+
+// The kernels the decoder picks at the current level
+struct Kernels
+{
+    void (*idct)(stbi_uc *out, int out_stride, short data[64]);
+    void (*YCbCrToRgb)(stbi_uc *out, const stbi_uc *y, const stbi_uc *pcb, const stbi_uc *pcr, int count, int step);
+    stbi_uc *(*resampleHv2)(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs);
+};
+
+Kernels currentKernels()
+{
+    auto jpeg = std::make_unique<stbi__jpeg>();
+    stbi__setup_jpeg(jpeg.get());
+    return {jpeg->idct_block_kernel, jpeg->YCbCr_to_RGB_kernel, jpeg->resample_row_hv_2_kernel};
+}
+
+// Rows sized exactly, so a kernel reading or writing past them shows under a sanitizer
+bool kernelsMatch(Kernels const &kernels, Kernels const &reference)
+{
+    bool passed = true;
+    std::mt19937 random(1);
+    auto randomBytes = [&](int count)
+    {
+        std::vector<stbi_uc> bytes((std::size_t)count);
+        for (auto &byte : bytes)
+        {
+            byte = (stbi_uc)random();
+        }
+        return bytes;
+    };
+    for (int width = 1; width <= 100; width++)
+    {
+        auto nearRow = randomBytes(width), farRow = randomBytes(width);
+        std::vector<stbi_uc> upsampled((std::size_t)width * 2), expected((std::size_t)width * 2);
+        reference.resampleHv2(expected.data(), nearRow.data(), farRow.data(), width, 2);
+        kernels.resampleHv2(upsampled.data(), nearRow.data(), farRow.data(), width, 2);
+        passed &= upsampled == expected;
+
+        // The C kernel writes the alpha of the last pixel at step 3 too, one byte past the row
+        auto luma = randomBytes(width), cb = randomBytes(width), cr = randomBytes(width);
+        for (int step : {3, 4})
+        {
+            std::vector<stbi_uc> rgb((std::size_t)width * step + 1), expectedRgb((std::size_t)width * step + 1);
+            reference.YCbCrToRgb(expectedRgb.data(), luma.data(), cb.data(), cr.data(), width, step);
+            kernels.YCbCrToRgb(rgb.data(), luma.data(), cb.data(), cr.data(), width, step);
+            passed &= std::equal(rgb.begin(), rgb.end() - 1, expectedRgb.begin());
+        }
+    }
+    // Dequantized coefficients of real images are small, mostly zero above the first row
+    for (int block = 0; block < 10000; block++)
+    {
+        alignas(16) short coefficients[64], expectedCoefficients[64];
+        for (int i = 0; i < 64; i++)
+        {
+            coefficients[i] = i < 8 || 0 == random() % 4 ? (short)((int)(random() % 1025) - 512) : 0;
+        }
+        std::memcpy(expectedCoefficients, coefficients, sizeof(coefficients));
+        stbi_uc pixels[64], expected[64];
+        reference.idct(expected, 8, expectedCoefficients);
+        kernels.idct(pixels, 8, coefficients);
+        passed &= 0 == std::memcmp(pixels, expected, sizeof(pixels));
+    }
+    return passed;
+}
+
+std::vector<unsigned char> readFile(std::filesystem::path const &filePath)
+{
+    std::ifstream file(filePath, std::ios::binary);
+    return std::vector<unsigned char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+int main(int argc, char **argv)
+{
+    bool passed = true;
+    std::filesystem::path directory = argc > 1 ? argv[1] : "bin/images";
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (auto const &entry : std::filesystem::directory_iterator(directory, error))
+    {
+        auto extension = entry.path().extension().string();
+        if (".jpg" == extension || ".jpeg" == extension)
+        {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty())
+    {
+        std::cout << "No JPEG files in " << directory.string() << std::endl;
+        return 1;
+    }
+
+    // Only the levels this build and CPU have, the setter returns the level it could give
+    std::vector<Level> available;
+    std::vector<Kernels> kernels;
+    for (auto const &level : levels)
+    {
+        if (stbi_set_simd_level(level.level) != level.level)
+        {
+            std::cout << level.name << ": not available" << std::endl;
+            continue;
+        }
+        available.push_back(level);
+        kernels.push_back(currentKernels());
+        if (kernels.size() > 1)
+        {
+            bool match = kernelsMatch(kernels.back(), kernels.front());
+            std::cout << level.name << " kernels: " << (match ? "match the C ones" : "MISMATCH") << std::endl;
+            passed &= match;
+        }
+    }
+
+    for (auto const &filePath : files)
+    {
+        auto file = readFile(filePath);
+        for (int channels : {3, 4})
+        {
+            std::vector<unsigned char> reference;
+            double referenceTime = 0.0;
+            int width = 0, height = 0;
+            std::cout << filePath.filename().string();
+            for (auto const &level : available)
+            {
+                stbi_set_simd_level(level.level);
+                int components = 0;
+                double time = measure([&]
+                                      { stbi_image_free(stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &components, channels)); });
+                std::vector<unsigned char> decoded;
+                if (unsigned char *pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &components, channels))
+                {
+                    decoded.assign(pixels, pixels + (std::size_t)width * height * channels);
+                    stbi_image_free(pixels);
+                }
+                else
+                {
+                    std::cout << ": failed to decode" << std::endl;
+                    return 1;
+                }
+                bool first = &level == &available.front();
+                if (first)
+                {
+                    reference = decoded;
+                    referenceTime = time;
+                    std::cout << " (" << width << "x" << height << ") " << (3 == channels ? "RGB:" : "RGBA:");
+                }
+                bool match = decoded == reference;
+                passed &= match;
+                double megabytes = (double)decoded.size() / (1024.0 * 1024.0);
+                std::cout << (first ? " " : ", ") << level.name << " " << std::fixed << std::setprecision(2) << megabytes / time * 1000.0 << " MB/s";
+                if (!first)
+                {
+                    std::cout << " (" << referenceTime / time << "x)";
+                }
+                std::cout << (match ? "" : " MISMATCH") << std::defaultfloat;
+            }
+            std::cout << std::endl;
+        }
+    }
+    stbi_set_simd_level(STBI_SIMD_AVX2);
+
+    std::cout << (passed ? "Every level decodes the same pixels" : "MISMATCH between the levels") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+// Correctness check and throughput of the batched mat4 kernels (scalar, SSE2, AVX2 + FMA).
+// Every level available on this machine is first compared against the scalar glm results,
+// the program returns 1 if any kernel is outside the tolerance.
+#include <MatrixKernels.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Largest component difference relative to the magnitude of the reference
+template <typename T>
+float relativeError(T const *result, T const *reference, std::size_t count)
+{
+    float const *a = reinterpret_cast<float const *>(result);
+    float const *b = reinterpret_cast<float const *>(reference);
+    std::size_t floatCount = count * sizeof(T) / sizeof(float);
+    float maxError = 0.0f;
+    for (std::size_t i = 0; i < floatCount; ++i)
+    {
+        maxError = std::max(maxError, std::abs(a[i] - b[i]) / (1.0f + std::abs(b[i])));
+    }
+    return maxError;
+}
+
+bool check(std::string const &name, SimdLevel level, float error, float tolerance)
+{
+    bool passed = error <= tolerance;
+    std::cout << std::setw(10) << simdLevelName(level) << std::setw(12) << name << "  max error " << std::scientific
+              << std::setprecision(2) << error << (passed ? "  ok" : "  FAILED") << std::defaultfloat << std::endl;
+    return passed;
+}
+
+int main()
+{
+    constexpr std::size_t count = 1 << 18;
+    std::mt19937 random(11);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+
+    // Random entries with a dominant diagonal keep the matrices well conditioned for the inverse
+    std::vector<glm::mat4> a(count), b(count);
+    std::vector<glm::vec4> v(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            for (int r = 0; r < 4; ++r)
+            {
+                a[i][c][r] = value(random) + (c == r ? 4.0f : 0.0f);
+                b[i][c][r] = value(random) + (c == r ? 4.0f : 0.0f);
+            }
+        }
+        v[i] = glm::vec4(value(random), value(random), value(random), value(random));
+    }
+
+    MatrixKernels scalar = matrixKernelsFor(SimdLevel::Scalar);
+    std::vector<glm::mat4> referenceProducts(count), referenceInverses(count);
+    std::vector<glm::vec4> referenceVectors(count);
+    scalar.multiply(a.data(), b.data(), referenceProducts.data(), count);
+    scalar.inverse(a.data(), referenceInverses.data(), count);
+    scalar.transform(a.data(), v.data(), referenceVectors.data(), count);
+
+    std::vector<SimdLevel> levels;
+    for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::Sse2, SimdLevel::Avx2})
+    {
+        if (matrixKernelsAvailable(level))
+        {
+            levels.push_back(level);
+        }
+        else
+        {
+            std::cout << simdLevelName(level) << " kernels are not available" << std::endl;
+        }
+    }
+
+    // Odd counts exercise the remainder paths of the batched kernels
+    bool passed = true;
+    std::vector<glm::mat4> products(count), inverses(count);
+    std::vector<glm::vec4> vectors(count);
+    for (SimdLevel level : levels)
+    {
+        MatrixKernels kernels = matrixKernelsFor(level);
+        for (std::size_t batch : {std::size_t(1), std::size_t(3), std::size_t(7), count})
+        {
+            kernels.multiply(a.data(), b.data(), products.data(), batch);
+            kernels.inverse(a.data(), inverses.data(), batch);
+            kernels.transform(a.data(), v.data(), vectors.data(), batch);
+            passed &= check("multiply", level, relativeError(products.data(), referenceProducts.data(), batch), 1e-5f);
+            passed &= check("inverse", level, relativeError(inverses.data(), referenceInverses.data(), batch), 1e-5f);
+            passed &= check("transform", level, relativeError(vectors.data(), referenceVectors.data(), batch), 1e-5f);
+        }
+    }
+
+    std::cout << std::endl
+              << std::setw(12) << "operation" << std::setw(10) << "data";
+    for (SimdLevel level : levels)
+    {
+        std::cout << std::setw(14) << simdLevelName(level);
+    }
+    std::cout << "   (million per second)" << std::endl;
+
+    // The whole arrays stream from memory, which bounds every level about the same. Batches of
+    // cachedBatch matrices, run over and over on the same data, stay in the L2 cache and show the kernels.
+    constexpr std::size_t cachedBatch = 1024;
+    auto printRow = [&](std::string const &name, std::size_t batch, auto &&run)
+    {
+        std::cout << std::setw(12) << name << std::setw(10) << (batch == count ? "memory" : "cache") << std::fixed << std::setprecision(1);
+        for (SimdLevel level : levels)
+        {
+            MatrixKernels kernels = matrixKernelsFor(level);
+            double time = measure([&]
+                                  {
+                for (std::size_t done = 0; done < count; done += batch)
+                {
+                    run(kernels, batch);
+                } });
+            std::cout << std::setw(14) << count / (time * 1e3);
+        }
+        std::cout << std::defaultfloat << std::endl;
+    };
+
+    for (std::size_t batch : {count, cachedBatch})
+    {
+        printRow("multiply", batch, [&](MatrixKernels const &kernels, std::size_t size)
+                 { kernels.multiply(a.data(), b.data(), products.data(), size); });
+        printRow("inverse", batch, [&](MatrixKernels const &kernels, std::size_t size)
+                 { kernels.inverse(a.data(), inverses.data(), size); });
+        printRow("transform", batch, [&](MatrixKernels const &kernels, std::size_t size)
+                 { kernels.transform(a.data(), v.data(), vectors.data(), size); });
+    }
+
+    std::cout << "Selected at run time: " << simdLevelName(matrixKernels().level) << std::endl;
+    return passed ? 0 : 1;
+}
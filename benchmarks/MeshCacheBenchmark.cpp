@@ -0,0 +1,111 @@
+// Compares the start-up cost of getting sphere geometry ready for upload:
+//  - cold generate: tessellate with createSphere
+//  - warm cache:    read the cached file through std::ifstream into a vector
+//  - mmap:          map the cached file and touch every page, as glBufferData would
+// Then checks that a packed mesh batch comes back from the cache mapped, with the same vertices,
+// indices, layout and bounds as packed in memory. The program returns 1 otherwise.
+#include <SphereMesh.h>
+#include <MeshCache.h>
+#include <Benchmark.h>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// Read one byte per page, so the lazily mapped data is actually faulted in
+unsigned int touchPages(const unsigned char *data, std::size_t size)
+{
+    unsigned int sum = 0;
+    for (std::size_t offset = 0; offset < size; offset += 4096)
+    {
+        sum += data[offset];
+    }
+    return sum;
+}
+
+int main()
+{
+    const auto cacheDirectory = std::filesystem::temp_directory_path() / "mesh_cache_benchmark";
+    MeshCache cache(cacheDirectory);
+    const int segmentCounts[] = {20, 100, 400, 1000, 2000};
+    volatile unsigned int sink = 0;
+
+    std::cout << std::setw(10) << "segments" << std::setw(12) << "vertices" << std::setw(12) << "size(MB)"
+              << std::setw(14) << "generate(ms)" << std::setw(14) << "ifstream(ms)" << std::setw(12) << "mmap(ms)" << std::endl;
+
+    for (auto segments : segmentCounts)
+    {
+        MeshCacheKey key("sphere", {sphereMeshVersion}, {2.0f, (float)segments, (float)segments});
+        Mesh mesh = createSphere(2.0f, segments, segments);
+        if (!cache.store(key, makeMeshView(mesh)))
+        {
+            std::cerr << "Failed to write " << cache.filePath(key) << std::endl;
+            return 1;
+        }
+
+        auto generateTime = measure([&]
+                                    {
+            Mesh generated = createSphere(2.0f, segments, segments);
+            sink = sink + generated.vertices.back().position[0]; });
+
+        auto readTime = measure([&]
+                                {
+            std::ifstream stream(cache.filePath(key), std::ios::binary);
+            std::vector<unsigned char> bytes(std::filesystem::file_size(cache.filePath(key)));
+            stream.read(reinterpret_cast<char *>(bytes.data()), (std::streamsize)bytes.size());
+            sink = sink + touchPages(bytes.data(), bytes.size()); });
+
+        auto mapTime = measure([&]
+                               {
+            CachedMesh cachedMesh;
+            if (cache.load(key, cachedMesh))
+            {
+                sink = sink + touchPages(cachedMesh.file.data(), cachedMesh.file.size());
+            } });
+
+        auto sizeInMB = (mesh.vertexDataSize() + mesh.indexDataSize()) / (1024.0 * 1024.0);
+        std::cout << std::fixed << std::setprecision(3)
+                  << std::setw(10) << segments << std::setw(12) << mesh.vertices.size() << std::setw(12) << sizeInMB
+                  << std::setw(14) << generateTime << std::setw(14) << readTime << std::setw(12) << mapTime << std::endl;
+    }
+
+    // Two sphere tessellations in one packed batch, generated on the first call, mapped on the second
+    std::vector<Mesh> meshes = {createSphere(2.0f, 20, 20), createSphere(2.0f, 300, 300)};
+    std::vector<MeshView> views = {makeMeshView(meshes[0]), makeMeshView(meshes[1])};
+    MeshBatch batch = buildMeshBatch(views);
+    PackedVertices packed = packVertices(batch.mesh.vertices.data(), batch.mesh.vertices.size());
+    auto expected = makePackedMeshBatchView(batch, packed);
+    MeshCacheKey batchKey("sphereBatch", {sphereMeshVersion, vertexPackingVersion}, {2.0f, 20.0f, 300.0f});
+    std::size_t generated = 0;
+    auto generator = [&]
+    {
+        generated++;
+        return buildMeshBatch(views);
+    };
+    cache.loadOrCreateBatch(batchKey, generator);
+    CachedMeshBatch cachedBatch = cache.loadOrCreateBatch(batchKey, generator);
+    auto const &view = cachedBatch.view;
+    auto vertexBytes = reinterpret_cast<const unsigned char *>(view.vertices);
+    bool mapped = 1 == generated && vertexBytes > cachedBatch.file.data() &&
+                  vertexBytes + view.vertexDataSize() <= cachedBatch.file.data() + cachedBatch.file.size();
+    bool same = view.layout.indexType == expected.layout.indexType && view.layout.vertexCount == expected.layout.vertexCount &&
+                view.layout.indexCount == expected.layout.indexCount && view.layout.meshes.size() == expected.layout.meshes.size() &&
+                view.bounds.center == expected.bounds.center && view.bounds.halfExtent == expected.bounds.halfExtent &&
+                0 == std::memcmp(view.vertices, expected.vertices, expected.vertexDataSize()) &&
+                0 == std::memcmp(view.indices, expected.indices, expected.indexDataSize());
+    for (std::size_t i = 0; same && i < view.layout.meshes.size(); ++i)
+    {
+        same = view.layout.meshes[i].firstIndex == expected.layout.meshes[i].firstIndex &&
+               view.layout.meshes[i].indexCount == expected.layout.meshes[i].indexCount &&
+               view.layout.meshes[i].baseVertex == expected.layout.meshes[i].baseVertex;
+    }
+    std::cout << std::endl
+              << "Packed batch of " << view.layout.meshes.size() << " meshes, " << view.layout.vertexCount << " vertices: "
+              << (mapped ? "mapped from the cache" : "NOT mapped from the cache") << ", " << (same ? "matches" : "MISMATCH with") << " the packing in memory"
+              << std::endl;
+
+    std::error_code error;
+    std::filesystem::remove_all(cacheDirectory, error);
+    return mapped && same ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+// Building the multi-draw indirect commands of a pass on the CPU, for 10,000 to 1,000,000 objects
+// spread over 8 and 64 meshes, with 1 thread and with the job system.
+// Every pass is then submitted to a stub GL loader (no GPU or window needed), once with
+// glMultiDrawElementsIndirect and once with the fallback loop, and the draw calls the stub received
+// are reported next to the one per object a pass without batching needs.
+// Checks that every object lands in the instance range of its mesh in its original order, and that
+// both submissions draw every instance with the draw calls the pass reports. A GL 4.1 stub with
+// ARB_multi_draw_indirect but without ARB_base_instance must fall back to the loop.
+// The program returns 1 otherwise.
+#include <MultiDrawIndirect.h>
+#include <Benchmark.h>
+#include <StubGl.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Draws seen by the stub driver
+struct StubState
+{
+    std::size_t drawCalls = 0;
+    std::size_t instances = 0;
+    std::vector<DrawElementsIndirectCommand> indirectCommands;
+} stub;
+
+void APIENTRY stubGenBuffers(GLsizei count, GLuint *buffers)
+{
+    static GLuint next = 1;
+    for (GLsizei i = 0; i < count; ++i)
+    {
+        buffers[i] = next++;
+    }
+}
+void APIENTRY stubDeleteBuffers(GLsizei, const GLuint *)
+{
+}
+void APIENTRY stubBindBuffer(GLenum, GLuint)
+{
+}
+void APIENTRY stubBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum)
+{
+    if (GL_DRAW_INDIRECT_BUFFER == target && data)
+    {
+        auto commands = static_cast<const DrawElementsIndirectCommand *>(data);
+        stub.indirectCommands.assign(commands, commands + size / sizeof(DrawElementsIndirectCommand));
+    }
+}
+void APIENTRY stubBufferSubData(GLenum, GLintptr, GLsizeiptr, const void *)
+{
+}
+void APIENTRY stubVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void *)
+{
+}
+void APIENTRY stubEnableVertexAttribArray(GLuint)
+{
+}
+void APIENTRY stubVertexAttribDivisor(GLuint, GLuint)
+{
+}
+void APIENTRY stubDrawElementsInstancedBaseVertex(GLenum, GLsizei, GLenum, const void *, GLsizei instanceCount, GLint)
+{
+    stub.drawCalls++;
+    stub.instances += (std::size_t)instanceCount;
+}
+void APIENTRY stubMultiDrawElementsIndirect(GLenum, GLenum, const void *, GLsizei drawCount, GLsizei)
+{
+    stub.drawCalls++;
+    for (GLsizei i = 0; i < drawCount && i < (GLsizei)stub.indirectCommands.size(); ++i)
+    {
+        stub.instances += stub.indirectCommands[i].instanceCount;
+    }
+}
+
+// Submits the pass to the stub, returns the draw calls it received or 0 when they or the instances
+// drawn disagree with the pass
+std::size_t submitToStub(MultiDrawPass &pass, MeshBatchLayout const &batch, std::size_t objectCount)
+{
+    InstanceAttributeLocations locations;
+    locations.world = 0;
+    locations.color = 4;
+    stub.drawCalls = 0;
+    stub.instances = 0;
+    pass.submit(batch, locations);
+    if (stub.drawCalls != pass.statistics().drawCalls || stub.instances != objectCount)
+    {
+        return 0;
+    }
+    return stub.drawCalls;
+}
+
+// Batch of meshCount fake meshes, only their index ranges matter here
+MeshBatchLayout makeBatch(std::size_t meshCount)
+{
+    MeshBatchLayout batch;
+    for (std::size_t mesh = 0; mesh < meshCount; ++mesh)
+    {
+        BatchedMesh batched;
+        batched.firstIndex = mesh * 300;
+        batched.indexCount = 300;
+        batched.baseVertex = (int)(mesh * 100);
+        batch.meshes.push_back(batched);
+    }
+    batch.vertexCount = meshCount * 100;
+    batch.indexCount = meshCount * 300;
+    return batch;
+}
+
+// Every object goes right after the previous one of its mesh, in the range of its mesh's command
+bool checkPass(MultiDrawPass const &pass, MeshBatchLayout const &batch, std::vector<MultiDrawObject> const &objects)
+{
+    std::vector<std::size_t> next(batch.meshes.size(), 0), end(batch.meshes.size(), 0);
+    std::size_t total = 0;
+    for (auto const &command : pass.commands())
+    {
+        std::size_t mesh = (command.firstIndex) / 300;
+        if (command.count != 300 || command.baseVertex != (int)(mesh * 100))
+        {
+            return false;
+        }
+        next[mesh] = command.baseInstance;
+        end[mesh] = command.baseInstance + command.instanceCount;
+        total += command.instanceCount;
+    }
+    if (total != objects.size() || pass.instances().size() != objects.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < objects.size(); ++i)
+    {
+        std::size_t mesh = objects[i].mesh;
+        if (next[mesh] >= end[mesh] || pass.instances()[next[mesh]].color.x != (float)i)
+        {
+            return false;
+        }
+        ++next[mesh];
+    }
+    return true;
+}
+
+int main()
+{
+    bool passed = true;
+    stubGl().version = "4.3.0 stub";
+    if (!loadStubGl({{"glGenBuffers", (void *)stubGenBuffers}, {"glDeleteBuffers", (void *)stubDeleteBuffers}, {"glBindBuffer", (void *)stubBindBuffer},
+                     {"glBufferData", (void *)stubBufferData}, {"glBufferSubData", (void *)stubBufferSubData},
+                     {"glVertexAttribPointer", (void *)stubVertexAttribPointer}, {"glEnableVertexAttribArray", (void *)stubEnableVertexAttribArray},
+                     {"glVertexAttribDivisor", (void *)stubVertexAttribDivisor}, {"glDrawElementsInstancedBaseVertex", (void *)stubDrawElementsInstancedBaseVertex},
+                     {"glMultiDrawElementsIndirect", (void *)stubMultiDrawElementsIndirect}}))
+    {
+        std::cout << "Failed to load the stub GL" << std::endl;
+        return 1;
+    }
+    JobSystem jobs;
+    std::mt19937 random(17);
+
+    std::cout << std::setw(9) << "objects" << std::setw(8) << "meshes" << std::setw(11) << "1 thread" << std::setw(11) << "jobs"
+              << std::setw(10) << "commands" << std::setw(12) << "loop calls" << std::setw(11) << "MDI calls" << std::setw(12) << "per object" << std::endl;
+    std::cout << std::setw(17) << "" << std::setw(22) << "(ms, " << jobs.threadCount() << " threads)" << std::endl;
+
+    for (std::size_t meshCount : {8u, 64u})
+    {
+        MeshBatchLayout batch = makeBatch(meshCount);
+        std::uniform_int_distribution<std::size_t> meshOf(0, meshCount - 1);
+        for (std::size_t count : {10000u, 100000u, 1000000u})
+        {
+            std::vector<MultiDrawObject> objects(count);
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                objects[i].mesh = meshOf(random);
+                objects[i].instance.world = glm::mat4(1.0f);
+                objects[i].instance.color = glm::vec4((float)i, 0.0f, 0.0f, 1.0f);
+            }
+
+            MultiDrawPass pass;
+            double serialTime = measure([&]
+                                        { pass.build(batch, objects); });
+            passed &= checkPass(pass, batch, objects);
+            double parallelTime = measure([&]
+                                          { pass.build(batch, objects, &jobs); });
+            passed &= checkPass(pass, batch, objects);
+
+            // The commands stay built when the pass is recreated without multi-draw indirect
+            pass.create((GLADloadproc)stubGlGetProcAddress);
+            passed &= pass.usesMultiDrawIndirect();
+            std::size_t indirectCalls = submitToStub(pass, batch, count);
+            pass.create((GLADloadproc)stubGlGetProcAddress, false);
+            std::size_t loopCalls = submitToStub(pass, batch, count);
+            passed &= 1 == indirectCalls && pass.statistics().commands == loopCalls;
+
+            std::cout << std::setw(9) << count << std::setw(8) << meshCount << std::fixed << std::setprecision(3) << std::setw(11) << serialTime
+                      << std::setw(11) << parallelTime << std::setw(10) << pass.statistics().commands << std::setw(12) << loopCalls
+                      << std::setw(11) << indirectCalls << std::setw(12) << count << std::defaultfloat << std::endl;
+        }
+    }
+
+    // Multi-draw indirect without base instances would draw every command from instance 0
+    stubGl().version = "4.1.0 stub";
+    stubGl().extensions = {"GL_stub_extension", "GL_ARB_multi_draw_indirect"};
+    gladLoadGLLoader((GLADloadproc)stubGlGetProcAddress);
+    MultiDrawPass pass;
+    pass.create((GLADloadproc)stubGlGetProcAddress);
+    bool fellBack = !pass.usesMultiDrawIndirect();
+    stubGl().extensions.push_back("GL_ARB_base_instance");
+    pass.create((GLADloadproc)stubGlGetProcAddress);
+    bool usedIndirect = pass.usesMultiDrawIndirect();
+    std::cout << "GL 4.1 with ARB_multi_draw_indirect: " << (fellBack ? "loop" : "multi-draw indirect") << " without ARB_base_instance, "
+              << (usedIndirect ? "multi-draw indirect" : "loop") << " with it" << std::endl;
+    passed &= fellBack && usedIndirect;
+
+    std::cout << (passed ? "Every object is drawn once, grouped by mesh in order" : "MISMATCH in the multi-draw commands or the draws submitted") << std::endl;
+    return passed ? 0 : 1;
+}
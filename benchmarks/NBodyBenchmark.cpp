@@ -0,0 +1,142 @@
+// Barnes-Hut gravity against the O(n^2) direct sum for 10,000 to 1,000,000 bodies:
+//  - octree build and force evaluation with 1 thread and with every hardware thread
+//  - direct sum time, measured on a sample of bodies and scaled to all of them beyond 10,000
+//  - relative force error of the tree against the direct sum on that sample
+// Then the energy drift of the leapfrog integrator over 1,000 steps of a small cluster.
+// The program returns 1 when the force error or the energy drift is too large.
+#include <NBody.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Plummer sphere of total mass 1 and scale radius 1, in rough virial equilibrium
+NBodySystem plummerSphere(std::size_t count, unsigned int seed)
+{
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    auto direction = [&]
+    {
+        float z = 2.0f * uniform(random) - 1.0f;
+        float angle = 6.2831853f * uniform(random);
+        float r = std::sqrt(1.0f - z * z);
+        return glm::vec3(r * std::cos(angle), r * std::sin(angle), z);
+    };
+    NBodySystem system;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        float radius = 1.0f / std::sqrt(std::pow(std::max(1e-4f, uniform(random)), -2.0f / 3.0f) - 1.0f);
+        radius = std::min(radius, 20.0f);
+        float escapeSpeed = std::sqrt(2.0f) * std::pow(1.0f + radius * radius, -0.25f);
+        system.addBody(direction() * radius, direction() * escapeSpeed * 0.5f * uniform(random), 1.0f / count);
+    }
+    return system;
+}
+
+int main()
+{
+    bool passed = true;
+    JobSystem jobs;
+    GravitySettings settings;
+
+    std::cout << std::setw(9) << "bodies" << std::setw(12) << "build 1T" << std::setw(12) << "build MT" << std::setw(12) << "tree 1T"
+              << std::setw(12) << "tree MT" << std::setw(14) << "direct MT" << std::setw(10) << "speedup" << std::setw(12) << "error" << std::endl;
+    std::cout << std::setw(9) << "" << std::setw(40) << "(ms, 1 thread and " << jobs.threadCount() << " threads)" << std::setw(33) << "(rms, max)" << std::endl;
+
+    for (std::size_t count : {10000u, 100000u, 1000000u})
+    {
+        NBodySystem system = plummerSphere(count, 3);
+        int numRuns = count >= 1000000 ? 1 : 3;
+
+        BarnesHutTree tree;
+        double buildSerial = measure([&]
+                                     { tree.build(system); },
+                                     numRuns);
+        double buildParallel = measure([&]
+                                       { tree.build(system, &jobs); },
+                                       numRuns);
+        double treeSerial = measure([&]
+                                    { tree.computeAccelerations(system, settings); },
+                                    numRuns);
+        double treeParallel = measure([&]
+                                      { tree.computeAccelerations(system, settings, &jobs); },
+                                      numRuns);
+        std::vector<glm::vec3> treeAcceleration(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            treeAcceleration[i] = glm::vec3(system.ax[i], system.ay[i], system.az[i]);
+        }
+
+        // Direct sum on every body up to 10,000, on a strided sample beyond
+        std::size_t sampleStride = std::max<std::size_t>(1, count / 10000);
+        std::vector<std::size_t> sample;
+        for (std::size_t i = 0; i < count; i += sampleStride)
+        {
+            sample.push_back(i);
+        }
+        std::vector<glm::vec3> directAcceleration(sample.size());
+        float softening2 = settings.softening * settings.softening;
+        double directTime = measure([&]
+                                    { jobs.parallelFor(0, sample.size(), 16, [&](std::size_t begin, std::size_t end)
+                                                       {
+                for (std::size_t s = begin; s < end; ++s)
+                {
+                    glm::vec3 p = system.position(sample[s]);
+                    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+                    for (std::size_t j = 0; j < count; ++j)
+                    {
+                        float dx = system.x[j] - p.x, dy = system.y[j] - p.y, dz = system.z[j] - p.z;
+                        float inverseR = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + softening2);
+                        float factor = system.mass[j] * inverseR * inverseR * inverseR;
+                        ax += dx * factor;
+                        ay += dy * factor;
+                        az += dz * factor;
+                    }
+                    directAcceleration[s] = glm::vec3(ax, ay, az);
+                } }); },
+                                    1) *
+                            static_cast<double>(count) / sample.size();
+
+        double squaredError = 0.0, maxError = 0.0;
+        for (std::size_t s = 0; s < sample.size(); ++s)
+        {
+            double error = glm::length(treeAcceleration[sample[s]] - directAcceleration[s]) / glm::length(directAcceleration[s]);
+            squaredError += error * error;
+            maxError = std::max(maxError, error);
+        }
+        double rmsError = std::sqrt(squaredError / sample.size());
+        passed &= rmsError < 0.01 && maxError < 0.1;
+
+        std::cout << std::setw(9) << count << std::fixed << std::setprecision(1) << std::setw(12) << buildSerial << std::setw(12) << buildParallel
+                  << std::setw(12) << treeSerial << std::setw(12) << treeParallel << std::setw(14) << directTime
+                  << std::setw(9) << directTime / (buildParallel + treeParallel) << "x" << std::scientific << std::setprecision(1)
+                  << std::setw(10) << rmsError << std::setw(9) << maxError << std::defaultfloat << std::endl;
+    }
+
+    // Leapfrog energy conservation
+    NBodySimulation simulation;
+    simulation.bodies = plummerSphere(2000, 7);
+    simulation.settings.softening = 0.05f;
+    simulation.timeStep = 1.0 / 256.0;
+    simulation.jobs = &jobs;
+    simulation.start();
+    double initialEnergy = totalEnergy(simulation.bodies, simulation.settings);
+    double stepTime = measure([&]
+                              {
+        for (int step = 0; step < 1000; ++step)
+        {
+            simulation.step();
+        } },
+                              1) /
+                      1000.0;
+    double drift = std::abs(totalEnergy(simulation.bodies, simulation.settings) - initialEnergy) / std::abs(initialEnergy);
+    passed &= drift < 0.01;
+    std::cout << "2000 bodies, 1000 leapfrog steps: " << std::fixed << std::setprecision(3) << stepTime << " ms per step, relative energy drift "
+              << std::scientific << std::setprecision(2) << drift << std::defaultfloat << std::endl;
+
+    std::cout << (passed ? "Barnes-Hut forces and energy are within tolerance" : "Barnes-Hut forces or energy OUT OF TOLERANCE") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Render command queue on 1,000,000 draw packets against a stub GL loader, no GPU or window needed.
+//  - record: packets written with 1 thread and from the job system, one command list per job
+//  - sort: the radix sort of the keys against std::stable_sort
+//  - submit: replay in recording order binding everything per draw, against the sorted replay through
+//    the state cache, with the GL calls each one makes
+// Checks that the sorted packets are a permutation of the recorded ones in key order, opaque ones front
+// to back within their state and blended ones back to front, and that every draw reaches the stub.
+// The program returns 1 otherwise.
+#include <JobSystem.h>
+#include <RenderQueue.h>
+#include <Benchmark.h>
+#include <StubGl.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// The stub driver only counts, draws and state changes apart
+std::size_t stubStateCalls = 0;
+std::size_t stubDraws = 0;
+
+void APIENTRY stubBind(GLuint)
+{
+    stubStateCalls++;
+}
+void APIENTRY stubBindTarget(GLenum, GLuint)
+{
+    stubStateCalls++;
+}
+void APIENTRY stubCapability(GLenum)
+{
+    stubStateCalls++;
+}
+void APIENTRY stubUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat *)
+{
+}
+void APIENTRY stubUniform4fv(GLint, GLsizei, const GLfloat *)
+{
+}
+void APIENTRY stubDrawElementsBaseVertex(GLenum, GLsizei, GLenum, const void *, GLint)
+{
+    stubDraws++;
+}
+
+// A scene of 4 programs, 16 textures and 8 meshes, one packet in five blended
+struct ScenePacket
+{
+    std::uint64_t key;
+    DrawCommand command;
+};
+
+std::vector<ScenePacket> makeScene(std::size_t count)
+{
+    std::mt19937 random(19);
+    std::uniform_int_distribution<unsigned int> program(1, 4), texture(1, 16), vertexArray(1, 8), blended(0, 4);
+    std::uniform_real_distribution<float> depth(0.0f, 1.0f);
+    std::vector<ScenePacket> scene(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        DrawCommand &command = scene[i].command;
+        command.program = program(random);
+        command.texture = texture(random);
+        command.vertexArray = vertexArray(random);
+        command.indexCount = 36;
+        command.color = glm::vec4((float)i, 0.0f, 0.0f, 1.0f);
+        float z = depth(random);
+        scene[i].key = 0 == blended(random) ? sortkey::blended(0, command.program, command.texture, command.vertexArray, z)
+                                            : sortkey::opaque(0, command.program, command.texture, command.vertexArray, z);
+    }
+    return scene;
+}
+
+void record(RenderQueue &queue, std::vector<ScenePacket> const &scene, JobSystem *jobs)
+{
+    queue.reset();
+    auto range = [&](std::size_t begin, std::size_t end)
+    {
+        auto &list = queue.acquireList();
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            list.draw(scene[i].key, scene[i].command);
+        }
+    };
+    if (jobs)
+    {
+        jobs->parallelFor(0, scene.size(), 16384, range);
+    }
+    else
+    {
+        range(0, scene.size());
+    }
+}
+
+// Keys never decrease, and every recorded packet shows up once with its own key.
+// Depth being the lowest field of the opaque keys and inverted in the blended ones, this orders them too.
+bool checkSorted(RenderQueue const &queue, std::vector<ScenePacket> const &scene)
+{
+    std::size_t count = scene.size();
+    auto const &packets = queue.packets();
+    if (packets.size() != count)
+    {
+        return false;
+    }
+    std::vector<char> seen(count, 0);
+    for (std::size_t i = 0; i < packets.size(); ++i)
+    {
+        if (i > 0 && packets[i - 1].key > packets[i].key)
+        {
+            return false;
+        }
+        std::size_t original = (std::size_t)queue.command(packets[i]).color.x;
+        if (original >= count || packets[i].key != scene[original].key || seen[original])
+        {
+            return false;
+        }
+        seen[original] = 1;
+    }
+    // Blended after opaque
+    auto firstBlended = std::find_if(packets.begin(), packets.end(), [](RenderPacket const &packet)
+                                     { return sortkey::isBlended(packet.key); });
+    return std::all_of(firstBlended, packets.end(), [](RenderPacket const &packet)
+                       { return sortkey::isBlended(packet.key); });
+}
+
+int main()
+{
+    bool passed = true;
+    if (!loadStubGl({{"glUseProgram", (void *)stubBind}, {"glBindVertexArray", (void *)stubBind}, {"glActiveTexture", (void *)stubCapability},
+                     {"glBindTexture", (void *)stubBindTarget}, {"glEnable", (void *)stubCapability}, {"glDisable", (void *)stubCapability},
+                     {"glUniformMatrix4fv", (void *)stubUniformMatrix4fv}, {"glUniform4fv", (void *)stubUniform4fv},
+                     {"glDrawElementsBaseVertex", (void *)stubDrawElementsBaseVertex}}))
+    {
+        std::cout << "Failed to load the stub GL" << std::endl;
+        return 1;
+    }
+
+    const std::size_t count = 1000000;
+    auto scene = makeScene(count);
+    JobSystem jobs;
+    RenderQueue queue;
+
+    double serialRecord = measure([&]
+                                  { record(queue, scene, nullptr); });
+    double parallelRecord = measure([&]
+                                    { record(queue, scene, &jobs); });
+    std::cout << "record " << count << " packets: " << std::fixed << std::setprecision(2) << serialRecord << " ms with 1 thread, "
+              << parallelRecord << " ms with " << jobs.threadCount() << " threads" << std::endl;
+
+    double radixTime = measure([&]
+                               { queue.sort(); });
+    passed &= checkSorted(queue, scene);
+    std::vector<RenderPacket> packets;
+    double stableSortTime = measure([&]
+                                    {
+        packets.clear();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            packets.push_back({scene[i].key, 0, (unsigned int)i});
+        }
+        std::stable_sort(packets.begin(), packets.end(), [](RenderPacket const &a, RenderPacket const &b)
+                         { return a.key < b.key; }); });
+    std::cout << "sort: " << radixTime << " ms radix (" << queue.statistics().sortPasses << " passes over " << queue.statistics().lists << " lists), " << stableSortTime
+              << " ms std::stable_sort" << std::endl;
+
+    // Same draws, in recording order with everything bound per draw, then sorted through the cache
+    auto setUniforms = [](DrawCommand const &command)
+    {
+        glUniformMatrix4fv(0, 1, GL_FALSE, &command.world[0][0]);
+        glUniform4fv(1, 1, &command.color[0]);
+    };
+    std::size_t callsBefore = stubStateCalls, drawsBefore = stubDraws;
+    double rawTime = measure([&]
+                             {
+        for (auto const &packet : scene)
+        {
+            DrawCommand const &command = packet.command;
+            if (sortkey::isBlended(packet.key))
+            {
+                glEnable(GL_BLEND);
+            }
+            else
+            {
+                glDisable(GL_BLEND);
+            }
+            glUseProgram(command.program);
+            glBindVertexArray(command.vertexArray);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, command.texture);
+            setUniforms(command);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)command.indexCount, command.indexType, (const void *)command.indexOffset, command.baseVertex);
+        } },
+                             1);
+    std::size_t rawCalls = stubStateCalls - callsBefore;
+    passed &= stubDraws - drawsBefore == count;
+
+    GlStateCache state;
+    callsBefore = stubStateCalls;
+    drawsBefore = stubDraws;
+    double sortedTime = measure([&]
+                                { queue.submit(state, setUniforms); },
+                                1);
+    std::size_t sortedCalls = stubStateCalls - callsBefore;
+    passed &= stubDraws - drawsBefore == count;
+    std::cout << "submit: " << rawTime << " ms and " << rawCalls << " state calls in recording order, " << sortedTime << " ms and "
+              << sortedCalls << " state calls sorted and cached" << std::defaultfloat << std::endl;
+
+    std::cout << (passed ? "Packets replayed once each, in key order" : "MISMATCH in the render queue") << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// World transform update cost of the flat TransformHierarchy against a classic
+// pointer based scene graph updated by recursion, from 4 to 1,000,000 nodes, then the
+// cost of the incremental update on mostly static scenes.
+#include <SceneGraph.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Reference: every node owns its children and the update recurses through them
+struct SceneNode
+{
+    glm::vec3 translation{0.0f};
+    glm::quat rotation{1.0f, 0.0f, 0.0f, 0.0f};
+    glm::vec3 scale{1.0f};
+    glm::mat4 world{1.0f};
+    std::vector<std::unique_ptr<SceneNode>> children;
+};
+
+void updateRecursive(SceneNode &node, glm::mat4 const &parentWorld)
+{
+    node.world = parentWorld * AffineTransform::fromTranslationRotationScale(node.translation, node.rotation, node.scale).toMat4();
+    for (auto &child : node.children)
+    {
+        updateRecursive(*child, node.world);
+    }
+}
+
+int main()
+{
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+    volatile float sink = 0.0f;
+
+    std::cout << std::setw(10) << "nodes" << std::setw(16) << "flat(ms)" << std::setw(16) << "recursive(ms)"
+              << std::setw(14) << "flat ns/node" << std::setw(18) << "recursive ns/node" << std::endl;
+
+    for (std::size_t nodeCount : {4u, 100u, 10000u, 100000u, 1000000u})
+    {
+        // Same random tree in both representations: each node's parent is an earlier node
+        TransformHierarchy hierarchy;
+        std::vector<TransformNode> handles;
+        std::vector<SceneNode *> sceneNodes;
+        SceneNode root;
+        for (std::size_t i = 0; i < nodeCount; ++i)
+        {
+            glm::vec3 translation(offset(random), offset(random), offset(random));
+            glm::quat rotation = glm::angleAxis(angle(random), glm::vec3(0.0f, 0.0f, 1.0f));
+            std::size_t parent = i > 0 ? std::uniform_int_distribution<std::size_t>(0, i - 1)(random) : 0;
+
+            handles.push_back(hierarchy.addNode(i > 0 ? handles[parent] : noParentNode, translation, rotation));
+
+            auto node = std::make_unique<SceneNode>();
+            node->translation = translation;
+            node->rotation = rotation;
+            sceneNodes.push_back(node.get());
+            (i > 0 ? sceneNodes[parent]->children : root.children).push_back(std::move(node));
+        }
+
+        auto flatTime = measure([&]
+                                {
+            hierarchy.invalidate();
+            hierarchy.updateWorldTransforms();
+            sink = sink + hierarchy.worldAffine(handles.back()).translation.x; });
+        auto recursiveTime = measure([&]
+                                     {
+            updateRecursive(root, glm::mat4(1.0f));
+            sink = sink + sceneNodes.back()->world[3][0]; });
+
+        std::cout << std::setw(10) << nodeCount << std::fixed << std::setprecision(4)
+                  << std::setw(16) << flatTime << std::setw(16) << recursiveTime << std::setprecision(1)
+                  << std::setw(14) << flatTime * 1e6 / nodeCount << std::setw(18) << recursiveTime * 1e6 / nodeCount << std::endl;
+    }
+
+    // Only the nodes that changed and their descendants are recomputed
+    std::cout << std::endl
+              << std::setw(10) << "nodes" << std::setw(22) << "scenario" << std::setw(12) << "ms" << std::setw(12) << "visited"
+              << std::setw(12) << "updated" << std::endl;
+    for (std::size_t nodeCount : {100000u, 1000000u})
+    {
+        // Wide and shallow like a game level: a few groups with many static props below them
+        TransformHierarchy hierarchy;
+        std::vector<TransformNode> handles;
+        for (std::size_t i = 0; i < nodeCount; ++i)
+        {
+            std::size_t parent = i > 0 ? std::uniform_int_distribution<std::size_t>(0, std::min<std::size_t>(i - 1, 1000))(random) : 0;
+            handles.push_back(hierarchy.addNode(i > 0 ? handles[parent] : noParentNode, glm::vec3(offset(random), offset(random), offset(random)),
+                                                glm::angleAxis(angle(random), glm::vec3(0.0f, 0.0f, 1.0f))));
+        }
+        hierarchy.updateWorldTransforms();
+
+        auto report = [&](const char *scenario, std::size_t changedNodes, bool nearRoot, bool everything = false)
+        {
+            float frame = 0.0f;
+            auto time = measure([&]
+                                {
+                frame += 1.0f;
+                for (std::size_t i = 0; i < changedNodes; ++i)
+                {
+                    std::size_t node = nearRoot ? 1 + i : nodeCount - 1 - (i * 7919) % (nodeCount / 2);
+                    hierarchy.setLocalRotation(handles[node], glm::angleAxis(frame * 0.01f, glm::vec3(0.0f, 0.0f, 1.0f)));
+                }
+                if (everything)
+                {
+                    hierarchy.invalidate();
+                }
+                hierarchy.updateWorldTransforms();
+                sink = sink + hierarchy.worldAffine(handles.back()).translation.x; });
+            auto const &statistics = hierarchy.lastUpdateStatistics();
+            std::cout << std::setw(10) << nodeCount << std::setw(22) << scenario << std::fixed << std::setprecision(4) << std::setw(12) << time
+                      << std::setw(12) << statistics.nodesVisited << std::setw(12) << statistics.nodesUpdated << std::endl;
+        };
+
+        report("static", 0, false);
+        report("1 leaf moved", 1, false);
+        report("1% leaves moved", nodeCount / 100, false);
+        report("1 group moved", 1, true);
+        report("full update", 0, false, true);
+    }
+    return 0;
+}
@@ -0,0 +1,400 @@
+// Program binary cache and program manager against a stub GL loader, no GPU or window needed.
+// The stub driver takes 20 ms to link a program, and gives back the sources as the program binary.
+//  - first run: the program is compiled, linked and stored
+//  - second run: the program is loaded from the cache, and reports the time it saved
+//  - a changed source, a binary the driver rejects and a driver without program binaries all compile
+//  - a shader that does not compile throws with its info log
+//  - ProgramManager with and without KHR_parallel_shader_compile: ready() never blocks while polling,
+//    failures are thrown every time the program is asked for, and the compile time stored with the
+//    binary leaves out the time the application spent on other work after submit()
+// The program returns 1 when the cache or the manager loads, compiles, stores or reports anything else.
+#include <ProgramManager.h>
+#include <ShaderProgram.h>
+#include <Benchmark.h>
+#include <StubGl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+constexpr const char *stubBinaryPrefix = "stub binary:";
+constexpr GLenum stubBinaryFormat = 1;
+constexpr double stubLinkMilliseconds = 20.0;
+
+// A source containing "error" fails to compile
+struct StubShader
+{
+    std::string source;
+    bool compiled = false;
+};
+
+// Without parallel compile, linking is done the first time the status is looked at and blocks for
+// stubLinkMilliseconds. With it, linking runs in the background and is done stubLinkMilliseconds later.
+struct StubProgram
+{
+    std::vector<GLuint> shaders;
+    std::string binary;
+    bool linkPending = false;
+    std::chrono::steady_clock::time_point linkDone;
+    bool linked = false;
+    bool retrievable = false;
+};
+
+std::map<GLuint, StubShader> stubShaders;
+std::map<GLuint, StubProgram> stubPrograms;
+GLuint stubNextName = 1;
+std::size_t stubLinks = 0;
+// Set by glMaxShaderCompilerThreadsKHR
+bool stubParallel = false;
+
+void APIENTRY stubMaxShaderCompilerThreads(GLuint)
+{
+    stubParallel = true;
+}
+GLuint APIENTRY stubCreateShader(GLenum)
+{
+    stubShaders[stubNextName];
+    return stubNextName++;
+}
+void APIENTRY stubShaderSource(GLuint shader, GLsizei, const GLchar *const *sources, const GLint *)
+{
+    stubShaders[shader].source = sources[0];
+}
+void APIENTRY stubCompileShader(GLuint shader)
+{
+    StubShader &stubShader = stubShaders[shader];
+    stubShader.compiled = std::string::npos == stubShader.source.find("error");
+}
+void APIENTRY stubDeleteShader(GLuint shader)
+{
+    stubShaders.erase(shader);
+}
+std::string stubShaderLog(GLuint shader)
+{
+    return stubShaders[shader].compiled ? "" : "0:1: error: stub";
+}
+void APIENTRY stubGetShaderiv(GLuint shader, GLenum name, GLint *value)
+{
+    if (GL_COMPILE_STATUS == name)
+    {
+        *value = stubShaders[shader].compiled ? GL_TRUE : GL_FALSE;
+    }
+    else if (GL_INFO_LOG_LENGTH == name)
+    {
+        *value = (GLint)stubShaderLog(shader).size() + 1;
+    }
+}
+void APIENTRY stubGetShaderInfoLog(GLuint shader, GLsizei size, GLsizei *length, GLchar *log)
+{
+    std::string text = stubShaderLog(shader).substr(0, (std::size_t)size - 1);
+    std::memcpy(log, text.c_str(), text.size() + 1);
+    if (length)
+    {
+        *length = (GLsizei)text.size();
+    }
+}
+GLuint APIENTRY stubCreateProgram()
+{
+    stubPrograms[stubNextName];
+    return stubNextName++;
+}
+void APIENTRY stubAttachShader(GLuint program, GLuint shader)
+{
+    stubPrograms[program].shaders.push_back(shader);
+}
+void APIENTRY stubDetachShader(GLuint, GLuint)
+{
+}
+void APIENTRY stubLinkProgram(GLuint program)
+{
+    StubProgram &stubProgram = stubPrograms[program];
+    stubProgram.linkPending = true;
+    stubProgram.linkDone = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                                   std::chrono::duration<double, std::milli>(stubLinkMilliseconds));
+    stubProgram.binary = stubBinaryPrefix;
+    stubProgram.linked = true;
+    for (GLuint shader : stubProgram.shaders)
+    {
+        stubProgram.binary += stubShaders[shader].source + "\n";
+        stubProgram.linked &= stubShaders[shader].compiled;
+    }
+    stubLinks++;
+}
+void APIENTRY stubDeleteProgram(GLuint program)
+{
+    stubPrograms.erase(program);
+}
+void stubWaitForLink(StubProgram &stubProgram)
+{
+    if (!stubProgram.linkPending)
+    {
+        return;
+    }
+    if (stubParallel)
+    {
+        std::this_thread::sleep_until(stubProgram.linkDone);
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(stubLinkMilliseconds));
+    }
+    stubProgram.linkPending = false;
+}
+void APIENTRY stubGetProgramiv(GLuint program, GLenum name, GLint *value)
+{
+    StubProgram &stubProgram = stubPrograms[program];
+    if (GL_LINK_STATUS == name)
+    {
+        stubWaitForLink(stubProgram);
+        *value = stubProgram.linked ? GL_TRUE : GL_FALSE;
+    }
+    else if (GL_COMPLETION_STATUS_KHR == name)
+    {
+        *value = !stubProgram.linkPending || std::chrono::steady_clock::now() >= stubProgram.linkDone ? GL_TRUE : GL_FALSE;
+    }
+    else if (GL_INFO_LOG_LENGTH == name)
+    {
+        *value = 1;
+    }
+    else if (GL_PROGRAM_BINARY_LENGTH == name)
+    {
+        *value = stubProgram.linked && stubProgram.retrievable ? (GLint)stubProgram.binary.size() : 0;
+    }
+}
+void APIENTRY stubGetProgramInfoLog(GLuint, GLsizei, GLsizei *length, GLchar *log)
+{
+    log[0] = '\0';
+    if (length)
+    {
+        *length = 0;
+    }
+}
+void APIENTRY stubProgramParameteri(GLuint program, GLenum name, GLint value)
+{
+    if (GL_PROGRAM_BINARY_RETRIEVABLE_HINT == name)
+    {
+        stubPrograms[program].retrievable = GL_TRUE == value;
+    }
+}
+void APIENTRY stubGetProgramBinary(GLuint program, GLsizei size, GLsizei *length, GLenum *format, void *binary)
+{
+    std::string const &text = stubPrograms[program].binary;
+    GLsizei copied = std::min(size, (GLsizei)text.size());
+    std::memcpy(binary, text.data(), (std::size_t)copied);
+    *length = copied;
+    *format = stubBinaryFormat;
+}
+// Only binaries in the stub's own format are accepted, and they link right away
+void APIENTRY stubProgramBinary(GLuint program, GLenum format, const void *binary, GLsizei length)
+{
+    StubProgram &stubProgram = stubPrograms[program];
+    stubProgram.binary.assign(static_cast<const char *>(binary), (std::size_t)length);
+    stubProgram.linked = stubBinaryFormat == format && 0 == stubProgram.binary.rfind(stubBinaryPrefix, 0);
+}
+
+const char *vertexSource = "#version 330 core\nvoid main() { gl_Position = vec4(0.0); }\n";
+const char *fragmentSource = "#version 330 core\nout vec4 FragColor;\nvoid main() { FragColor = vec4(1.0); }\n";
+const char *changedFragmentSource = "#version 330 core\nout vec4 FragColor;\nvoid main() { FragColor = vec4(0.5); }\n";
+
+bool check(bool condition, const char *what)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED: " << what << std::endl;
+    }
+    return condition;
+}
+
+// Creates one program with a new cache on the directory, as a new run of a sample would
+ShaderCacheStatistics run(std::filesystem::path const &directory, const char *fragment, GLADloadproc getProcAddress = (GLADloadproc)stubGlGetProcAddress)
+{
+    ProgramBinaryCache cache(directory, getProcAddress);
+    unsigned int program = cache.createProgram(vertexSource, fragment);
+    glDeleteProgram(program);
+    std::cout << std::setw(28) << std::left << (directory.filename().string() + ":") << std::right << cache.summary() << std::endl;
+    return cache.statistics();
+}
+
+// Compile time stored with the binary of the program
+double storedCompileMilliseconds(std::filesystem::path const &directory, const char *fragment)
+{
+    ProgramBinaryCache cache(directory, (GLADloadproc)stubGlGetProcAddress);
+    ProgramBinaryHeader header;
+    std::ifstream file(cache.filePath(programBinaryHash(vertexSource, fragment)), std::ios::binary);
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    return file ? header.compileMilliseconds : -1.0;
+}
+
+// One ProgramManager scenario: submit, let the application work for busyMilliseconds, then poll every
+// millisecond, or ask for the program right away when polling is off
+bool checkManager(std::filesystem::path const &directory, bool parallel, double busyMilliseconds, bool poll)
+{
+    bool passed = true;
+    std::string fragment = std::string(fragmentSource) + "// " + (parallel ? "parallel" : "blocking") + " " +
+                           std::to_string((int)busyMilliseconds) + (poll ? " polled" : "") + "\n";
+    stubParallel = false;
+    ProgramManager programs;
+    programs.create((GLADloadproc)stubGlGetProcAddress, directory, parallel);
+    passed &= check(parallel == programs.parallel(), "parallel compile is used when allowed");
+
+    ProgramHandle handle = programs.submit(vertexSource, fragment.c_str());
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(busyMilliseconds));
+    std::size_t pendingPolls = 0;
+    double slowestPoll = 0.0;
+    if (poll)
+    {
+        for (;;)
+        {
+            auto start = Clock::now();
+            bool ready = programs.ready(handle);
+            std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+            if (ready)
+            {
+                break;
+            }
+            slowestPoll = std::max(slowestPoll, elapsed.count());
+            pendingPolls++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    passed &= check(0 != programs.program(handle), "the program is linked");
+
+    double stored = storedCompileMilliseconds(directory, fragment.c_str());
+    double latency = programs.statistics().slowestMilliseconds;
+    std::cout << std::setw(10) << (parallel ? "parallel" : "blocking") << std::setw(10) << busyMilliseconds << std::setw(8) << (poll ? "yes" : "no")
+              << std::setw(8) << pendingPolls << std::fixed << std::setprecision(2) << std::setw(14) << slowestPoll << std::setw(14) << latency
+              << std::setw(14) << stored << std::defaultfloat << std::endl;
+
+    passed &= check(latency >= busyMilliseconds, "the latency includes the time before the program is asked for");
+    passed &= check(stored >= 0.0 && stored < std::max(busyMilliseconds, stubLinkMilliseconds) + 10.0, "the stored compile time leaves out the other work");
+    if (parallel && poll && busyMilliseconds < stubLinkMilliseconds)
+    {
+        passed &= check(pendingPolls > 0 && slowestPoll < 0.5 * stubLinkMilliseconds, "polling sees the program compiling and never blocks");
+        passed &= check(stored >= stubLinkMilliseconds - busyMilliseconds, "the stored compile time covers the background link");
+    }
+    if (!parallel)
+    {
+        passed &= check(stored >= stubLinkMilliseconds, "the stored compile time covers the blocking link");
+    }
+    return passed;
+}
+
+// A program that fails to compile throws from ready() and program(), every time
+bool checkManagerFailure(std::filesystem::path const &directory, bool parallel)
+{
+    stubParallel = false;
+    ProgramManager programs;
+    programs.create((GLADloadproc)stubGlGetProcAddress, directory, parallel);
+    ProgramHandle handle = programs.submit(vertexSource, "#version 330 core\nerror\n");
+    std::size_t throws = 0;
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        try
+        {
+            if (parallel)
+            {
+                while (!programs.ready(handle))
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+            }
+            else
+            {
+                programs.program(handle);
+            }
+        }
+        catch (std::runtime_error const &exception)
+        {
+            throws += std::string::npos != std::string(exception.what()).find("Failed to compile fragment shader 0:1: error");
+        }
+    }
+    return check(2 == throws, "a failed program throws its compile log every time it is asked for");
+}
+
+int main()
+{
+    bool passed = true;
+    // One program binary format
+    stubGl().version = "4.1.0 stub";
+    stubGl().extensions = {"GL_KHR_parallel_shader_compile"};
+    stubGl().integers[GL_NUM_PROGRAM_BINARY_FORMATS] = 1;
+    if (!loadStubGl({{"glCreateShader", (void *)stubCreateShader}, {"glShaderSource", (void *)stubShaderSource}, {"glCompileShader", (void *)stubCompileShader},
+                     {"glDeleteShader", (void *)stubDeleteShader}, {"glGetShaderiv", (void *)stubGetShaderiv}, {"glGetShaderInfoLog", (void *)stubGetShaderInfoLog},
+                     {"glCreateProgram", (void *)stubCreateProgram}, {"glAttachShader", (void *)stubAttachShader}, {"glDetachShader", (void *)stubDetachShader},
+                     {"glLinkProgram", (void *)stubLinkProgram}, {"glDeleteProgram", (void *)stubDeleteProgram}, {"glGetProgramiv", (void *)stubGetProgramiv},
+                     {"glGetProgramInfoLog", (void *)stubGetProgramInfoLog}, {"glProgramParameteri", (void *)stubProgramParameteri},
+                     {"glGetProgramBinary", (void *)stubGetProgramBinary}, {"glProgramBinary", (void *)stubProgramBinary},
+                     {"glMaxShaderCompilerThreadsKHR", (void *)stubMaxShaderCompilerThreads}}))
+    {
+        std::cout << "Failed to load the stub GL" << std::endl;
+        return 1;
+    }
+    const auto cacheDirectory = std::filesystem::temp_directory_path() / "shader_cache_benchmark";
+    std::error_code error;
+    std::filesystem::remove_all(cacheDirectory, error);
+
+    auto first = run(cacheDirectory, fragmentSource);
+    passed &= check(1 == first.compiled && 1 == first.stored && 0 == first.loaded, "first run compiles and stores");
+    passed &= check(first.milliseconds >= stubLinkMilliseconds, "first run counts the link time");
+
+    std::size_t linksBefore = stubLinks;
+    auto second = run(cacheDirectory, fragmentSource);
+    passed &= check(1 == second.loaded && 0 == second.compiled && linksBefore == stubLinks, "second run loads without linking");
+    passed &= check(second.savedMilliseconds > 0.5 * stubLinkMilliseconds, "second run reports the time it saved");
+
+    auto changed = run(cacheDirectory, changedFragmentSource);
+    passed &= check(1 == changed.compiled && 0 == changed.loaded, "a changed source misses");
+
+    // Overwrite the binary of the first program, keeping its header, so only the driver can tell
+    {
+        ProgramBinaryCache cache(cacheDirectory, (GLADloadproc)stubGlGetProcAddress);
+        auto path = cache.filePath(programBinaryHash(vertexSource, fragmentSource));
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.seekp(sizeof(ProgramBinaryHeader));
+        file.write("garbage", 7);
+    }
+    auto rejected = run(cacheDirectory, fragmentSource);
+    passed &= check(1 == rejected.compiled && 1 == rejected.stored && 0 == rejected.loaded, "a binary the driver rejects is compiled and replaced");
+    auto replaced = run(cacheDirectory, fragmentSource);
+    passed &= check(1 == replaced.loaded, "the replaced binary loads");
+
+    auto unsupported = run(cacheDirectory, fragmentSource, nullptr);
+    passed &= check(1 == unsupported.compiled && 0 == unsupported.stored && 0 == unsupported.loaded, "without program binaries it only compiles");
+
+    try
+    {
+        ProgramBinaryCache cache(cacheDirectory, (GLADloadproc)stubGlGetProcAddress);
+        cache.createProgram(vertexSource, "#version 330 core\nerror\n");
+        passed &= check(false, "a shader that does not compile throws");
+    }
+    catch (std::runtime_error const &exception)
+    {
+        passed &= check(std::string::npos != std::string(exception.what()).find("Failed to compile fragment shader 0:1: error"),
+                        "the compile error carries the fragment shader log");
+    }
+
+    std::cout << std::endl
+              << std::setw(10) << "compile" << std::setw(10) << "busy ms" << std::setw(8) << "polled" << std::setw(8) << "pending"
+              << std::setw(14) << "max poll ms" << std::setw(14) << "latency ms" << std::setw(14) << "stored ms" << std::endl;
+    for (bool parallel : {true, false})
+    {
+        passed &= checkManager(cacheDirectory, parallel, 0.0, true);
+        passed &= checkManager(cacheDirectory, parallel, 50.0, true);
+        passed &= checkManager(cacheDirectory, parallel, 50.0, false);
+        passed &= checkManagerFailure(cacheDirectory, parallel);
+    }
+
+    std::filesystem::remove_all(cacheDirectory, error);
+    std::cout << (passed ? "The cache and the manager compiled, stored and loaded every program as expected"
+                         : "MISMATCH in the program binary cache or the program manager")
+              << std::endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+// Loading 32 textures (the sample images, alternately) against a stub GL loader, no GPU or window needed.
+//  - synchronous: stbi_load and glTexImage2D on the GL thread, as the samples used to, it stalls for all of it
+//  - asynchronous: TextureLoader decoding on worker threads, one update() per frame with a 4 MB budget,
+//    with the number of frames and the time update() holds the GL thread, on average and at worst
+// Checks that the placeholder is drawn until a texture is complete, and that every texture ends up with
+// the rows of a synchronous decode, bottom first. The program returns 1 otherwise.
+// Run from the repository root, or pass the directory of the images.
+#define STB_IMAGE_IMPLEMENTATION
+#include <TextureLoader.h>
+#include <Benchmark.h>
+#include <StubGl.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The stub driver keeps buffers and texture level 0 in memory, uploads copy like a driver would
+struct StubTexture
+{
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    std::vector<unsigned char> pixels;
+};
+std::map<GLuint, std::vector<unsigned char>> stubBuffers;
+std::map<GLuint, StubTexture> stubTextures;
+std::map<GLenum, GLuint> stubBoundBuffers;
+GLuint stubBoundTexture = 0;
+GLuint stubNextName = 1;
+GLint stubUnpackAlignment = 4;
+
+void APIENTRY stubGenNames(GLsizei count, GLuint *names)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        names[i] = stubNextName++;
+    }
+}
+void APIENTRY stubDeleteBuffers(GLsizei count, const GLuint *names)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        stubBuffers.erase(names[i]);
+    }
+}
+void APIENTRY stubDeleteTextures(GLsizei count, const GLuint *names)
+{
+    for (GLsizei i = 0; i < count; i++)
+    {
+        stubTextures.erase(names[i]);
+    }
+}
+void APIENTRY stubBindBuffer(GLenum target, GLuint buffer)
+{
+    stubBoundBuffers[target] = buffer;
+}
+void APIENTRY stubBufferData(GLenum target, GLsizeiptr size, const void *, GLenum)
+{
+    stubBuffers[stubBoundBuffers[target]].assign((std::size_t)size, 0);
+}
+void *APIENTRY stubMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr, GLbitfield)
+{
+    return stubBuffers[stubBoundBuffers[target]].data() + offset;
+}
+GLboolean APIENTRY stubUnmapBuffer(GLenum)
+{
+    return GL_TRUE;
+}
+GLsync APIENTRY stubFenceSync(GLenum, GLbitfield)
+{
+    return reinterpret_cast<GLsync>(1);
+}
+GLenum APIENTRY stubClientWaitSync(GLsync, GLbitfield, GLuint64)
+{
+    return GL_ALREADY_SIGNALED;
+}
+void APIENTRY stubDeleteSync(GLsync)
+{
+}
+void APIENTRY stubActiveTexture(GLenum)
+{
+}
+void APIENTRY stubBindTexture(GLenum, GLuint texture)
+{
+    stubBoundTexture = texture;
+}
+void APIENTRY stubTexParameteri(GLenum, GLenum, GLint)
+{
+}
+void APIENTRY stubPixelStorei(GLenum name, GLint value)
+{
+    if (GL_UNPACK_ALIGNMENT == name)
+    {
+        stubUnpackAlignment = value;
+    }
+}
+void APIENTRY stubGenerateMipmap(GLenum)
+{
+}
+// Source rows of an upload, from the bound unpack buffer when there is one
+const unsigned char *stubUnpackSource(const void *pixels)
+{
+    GLuint buffer = stubBoundBuffers[GL_PIXEL_UNPACK_BUFFER];
+    if (0 == buffer)
+    {
+        return static_cast<const unsigned char *>(pixels);
+    }
+    return stubBuffers[buffer].data() + reinterpret_cast<std::size_t>(pixels);
+}
+void APIENTRY stubTexSubImage2D(GLenum, GLint, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum, const void *pixels)
+{
+    StubTexture &texture = stubTextures[stubBoundTexture];
+    int components = GL_RGBA == format ? 4 : 3;
+    std::size_t rowBytes = (std::size_t)width * components;
+    std::size_t sourceStride = (rowBytes + stubUnpackAlignment - 1) / stubUnpackAlignment * stubUnpackAlignment;
+    const unsigned char *source = stubUnpackSource(pixels);
+    for (GLsizei row = 0; row < height; row++)
+    {
+        std::memcpy(&texture.pixels[((std::size_t)(y + row) * texture.width + x) * texture.components], source + row * sourceStride, rowBytes);
+    }
+}
+void APIENTRY stubTexImage2D(GLenum target, GLint level, GLint, GLsizei width, GLsizei height, GLint, GLenum format, GLenum type, const void *pixels)
+{
+    StubTexture &texture = stubTextures[stubBoundTexture];
+    texture.width = width;
+    texture.height = height;
+    texture.components = GL_RGBA == format ? 4 : 3;
+    texture.pixels.assign((std::size_t)width * height * texture.components, 0);
+    if (pixels || 0 != stubBoundBuffers[GL_PIXEL_UNPACK_BUFFER])
+    {
+        stubTexSubImage2D(target, level, 0, 0, width, height, format, type, pixels);
+    }
+}
+
+// What the samples did before: decode and upload on the GL thread
+unsigned int loadSynchronously(std::string const &filePath)
+{
+    stbi_set_flip_vertically_on_load(true);
+    int width = 0, height = 0, channels = 0;
+    unsigned char *pixels = stbi_load(filePath.c_str(), &width, &height, &channels, 0);
+    if (!pixels)
+    {
+        return 0;
+    }
+    unsigned int texture = 0;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    auto format = 4 == channels ? GL_RGBA : GL_RGB;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    stbi_image_free(pixels);
+    return texture;
+}
+
+int main(int argc, char **argv)
+{
+    bool passed = true;
+    if (!loadStubGl({{"glGenBuffers", (void *)stubGenNames}, {"glGenTextures", (void *)stubGenNames}, {"glDeleteBuffers", (void *)stubDeleteBuffers},
+                     {"glDeleteTextures", (void *)stubDeleteTextures}, {"glBindBuffer", (void *)stubBindBuffer}, {"glBufferData", (void *)stubBufferData},
+                     {"glMapBufferRange", (void *)stubMapBufferRange}, {"glUnmapBuffer", (void *)stubUnmapBuffer}, {"glFenceSync", (void *)stubFenceSync},
+                     {"glClientWaitSync", (void *)stubClientWaitSync}, {"glDeleteSync", (void *)stubDeleteSync}, {"glActiveTexture", (void *)stubActiveTexture},
+                     {"glBindTexture", (void *)stubBindTexture}, {"glTexParameteri", (void *)stubTexParameteri}, {"glPixelStorei", (void *)stubPixelStorei},
+                     {"glGenerateMipmap", (void *)stubGenerateMipmap}, {"glTexImage2D", (void *)stubTexImage2D}, {"glTexSubImage2D", (void *)stubTexSubImage2D}}))
+    {
+        std::cout << "Failed to load the stub GL" << std::endl;
+        return 1;
+    }
+    std::string directory = argc > 1 ? argv[1] : "bin/images";
+    std::vector<std::string> files;
+    for (int i = 0; i < 32; i++)
+    {
+        files.push_back(directory + (i % 2 ? "/wall.jpg" : "/face.png"));
+    }
+
+    // Reference pixels, and the cost of the synchronous path
+    std::vector<unsigned int> references;
+    double synchronousTime = measure([&]
+                                     {
+        references.clear();
+        stubTextures.clear();
+        for (auto const &file : files)
+        {
+            references.push_back(loadSynchronously(file));
+        } },
+                                     1);
+    if (std::find(references.begin(), references.end(), 0u) != references.end())
+    {
+        std::cout << "Failed to load the images from " << directory << std::endl;
+        return 1;
+    }
+    std::map<unsigned int, StubTexture> expected;
+    for (unsigned int reference : references)
+    {
+        expected[reference] = stubTextures[reference];
+    }
+    std::cout << "synchronous: " << std::fixed << std::setprecision(2) << synchronousTime << " ms holding the GL thread for "
+              << files.size() << " textures" << std::endl;
+
+    GlStateCache state;
+    TextureLoader loader;
+    // 4 decode threads whatever the machine, so the stalls do not depend on its core count
+    loader.create((GLADloadproc)stubGlGetProcAddress, state, 4 * 1024 * 1024, 4);
+    auto start = Clock::now();
+    std::vector<TextureHandle> handles;
+    for (auto const &file : files)
+    {
+        handles.push_back(loader.load(file));
+    }
+    for (TextureHandle handle : handles)
+    {
+        passed &= loader.texture(handle) == loader.placeholder();
+    }
+    std::size_t frames = 0;
+    double slowestUpdate = 0.0, totalUpdate = 0.0;
+    while (!loader.allReady())
+    {
+        auto frameStart = Clock::now();
+        loader.update();
+        std::chrono::duration<double, std::milli> updateTime = Clock::now() - frameStart;
+        slowestUpdate = std::max(slowestUpdate, updateTime.count());
+        totalUpdate += updateTime.count();
+        frames++;
+        passed &= loader.statistics().bytesLastFrame <= 4 * 1024 * 1024;
+        // A 60 Hz frame
+        std::this_thread::sleep_for(std::chrono::milliseconds(16));
+    }
+    std::chrono::duration<double, std::milli> asynchronousTime = Clock::now() - start;
+    auto statistics = loader.statistics();
+    std::cout << "asynchronous: " << asynchronousTime.count() << " ms and " << frames << " frames until all ready, update "
+              << totalUpdate / (double)frames << " ms on average and " << slowestUpdate << " ms at worst, " << statistics.decodeMilliseconds << " ms decoding on the workers" << std::defaultfloat << std::endl;
+
+    for (std::size_t i = 0; i < handles.size(); i++)
+    {
+        StubTexture const &texture = stubTextures[loader.texture(handles[i])];
+        StubTexture const &reference = expected[references[i]];
+        passed &= loader.texture(handles[i]) != loader.placeholder() && texture.width == reference.width && texture.height == reference.height &&
+                  texture.components == reference.components && texture.pixels == reference.pixels;
+    }
+
+    // A missing file keeps its placeholder and throws when asked for
+    TextureHandle missing = loader.load(directory + "/missing.png");
+    bool thrown = false;
+    try
+    {
+        while (!loader.ready(missing))
+        {
+            loader.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    catch (std::runtime_error const &)
+    {
+        thrown = true;
+    }
+    passed &= thrown && loader.texture(missing) == loader.placeholder();
+    loader.release();
+
+    std::cout << (passed ? "Textures match the synchronous decode" : "MISMATCH in the loaded textures") << std::endl;
+    return passed ? 0 : 1;
+}
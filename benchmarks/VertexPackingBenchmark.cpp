@@ -0,0 +1,81 @@
+// Measures the compressed vertex format against the 32-byte float layout:
+//  - round-trip error of positions, normals and texture coordinates
+//  - vertex memory and the bytes fetched per draw after the post-transform cache
+//  - time to pack, and time to stream through both vertex buffers on the CPU
+#include <SphereMesh.h>
+#include <MeshOptimizer.h>
+#include <VertexPacking.h>
+#include <Benchmark.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+// Sum every 32-bit word of the buffer, a proxy for the cost of fetching it
+unsigned int streamBuffer(const void *data, std::size_t size)
+{
+    auto words = static_cast<const unsigned int *>(data);
+    unsigned int sum = 0;
+    for (std::size_t i = 0; i < size / sizeof(unsigned int); ++i)
+    {
+        sum += words[i];
+    }
+    return sum;
+}
+
+int main()
+{
+    constexpr std::size_t cacheSize = 16;
+    volatile unsigned int sink = 0;
+
+    for (int segments : {60, 250, 1000})
+    {
+        Mesh mesh = createSphere(2.0f, segments, segments);
+        optimizeMesh(mesh);
+
+        PackedVertices packed;
+        auto packTime = measure([&]
+                                { packed = packVertices(mesh.vertices.data(), mesh.vertices.size()); });
+
+        double maxPositionError = 0.0, maxNormalAngle = 0.0, maxTexCoordError = 0.0;
+        for (std::size_t i = 0; i < mesh.vertices.size(); ++i)
+        {
+            auto const &original = mesh.vertices[i];
+            auto decoded = unpackVertex(packed.vertices[i], packed.bounds);
+            glm::vec3 originalNormal(original.normal[0], original.normal[1], original.normal[2]);
+            glm::vec3 decodedNormal(decoded.normal[0], decoded.normal[1], decoded.normal[2]);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                maxPositionError = std::max(maxPositionError, (double)std::abs(original.position[axis] - decoded.position[axis]));
+            }
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                maxTexCoordError = std::max(maxTexCoordError, (double)std::abs(original.texCoord[axis] - decoded.texCoord[axis]));
+            }
+            float cosine = glm::clamp(glm::dot(glm::normalize(originalNormal), decodedNormal), -1.0f, 1.0f);
+            maxNormalAngle = std::max(maxNormalAngle, (double)glm::degrees(std::acos(cosine)));
+        }
+
+        VertexCacheStatistics cacheStatistics;
+        visitIndices(mesh, [&](auto const &indices)
+                     { cacheStatistics = analyzeVertexCache(indices, mesh.vertices.size(), cacheSize, VertexCacheModel::Fifo); });
+
+        auto floatStreamTime = measure([&]
+                                       { sink = sink + streamBuffer(mesh.vertices.data(), mesh.vertexDataSize()); });
+        auto packedStreamTime = measure([&]
+                                        { sink = sink + streamBuffer(packed.vertices.data(), packed.vertexDataSize()); });
+
+        std::cout << "Sphere " << segments << "x" << segments << ", " << mesh.vertices.size() << " vertices" << std::endl;
+        std::cout << std::fixed << std::setprecision(6)
+                  << "  max position error:  " << maxPositionError << " (radius 2)" << std::endl
+                  << "  max normal error:    " << maxNormalAngle << " degrees" << std::endl
+                  << "  max texcoord error:  " << maxTexCoordError << std::endl
+                  << std::setprecision(3)
+                  << "  vertex memory:       " << mesh.vertexDataSize() / 1024.0 << " KB -> " << packed.vertexDataSize() / 1024.0 << " KB" << std::endl
+                  << "  fetched per draw:    " << cacheStatistics.cacheMisses * sizeof(MeshVertex) / 1024.0 << " KB -> "
+                  << cacheStatistics.cacheMisses * sizeof(PackedVertex) / 1024.0 << " KB (FIFO " << cacheSize << ", ACMR " << cacheStatistics.acmr() << ")" << std::endl
+                  << "  pack time:           " << packTime << " ms" << std::endl
+                  << "  stream time:         " << floatStreamTime << " ms -> " << packedStreamTime << " ms" << std::endl
+                  << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Affine transformation stored as a 3x3 linear part and a translation (3x4).
+// The projective row of a glm::mat4 is always (0, 0, 0, 1) here, so composition,
+// inversion and point transformation skip it.
+struct AffineTransform
+{
+    glm::mat3 linear{1.0f};
+    glm::vec3 translation{0.0f};
+
+    AffineTransform() = default;
+
+    AffineTransform(glm::mat3 const &linearPart, glm::vec3 const &translationPart)
+        : linear(linearPart), translation(translationPart)
+    {
+    }
+
+    // The bottom row of the matrix is ignored, it must be (0, 0, 0, 1)
+    explicit AffineTransform(glm::mat4 const &matrix)
+        : linear(matrix), translation(matrix[3])
+    {
+    }
+
+    // T * R * S
+    static AffineTransform fromTranslationRotationScale(glm::vec3 const &translation, glm::quat const &rotation, glm::vec3 const &scale)
+    {
+        glm::mat3 rotationMatrix = glm::mat3_cast(rotation);
+        rotationMatrix[0] *= scale.x;
+        rotationMatrix[1] *= scale.y;
+        rotationMatrix[2] *= scale.z;
+        return AffineTransform(rotationMatrix, translation);
+    }
+
+    // Matrix to upload with glUniformMatrix4fv
+    glm::mat4 toMat4() const
+    {
+        return glm::mat4(glm::vec4(linear[0], 0.0f), glm::vec4(linear[1], 0.0f), glm::vec4(linear[2], 0.0f), glm::vec4(translation, 1.0f));
+    }
+
+    glm::vec3 transformPoint(glm::vec3 const &point) const
+    {
+        return linear * point + translation;
+    }
+
+    glm::vec3 transformVector(glm::vec3 const &vector) const
+    {
+        return linear * vector;
+    }
+
+    // General inverse, only the 3x3 part needs inverting
+    AffineTransform inverse() const
+    {
+        glm::mat3 inverseLinear = glm::inverse(linear);
+        return AffineTransform(inverseLinear, -(inverseLinear * translation));
+    }
+
+    // Inverse of a rotation with uniform scale and a translation: the transpose divided by the squared scale
+    AffineTransform rigidInverse() const
+    {
+        glm::mat3 inverseLinear = glm::transpose(linear) * (1.0f / glm::dot(linear[0], linear[0]));
+        return AffineTransform(inverseLinear, -(inverseLinear * translation));
+    }
+};
+
+// Apply rhs first, then lhs, like glm::mat4 multiplication
+inline AffineTransform operator*(AffineTransform const &lhs, AffineTransform const &rhs)
+{
+    return AffineTransform(lhs.linear * rhs.linear, lhs.linear * rhs.translation + lhs.translation);
+}
@@ -0,0 +1,334 @@
+#pragma once
+
+#include "CpuFeatures.h"
+#include "JobSystem.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Transformation of large coordinate arrays by one glm::mat4.
+// Coordinates are either structure of arrays (x[], y[], z[]) or an array of structures with a
+// byte stride, so positions can be read straight out of a MeshVertex buffer. The array of
+// structures path copies tiles into structure of arrays scratch buffers that stay in L1, runs
+// the same SIMD kernels and copies the results back. Input and output may be the same arrays.
+
+enum class TransformMode
+{
+    // M * (x, y, z, 1), the w row of the matrix is ignored
+    Point,
+    // M * (x, y, z, 0)
+    Direction,
+    // M * (x, y, z, 1) divided by its w
+    Projective
+};
+
+struct BatchTransformOptions
+{
+    // When set, large batches are split over the threads of the job system and threadCount is ignored
+    JobSystem *jobs = nullptr;
+    // 1 transforms on the calling thread, 0 uses every hardware thread
+    unsigned int threadCount = 1;
+    // Batches smaller than this per thread are not split
+    std::size_t minCountPerThread = 1 << 16;
+    // Highest instruction set used, lower it to compare the kernels
+    SimdLevel maxLevel = SimdLevel::Avx2;
+};
+
+// Coordinates of the elements processed per tile of the array of structures path
+constexpr std::size_t batchTransformTileSize = 256;
+
+struct SoaSpan
+{
+    float *x;
+    float *y;
+    float *z;
+};
+
+struct ConstSoaSpan
+{
+    float const *x;
+    float const *y;
+    float const *z;
+
+    ConstSoaSpan(float const *xs, float const *ys, float const *zs) : x(xs), y(ys), z(zs) {}
+    ConstSoaSpan(SoaSpan const &span) : x(span.x), y(span.y), z(span.z) {}
+};
+
+namespace detail
+{
+    // Matrix coefficients by row, the rows that a mode does not need are left untouched
+    struct TransformRows
+    {
+        float m[4][4];
+
+        explicit TransformRows(glm::mat4 const &matrix)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                for (int column = 0; column < 4; column++)
+                {
+                    m[row][column] = matrix[column][row];
+                }
+            }
+        }
+    };
+
+    template <TransformMode Mode>
+    void transformSoaScalar(TransformRows const &r, ConstSoaSpan in, SoaSpan out, std::size_t begin, std::size_t end)
+    {
+        float const w = Mode == TransformMode::Direction ? 0.0f : 1.0f;
+        for (std::size_t i = begin; i < end; i++)
+        {
+            float x = in.x[i], y = in.y[i], z = in.z[i];
+            float rx = r.m[0][0] * x + r.m[0][1] * y + r.m[0][2] * z + r.m[0][3] * w;
+            float ry = r.m[1][0] * x + r.m[1][1] * y + r.m[1][2] * z + r.m[1][3] * w;
+            float rz = r.m[2][0] * x + r.m[2][1] * y + r.m[2][2] * z + r.m[2][3] * w;
+            if (Mode == TransformMode::Projective)
+            {
+                float inverseW = 1.0f / (r.m[3][0] * x + r.m[3][1] * y + r.m[3][2] * z + r.m[3][3]);
+                rx *= inverseW;
+                ry *= inverseW;
+                rz *= inverseW;
+            }
+            out.x[i] = rx;
+            out.y[i] = ry;
+            out.z[i] = rz;
+        }
+    }
+
+#if CPU_HAS_X86_SIMD
+    template <TransformMode Mode>
+    CPU_TARGET_SSE2 void transformSoaSse2(TransformRows const &r, ConstSoaSpan in, SoaSpan out, std::size_t begin, std::size_t end)
+    {
+        __m128 m[4][4];
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                m[row][column] = _mm_set1_ps(r.m[row][column]);
+            }
+        }
+
+        std::size_t i = begin;
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(in.x + i);
+            __m128 y = _mm_loadu_ps(in.y + i);
+            __m128 z = _mm_loadu_ps(in.z + i);
+            __m128 result[3];
+            for (int row = 0; row < 3; row++)
+            {
+                __m128 sum = _mm_add_ps(_mm_mul_ps(m[row][0], x), _mm_mul_ps(m[row][1], y));
+                sum = _mm_add_ps(sum, _mm_mul_ps(m[row][2], z));
+                if (Mode != TransformMode::Direction)
+                {
+                    sum = _mm_add_ps(sum, m[row][3]);
+                }
+                result[row] = sum;
+            }
+            if (Mode == TransformMode::Projective)
+            {
+                __m128 w = _mm_add_ps(_mm_mul_ps(m[3][0], x), _mm_mul_ps(m[3][1], y));
+                w = _mm_add_ps(_mm_add_ps(w, _mm_mul_ps(m[3][2], z)), m[3][3]);
+                __m128 inverseW = _mm_div_ps(_mm_set1_ps(1.0f), w);
+                for (int row = 0; row < 3; row++)
+                {
+                    result[row] = _mm_mul_ps(result[row], inverseW);
+                }
+            }
+            _mm_storeu_ps(out.x + i, result[0]);
+            _mm_storeu_ps(out.y + i, result[1]);
+            _mm_storeu_ps(out.z + i, result[2]);
+        }
+        transformSoaScalar<Mode>(r, in, out, i, end);
+    }
+
+#if CPU_HAS_AVX2
+    template <TransformMode Mode>
+    CPU_TARGET_AVX2 void transformSoaAvx2(TransformRows const &r, ConstSoaSpan in, SoaSpan out, std::size_t begin, std::size_t end)
+    {
+        __m256 m[4][4];
+        for (int row = 0; row < 4; row++)
+        {
+            for (int column = 0; column < 4; column++)
+            {
+                m[row][column] = _mm256_set1_ps(r.m[row][column]);
+            }
+        }
+
+        std::size_t i = begin;
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 x = _mm256_loadu_ps(in.x + i);
+            __m256 y = _mm256_loadu_ps(in.y + i);
+            __m256 z = _mm256_loadu_ps(in.z + i);
+            __m256 result[3];
+            for (int row = 0; row < 3; row++)
+            {
+                __m256 sum = Mode == TransformMode::Direction ? _mm256_mul_ps(m[row][0], x) : _mm256_fmadd_ps(m[row][0], x, m[row][3]);
+                sum = _mm256_fmadd_ps(m[row][1], y, sum);
+                result[row] = _mm256_fmadd_ps(m[row][2], z, sum);
+            }
+            if (Mode == TransformMode::Projective)
+            {
+                __m256 w = _mm256_fmadd_ps(m[3][0], x, m[3][3]);
+                w = _mm256_fmadd_ps(m[3][1], y, w);
+                w = _mm256_fmadd_ps(m[3][2], z, w);
+                __m256 inverseW = _mm256_div_ps(_mm256_set1_ps(1.0f), w);
+                for (int row = 0; row < 3; row++)
+                {
+                    result[row] = _mm256_mul_ps(result[row], inverseW);
+                }
+            }
+            _mm256_storeu_ps(out.x + i, result[0]);
+            _mm256_storeu_ps(out.y + i, result[1]);
+            _mm256_storeu_ps(out.z + i, result[2]);
+        }
+        transformSoaScalar<Mode>(r, in, out, i, end);
+    }
+#endif
+#endif
+
+    using TransformSoaKernel = void (*)(TransformRows const &, ConstSoaSpan, SoaSpan, std::size_t, std::size_t);
+
+    template <TransformMode Mode>
+    TransformSoaKernel selectTransformSoaKernel(SimdLevel maxLevel)
+    {
+#if CPU_HAS_X86_SIMD
+#if CPU_HAS_AVX2
+        if (maxLevel >= SimdLevel::Avx2 && cpuFeatures().supports(SimdLevel::Avx2))
+        {
+            return transformSoaAvx2<Mode>;
+        }
+#endif
+        if (maxLevel >= SimdLevel::Sse2 && cpuFeatures().supports(SimdLevel::Sse2))
+        {
+            return transformSoaSse2<Mode>;
+        }
+#endif
+        return transformSoaScalar<Mode>;
+    }
+
+    inline TransformSoaKernel selectTransformSoaKernel(TransformMode mode, SimdLevel maxLevel)
+    {
+        switch (mode)
+        {
+        case TransformMode::Direction:
+            return selectTransformSoaKernel<TransformMode::Direction>(maxLevel);
+        case TransformMode::Projective:
+            return selectTransformSoaKernel<TransformMode::Projective>(maxLevel);
+        default:
+            return selectTransformSoaKernel<TransformMode::Point>(maxLevel);
+        }
+    }
+
+    // Runs fn(begin, end) over tile aligned ranges, on the job system or on extra threads when the batch is large enough
+    template <typename Fn>
+    void forEachBatchRange(std::size_t count, BatchTransformOptions const &options, Fn &&fn)
+    {
+        if (options.jobs)
+        {
+            // Whole tiles per job
+            std::size_t grainTiles = (std::max(options.minCountPerThread, batchTransformTileSize) + batchTransformTileSize - 1) / batchTransformTileSize;
+            std::size_t tileCount = (count + batchTransformTileSize - 1) / batchTransformTileSize;
+            options.jobs->parallelFor(0, tileCount, grainTiles, [&](std::size_t beginTile, std::size_t endTile)
+                                      { fn(beginTile * batchTransformTileSize, std::min(count, endTile * batchTransformTileSize)); });
+            return;
+        }
+        unsigned int threadCount = options.threadCount != 0 ? options.threadCount : std::max(1u, std::thread::hardware_concurrency());
+        std::size_t minCount = std::max<std::size_t>(options.minCountPerThread, batchTransformTileSize);
+        threadCount = static_cast<unsigned int>(std::min<std::size_t>(threadCount, std::max<std::size_t>(1, count / minCount)));
+        if (threadCount <= 1)
+        {
+            fn(std::size_t(0), count);
+            return;
+        }
+
+        std::size_t tileCount = (count + batchTransformTileSize - 1) / batchTransformTileSize;
+        std::size_t tilesPerThread = (tileCount + threadCount - 1) / threadCount;
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned int t = 1; t < threadCount; t++)
+        {
+            std::size_t begin = std::min(count, t * tilesPerThread * batchTransformTileSize);
+            std::size_t end = std::min(count, begin + tilesPerThread * batchTransformTileSize);
+            if (begin < end)
+            {
+                threads.emplace_back([&fn, begin, end]
+                                     { fn(begin, end); });
+            }
+        }
+        fn(std::size_t(0), std::min(count, tilesPerThread * batchTransformTileSize));
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+// Transforms count coordinates stored as separate x, y and z arrays
+inline void transformCoordinates(TransformMode mode, glm::mat4 const &matrix, ConstSoaSpan in, SoaSpan out, std::size_t count,
+                                 BatchTransformOptions const &options = BatchTransformOptions())
+{
+    detail::TransformRows rows(matrix);
+    detail::TransformSoaKernel kernel = detail::selectTransformSoaKernel(mode, options.maxLevel);
+    detail::forEachBatchRange(count, options, [&](std::size_t begin, std::size_t end)
+                              { kernel(rows, in, out, begin, end); });
+}
+
+// Transforms count coordinates of 3 consecutive floats found every inStride bytes, and writes
+// them every outStride bytes
+inline void transformCoordinates(TransformMode mode, glm::mat4 const &matrix, float const *in, std::size_t inStride, float *out, std::size_t outStride,
+                                 std::size_t count, BatchTransformOptions const &options = BatchTransformOptions())
+{
+    detail::TransformRows rows(matrix);
+    detail::TransformSoaKernel kernel = detail::selectTransformSoaKernel(mode, options.maxLevel);
+    unsigned char const *inBytes = reinterpret_cast<unsigned char const *>(in);
+    unsigned char *outBytes = reinterpret_cast<unsigned char *>(out);
+    detail::forEachBatchRange(count, options, [&](std::size_t begin, std::size_t end)
+                              {
+        float x[batchTransformTileSize], y[batchTransformTileSize], z[batchTransformTileSize];
+        for (std::size_t tile = begin; tile < end; tile += batchTransformTileSize)
+        {
+            std::size_t tileCount = std::min(batchTransformTileSize, end - tile);
+            for (std::size_t i = 0; i < tileCount; i++)
+            {
+                float const *source = reinterpret_cast<float const *>(inBytes + (tile + i) * inStride);
+                x[i] = source[0];
+                y[i] = source[1];
+                z[i] = source[2];
+            }
+            kernel(rows, ConstSoaSpan(x, y, z), SoaSpan{x, y, z}, 0, tileCount);
+            for (std::size_t i = 0; i < tileCount; i++)
+            {
+                float *destination = reinterpret_cast<float *>(outBytes + (tile + i) * outStride);
+                destination[0] = x[i];
+                destination[1] = y[i];
+                destination[2] = z[i];
+            }
+        } });
+}
+
+inline void transformPoints(glm::mat4 const &matrix, glm::vec3 const *in, glm::vec3 *out, std::size_t count,
+                            BatchTransformOptions const &options = BatchTransformOptions())
+{
+    transformCoordinates(TransformMode::Point, matrix, reinterpret_cast<float const *>(in), sizeof(glm::vec3), reinterpret_cast<float *>(out), sizeof(glm::vec3), count, options);
+}
+
+inline void transformDirections(glm::mat4 const &matrix, glm::vec3 const *in, glm::vec3 *out, std::size_t count,
+                                BatchTransformOptions const &options = BatchTransformOptions())
+{
+    transformCoordinates(TransformMode::Direction, matrix, reinterpret_cast<float const *>(in), sizeof(glm::vec3), reinterpret_cast<float *>(out), sizeof(glm::vec3), count, options);
+}
+
+// Points to normalized device coordinates (or any space reached with a perspective divide)
+inline void projectPoints(glm::mat4 const &matrix, glm::vec3 const *in, glm::vec3 *out, std::size_t count,
+                          BatchTransformOptions const &options = BatchTransformOptions())
+{
+    transformCoordinates(TransformMode::Projective, matrix, reinterpret_cast<float const *>(in), sizeof(glm::vec3), reinterpret_cast<float *>(out), sizeof(glm::vec3), count, options);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+using Clock = std::chrono::steady_clock;
+
+// Best of a few runs, in milliseconds
+template <typename Fn>
+double measure(Fn &&fn, int numRuns = 5)
+{
+    double best = 1e30;
+    for (int run = 0; run < numRuns; ++run)
+    {
+        auto start = Clock::now();
+        fn();
+        std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
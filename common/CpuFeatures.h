@@ -0,0 +1,155 @@
+#pragma once
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#define CPU_HAS_X86_SIMD 1
+// Compile a function for SSE2 or AVX2 + FMA whatever the compiler flags are; it may only be
+// called after cpuFeatures().supports() returned true for that level.
+#if defined(_MSC_VER) && !defined(__clang__)
+#define CPU_TARGET_SSE2
+#define CPU_TARGET_AVX2
+#else
+#define CPU_TARGET_SSE2 __attribute__((target("sse2")))
+#define CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+// AVX2 kernels are only compiled in when CPU_HAS_AVX2 is set. MinGW GCC does not realign the
+// stack to 32 bytes for spilled YMM registers (gcc bug 54412) and aligned moves to those slots
+// fault, so it is left out there unless CPU_MINGW_ENABLE_AVX2 is defined; stb_image applies the
+// same rule to its JPEG kernels with STBI_MINGW_ENABLE_AVX2.
+#if !defined(__MINGW32__) || defined(CPU_MINGW_ENABLE_AVX2)
+#define CPU_HAS_AVX2 1
+#endif
+#endif
+
+// Instruction set levels used to pick SIMD kernels at run time.
+enum class SimdLevel
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+inline const char *simdLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Sse2:
+        return "SSE2";
+    case SimdLevel::Avx2:
+        return "AVX2";
+    default:
+        return "scalar";
+    }
+}
+
+struct CpuFeatures
+{
+    bool sse2 = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool fma = false;
+    // The OS saves the upper halves of the YMM registers on context switches
+    bool osYmmState = false;
+
+    bool supports(SimdLevel level) const
+    {
+        switch (level)
+        {
+        case SimdLevel::Sse2:
+            return sse2;
+        case SimdLevel::Avx2:
+            return avx2 && fma && osYmmState;
+        default:
+            return true;
+        }
+    }
+};
+
+namespace detail
+{
+    inline void cpuid(int leaf, int subLeaf, unsigned int regs[4])
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        int info[4];
+        __cpuidex(info, leaf, subLeaf);
+        for (int i = 0; i < 4; i++)
+        {
+            regs[i] = static_cast<unsigned int>(info[i]);
+        }
+#elif defined(__x86_64__) || defined(__i386__)
+        __cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    inline unsigned long long xgetbv0()
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        return _xgetbv(0);
+#elif defined(__x86_64__) || defined(__i386__)
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#else
+        return 0;
+#endif
+    }
+
+    inline CpuFeatures queryCpuFeatures()
+    {
+        CpuFeatures features;
+        unsigned int regs[4];
+        cpuid(0, 0, regs);
+        unsigned int maxLeaf = regs[0];
+        if (maxLeaf < 1)
+        {
+            return features;
+        }
+
+        cpuid(1, 0, regs);
+        features.sse2 = (regs[3] & (1u << 26)) != 0;
+        features.fma = (regs[2] & (1u << 12)) != 0;
+        features.avx = (regs[2] & (1u << 28)) != 0;
+        bool osxsave = (regs[2] & (1u << 27)) != 0;
+        // XCR0 bits 1 and 2: SSE and AVX state enabled by the OS
+        if (osxsave)
+        {
+            features.osYmmState = (xgetbv0() & 0x6) == 0x6;
+        }
+
+        if (maxLeaf >= 7)
+        {
+            cpuid(7, 0, regs);
+            features.avx2 = (regs[1] & (1u << 5)) != 0;
+        }
+        return features;
+    }
+}
+
+// Features of the CPU the program runs on, queried once
+inline const CpuFeatures &cpuFeatures()
+{
+    static const CpuFeatures features = detail::queryCpuFeatures();
+    return features;
+}
+
+// Highest level supported by the CPU
+inline SimdLevel bestSimdLevel()
+{
+    if (cpuFeatures().supports(SimdLevel::Avx2))
+    {
+        return SimdLevel::Avx2;
+    }
+    if (cpuFeatures().supports(SimdLevel::Sse2))
+    {
+        return SimdLevel::Sse2;
+    }
+    return SimdLevel::Scalar;
+}
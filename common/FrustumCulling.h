@@ -0,0 +1,285 @@
+#pragma once
+
+#include "CpuFeatures.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+struct BoundingSphere
+{
+    glm::vec3 center{0.0f};
+    float radius = 0.0f;
+};
+
+struct BoundingBox
+{
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{-std::numeric_limits<float>::max()};
+
+    void extend(BoundingSphere const &sphere)
+    {
+        min = glm::min(min, sphere.center - sphere.radius);
+        max = glm::max(max, sphere.center + sphere.radius);
+    }
+
+    void extend(BoundingBox const &box)
+    {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    // Half of the surface area, proportional to the probability of a random ray hitting the box
+    float halfArea() const
+    {
+        glm::vec3 size = glm::max(max - min, glm::vec3(0.0f));
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    }
+};
+
+// Sphere of radius localRadius around the origin of the local space, moved to world space.
+// The radius grows with the largest scale of the transformation.
+inline BoundingSphere transformBoundingSphere(glm::mat4 const &world, float localRadius)
+{
+    float scale = std::sqrt(std::max({glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+                                      glm::dot(glm::vec3(world[1]), glm::vec3(world[1])),
+                                      glm::dot(glm::vec3(world[2]), glm::vec3(world[2]))}));
+    return BoundingSphere{glm::vec3(world[3]), localRadius * scale};
+}
+
+enum class FrustumTest
+{
+    Outside,
+    Intersecting,
+    Inside
+};
+
+// Six planes (a, b, c, d) with normals pointing inside, a point p is inside when dot(abc, p) + d >= 0
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // Planes of the clip volume of an OpenGL view projection (Gribb and Hartmann)
+    static Frustum fromViewProjection(glm::mat4 const &viewProjection)
+    {
+        glm::vec4 rows[4];
+        for (int row = 0; row < 4; row++)
+        {
+            rows[row] = glm::vec4(viewProjection[0][row], viewProjection[1][row], viewProjection[2][row], viewProjection[3][row]);
+        }
+
+        Frustum frustum;
+        frustum.planes[0] = rows[3] + rows[0]; // left
+        frustum.planes[1] = rows[3] - rows[0]; // right
+        frustum.planes[2] = rows[3] + rows[1]; // bottom
+        frustum.planes[3] = rows[3] - rows[1]; // top
+        frustum.planes[4] = rows[3] + rows[2]; // near
+        frustum.planes[5] = rows[3] - rows[2]; // far
+        for (glm::vec4 &plane : frustum.planes)
+        {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        return frustum;
+    }
+
+    bool intersects(BoundingSphere const &sphere) const
+    {
+        for (glm::vec4 const &plane : planes)
+        {
+            if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Box against the planes using the corners furthest along and against each normal
+    FrustumTest test(BoundingBox const &box) const
+    {
+        FrustumTest result = FrustumTest::Inside;
+        for (glm::vec4 const &plane : planes)
+        {
+            glm::vec3 normal(plane);
+            glm::vec3 positive(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y, normal.z >= 0.0f ? box.max.z : box.min.z);
+            glm::vec3 negative(normal.x >= 0.0f ? box.min.x : box.max.x, normal.y >= 0.0f ? box.min.y : box.max.y, normal.z >= 0.0f ? box.min.z : box.max.z);
+            if (glm::dot(normal, positive) + plane.w < 0.0f)
+            {
+                return FrustumTest::Outside;
+            }
+            if (glm::dot(normal, negative) + plane.w < 0.0f)
+            {
+                result = FrustumTest::Intersecting;
+            }
+        }
+        return result;
+    }
+};
+
+namespace detail
+{
+    inline std::size_t cullSpheresScalar(Frustum const &frustum, float const *x, float const *y, float const *z, float const *radius,
+                                         std::size_t count, unsigned char *visible)
+    {
+        std::size_t visibleCount = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            visible[i] = frustum.intersects(BoundingSphere{glm::vec3(x[i], y[i], z[i]), radius[i]}) ? 1 : 0;
+            visibleCount += visible[i];
+        }
+        return visibleCount;
+    }
+
+#if CPU_HAS_X86_SIMD
+    // Four spheres against one plane per step
+    CPU_TARGET_SSE2 inline std::size_t cullSpheresSse2(Frustum const &frustum, float const *x, float const *y, float const *z, float const *radius,
+                                                       std::size_t count, unsigned char *visible)
+    {
+        std::size_t visibleCount = 0;
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(x + i), cy = _mm_loadu_ps(y + i), cz = _mm_loadu_ps(z + i);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + i));
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (glm::vec4 const &plane : frustum.planes)
+            {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane.x)), _mm_mul_ps(cy, _mm_set1_ps(plane.y)));
+                distance = _mm_add_ps(distance, _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+            }
+            int mask = _mm_movemask_ps(inside);
+            for (int lane = 0; lane < 4; lane++)
+            {
+                visible[i + lane] = (mask >> lane) & 1;
+                visibleCount += visible[i + lane];
+            }
+        }
+        return visibleCount + cullSpheresScalar(frustum, x + i, y + i, z + i, radius + i, count - i, visible + i);
+    }
+
+#if CPU_HAS_AVX2
+    // Eight spheres against one plane per step
+    CPU_TARGET_AVX2 inline std::size_t cullSpheresAvx2(Frustum const &frustum, float const *x, float const *y, float const *z, float const *radius,
+                                                       std::size_t count, unsigned char *visible)
+    {
+        std::size_t visibleCount = 0;
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(x + i), cy = _mm256_loadu_ps(y + i), cz = _mm256_loadu_ps(z + i);
+            __m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(radius + i));
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (glm::vec4 const &plane : frustum.planes)
+            {
+                __m256 distance = _mm256_fmadd_ps(cx, _mm256_set1_ps(plane.x), _mm256_set1_ps(plane.w));
+                distance = _mm256_fmadd_ps(cy, _mm256_set1_ps(plane.y), distance);
+                distance = _mm256_fmadd_ps(cz, _mm256_set1_ps(plane.z), distance);
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+            }
+            int mask = _mm256_movemask_ps(inside);
+            for (int lane = 0; lane < 8; lane++)
+            {
+                visible[i + lane] = (mask >> lane) & 1;
+                visibleCount += visible[i + lane];
+            }
+        }
+        return visibleCount + cullSpheresScalar(frustum, x + i, y + i, z + i, radius + i, count - i, visible + i);
+    }
+#endif
+#endif
+}
+
+// Tests count spheres stored as separate x, y, z and radius arrays, visible[i] is set to 1 when
+// sphere i intersects the frustum. Returns the number of visible spheres.
+using CullSpheresKernel = std::size_t (*)(Frustum const &, float const *, float const *, float const *, float const *, std::size_t, unsigned char *);
+
+inline CullSpheresKernel selectCullSpheresKernel(SimdLevel maxLevel = SimdLevel::Avx2)
+{
+#if CPU_HAS_X86_SIMD
+#if CPU_HAS_AVX2
+    if (maxLevel >= SimdLevel::Avx2 && cpuFeatures().supports(SimdLevel::Avx2))
+    {
+        return detail::cullSpheresAvx2;
+    }
+#endif
+    if (maxLevel >= SimdLevel::Sse2 && cpuFeatures().supports(SimdLevel::Sse2))
+    {
+        return detail::cullSpheresSse2;
+    }
+#endif
+    return detail::cullSpheresScalar;
+}
+
+struct Ray
+{
+    glm::vec3 origin{0.0f};
+    // Normalized
+    glm::vec3 direction{0.0f, 0.0f, -1.0f};
+};
+
+// Ray through a window position in pixels (origin at the top left, like glfwGetCursorPos),
+// from the near plane towards the far plane of the view projection
+inline Ray rayFromScreen(glm::vec2 const &cursor, glm::vec2 const &viewportSize, glm::mat4 const &viewProjection)
+{
+    glm::vec2 ndc(2.0f * cursor.x / viewportSize.x - 1.0f, 1.0f - 2.0f * cursor.y / viewportSize.y);
+    glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+    glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+    Ray ray;
+    ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+    ray.direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - ray.origin);
+    return ray;
+}
+
+// Distance along the ray to the first intersection with the sphere, negative when missed.
+// A ray starting inside the sphere hits it at distance 0.
+inline float intersectRaySphere(Ray const &ray, BoundingSphere const &sphere)
+{
+    glm::vec3 offset = ray.origin - sphere.center;
+    float b = glm::dot(offset, ray.direction);
+    float c = glm::dot(offset, offset) - sphere.radius * sphere.radius;
+    if (c > 0.0f && b > 0.0f)
+    {
+        return -1.0f;
+    }
+    float discriminant = b * b - c;
+    if (discriminant < 0.0f)
+    {
+        return -1.0f;
+    }
+    return std::max(0.0f, -b - std::sqrt(discriminant));
+}
+
+// Slab test, inverseDirection is 1 / ray.direction. Returns the entry distance or a negative value.
+// A ray parallel to a slab is inside it everywhere or nowhere; that axis is tested on the origin,
+// since the slab distances would be 0 * inf = NaN for an origin on the slab's plane.
+inline float intersectRayBox(Ray const &ray, glm::vec3 const &inverseDirection, BoundingBox const &box, float maxDistance)
+{
+    float entry = 0.0f;
+    float exit = maxDistance;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (0.0f == ray.direction[axis])
+        {
+            if (ray.origin[axis] < box.min[axis] || ray.origin[axis] > box.max[axis])
+            {
+                return -1.0f;
+            }
+            continue;
+        }
+        float t0 = (box.min[axis] - ray.origin[axis]) * inverseDirection[axis];
+        float t1 = (box.max[axis] - ray.origin[axis]) * inverseDirection[axis];
+        entry = std::max(entry, std::min(t0, t1));
+        exit = std::min(exit, std::max(t0, t1));
+    }
+    return entry <= exit ? entry : -1.0f;
+}
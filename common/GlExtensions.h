@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstring>
+
+// Features beyond GL 3.3 are looked up at run time: the loader only knows the 3.3 core functions.
+
+// Whether the current context is at least the given version
+inline bool hasGlVersion(int major, int minor)
+{
+    return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+// Whether the current context lists an extension
+inline bool hasGlExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        auto extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, (GLuint)i));
+        if (extension && 0 == std::strcmp(extension, name))
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,317 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+struct GlStateStatistics
+{
+    // State changes that reached GL
+    std::size_t calls = 0;
+    // State changes dropped because GL was already in that state
+    std::size_t skipped = 0;
+};
+
+// Shadow copy of the GL state that draws change most often: program, vertex array, buffer and
+// texture bindings, enabled capabilities, blending and polygon mode. A change only reaches GL when
+// it differs from the shadow. Every call goes through the glad entry points, so a stub loader can
+// count them without a GPU.
+//
+// The shadow only knows the changes made through the cache, call invalidate() after changing state
+// behind its back. The samples draw with program, vertex array, texture and capability changes from
+// the cache, but the buffer helpers (InstanceBuffer, StreamingBuffer, MultiDrawPass, TextureLoader)
+// bind their buffers directly and leave the target at 0. Deleting a bound object unbinds it in GL,
+// tell the cache with the forget functions so a new object reusing the name gets bound.
+class GlStateCache
+{
+public:
+    static constexpr unsigned int textureUnitCount = 16;
+
+    GlStateCache()
+    {
+        invalidate();
+    }
+
+    // Forgets the whole shadow, the next change of each kind reaches GL
+    void invalidate()
+    {
+        mProgram = unknown;
+        mVertexArray = unknown;
+        for (auto &buffer : mBuffers)
+        {
+            buffer = unknown;
+        }
+        mActiveTexture = unknown;
+        for (auto &unit : mTextures)
+        {
+            for (auto &texture : unit)
+            {
+                texture = unknown;
+            }
+        }
+        for (auto &enabled : mCapabilities)
+        {
+            enabled = unknownFlag;
+        }
+        mBlendSource = mBlendDestination = unknown;
+        mPolygonMode = unknown;
+    }
+
+    // Starts counting a new frame, statistics() keeps the counts of the frame that just ended
+    void beginFrame()
+    {
+        mLastFrame = mFrame;
+        mFrame = GlStateStatistics();
+    }
+
+    void useProgram(unsigned int program)
+    {
+        if (change(mProgram, program))
+        {
+            glUseProgram(program);
+        }
+    }
+
+    void bindVertexArray(unsigned int vertexArray)
+    {
+        if (change(mVertexArray, vertexArray))
+        {
+            glBindVertexArray(vertexArray);
+            // The element array binding belongs to the vertex array
+            mBuffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+        }
+    }
+
+    // Targets outside the shadowed ones always reach GL
+    void bindBuffer(unsigned int target, unsigned int buffer)
+    {
+        int slot = bufferSlot(target);
+        if (slot < 0 || change(mBuffers[slot], buffer))
+        {
+            if (slot < 0)
+            {
+                mFrame.calls++;
+            }
+            glBindBuffer(target, buffer);
+        }
+    }
+
+    // Binds a texture to a unit, switching the active unit only when needed
+    void bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+    {
+        int slot = textureSlot(target);
+        if (unit >= textureUnitCount || slot < 0)
+        {
+            mFrame.calls++;
+            activeTexture(unit);
+            glBindTexture(target, texture);
+            return;
+        }
+        if (change(mTextures[unit][slot], texture))
+        {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+        }
+    }
+
+    void activeTexture(unsigned int unit)
+    {
+        if (change(mActiveTexture, unit))
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+        }
+    }
+
+    // glEnable / glDisable of GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST or GL_STENCIL_TEST
+    void setEnabled(unsigned int capability, bool enabled)
+    {
+        int slot = capabilitySlot(capability);
+        unsigned char flag = enabled ? 1 : 0;
+        if (slot >= 0 && mCapabilities[slot] == flag)
+        {
+            mFrame.skipped++;
+            return;
+        }
+        if (slot >= 0)
+        {
+            mCapabilities[slot] = flag;
+        }
+        mFrame.calls++;
+        if (enabled)
+        {
+            glEnable(capability);
+        }
+        else
+        {
+            glDisable(capability);
+        }
+    }
+
+    void blendFunc(unsigned int source, unsigned int destination)
+    {
+        if (mBlendSource == source && mBlendDestination == destination)
+        {
+            mFrame.skipped++;
+            return;
+        }
+        mBlendSource = source;
+        mBlendDestination = destination;
+        mFrame.calls++;
+        glBlendFunc(source, destination);
+    }
+
+    // For GL_FRONT_AND_BACK, the only face of a core profile
+    void polygonMode(unsigned int mode)
+    {
+        if (change(mPolygonMode, mode))
+        {
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+        }
+    }
+
+    void forgetProgram(unsigned int program)
+    {
+        forget(mProgram, program);
+    }
+
+    void forgetVertexArray(unsigned int vertexArray)
+    {
+        forget(mVertexArray, vertexArray);
+    }
+
+    void forgetBuffer(unsigned int buffer)
+    {
+        for (auto &bound : mBuffers)
+        {
+            forget(bound, buffer);
+        }
+    }
+
+    void forgetTexture(unsigned int texture)
+    {
+        for (auto &unit : mTextures)
+        {
+            for (auto &bound : unit)
+            {
+                forget(bound, texture);
+            }
+        }
+    }
+
+    unsigned int program() const
+    {
+        return mProgram;
+    }
+
+    unsigned int vertexArray() const
+    {
+        return mVertexArray;
+    }
+
+    // Counts of the last complete frame
+    GlStateStatistics const &statistics() const
+    {
+        return mLastFrame;
+    }
+
+    // Counts since beginFrame()
+    GlStateStatistics const &frameStatistics() const
+    {
+        return mFrame;
+    }
+
+private:
+    static constexpr unsigned int unknown = ~0u;
+    static constexpr unsigned char unknownFlag = 0xff;
+    static constexpr int bufferTargetCount = 6;
+    static constexpr int textureTargetCount = 4;
+    static constexpr int capabilityCount = 5;
+
+    static int bufferSlot(unsigned int target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:
+            return 0;
+        case GL_ELEMENT_ARRAY_BUFFER:
+            return 1;
+        case GL_UNIFORM_BUFFER:
+            return 2;
+        case GL_PIXEL_UNPACK_BUFFER:
+            return 3;
+        case GL_COPY_READ_BUFFER:
+            return 4;
+        case GL_COPY_WRITE_BUFFER:
+            return 5;
+        default:
+            return -1;
+        }
+    }
+
+    static int textureSlot(unsigned int target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_CUBE_MAP:
+            return 1;
+        case GL_TEXTURE_2D_ARRAY:
+            return 2;
+        case GL_TEXTURE_3D:
+            return 3;
+        default:
+            return -1;
+        }
+    }
+
+    static int capabilitySlot(unsigned int capability)
+    {
+        switch (capability)
+        {
+        case GL_BLEND:
+            return 0;
+        case GL_DEPTH_TEST:
+            return 1;
+        case GL_CULL_FACE:
+            return 2;
+        case GL_SCISSOR_TEST:
+            return 3;
+        case GL_STENCIL_TEST:
+            return 4;
+        default:
+            return -1;
+        }
+    }
+
+    // Records the new value, returns false and counts a skip when it is already current
+    bool change(unsigned int &shadow, unsigned int value)
+    {
+        if (shadow == value)
+        {
+            mFrame.skipped++;
+            return false;
+        }
+        shadow = value;
+        mFrame.calls++;
+        return true;
+    }
+
+    static void forget(unsigned int &shadow, unsigned int name)
+    {
+        if (shadow == name)
+        {
+            shadow = unknown;
+        }
+    }
+
+    unsigned int mProgram;
+    unsigned int mVertexArray;
+    unsigned int mBuffers[bufferTargetCount];
+    unsigned int mActiveTexture;
+    unsigned int mTextures[textureUnitCount][textureTargetCount];
+    unsigned char mCapabilities[capabilityCount];
+    unsigned int mBlendSource, mBlendDestination;
+    unsigned int mPolygonMode;
+    GlStateStatistics mFrame;
+    GlStateStatistics mLastFrame;
+};
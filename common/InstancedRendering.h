@@ -0,0 +1,168 @@
+#pragma once
+
+#include "ShaderReflection.h"
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <cstddef>
+#include <vector>
+
+// Per-instance attributes, read once per instance through glVertexAttribDivisor.
+// The world matrix takes four consecutive attribute locations, one per column.
+struct InstanceData
+{
+    glm::mat4 world;
+    glm::vec4 color;
+};
+
+static_assert(sizeof(InstanceData) == 80, "InstanceData must stay tightly packed");
+
+// Instances of one mesh (or one level of detail), contiguous in the instance buffer
+struct InstanceRange
+{
+    std::size_t first = 0;
+    std::size_t count = 0;
+};
+
+struct InstanceStatistics
+{
+    std::size_t instances = 0;
+    std::size_t drawCalls = 0;
+};
+
+// Collects the instances of a frame grouped by mesh, so every mesh is drawn with one call
+class InstanceBatches
+{
+public:
+    void reset(std::size_t meshCount)
+    {
+        mPerMesh.resize(meshCount);
+        for (auto &instances : mPerMesh)
+        {
+            instances.clear();
+        }
+    }
+
+    void add(std::size_t mesh, InstanceData const &instance)
+    {
+        mPerMesh[mesh].push_back(instance);
+    }
+
+    // Concatenates the groups into instances, ranges[mesh] tells where each one landed
+    void flatten(std::vector<InstanceData> &instances, std::vector<InstanceRange> &ranges) const
+    {
+        instances.clear();
+        ranges.resize(mPerMesh.size());
+        for (std::size_t mesh = 0; mesh < mPerMesh.size(); mesh++)
+        {
+            ranges[mesh].first = instances.size();
+            ranges[mesh].count = mPerMesh[mesh].size();
+            instances.insert(instances.end(), mPerMesh[mesh].begin(), mPerMesh[mesh].end());
+        }
+    }
+
+private:
+    std::vector<std::vector<InstanceData>> mPerMesh;
+};
+
+// Locations of the instance attributes in a linked program, -1 for the ones it does not use.
+// Looked up once after linking, so drawing never queries the program.
+struct InstanceAttributeLocations
+{
+    int world = -1;
+    int color = -1;
+
+    InstanceAttributeLocations() = default;
+
+    explicit InstanceAttributeLocations(ProgramReflection const &reflection)
+        : world(reflection.optionalAttributeLocation("aInstanceWorld")), color(reflection.optionalAttributeLocation("aInstanceColor"))
+    {
+    }
+};
+
+// Dynamic GL buffer holding the instances of a frame.
+// It grows by doubling, and is orphaned before every upload so the driver never waits for the
+// previous frame to finish reading it.
+class InstanceBuffer
+{
+public:
+    InstanceBuffer() = default;
+    InstanceBuffer(InstanceBuffer const &) = delete;
+    InstanceBuffer &operator=(InstanceBuffer const &) = delete;
+
+    ~InstanceBuffer()
+    {
+        release();
+    }
+
+    void upload(InstanceData const *instances, std::size_t count)
+    {
+        if (0 == mBuffer)
+        {
+            glGenBuffers(1, &mBuffer);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+        std::size_t capacity = mCapacity;
+        while (capacity < count)
+        {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+        }
+        mCapacity = capacity;
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(mCapacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+        if (count > 0)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)(count * sizeof(InstanceData)), instances);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Points the instance attributes of the bound vertex array at the instances from firstInstance on.
+    // Without base instance (GL 4.2) this is how a draw starts at a range of the buffer.
+    void bindAttributes(InstanceAttributeLocations const &locations, std::size_t firstInstance = 0) const
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, mBuffer);
+        std::size_t base = firstInstance * sizeof(InstanceData);
+        if (locations.world >= 0)
+        {
+            for (GLuint column = 0; column < 4; column++)
+            {
+                GLuint location = (GLuint)locations.world + column;
+                glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                                      (void *)(base + offsetof(InstanceData, world) + column * sizeof(glm::vec4)));
+                glEnableVertexAttribArray(location);
+                glVertexAttribDivisor(location, 1);
+            }
+        }
+        if (locations.color >= 0)
+        {
+            GLuint location = (GLuint)locations.color;
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *)(base + offsetof(InstanceData, color)));
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void release()
+    {
+        if (0 < mBuffer)
+        {
+            glDeleteBuffers(1, &mBuffer);
+        }
+        mBuffer = 0;
+        mCapacity = 0;
+    }
+
+    unsigned int buffer() const
+    {
+        return mBuffer;
+    }
+
+private:
+    unsigned int mBuffer = 0;
+    std::size_t mCapacity = 0;
+};
+
+// GLSL declarations of the instance attributes, for the vertex shader of an instanced program
+constexpr const char *instanceAttributesGlsl = "in mat4 aInstanceWorld;\n"
+                                               "in vec4 aInstanceColor;\n";
@@ -0,0 +1,436 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+namespace detail
+{
+    struct Job;
+}
+
+// Number of jobs still to run, to wait for a group of jobs or to start jobs after it.
+// A counter can be reused once it reached zero.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+
+    // The last job decrements the counter under the lock, taking it here lets a waiter destroy
+    // the counter as soon as it sees zero
+    ~JobCounter()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+    }
+
+    JobCounter(JobCounter const &) = delete;
+    JobCounter &operator=(JobCounter const &) = delete;
+
+    bool done() const
+    {
+        return 0 == mPending.load(std::memory_order_acquire);
+    }
+
+private:
+    friend class JobSystem;
+
+    std::atomic<int> mPending{0};
+    // Jobs that depend on this counter, scheduled when it reaches zero
+    std::mutex mMutex;
+    std::vector<detail::Job *> mContinuations;
+};
+
+namespace detail
+{
+    struct Job
+    {
+        std::function<void()> function;
+        JobCounter *counter = nullptr;
+    };
+
+    // Chase-Lev work-stealing deque of fixed capacity.
+    // The owner pushes and pops at the bottom, other threads steal from the top.
+    class WorkStealingDeque
+    {
+    public:
+        static constexpr std::int64_t capacity = 4096;
+
+        bool push(Job *job)
+        {
+            std::int64_t bottom = mBottom.load(std::memory_order_relaxed);
+            std::int64_t top = mTop.load(std::memory_order_acquire);
+            if (bottom - top >= capacity)
+            {
+                return false;
+            }
+            mJobs[bottom & (capacity - 1)].store(job, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        Job *pop()
+        {
+            std::int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+            mBottom.store(bottom, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t top = mTop.load(std::memory_order_relaxed);
+            if (top > bottom)
+            {
+                mBottom.store(bottom + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            Job *job = mJobs[bottom & (capacity - 1)].load(std::memory_order_relaxed);
+            if (top == bottom)
+            {
+                // Last job, race against the thieves for it
+                if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    job = nullptr;
+                }
+                mBottom.store(bottom + 1, std::memory_order_relaxed);
+            }
+            return job;
+        }
+
+        Job *steal()
+        {
+            std::int64_t top = mTop.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            std::int64_t bottom = mBottom.load(std::memory_order_acquire);
+            if (top >= bottom)
+            {
+                return nullptr;
+            }
+            Job *job = mJobs[top & (capacity - 1)].load(std::memory_order_relaxed);
+            if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                return nullptr;
+            }
+            return job;
+        }
+
+    private:
+        // Top and bottom on their own cache lines, thieves hammer the top
+        alignas(64) std::atomic<std::int64_t> mTop{0};
+        alignas(64) std::atomic<std::int64_t> mBottom{0};
+        std::atomic<Job *> mJobs[capacity];
+    };
+}
+
+struct JobSystemStatistics
+{
+    std::size_t jobsExecuted = 0;
+    std::size_t jobsStolen = 0;
+};
+
+// Work-stealing thread pool.
+// Every worker and the thread that created the pool own a deque: jobs they submit go to the
+// bottom of it and are popped from there (last in, first out, still hot in the cache), idle
+// threads steal the oldest jobs from the top of the others. Threads that are not part of the pool
+// submit through a shared queue. Waiting on a counter runs jobs instead of blocking, so the main
+// thread keeps working while it waits for a frame's jobs.
+class JobSystem
+{
+public:
+    // workerCount threads in addition to the thread creating the pool, 0 uses every hardware thread
+    explicit JobSystem(unsigned int workerCount = 0)
+    {
+        if (0 == workerCount)
+        {
+            workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        }
+
+        mQueues.reserve(workerCount + 1);
+        for (unsigned int i = 0; i <= workerCount; i++)
+        {
+            mQueues.push_back(std::make_unique<detail::WorkStealingDeque>());
+        }
+        mExecuted = std::make_unique<std::atomic<std::size_t>[]>(workerCount + 1);
+        for (unsigned int i = 0; i <= workerCount; i++)
+        {
+            mExecuted[i] = 0;
+        }
+
+        sThreadIndex() = 0;
+        sThreadOwner() = this;
+        for (unsigned int i = 1; i <= workerCount; i++)
+        {
+            mThreads.emplace_back([this, i]
+                                  { workerLoop(i); });
+        }
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mStop = true;
+        }
+        mWakeUp.notify_all();
+        for (std::thread &thread : mThreads)
+        {
+            thread.join();
+        }
+        if (sThreadOwner() == this)
+        {
+            sThreadOwner() = nullptr;
+        }
+    }
+
+    JobSystem(JobSystem const &) = delete;
+    JobSystem &operator=(JobSystem const &) = delete;
+
+    // Threads that run jobs, including the thread that created the pool
+    unsigned int threadCount() const
+    {
+        return static_cast<unsigned int>(mQueues.size());
+    }
+
+    // Schedule a job, counter (optional) is decremented when it finished.
+    // With a dependency the job only starts once the dependency counter reached zero.
+    void run(std::function<void()> function, JobCounter *counter = nullptr, JobCounter *dependency = nullptr)
+    {
+        detail::Job *job = new detail::Job{std::move(function), counter};
+        if (counter)
+        {
+            counter->mPending.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (dependency && !dependency->done())
+        {
+            std::lock_guard<std::mutex> lock(dependency->mMutex);
+            if (!dependency->done())
+            {
+                dependency->mContinuations.push_back(job);
+                return;
+            }
+        }
+        schedule(job);
+    }
+
+    // Run jobs until the counter reaches zero
+    void wait(JobCounter &counter)
+    {
+        while (!counter.done())
+        {
+            if (detail::Job *job = findJob())
+            {
+                execute(job);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // Calls fn(begin, end) over sub-ranges of [begin, end) of at least grainSize elements, on all
+    // the threads of the pool, and returns when every sub-range is done
+    template <typename Fn>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grainSize, Fn &&fn)
+    {
+        std::size_t count = end > begin ? end - begin : 0;
+        grainSize = std::max<std::size_t>(1, grainSize);
+        // A few chunks per thread so stealing can even out uneven chunks
+        std::size_t chunkCount = std::min<std::size_t>(std::max<std::size_t>(1, count / grainSize), threadCount() * 4);
+        if (chunkCount <= 1)
+        {
+            if (count > 0)
+            {
+                fn(begin, end);
+            }
+            return;
+        }
+
+        std::size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        JobCounter counter;
+        for (std::size_t chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize)
+        {
+            std::size_t chunkEnd = std::min(end, chunkBegin + chunkSize);
+            run([&fn, chunkBegin, chunkEnd]
+                { fn(chunkBegin, chunkEnd); },
+                &counter);
+        }
+        // The calling thread takes the first chunk itself
+        fn(begin, std::min(end, begin + chunkSize));
+        wait(counter);
+    }
+
+    // Counters since the pool was created
+    JobSystemStatistics statistics() const
+    {
+        JobSystemStatistics statistics;
+        for (unsigned int i = 0; i < threadCount(); i++)
+        {
+            statistics.jobsExecuted += mExecuted[i].load(std::memory_order_relaxed);
+        }
+        statistics.jobsStolen = mStolen.load(std::memory_order_relaxed);
+        return statistics;
+    }
+
+private:
+    // Index of the calling thread in the pool that owns it, threads outside of it have no deque
+    static int &sThreadIndex()
+    {
+        thread_local int index = -1;
+        return index;
+    }
+
+    static JobSystem *&sThreadOwner()
+    {
+        thread_local JobSystem *owner = nullptr;
+        return owner;
+    }
+
+    int ownIndex() const
+    {
+        return sThreadOwner() == this ? sThreadIndex() : -1;
+    }
+
+    void schedule(detail::Job *job)
+    {
+        int index = ownIndex();
+        if (index < 0 || !mQueues[index]->push(job))
+        {
+            std::lock_guard<std::mutex> lock(mSharedMutex);
+            mShared.push_back(job);
+        }
+        // Sequentially consistent with the sleeper, which increments mSleeping and then reads mQueued:
+        // either it sees the job or we see it sleeping
+        mQueued.fetch_add(1);
+        if (mSleeping.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(mSleepMutex);
+            mWakeUp.notify_one();
+        }
+    }
+
+    detail::Job *findJob()
+    {
+        int index = ownIndex();
+        detail::Job *job = nullptr;
+        if (index >= 0)
+        {
+            job = mQueues[index]->pop();
+        }
+        if (!job)
+        {
+            // Steal starting after our own deque, so thieves spread over the victims
+            std::size_t queueCount = mQueues.size();
+            std::size_t start = index >= 0 ? index + 1 : 0;
+            for (std::size_t i = 0; i < queueCount && !job; i++)
+            {
+                std::size_t victim = (start + i) % queueCount;
+                if (static_cast<int>(victim) != index)
+                {
+                    job = mQueues[victim]->steal();
+                    if (job)
+                    {
+                        mStolen.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+        }
+        if (!job && mQueued.load(std::memory_order_acquire) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mSharedMutex);
+            if (!mShared.empty())
+            {
+                job = mShared.front();
+                mShared.pop_front();
+            }
+        }
+        if (job)
+        {
+            mQueued.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    void execute(detail::Job *job)
+    {
+        job->function();
+        int index = ownIndex();
+        if (index >= 0)
+        {
+            mExecuted[index].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        JobCounter *counter = job->counter;
+        delete job;
+        if (counter)
+        {
+            std::vector<detail::Job *> continuations;
+            {
+                std::lock_guard<std::mutex> lock(counter->mMutex);
+                if (1 == counter->mPending.fetch_sub(1, std::memory_order_acq_rel))
+                {
+                    continuations.swap(counter->mContinuations);
+                }
+            }
+            for (detail::Job *continuation : continuations)
+            {
+                schedule(continuation);
+            }
+        }
+    }
+
+    void workerLoop(unsigned int index)
+    {
+        sThreadIndex() = static_cast<int>(index);
+        sThreadOwner() = this;
+        int idleRounds = 0;
+        while (true)
+        {
+            if (detail::Job *job = findJob())
+            {
+                execute(job);
+                idleRounds = 0;
+                continue;
+            }
+            // Spin a little before sleeping, jobs of a frame tend to come in bursts
+            if (++idleRounds < 64)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(mSleepMutex);
+            mSleeping.fetch_add(1);
+            mWakeUp.wait(lock, [this]
+                         { return mStop || mQueued.load() > 0; });
+            mSleeping.fetch_sub(1);
+            if (mStop)
+            {
+                return;
+            }
+            idleRounds = 0;
+        }
+    }
+
+    std::vector<std::unique_ptr<detail::WorkStealingDeque>> mQueues;
+    std::vector<std::thread> mThreads;
+    std::unique_ptr<std::atomic<std::size_t>[]> mExecuted;
+    std::atomic<std::size_t> mStolen{0};
+
+    // Jobs submitted from threads outside of the pool, or when a deque is full
+    std::mutex mSharedMutex;
+    std::deque<detail::Job *> mShared;
+
+    // Jobs waiting in any queue, lets sleeping workers know there is work
+    std::atomic<int> mQueued{0};
+    std::atomic<int> mSleeping{0};
+    std::mutex mSleepMutex;
+    std::condition_variable mWakeUp;
+    bool mStop = false;
+};
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file.
+// The mapping is released when the object is destroyed.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(std::string const &filePath)
+    {
+        open(filePath);
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile &operator=(MappedFile &&other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+            mData = other.mData;
+            mSize = other.mSize;
+            other.mData = nullptr;
+            other.mSize = 0;
+        }
+        return *this;
+    }
+
+    // Map the file, returns false if the file does not exist or cannot be mapped
+    bool open(std::string const &filePath)
+    {
+        close();
+#if defined(_WIN32)
+        HANDLE file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (INVALID_HANDLE_VALUE == file)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || 0 == fileSize.QuadPart)
+        {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping)
+        {
+            return false;
+        }
+        mData = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        // The view keeps the mapping alive
+        CloseHandle(mapping);
+        if (!mData)
+        {
+            return false;
+        }
+        mSize = (std::size_t)fileSize.QuadPart;
+#else
+        int file = ::open(filePath.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat fileStat;
+        if (fstat(file, &fileStat) != 0 || 0 == fileStat.st_size)
+        {
+            ::close(file);
+            return false;
+        }
+        void *data = mmap(nullptr, (std::size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (MAP_FAILED == data)
+        {
+            return false;
+        }
+        mData = data;
+        mSize = (std::size_t)fileStat.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (mData)
+        {
+#if defined(_WIN32)
+            UnmapViewOfFile(mData);
+#else
+            munmap(mData, mSize);
+#endif
+        }
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    bool isOpen() const
+    {
+        return nullptr != mData;
+    }
+
+    const unsigned char *data() const
+    {
+        return static_cast<const unsigned char *>(mData);
+    }
+
+    std::size_t size() const
+    {
+        return mSize;
+    }
+
+private:
+    void *mData = nullptr;
+    std::size_t mSize = 0;
+};
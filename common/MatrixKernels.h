@@ -0,0 +1,429 @@
+#pragma once
+
+#include "CpuFeatures.h"
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <glm/matrix.hpp>
+#include <glm/simd/matrix.h>
+
+#include <cstddef>
+
+// Batched mat4 kernels selected at run time from the instruction sets of the CPU.
+// The AVX2 kernels are compiled in wherever CPU_HAS_AVX2 is set (they carry their own target attribute), the SSE2
+// kernels are the ones glm builds when GLM_ARCH includes SSE2 (GLM_FORCE_INTRINSICS or a
+// GLM_FORCE_SSE* define), and the scalar kernels are plain glm.
+struct MatrixKernels
+{
+    SimdLevel level = SimdLevel::Scalar;
+    // out[i] = a[i] * b[i]
+    void (*multiply)(glm::mat4 const *a, glm::mat4 const *b, glm::mat4 *out, std::size_t count) = nullptr;
+    // out[i] = inverse(m[i])
+    void (*inverse)(glm::mat4 const *m, glm::mat4 *out, std::size_t count) = nullptr;
+    // out[i] = m[i] * v[i]
+    void (*transform)(glm::mat4 const *m, glm::vec4 const *v, glm::vec4 *out, std::size_t count) = nullptr;
+};
+
+namespace detail
+{
+    inline void multiplyScalar(glm::mat4 const *a, glm::mat4 const *b, glm::mat4 *out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            out[i] = a[i] * b[i];
+        }
+    }
+
+    inline void inverseScalar(glm::mat4 const *m, glm::mat4 *out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            out[i] = glm::inverse(m[i]);
+        }
+    }
+
+    inline void transformScalar(glm::mat4 const *m, glm::vec4 const *v, glm::vec4 *out, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; i++)
+        {
+            out[i] = m[i] * v[i];
+        }
+    }
+
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    // glm::mat4 is not guaranteed to be 16 byte aligned, so the columns go through unaligned loads
+    inline void loadColumns(glm::mat4 const &m, glm_vec4 columns[4])
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            columns[i] = _mm_loadu_ps(&m[i][0]);
+        }
+    }
+
+    inline void storeColumns(glm_vec4 const columns[4], glm::mat4 &m)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            _mm_storeu_ps(&m[i][0], columns[i]);
+        }
+    }
+
+    inline void multiplySse2(glm::mat4 const *a, glm::mat4 const *b, glm::mat4 *out, std::size_t count)
+    {
+        glm_vec4 in1[4], in2[4], result[4];
+        for (std::size_t i = 0; i < count; i++)
+        {
+            loadColumns(a[i], in1);
+            loadColumns(b[i], in2);
+            glm_mat4_mul(in1, in2, result);
+            storeColumns(result, out[i]);
+        }
+    }
+
+    inline void inverseSse2(glm::mat4 const *m, glm::mat4 *out, std::size_t count)
+    {
+        glm_vec4 in[4], result[4];
+        for (std::size_t i = 0; i < count; i++)
+        {
+            loadColumns(m[i], in);
+            glm_mat4_inverse(in, result);
+            storeColumns(result, out[i]);
+        }
+    }
+
+    inline void transformSse2(glm::mat4 const *m, glm::vec4 const *v, glm::vec4 *out, std::size_t count)
+    {
+        glm_vec4 in[4];
+        for (std::size_t i = 0; i < count; i++)
+        {
+            loadColumns(m[i], in);
+            _mm_storeu_ps(&out[i][0], glm_mat4_mul_vec4(in, _mm_loadu_ps(&v[i][0])));
+        }
+    }
+#endif
+
+#if CPU_HAS_AVX2
+    // Single-matrix and batched mat4 kernels on column-major float[16] matrices (the memory layout
+    // of glm::mat4); consecutive matrices are contiguous and no alignment is required.
+
+    // Two output columns per 256-bit register: both lanes hold the same column of in1 and the
+    // in-lane permute broadcasts one element of two consecutive columns of in2.
+    CPU_TARGET_AVX2 inline void mat4MultiplyAvx2(float const *in1, float const *in2, float *out)
+    {
+        __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 0));
+        __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 4));
+        __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 8));
+        __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 12));
+
+        __m256 b01 = _mm256_loadu_ps(in2 + 0);
+        __m256 b23 = _mm256_loadu_ps(in2 + 8);
+
+        __m256 r01 = _mm256_mul_ps(c0, _mm256_permute_ps(b01, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 r23 = _mm256_mul_ps(c0, _mm256_permute_ps(b23, _MM_SHUFFLE(0, 0, 0, 0)));
+        r01 = _mm256_fmadd_ps(c1, _mm256_permute_ps(b01, _MM_SHUFFLE(1, 1, 1, 1)), r01);
+        r23 = _mm256_fmadd_ps(c1, _mm256_permute_ps(b23, _MM_SHUFFLE(1, 1, 1, 1)), r23);
+        r01 = _mm256_fmadd_ps(c2, _mm256_permute_ps(b01, _MM_SHUFFLE(2, 2, 2, 2)), r01);
+        r23 = _mm256_fmadd_ps(c2, _mm256_permute_ps(b23, _MM_SHUFFLE(2, 2, 2, 2)), r23);
+        r01 = _mm256_fmadd_ps(c3, _mm256_permute_ps(b01, _MM_SHUFFLE(3, 3, 3, 3)), r01);
+        r23 = _mm256_fmadd_ps(c3, _mm256_permute_ps(b23, _MM_SHUFFLE(3, 3, 3, 3)), r23);
+
+        _mm256_storeu_ps(out + 0, r01);
+        _mm256_storeu_ps(out + 8, r23);
+    }
+
+    // Two products in flight: the steps of both are interleaved, so four independent FMA chains
+    // hide each other's latency. With the columns of in2 and the accumulators of both products
+    // this keeps about 12 of the 16 ymm registers busy; a third or fourth product would spill.
+    CPU_TARGET_AVX2 inline void mat4MultiplyX2Avx2(float const *in1, float const *in2, float *out)
+    {
+        __m256 a01 = _mm256_loadu_ps(in2 + 0);
+        __m256 a23 = _mm256_loadu_ps(in2 + 8);
+        __m256 b01 = _mm256_loadu_ps(in2 + 16);
+        __m256 b23 = _mm256_loadu_ps(in2 + 24);
+
+        __m256 ca = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 0));
+        __m256 cb = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 16));
+        __m256 ra01 = _mm256_mul_ps(ca, _mm256_permute_ps(a01, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 ra23 = _mm256_mul_ps(ca, _mm256_permute_ps(a23, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 rb01 = _mm256_mul_ps(cb, _mm256_permute_ps(b01, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 rb23 = _mm256_mul_ps(cb, _mm256_permute_ps(b23, _MM_SHUFFLE(0, 0, 0, 0)));
+
+        ca = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 4));
+        cb = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 20));
+        ra01 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a01, _MM_SHUFFLE(1, 1, 1, 1)), ra01);
+        ra23 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a23, _MM_SHUFFLE(1, 1, 1, 1)), ra23);
+        rb01 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b01, _MM_SHUFFLE(1, 1, 1, 1)), rb01);
+        rb23 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b23, _MM_SHUFFLE(1, 1, 1, 1)), rb23);
+
+        ca = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 8));
+        cb = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 24));
+        ra01 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a01, _MM_SHUFFLE(2, 2, 2, 2)), ra01);
+        ra23 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a23, _MM_SHUFFLE(2, 2, 2, 2)), ra23);
+        rb01 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b01, _MM_SHUFFLE(2, 2, 2, 2)), rb01);
+        rb23 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b23, _MM_SHUFFLE(2, 2, 2, 2)), rb23);
+
+        ca = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 12));
+        cb = _mm256_broadcast_ps(reinterpret_cast<__m128 const *>(in1 + 28));
+        ra01 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a01, _MM_SHUFFLE(3, 3, 3, 3)), ra01);
+        ra23 = _mm256_fmadd_ps(ca, _mm256_permute_ps(a23, _MM_SHUFFLE(3, 3, 3, 3)), ra23);
+        rb01 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b01, _MM_SHUFFLE(3, 3, 3, 3)), rb01);
+        rb23 = _mm256_fmadd_ps(cb, _mm256_permute_ps(b23, _MM_SHUFFLE(3, 3, 3, 3)), rb23);
+
+        _mm256_storeu_ps(out + 0, ra01);
+        _mm256_storeu_ps(out + 8, ra23);
+        _mm256_storeu_ps(out + 16, rb01);
+        _mm256_storeu_ps(out + 24, rb23);
+    }
+
+    CPU_TARGET_AVX2 inline void mat4TransformAvx2(float const *m, float const *v, float *out)
+    {
+        __m128 vec = _mm_loadu_ps(v);
+        __m256 v01 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_permute_ps(vec, _MM_SHUFFLE(0, 0, 0, 0))), _mm_permute_ps(vec, _MM_SHUFFLE(1, 1, 1, 1)), 1);
+        __m256 v23 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_permute_ps(vec, _MM_SHUFFLE(2, 2, 2, 2))), _mm_permute_ps(vec, _MM_SHUFFLE(3, 3, 3, 3)), 1);
+
+        __m256 r = _mm256_mul_ps(_mm256_loadu_ps(m + 0), v01);
+        r = _mm256_fmadd_ps(_mm256_loadu_ps(m + 8), v23, r);
+
+        _mm_storeu_ps(out, _mm_add_ps(_mm256_castps256_ps128(r), _mm256_extractf128_ps(r, 1)));
+    }
+
+    // Column k of two consecutive matrices, matrix 0 in lane 0 and matrix 1 in lane 1
+    CPU_TARGET_AVX2 inline __m256 mat4ColumnX2Avx2(float const *m, int k)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(m + k * 4)), _mm_loadu_ps(m + 16 + k * 4), 1);
+    }
+
+    // Lane 0 holds matrix/vector pair 0, lane 1 holds pair 1.
+    CPU_TARGET_AVX2 inline void mat4TransformX2Avx2(float const *m, float const *v, float *out)
+    {
+        __m256 vec = _mm256_loadu_ps(v);
+
+        __m256 r0 = _mm256_mul_ps(mat4ColumnX2Avx2(m, 0), _mm256_permute_ps(vec, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 r1 = _mm256_mul_ps(mat4ColumnX2Avx2(m, 1), _mm256_permute_ps(vec, _MM_SHUFFLE(1, 1, 1, 1)));
+        r0 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m, 2), _mm256_permute_ps(vec, _MM_SHUFFLE(2, 2, 2, 2)), r0);
+        r1 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m, 3), _mm256_permute_ps(vec, _MM_SHUFFLE(3, 3, 3, 3)), r1);
+
+        _mm256_storeu_ps(out, _mm256_add_ps(r0, r1));
+    }
+
+    // Two lane pairs in flight: pairs (0, 1) and (2, 3) interleaved step by step, four independent
+    // accumulators instead of the two of mat4TransformX2Avx2.
+    CPU_TARGET_AVX2 inline void mat4TransformX4Avx2(float const *m, float const *v, float *out)
+    {
+        __m256 va = _mm256_loadu_ps(v);
+        __m256 vb = _mm256_loadu_ps(v + 8);
+
+        __m256 ra0 = _mm256_mul_ps(mat4ColumnX2Avx2(m, 0), _mm256_permute_ps(va, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 rb0 = _mm256_mul_ps(mat4ColumnX2Avx2(m + 32, 0), _mm256_permute_ps(vb, _MM_SHUFFLE(0, 0, 0, 0)));
+        __m256 ra1 = _mm256_mul_ps(mat4ColumnX2Avx2(m, 1), _mm256_permute_ps(va, _MM_SHUFFLE(1, 1, 1, 1)));
+        __m256 rb1 = _mm256_mul_ps(mat4ColumnX2Avx2(m + 32, 1), _mm256_permute_ps(vb, _MM_SHUFFLE(1, 1, 1, 1)));
+        ra0 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m, 2), _mm256_permute_ps(va, _MM_SHUFFLE(2, 2, 2, 2)), ra0);
+        rb0 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m + 32, 2), _mm256_permute_ps(vb, _MM_SHUFFLE(2, 2, 2, 2)), rb0);
+        ra1 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m, 3), _mm256_permute_ps(va, _MM_SHUFFLE(3, 3, 3, 3)), ra1);
+        rb1 = _mm256_fmadd_ps(mat4ColumnX2Avx2(m + 32, 3), _mm256_permute_ps(vb, _MM_SHUFFLE(3, 3, 3, 3)), rb1);
+
+        _mm256_storeu_ps(out, _mm256_add_ps(ra0, ra1));
+        _mm256_storeu_ps(out + 8, _mm256_add_ps(rb0, rb1));
+    }
+
+    // One 2x2 sub-factor vector of glm_mat4_inverse; _mm256_shuffle_ps works per 128-bit lane,
+    // so each lane computes the factors of its own matrix.
+    template <int A, int B>
+    CPU_TARGET_AVX2 inline __m256 mat4InverseFactorAvx2(__m256 const in[4])
+    {
+        __m256 Swp0a = _mm256_shuffle_ps(in[3], in[2], _MM_SHUFFLE(A, A, A, A));
+        __m256 Swp0b = _mm256_shuffle_ps(in[3], in[2], _MM_SHUFFLE(B, B, B, B));
+
+        __m256 Swp00 = _mm256_shuffle_ps(in[2], in[1], _MM_SHUFFLE(B, B, B, B));
+        __m256 Swp01 = _mm256_shuffle_ps(Swp0a, Swp0a, _MM_SHUFFLE(2, 0, 0, 0));
+        __m256 Swp02 = _mm256_shuffle_ps(Swp0b, Swp0b, _MM_SHUFFLE(2, 0, 0, 0));
+        __m256 Swp03 = _mm256_shuffle_ps(in[2], in[1], _MM_SHUFFLE(A, A, A, A));
+
+        return _mm256_fmsub_ps(Swp00, Swp01, _mm256_mul_ps(Swp02, Swp03));
+    }
+
+    // Same algorithm as glm_mat4_inverse with two matrices per call, one per 128-bit lane.
+    CPU_TARGET_AVX2 inline void mat4InverseX2Avx2(float const *m, float *out)
+    {
+        __m256 in[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            in[i] = mat4ColumnX2Avx2(m, i);
+        }
+
+        __m256 Fac0 = mat4InverseFactorAvx2<3, 2>(in);
+        __m256 Fac1 = mat4InverseFactorAvx2<3, 1>(in);
+        __m256 Fac2 = mat4InverseFactorAvx2<2, 1>(in);
+        __m256 Fac3 = mat4InverseFactorAvx2<3, 0>(in);
+        __m256 Fac4 = mat4InverseFactorAvx2<2, 0>(in);
+        __m256 Fac5 = mat4InverseFactorAvx2<1, 0>(in);
+
+        __m256 SignA = _mm256_set_ps(1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f);
+        __m256 SignB = _mm256_set_ps(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+
+        __m256 Temp0 = _mm256_shuffle_ps(in[1], in[0], _MM_SHUFFLE(0, 0, 0, 0));
+        __m256 Vec0 = _mm256_shuffle_ps(Temp0, Temp0, _MM_SHUFFLE(2, 2, 2, 0));
+        __m256 Temp1 = _mm256_shuffle_ps(in[1], in[0], _MM_SHUFFLE(1, 1, 1, 1));
+        __m256 Vec1 = _mm256_shuffle_ps(Temp1, Temp1, _MM_SHUFFLE(2, 2, 2, 0));
+        __m256 Temp2 = _mm256_shuffle_ps(in[1], in[0], _MM_SHUFFLE(2, 2, 2, 2));
+        __m256 Vec2 = _mm256_shuffle_ps(Temp2, Temp2, _MM_SHUFFLE(2, 2, 2, 0));
+        __m256 Temp3 = _mm256_shuffle_ps(in[1], in[0], _MM_SHUFFLE(3, 3, 3, 3));
+        __m256 Vec3 = _mm256_shuffle_ps(Temp3, Temp3, _MM_SHUFFLE(2, 2, 2, 0));
+
+        // Inv = Sign * (VecA * FacA - VecB * FacB + VecC * FacC)
+        __m256 Inv0 = _mm256_mul_ps(SignB, _mm256_fmadd_ps(Vec3, Fac2, _mm256_fnmadd_ps(Vec2, Fac1, _mm256_mul_ps(Vec1, Fac0))));
+        __m256 Inv1 = _mm256_mul_ps(SignA, _mm256_fmadd_ps(Vec3, Fac4, _mm256_fnmadd_ps(Vec2, Fac3, _mm256_mul_ps(Vec0, Fac0))));
+        __m256 Inv2 = _mm256_mul_ps(SignB, _mm256_fmadd_ps(Vec3, Fac5, _mm256_fnmadd_ps(Vec1, Fac3, _mm256_mul_ps(Vec0, Fac1))));
+        __m256 Inv3 = _mm256_mul_ps(SignA, _mm256_fmadd_ps(Vec2, Fac5, _mm256_fnmadd_ps(Vec1, Fac4, _mm256_mul_ps(Vec0, Fac2))));
+
+        __m256 Row0 = _mm256_shuffle_ps(Inv0, Inv1, _MM_SHUFFLE(0, 0, 0, 0));
+        __m256 Row1 = _mm256_shuffle_ps(Inv2, Inv3, _MM_SHUFFLE(0, 0, 0, 0));
+        __m256 Row2 = _mm256_shuffle_ps(Row0, Row1, _MM_SHUFFLE(2, 0, 2, 0));
+
+        // _mm256_dp_ps also works per lane, giving each matrix its own determinant
+        __m256 Det0 = _mm256_dp_ps(in[0], Row2, 0xff);
+        __m256 Rcp0 = _mm256_div_ps(_mm256_set1_ps(1.0f), Det0);
+
+        __m256 Out0 = _mm256_mul_ps(Inv0, Rcp0);
+        __m256 Out1 = _mm256_mul_ps(Inv1, Rcp0);
+        __m256 Out2 = _mm256_mul_ps(Inv2, Rcp0);
+        __m256 Out3 = _mm256_mul_ps(Inv3, Rcp0);
+
+        _mm256_storeu_ps(out + 0, _mm256_permute2f128_ps(Out0, Out1, 0x20));
+        _mm256_storeu_ps(out + 8, _mm256_permute2f128_ps(Out2, Out3, 0x20));
+        _mm256_storeu_ps(out + 16, _mm256_permute2f128_ps(Out0, Out1, 0x31));
+        _mm256_storeu_ps(out + 24, _mm256_permute2f128_ps(Out2, Out3, 0x31));
+    }
+
+    // Two matrices per iteration, the remainder goes through the single matrix kernel
+    CPU_TARGET_AVX2 inline void multiplyAvx2(glm::mat4 const *a, glm::mat4 const *b, glm::mat4 *out, std::size_t count)
+    {
+        float const *in1 = reinterpret_cast<float const *>(a);
+        float const *in2 = reinterpret_cast<float const *>(b);
+        float *result = reinterpret_cast<float *>(out);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            mat4MultiplyX2Avx2(in1 + i * 16, in2 + i * 16, result + i * 16);
+        }
+        for (; i < count; i++)
+        {
+            mat4MultiplyAvx2(in1 + i * 16, in2 + i * 16, result + i * 16);
+        }
+    }
+
+    // The inverse already takes all the registers for two matrices, one per lane
+    CPU_TARGET_AVX2 inline void inverseAvx2(glm::mat4 const *m, glm::mat4 *out, std::size_t count)
+    {
+        float const *in = reinterpret_cast<float const *>(m);
+        float *result = reinterpret_cast<float *>(out);
+        std::size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            mat4InverseX2Avx2(in + i * 16, result + i * 16);
+        }
+        if (i < count)
+        {
+            // Pad the odd matrix with a copy of itself
+            float pair[32], inversePair[32];
+            for (int j = 0; j < 16; j++)
+            {
+                pair[j] = pair[j + 16] = in[i * 16 + j];
+            }
+            mat4InverseX2Avx2(pair, inversePair);
+            for (int j = 0; j < 16; j++)
+            {
+                result[i * 16 + j] = inversePair[j];
+            }
+        }
+    }
+
+    CPU_TARGET_AVX2 inline void transformAvx2(glm::mat4 const *m, glm::vec4 const *v, glm::vec4 *out, std::size_t count)
+    {
+        float const *matrices = reinterpret_cast<float const *>(m);
+        float const *vectors = reinterpret_cast<float const *>(v);
+        float *result = reinterpret_cast<float *>(out);
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            mat4TransformX4Avx2(matrices + i * 16, vectors + i * 4, result + i * 4);
+        }
+        for (; i + 2 <= count; i += 2)
+        {
+            mat4TransformX2Avx2(matrices + i * 16, vectors + i * 4, result + i * 4);
+        }
+        for (; i < count; i++)
+        {
+            mat4TransformAvx2(matrices + i * 16, vectors + i * 4, result + i * 4);
+        }
+    }
+#endif
+}
+
+// True when the kernels of this level are compiled in and the CPU can run them
+inline bool matrixKernelsAvailable(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Avx2:
+#if CPU_HAS_AVX2
+        return cpuFeatures().supports(SimdLevel::Avx2);
+#else
+        return false;
+#endif
+    case SimdLevel::Sse2:
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+        return cpuFeatures().supports(SimdLevel::Sse2);
+#else
+        return false;
+#endif
+    default:
+        return true;
+    }
+}
+
+// Kernels of one level, falls back to the next lower level that is available
+inline MatrixKernels matrixKernelsFor(SimdLevel level)
+{
+    MatrixKernels kernels;
+    if (level == SimdLevel::Avx2 && !matrixKernelsAvailable(SimdLevel::Avx2))
+    {
+        level = SimdLevel::Sse2;
+    }
+    if (level == SimdLevel::Sse2 && !matrixKernelsAvailable(SimdLevel::Sse2))
+    {
+        level = SimdLevel::Scalar;
+    }
+
+    kernels.level = level;
+    switch (level)
+    {
+#if CPU_HAS_AVX2
+    case SimdLevel::Avx2:
+        kernels.multiply = detail::multiplyAvx2;
+        kernels.inverse = detail::inverseAvx2;
+        kernels.transform = detail::transformAvx2;
+        break;
+#endif
+#if GLM_ARCH & GLM_ARCH_SSE2_BIT
+    case SimdLevel::Sse2:
+        kernels.multiply = detail::multiplySse2;
+        kernels.inverse = detail::inverseSse2;
+        kernels.transform = detail::transformSse2;
+        break;
+#endif
+    default:
+        kernels.multiply = detail::multiplyScalar;
+        kernels.inverse = detail::inverseScalar;
+        kernels.transform = detail::transformScalar;
+        break;
+    }
+    return kernels;
+}
+
+// Fastest kernels for this machine, selected on first use
+inline const MatrixKernels &matrixKernels()
+{
+    static const MatrixKernels kernels = matrixKernelsFor(SimdLevel::Avx2);
+    return kernels;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Interleaved vertex layout shared by all the mesh generators
+struct MeshVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+};
+
+// Triangle mesh with one interleaved vertex buffer.
+// Only one of the index vectors is used: 16-bit indices when every vertex can be
+// addressed by an unsigned short, 32-bit indices otherwise.
+struct Mesh
+{
+    std::vector<MeshVertex> vertices;
+    std::vector<unsigned short> indices16;
+    std::vector<unsigned int> indices32;
+
+    bool uses32BitIndices() const
+    {
+        return !indices32.empty();
+    }
+
+    // OpenGL type to pass to glDrawElements
+    unsigned int indexType() const
+    {
+        return uses32BitIndices() ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    }
+
+    std::size_t indexCount() const
+    {
+        return uses32BitIndices() ? indices32.size() : indices16.size();
+    }
+
+    std::size_t indexSize() const
+    {
+        return uses32BitIndices() ? sizeof(unsigned int) : sizeof(unsigned short);
+    }
+
+    const void *indexData() const
+    {
+        return uses32BitIndices() ? static_cast<const void *>(indices32.data()) : static_cast<const void *>(indices16.data());
+    }
+
+    std::size_t indexDataSize() const
+    {
+        return indexCount() * indexSize();
+    }
+
+    std::size_t vertexDataSize() const
+    {
+        return vertices.size() * sizeof(MeshVertex);
+    }
+};
+
+// Returns true when the vertex count needs 32-bit indices
+inline bool needs32BitIndices(std::size_t numVertices)
+{
+    return numVertices > static_cast<std::size_t>(std::numeric_limits<unsigned short>::max()) + 1;
+}
+
+// Size the index storage of the mesh, choosing the index width from the vertex count
+inline void resizeIndices(Mesh &mesh, std::size_t numIndices)
+{
+    if (needs32BitIndices(mesh.vertices.size()))
+    {
+        mesh.indices16.clear();
+        mesh.indices32.resize(numIndices);
+    }
+    else
+    {
+        mesh.indices32.clear();
+        mesh.indices16.resize(numIndices);
+    }
+}
+
+// Store 32-bit indices built by a generator, narrowing them to 16 bits when the vertex count allows
+inline void assignIndices(Mesh &mesh, std::vector<unsigned int> &&indices)
+{
+    if (needs32BitIndices(mesh.vertices.size()))
+    {
+        mesh.indices16.clear();
+        mesh.indices32 = std::move(indices);
+    }
+    else
+    {
+        mesh.indices32.clear();
+        mesh.indices16.assign(indices.begin(), indices.end());
+    }
+}
+
+// Call fn with the index vector in use, so passes can be written once for both widths
+template <typename Fn>
+void visitIndices(Mesh &mesh, Fn &&fn)
+{
+    if (mesh.uses32BitIndices())
+    {
+        fn(mesh.indices32);
+    }
+    else
+    {
+        fn(mesh.indices16);
+    }
+}
+
+template <typename Fn>
+void visitIndices(Mesh const &mesh, Fn &&fn)
+{
+    if (mesh.uses32BitIndices())
+    {
+        fn(mesh.indices32);
+    }
+    else
+    {
+        fn(mesh.indices16);
+    }
+}
+
+// Non-owning view of mesh data, ready to be handed to glBufferData.
+// It can point into a Mesh or straight into a memory-mapped cache file.
+struct MeshView
+{
+    const MeshVertex *vertices = nullptr;
+    std::size_t vertexCount = 0;
+    const void *indices = nullptr;
+    std::size_t indexCount = 0;
+    unsigned int indexType = GL_UNSIGNED_SHORT;
+
+    std::size_t vertexDataSize() const
+    {
+        return vertexCount * sizeof(MeshVertex);
+    }
+
+    std::size_t indexSize() const
+    {
+        return GL_UNSIGNED_INT == indexType ? sizeof(unsigned int) : sizeof(unsigned short);
+    }
+
+    std::size_t indexDataSize() const
+    {
+        return indexCount * indexSize();
+    }
+};
+
+inline MeshView makeMeshView(Mesh const &mesh)
+{
+    MeshView view;
+    view.vertices = mesh.vertices.data();
+    view.vertexCount = mesh.vertices.size();
+    view.indices = mesh.indexData();
+    view.indexCount = mesh.indexCount();
+    view.indexType = mesh.indexType();
+    return view;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "Mesh.h"
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// One mesh inside a batch. Indices are local to the mesh, draw with glDrawElementsBaseVertex.
+struct BatchedMesh
+{
+    std::size_t firstIndex = 0;
+    std::size_t indexCount = 0;
+    int baseVertex = 0;
+
+    std::size_t triangleCount() const
+    {
+        return indexCount / 3;
+    }
+};
+
+// Where the meshes of a batch sit in its shared vertex and index buffer. This is all the draws
+// need, the geometry itself can stay wherever it was uploaded from.
+struct MeshBatchLayout
+{
+    std::vector<BatchedMesh> meshes;
+    // OpenGL type to pass to glDrawElements
+    unsigned int indexType = GL_UNSIGNED_SHORT;
+    std::size_t vertexCount = 0;
+    std::size_t indexCount = 0;
+
+    std::size_t indexSize() const
+    {
+        return GL_UNSIGNED_INT == indexType ? sizeof(unsigned int) : sizeof(unsigned short);
+    }
+
+    // Byte offset of the mesh's first index, for the indices argument of glDrawElementsBaseVertex
+    const void *indexOffset(std::size_t index) const
+    {
+        return (const void *)(meshes[index].firstIndex * indexSize());
+    }
+};
+
+// Several meshes packed into one vertex and index buffer, so they can be drawn without
+// switching buffers or vertex arrays between them
+struct MeshBatch
+{
+    Mesh mesh;
+    MeshBatchLayout layout;
+};
+
+// Place the meshes one after the other, in order, without touching their geometry
+inline MeshBatchLayout layoutMeshBatch(std::vector<MeshView> const &views)
+{
+    MeshBatchLayout layout;
+    std::size_t maxMeshVertices = 0;
+    for (auto const &view : views)
+    {
+        BatchedMesh batched;
+        batched.firstIndex = layout.indexCount;
+        batched.indexCount = view.indexCount;
+        batched.baseVertex = (int)layout.vertexCount;
+        layout.meshes.push_back(batched);
+
+        layout.vertexCount += view.vertexCount;
+        layout.indexCount += view.indexCount;
+        maxMeshVertices = std::max(maxMeshVertices, view.vertexCount);
+    }
+    if (layout.vertexCount > (std::size_t)std::numeric_limits<int>::max())
+    {
+        throw std::invalid_argument("Mesh batch is too large for glDrawElementsBaseVertex");
+    }
+
+    // Indices are mesh-local, so the width only depends on the largest mesh
+    layout.indexType = needs32BitIndices(maxMeshVertices) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+    return layout;
+}
+
+// Pack the meshes one after the other, in order
+inline MeshBatch buildMeshBatch(std::vector<MeshView> const &views)
+{
+    MeshBatch batch;
+    batch.layout = layoutMeshBatch(views);
+    const bool wideIndices = GL_UNSIGNED_INT == batch.layout.indexType;
+    batch.mesh.vertices.reserve(batch.layout.vertexCount);
+    if (wideIndices)
+    {
+        batch.mesh.indices32.reserve(batch.layout.indexCount);
+    }
+    else
+    {
+        batch.mesh.indices16.reserve(batch.layout.indexCount);
+    }
+
+    for (auto const &view : views)
+    {
+        batch.mesh.vertices.insert(batch.mesh.vertices.end(), view.vertices, view.vertices + view.vertexCount);
+        for (std::size_t i = 0; i < view.indexCount; ++i)
+        {
+            unsigned int index = GL_UNSIGNED_INT == view.indexType ? static_cast<const unsigned int *>(view.indices)[i]
+                                                                   : static_cast<const unsigned short *>(view.indices)[i];
+            if (wideIndices)
+            {
+                batch.mesh.indices32.push_back(index);
+            }
+            else
+            {
+                batch.mesh.indices16.push_back((unsigned short)index);
+            }
+        }
+    }
+    return batch;
+}
+
+// Compressed vertices of a batch, its indices and its layout, ready to be handed to glBufferData.
+// It can point into a MeshBatch and its packVertices output, or straight into a mapped cache file.
+struct PackedMeshBatchView
+{
+    const PackedVertex *vertices = nullptr;
+    const void *indices = nullptr;
+    QuantizationBounds bounds;
+    MeshBatchLayout layout;
+
+    std::size_t vertexDataSize() const
+    {
+        return layout.vertexCount * sizeof(PackedVertex);
+    }
+
+    std::size_t indexDataSize() const
+    {
+        return layout.indexCount * layout.indexSize();
+    }
+};
+
+inline PackedMeshBatchView makePackedMeshBatchView(MeshBatch const &batch, PackedVertices const &packed)
+{
+    PackedMeshBatchView view;
+    view.vertices = packed.vertices.data();
+    view.indices = batch.mesh.indexData();
+    view.bounds = packed.bounds;
+    view.layout = batch.layout;
+    return view;
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "Mesh.h"
+#include "MeshBatch.h"
+#include "MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// Identifies a generated mesh by its generator name, the versions of the code that
+// produced it and its parameters, e.g.
+// MeshCacheKey("sphere", {sphereMeshVersion}, {radius, numSegmentsInWidth, numSegmentsInHeight})
+// Bumping a version changes the hash, so meshes cached by older code are regenerated.
+struct MeshCacheKey
+{
+    std::string generator;
+    std::vector<std::uint32_t> versions;
+    std::vector<float> parameters;
+
+    MeshCacheKey(std::string generatorName, std::initializer_list<std::uint32_t> generatorVersions,
+                 std::initializer_list<float> generatorParameters)
+        : generator(std::move(generatorName)), versions(generatorVersions), parameters(generatorParameters)
+    {
+    }
+
+    // 64-bit FNV-1a hash of the generator name, the versions and the parameter bits
+    std::uint64_t hash() const
+    {
+        std::uint64_t value = 14695981039346656037ull;
+        auto hashBytes = [&value](const void *data, std::size_t size)
+        {
+            auto bytes = static_cast<const unsigned char *>(data);
+            for (std::size_t i = 0; i < size; ++i)
+            {
+                value = (value ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        hashBytes(generator.data(), generator.size());
+        hashBytes(versions.data(), versions.size() * sizeof(std::uint32_t));
+        hashBytes(parameters.data(), parameters.size() * sizeof(float));
+        return value;
+    }
+
+    std::string fileName() const
+    {
+        char hashText[17];
+        std::snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)hash());
+        return generator + "_" + hashText + ".mesh";
+    }
+};
+
+// On-disk layout of a cached mesh or packed mesh batch:
+//   MeshCacheHeader | padding | vertex data | padding | index data | padding | mesh table
+// All blocks start on a MeshCacheHeader::alignment boundary, so the mapped file can be
+// handed to glBufferData as it is. Only batches have a mesh table.
+struct MeshCacheHeader
+{
+    static constexpr std::uint32_t magicValue = 0x4853454Du; // "MESH"
+    static constexpr std::uint32_t currentVersion = 2;
+    static constexpr std::uint64_t alignment = 64;
+
+    std::uint32_t magic = magicValue;
+    std::uint32_t version = currentVersion;
+    std::uint64_t keyHash = 0;
+    // sizeof(MeshVertex) for a mesh, sizeof(PackedVertex) for a packed batch
+    std::uint32_t vertexStride = sizeof(MeshVertex);
+    std::uint32_t indexType = GL_UNSIGNED_SHORT;
+    std::uint64_t vertexCount = 0;
+    std::uint64_t indexCount = 0;
+    std::uint64_t vertexOffset = 0;
+    std::uint64_t indexOffset = 0;
+    std::uint64_t meshCount = 0;
+    std::uint64_t meshOffset = 0;
+    // Quantization bounds of a packed batch
+    float boundsCenter[3] = {0.0f, 0.0f, 0.0f};
+    float boundsHalfExtent[3] = {1.0f, 1.0f, 1.0f};
+};
+
+// One entry of the mesh table of a cached batch
+struct MeshCacheBatchedMesh
+{
+    std::uint64_t firstIndex;
+    std::uint64_t indexCount;
+    std::int64_t baseVertex;
+};
+
+inline std::uint64_t alignMeshCacheOffset(std::uint64_t offset)
+{
+    return (offset + MeshCacheHeader::alignment - 1) & ~(MeshCacheHeader::alignment - 1);
+}
+
+// A mesh served from the cache. The view points into the mapped file, so it is
+// only valid while this object is alive.
+struct CachedMesh
+{
+    MappedFile file;
+    // Only used when the mesh could not be written to the cache
+    Mesh generated;
+    MeshView view;
+};
+
+// A packed mesh batch served from the cache. The view points into the mapped file, so it is
+// only valid while this object is alive.
+struct CachedMeshBatch
+{
+    MappedFile file;
+    // Only used when the batch could not be written to the cache
+    MeshBatch generated;
+    PackedVertices packed;
+    PackedMeshBatchView view;
+};
+
+// Directory of binary meshes keyed by generator parameters
+class MeshCache
+{
+public:
+    explicit MeshCache(std::filesystem::path directory)
+        : mDirectory(std::move(directory))
+    {
+    }
+
+    std::filesystem::path filePath(MeshCacheKey const &key) const
+    {
+        return mDirectory / key.fileName();
+    }
+
+    // Map the cached mesh, returns false on a cache miss or an out of date file
+    bool load(MeshCacheKey const &key, CachedMesh &cachedMesh) const
+    {
+        MappedFile file;
+        MeshCacheHeader header;
+        if (!open(key, sizeof(MeshVertex), file, header) || header.meshCount != 0)
+        {
+            return false;
+        }
+
+        MeshView view;
+        view.vertexCount = (std::size_t)header.vertexCount;
+        view.indexCount = (std::size_t)header.indexCount;
+        view.indexType = header.indexType;
+        view.vertices = reinterpret_cast<const MeshVertex *>(file.data() + header.vertexOffset);
+        view.indices = file.data() + header.indexOffset;
+
+        cachedMesh.generated = Mesh();
+        cachedMesh.file = std::move(file);
+        cachedMesh.view = view;
+        return true;
+    }
+
+    // Map the cached packed batch, returns false on a cache miss or an out of date file
+    bool loadBatch(MeshCacheKey const &key, CachedMeshBatch &cachedBatch) const
+    {
+        MappedFile file;
+        MeshCacheHeader header;
+        if (!open(key, sizeof(PackedVertex), file, header))
+        {
+            return false;
+        }
+
+        PackedMeshBatchView view;
+        view.layout.indexType = header.indexType;
+        view.layout.vertexCount = (std::size_t)header.vertexCount;
+        view.layout.indexCount = (std::size_t)header.indexCount;
+        view.bounds.center = glm::vec3(header.boundsCenter[0], header.boundsCenter[1], header.boundsCenter[2]);
+        view.bounds.halfExtent = glm::vec3(header.boundsHalfExtent[0], header.boundsHalfExtent[1], header.boundsHalfExtent[2]);
+        for (std::uint64_t i = 0; i < header.meshCount; ++i)
+        {
+            MeshCacheBatchedMesh entry;
+            std::memcpy(&entry, file.data() + header.meshOffset + i * sizeof(entry), sizeof(entry));
+            if (entry.firstIndex + entry.indexCount > header.indexCount || entry.baseVertex < 0 || (std::uint64_t)entry.baseVertex > header.vertexCount)
+            {
+                return false;
+            }
+            view.layout.meshes.push_back({(std::size_t)entry.firstIndex, (std::size_t)entry.indexCount, (int)entry.baseVertex});
+        }
+        view.vertices = reinterpret_cast<const PackedVertex *>(file.data() + header.vertexOffset);
+        view.indices = file.data() + header.indexOffset;
+
+        cachedBatch.generated = MeshBatch();
+        cachedBatch.packed = PackedVertices();
+        cachedBatch.file = std::move(file);
+        cachedBatch.view = std::move(view);
+        return true;
+    }
+
+    // Write the mesh to the cache, returns false if the file could not be written
+    bool store(MeshCacheKey const &key, MeshView const &view) const
+    {
+        MeshCacheHeader header;
+        header.indexType = view.indexType;
+        header.vertexCount = view.vertexCount;
+        header.indexCount = view.indexCount;
+        return write(key, header, view.vertices, view.indices, {});
+    }
+
+    // Write the packed batch to the cache, returns false if the file could not be written
+    bool storeBatch(MeshCacheKey const &key, PackedMeshBatchView const &view) const
+    {
+        MeshCacheHeader header;
+        header.vertexStride = sizeof(PackedVertex);
+        header.indexType = view.layout.indexType;
+        header.vertexCount = view.layout.vertexCount;
+        header.indexCount = view.layout.indexCount;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            header.boundsCenter[axis] = view.bounds.center[axis];
+            header.boundsHalfExtent[axis] = view.bounds.halfExtent[axis];
+        }
+        std::vector<MeshCacheBatchedMesh> meshes;
+        for (auto const &batched : view.layout.meshes)
+        {
+            meshes.push_back({batched.firstIndex, batched.indexCount, batched.baseVertex});
+        }
+        return write(key, header, view.vertices, view.indices, meshes);
+    }
+
+    // Map the cached mesh, generating and storing it first on a cache miss
+    CachedMesh loadOrCreate(MeshCacheKey const &key, std::function<Mesh()> const &generator) const
+    {
+        CachedMesh cachedMesh;
+        if (load(key, cachedMesh))
+        {
+            return cachedMesh;
+        }
+
+        Mesh mesh = generator();
+        if (store(key, makeMeshView(mesh)) && load(key, cachedMesh))
+        {
+            return cachedMesh;
+        }
+
+        // Cache directory is not writable, serve the generated mesh directly
+        cachedMesh.generated = std::move(mesh);
+        cachedMesh.view = makeMeshView(cachedMesh.generated);
+        return cachedMesh;
+    }
+
+    // Map the cached packed batch, generating, packing and storing it first on a cache miss.
+    // The key must cover the packing as well as the generators.
+    CachedMeshBatch loadOrCreateBatch(MeshCacheKey const &key, std::function<MeshBatch()> const &generator) const
+    {
+        CachedMeshBatch cachedBatch;
+        if (loadBatch(key, cachedBatch))
+        {
+            return cachedBatch;
+        }
+
+        MeshBatch batch = generator();
+        PackedVertices packed = packVertices(batch.mesh.vertices.data(), batch.mesh.vertices.size());
+        if (storeBatch(key, makePackedMeshBatchView(batch, packed)) && loadBatch(key, cachedBatch))
+        {
+            return cachedBatch;
+        }
+
+        // Cache directory is not writable, serve the generated batch directly
+        cachedBatch.generated = std::move(batch);
+        cachedBatch.packed = std::move(packed);
+        cachedBatch.view = makePackedMeshBatchView(cachedBatch.generated, cachedBatch.packed);
+        return cachedBatch;
+    }
+
+private:
+    // Map the file of the key and check the header and the block bounds, for vertices of the given stride
+    bool open(MeshCacheKey const &key, std::uint32_t vertexStride, MappedFile &file, MeshCacheHeader &header) const
+    {
+        if (!file.open(filePath(key).string()) || file.size() < sizeof(MeshCacheHeader))
+        {
+            return false;
+        }
+
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != MeshCacheHeader::magicValue || header.version != MeshCacheHeader::currentVersion ||
+            header.keyHash != key.hash() || header.vertexStride != vertexStride ||
+            (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT))
+        {
+            return false;
+        }
+
+        const std::uint64_t indexSize = GL_UNSIGNED_INT == header.indexType ? sizeof(unsigned int) : sizeof(unsigned short);
+        return header.vertexOffset % MeshCacheHeader::alignment == 0 && header.indexOffset % MeshCacheHeader::alignment == 0 &&
+               header.meshOffset % MeshCacheHeader::alignment == 0 &&
+               header.vertexOffset + header.vertexCount * vertexStride <= file.size() &&
+               header.indexOffset + header.indexCount * indexSize <= file.size() &&
+               header.meshOffset + header.meshCount * sizeof(MeshCacheBatchedMesh) <= file.size();
+    }
+
+    // Write the blocks after the header, which only needs the stride, index type, counts and bounds
+    bool write(MeshCacheKey const &key, MeshCacheHeader header, const void *vertices, const void *indices,
+               std::vector<MeshCacheBatchedMesh> const &meshes) const
+    {
+        std::error_code error;
+        std::filesystem::create_directories(mDirectory, error);
+
+        const std::uint64_t vertexDataSize = header.vertexCount * header.vertexStride;
+        const std::uint64_t indexDataSize = header.indexCount * (GL_UNSIGNED_INT == header.indexType ? sizeof(unsigned int) : sizeof(unsigned short));
+        header.keyHash = key.hash();
+        header.meshCount = meshes.size();
+        header.vertexOffset = alignMeshCacheOffset(sizeof(MeshCacheHeader));
+        header.indexOffset = alignMeshCacheOffset(header.vertexOffset + vertexDataSize);
+        header.meshOffset = meshes.empty() ? 0 : alignMeshCacheOffset(header.indexOffset + indexDataSize);
+
+        // Write next to the final file and rename, so a reader never maps a partial file
+        auto finalPath = filePath(key);
+        auto temporaryPath = finalPath;
+        temporaryPath += ".tmp";
+        {
+            std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+            if (!stream)
+            {
+                return false;
+            }
+            const char padding[MeshCacheHeader::alignment] = {};
+            stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            stream.write(padding, (std::streamsize)(header.vertexOffset - sizeof(header)));
+            stream.write(static_cast<const char *>(vertices), (std::streamsize)vertexDataSize);
+            stream.write(padding, (std::streamsize)(header.indexOffset - header.vertexOffset - vertexDataSize));
+            stream.write(static_cast<const char *>(indices), (std::streamsize)indexDataSize);
+            if (!meshes.empty())
+            {
+                stream.write(padding, (std::streamsize)(header.meshOffset - header.indexOffset - indexDataSize));
+                stream.write(reinterpret_cast<const char *>(meshes.data()), (std::streamsize)(meshes.size() * sizeof(MeshCacheBatchedMesh)));
+            }
+            if (!stream)
+            {
+                stream.close();
+                std::filesystem::remove(temporaryPath, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporaryPath, finalPath, error);
+        return !error;
+    }
+
+    std::filesystem::path mDirectory;
+};
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "MeshBatch.h"
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+#include <glm/trigonometric.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// One level of detail inside a mesh batch.
+// Indices are local to the level, draw with glDrawElementsBaseVertex.
+struct LodLevel
+{
+    std::size_t firstIndex = 0;
+    std::size_t indexCount = 0;
+    int baseVertex = 0;
+    // Maximum distance between the tessellation and the exact surface, in object space
+    float geometricError = 0.0f;
+
+    std::size_t triangleCount() const
+    {
+        return indexCount / 3;
+    }
+};
+
+// Chain of tessellations of the same body, finest level first, as index ranges of a mesh batch
+struct LodChain
+{
+    std::vector<LodLevel> levels;
+    float boundingRadius = 1.0f;
+    // Index size of the batch the levels are in
+    std::size_t indexSize = sizeof(unsigned short);
+
+    // Byte offset of the level's first index, for the indices argument of glDrawElementsBaseVertex
+    const void *indexOffset(int level) const
+    {
+        return (const void *)(levels[level].firstIndex * indexSize);
+    }
+};
+
+// Largest distance between a UV sphere tessellation and the analytic sphere.
+// Each facet spans 2*PI/numSegmentsInWidth around and PI/numSegmentsInHeight from pole to pole;
+// the error is the sagitta of the wider of the two arcs.
+inline float sphereTessellationError(float radius, int numSegmentsInWidth, int numSegmentsInHeight)
+{
+    const float halfAngle = std::max(glm::pi<float>() / numSegmentsInWidth, glm::pi<float>() / (2.0f * numSegmentsInHeight));
+    return radius * (1.0f - std::cos(halfAngle));
+}
+
+// Levels are the meshes of the batch from firstMesh on, one per geometric error, ordered from finest
+// to coarsest. Only their index ranges are taken, the geometry stays in the batch's buffers.
+inline LodChain buildLodChain(MeshBatchLayout const &batch, std::size_t firstMesh, std::vector<float> const &geometricErrors,
+                              float boundingRadius)
+{
+    if (geometricErrors.empty() || firstMesh + geometricErrors.size() > batch.meshes.size())
+    {
+        throw std::invalid_argument("LOD chain needs one mesh of the batch per geometric error");
+    }
+
+    LodChain chain;
+    chain.boundingRadius = boundingRadius;
+    chain.indexSize = batch.indexSize();
+    for (std::size_t levelIndex = 0; levelIndex < geometricErrors.size(); ++levelIndex)
+    {
+        auto const &batched = batch.meshes[firstMesh + levelIndex];
+        LodLevel lodLevel;
+        lodLevel.firstIndex = batched.firstIndex;
+        lodLevel.indexCount = batched.indexCount;
+        lodLevel.baseVertex = batched.baseVertex;
+        lodLevel.geometricError = geometricErrors[levelIndex];
+        chain.levels.push_back(lodLevel);
+    }
+    return chain;
+}
+
+// Radius in pixels of a bounding sphere centred at the object origin.
+// objectToClip is the full transformation applied in the vertex shader.
+inline float projectedSphereRadius(glm::mat4 const &objectToClip, float objectRadius, glm::vec2 const &viewportSize)
+{
+    const float w = objectToClip[3][3];
+    if (w <= std::numeric_limits<float>::epsilon())
+    {
+        // Centre is behind the eye, keep the finest level
+        return std::numeric_limits<float>::max();
+    }
+    const glm::vec2 halfViewport = 0.5f * viewportSize;
+    float pixelsPerUnit = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        glm::vec2 axisInPixels(objectToClip[axis][0] * halfViewport.x, objectToClip[axis][1] * halfViewport.y);
+        pixelsPerUnit = std::max(pixelsPerUnit, glm::length(axisInPixels));
+    }
+    return objectRadius * pixelsPerUnit / w;
+}
+
+struct LodSettings
+{
+    // Largest allowed screen-space error, in pixels
+    float pixelErrorThreshold = 0.5f;
+    // Switching to a coarser level needs its error to be this fraction below the threshold
+    float hysteresis = 0.25f;
+};
+
+// Pick the coarsest level whose projected error stays under the threshold.
+// A finer level is taken as soon as it is needed, a coarser one only once it is
+// clearly good enough, so bodies near a boundary do not pop between levels.
+inline int selectLodLevel(LodChain const &chain, float projectedRadius, LodSettings const &settings, int currentLevel)
+{
+    const float pixelsPerUnit = projectedRadius / chain.boundingRadius;
+    const int numLevels = (int)chain.levels.size();
+    currentLevel = std::min(std::max(currentLevel, 0), numLevels - 1);
+
+    int level = 0;
+    for (int candidate = numLevels - 1; candidate >= 0; --candidate)
+    {
+        if (chain.levels[candidate].geometricError * pixelsPerUnit <= settings.pixelErrorThreshold)
+        {
+            level = candidate;
+            break;
+        }
+    }
+
+    if (level > currentLevel)
+    {
+        // Coarsen only to a level that also passes the stricter threshold
+        const float strictThreshold = settings.pixelErrorThreshold * (1.0f - settings.hysteresis);
+        while (level > currentLevel && chain.levels[level].geometricError * pixelsPerUnit > strictThreshold)
+        {
+            --level;
+        }
+    }
+    return level;
+}
+
+// Triangle counts for one frame
+struct LodStatistics
+{
+    std::size_t drawCount = 0;
+    std::size_t trianglesDrawn = 0;
+    // Triangles that would have been drawn with the finest level everywhere
+    std::size_t trianglesFull = 0;
+    std::vector<std::size_t> drawsPerLevel;
+
+    void reset()
+    {
+        drawCount = trianglesDrawn = trianglesFull = 0;
+        std::fill(drawsPerLevel.begin(), drawsPerLevel.end(), 0);
+    }
+
+    void record(LodChain const &chain, int level)
+    {
+        drawsPerLevel.resize(std::max(drawsPerLevel.size(), chain.levels.size()));
+        ++drawsPerLevel[level];
+        ++drawCount;
+        trianglesDrawn += chain.levels[level].triangleCount();
+        trianglesFull += chain.levels[0].triangleCount();
+    }
+
+    std::size_t trianglesSaved() const
+    {
+        return trianglesFull - trianglesDrawn;
+    }
+};
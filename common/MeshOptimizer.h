@@ -0,0 +1,396 @@
+#pragma once
+
+#include "Mesh.h"
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+// Version of the optimizers' output, bump it whenever they change so cached meshes are regenerated
+constexpr std::uint32_t meshOptimizerVersion = 1;
+
+// Post-transform cache behaviour of an index buffer
+struct VertexCacheStatistics
+{
+    std::size_t triangleCount = 0;
+    std::size_t vertexCount = 0;
+    std::size_t cacheMisses = 0;
+
+    // Average cache miss ratio: transformed vertices per triangle, 0.5 is the ideal for large grids
+    float acmr() const
+    {
+        return triangleCount ? (float)cacheMisses / triangleCount : 0.0f;
+    }
+
+    // Average transform to vertex ratio: 1.0 means every vertex is transformed once
+    float atvr() const
+    {
+        return vertexCount ? (float)cacheMisses / vertexCount : 0.0f;
+    }
+};
+
+enum class VertexCacheModel
+{
+    Fifo,
+    Lru
+};
+
+// Simulate a post-transform vertex cache of the given size over the index buffer
+template <typename Index>
+VertexCacheStatistics analyzeVertexCache(std::vector<Index> const &indices, std::size_t vertexCount, std::size_t cacheSize, VertexCacheModel model)
+{
+    VertexCacheStatistics statistics;
+    statistics.triangleCount = indices.size() / 3;
+
+    // FIFO: a vertex is cached while fewer than cacheSize misses happened since it was loaded.
+    // LRU: a vertex is cached while fewer than cacheSize distinct vertices were used since its last use.
+    std::vector<std::size_t> timestamp(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    std::vector<Index> lruCache;
+    lruCache.reserve(cacheSize + 1);
+    std::size_t time = cacheSize + 1;
+
+    for (auto index : indices)
+    {
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++statistics.vertexCount;
+        }
+        if (VertexCacheModel::Fifo == model)
+        {
+            if (time - timestamp[index] > cacheSize)
+            {
+                timestamp[index] = time++;
+                ++statistics.cacheMisses;
+            }
+        }
+        else
+        {
+            auto found = std::find(lruCache.begin(), lruCache.end(), index);
+            if (found == lruCache.end())
+            {
+                ++statistics.cacheMisses;
+                if (lruCache.size() == cacheSize)
+                {
+                    lruCache.pop_back();
+                }
+            }
+            else
+            {
+                lruCache.erase(found);
+            }
+            lruCache.insert(lruCache.begin(), index);
+        }
+    }
+    return statistics;
+}
+
+namespace detail
+{
+    constexpr std::size_t forsythCacheSize = 32;
+
+    // Vertex score of Forsyth's "Linear-Speed Vertex Cache Optimisation"
+    inline float forsythVertexScore(int cachePosition, unsigned int remainingTriangles)
+    {
+        if (0 == remainingTriangles)
+        {
+            return -1.0f;
+        }
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // Vertices of the triangle just emitted get a fixed score, so the order inside it does not matter
+            if (cachePosition < 3)
+            {
+                score = 0.75f;
+            }
+            else
+            {
+                const float scaler = 1.0f / (forsythCacheSize - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+            }
+        }
+        // Favour vertices with few triangles left, so lone triangles are not left behind
+        score += 2.0f / std::sqrt((float)remainingTriangles);
+        return score;
+    }
+}
+
+// Reorder the triangles for the GPU post-transform vertex cache (Forsyth's algorithm)
+template <typename Index>
+void optimizeVertexCache(std::vector<Index> &indices, std::size_t vertexCount)
+{
+    using detail::forsythCacheSize;
+    const std::size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // Triangles using each vertex, as offsets into one adjacency array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (auto index : indices)
+    {
+        ++remaining[index];
+    }
+    std::vector<std::size_t> adjacencyOffset(vertexCount + 1, 0);
+    for (std::size_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        adjacencyOffset[vertex + 1] = adjacencyOffset[vertex] + remaining[vertex];
+    }
+    std::vector<unsigned int> adjacency(indices.size());
+    {
+        std::vector<std::size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                adjacency[fill[indices[triangle * 3 + corner]]++] = (unsigned int)triangle;
+            }
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for (std::size_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        vertexScore[vertex] = detail::forsythVertexScore(-1, remaining[vertex]);
+    }
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        triangleScore[triangle] = vertexScore[indices[triangle * 3]] + vertexScore[indices[triangle * 3 + 1]] + vertexScore[indices[triangle * 3 + 2]];
+    }
+
+    std::vector<Index> output;
+    output.reserve(indices.size());
+    // The cache holds three extra entries for the vertices of the triangle being emitted
+    std::vector<Index> cache, nextCache;
+    cache.reserve(forsythCacheSize + 3);
+    nextCache.reserve(forsythCacheSize + 3);
+
+    std::size_t bestTriangle = (std::size_t)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+    std::size_t scanCursor = 0;
+
+    for (std::size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        if (bestTriangle >= triangleCount)
+        {
+            // Nothing left around the cache, continue with the next triangle in input order
+            while (emitted[scanCursor])
+            {
+                ++scanCursor;
+            }
+            bestTriangle = scanCursor;
+        }
+
+        emitted[bestTriangle] = true;
+        const Index *corners = &indices[bestTriangle * 3];
+        nextCache.assign(corners, corners + 3);
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            output.push_back(corners[corner]);
+
+            // Remove the triangle from the vertex adjacency, so only live triangles are scored
+            auto vertex = corners[corner];
+            auto begin = adjacency.begin() + adjacencyOffset[vertex];
+            auto end = begin + remaining[vertex];
+            std::iter_swap(std::find(begin, end, (unsigned int)bestTriangle), end - 1);
+            --remaining[vertex];
+        }
+        for (auto vertex : cache)
+        {
+            if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+            {
+                nextCache.push_back(vertex);
+            }
+        }
+        std::swap(cache, nextCache);
+
+        // Rescore the cached vertices and every live triangle touching them
+        for (std::size_t position = 0; position < cache.size(); ++position)
+        {
+            auto vertex = cache[position];
+            cachePosition[vertex] = position < forsythCacheSize ? (int)position : -1;
+            vertexScore[vertex] = detail::forsythVertexScore(cachePosition[vertex], remaining[vertex]);
+        }
+        if (cache.size() > forsythCacheSize)
+        {
+            cache.resize(forsythCacheSize);
+        }
+
+        float bestScore = -1.0f;
+        bestTriangle = triangleCount;
+        for (auto vertex : cache)
+        {
+            for (std::size_t i = 0; i < remaining[vertex]; ++i)
+            {
+                auto triangle = adjacency[adjacencyOffset[vertex] + i];
+                const Index *triangleCorners = &indices[(std::size_t)triangle * 3];
+                float score = vertexScore[triangleCorners[0]] + vertexScore[triangleCorners[1]] + vertexScore[triangleCorners[2]];
+                triangleScore[triangle] = score;
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTriangle = triangle;
+                }
+            }
+        }
+    }
+    indices.swap(output);
+}
+
+// Reorder clusters of triangles so the ones facing away from the mesh centre come first,
+// which lets early depth testing reject more of the hidden fragments (Sander et al.,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+// Run it after optimizeVertexCache: clusters are cut where the cache order restarts or where
+// splitting keeps the cluster ACMR within threshold times the unsplit one, so the cache gain is kept.
+template <typename Index>
+void optimizeOverdraw(std::vector<Index> &indices, std::vector<MeshVertex> const &vertices, float threshold = 1.05f, std::size_t cacheSize = 16)
+{
+    const std::size_t triangleCount = indices.size() / 3;
+    if (triangleCount < 2)
+    {
+        return;
+    }
+
+    // Hard boundaries: triangles where all three vertices miss the FIFO cache
+    std::vector<std::size_t> clusterStarts;
+    std::vector<unsigned char> misses(triangleCount, 0);
+    {
+        std::vector<std::size_t> timestamp(vertices.size(), 0);
+        std::size_t time = cacheSize + 1;
+        for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+        {
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                auto vertex = indices[triangle * 3 + corner];
+                if (time - timestamp[vertex] > cacheSize)
+                {
+                    timestamp[vertex] = time++;
+                    ++misses[triangle];
+                }
+            }
+            if (0 == triangle || 3 == misses[triangle])
+            {
+                clusterStarts.push_back(triangle);
+            }
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    // Soft boundaries: split a hard cluster as soon as the part so far, simulated from a cold cache,
+    // is about as cache friendly as the whole cluster
+    std::vector<std::size_t> softStarts;
+    {
+        std::vector<std::size_t> timestamp(vertices.size(), 0);
+        std::size_t time = cacheSize + 1;
+        for (std::size_t cluster = 0; cluster + 1 < clusterStarts.size(); ++cluster)
+        {
+            const std::size_t begin = clusterStarts[cluster], end = clusterStarts[cluster + 1];
+            std::size_t clusterMisses = 0;
+            for (std::size_t triangle = begin; triangle < end; ++triangle)
+            {
+                clusterMisses += misses[triangle];
+            }
+            const float partThreshold = threshold * clusterMisses / (end - begin);
+
+            softStarts.push_back(begin);
+            // Moving the time forward by more than the cache size empties the cache
+            time += cacheSize + 1;
+            std::size_t partMisses = 0, partTriangles = 0;
+            for (std::size_t triangle = begin; triangle < end; ++triangle)
+            {
+                for (int corner = 0; corner < 3; ++corner)
+                {
+                    auto vertex = indices[triangle * 3 + corner];
+                    if (time - timestamp[vertex] > cacheSize)
+                    {
+                        timestamp[vertex] = time++;
+                        ++partMisses;
+                    }
+                }
+                ++partTriangles;
+                if (triangle + 1 < end && partMisses <= partThreshold * partTriangles)
+                {
+                    softStarts.push_back(triangle + 1);
+                    time += cacheSize + 1;
+                    partMisses = partTriangles = 0;
+                }
+            }
+        }
+    }
+    softStarts.push_back(triangleCount);
+
+    auto position = [&](Index index)
+    {
+        return glm::vec3(vertices[index].position[0], vertices[index].position[1], vertices[index].position[2]);
+    };
+
+    // Area weighted centroid of the whole mesh
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (std::size_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        auto p0 = position(indices[triangle * 3]), p1 = position(indices[triangle * 3 + 1]), p2 = position(indices[triangle * 3 + 2]);
+        float area = glm::length(glm::cross(p1 - p0, p2 - p0));
+        meshCentroid += area * (p0 + p1 + p2) / 3.0f;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+    {
+        meshCentroid /= meshArea;
+    }
+
+    // Sort key: how much the cluster faces away from the mesh centre
+    const std::size_t clusterCount = softStarts.size() - 1;
+    std::vector<float> sortKey(clusterCount);
+    for (std::size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (std::size_t triangle = softStarts[cluster]; triangle < softStarts[cluster + 1]; ++triangle)
+        {
+            auto p0 = position(indices[triangle * 3]), p1 = position(indices[triangle * 3 + 1]), p2 = position(indices[triangle * 3 + 2]);
+            glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(areaNormal);
+            centroid += triangleArea * (p0 + p1 + p2) / 3.0f;
+            normal += areaNormal;
+            area += triangleArea;
+        }
+        if (area > 0.0f)
+        {
+            centroid /= area;
+        }
+        float normalLength = glm::length(normal);
+        sortKey[cluster] = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+    }
+
+    std::vector<std::size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b)
+                     { return sortKey[a] > sortKey[b]; });
+
+    std::vector<Index> output;
+    output.reserve(indices.size());
+    for (auto cluster : order)
+    {
+        output.insert(output.end(), indices.begin() + softStarts[cluster] * 3, indices.begin() + softStarts[cluster + 1] * 3);
+    }
+    indices.swap(output);
+}
+
+// Run the vertex cache and overdraw passes on a mesh, before it is uploaded or cached
+inline void optimizeMesh(Mesh &mesh, float overdrawThreshold = 1.05f)
+{
+    visitIndices(mesh, [&](auto &indices)
+                 {
+        optimizeVertexCache(indices, mesh.vertices.size());
+        optimizeOverdraw(indices, mesh.vertices, overdrawThreshold); });
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "GlExtensions.h"
+#include "InstancedRendering.h"
+#include "JobSystem.h"
+#include "MeshBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// GL 4.0 / 4.3 (ARB_draw_indirect, ARB_multi_draw_indirect), not part of the GL 3.3 loader
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_ARB_multi_draw_indirect
+typedef void(APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+#endif
+
+// Layout read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand must match the GL layout");
+
+// One object of a pass: which mesh of the batch, and its instance attributes
+struct MultiDrawObject
+{
+    std::size_t mesh;
+    InstanceData instance;
+};
+
+struct MultiDrawStatistics
+{
+    std::size_t objects = 0;
+    std::size_t commands = 0;
+    std::size_t drawCalls = 0;
+    double buildMilliseconds = 0.0;
+};
+
+// Draws every object of a pass over the meshes of a batch with one glMultiDrawElementsIndirect.
+// Objects are grouped by mesh into one instanced command each, baseInstance pointing at the group
+// in the instance buffer. Without multi-draw indirect, or without base instances for it to honour,
+// the commands are replayed one by one.
+class MultiDrawPass
+{
+public:
+    // Objects per job of the grouping
+    static constexpr std::size_t chunkSize = 16384;
+
+    MultiDrawPass() = default;
+    MultiDrawPass(MultiDrawPass const &) = delete;
+    MultiDrawPass &operator=(MultiDrawPass const &) = delete;
+
+    ~MultiDrawPass()
+    {
+        release();
+    }
+
+    // getProcAddress (glfwGetProcAddress) finds glMultiDrawElementsIndirect on GL 4.3 or with ARB_multi_draw_indirect.
+    // The commands also need a non-zero baseInstance, GL 4.2 or ARB_base_instance.
+    void create(GLADloadproc getProcAddress, bool allowIndirect = true)
+    {
+        release();
+        bool multiDrawIndirect = hasGlVersion(4, 3) || hasGlExtension("GL_ARB_multi_draw_indirect");
+        bool baseInstance = hasGlVersion(4, 2) || hasGlExtension("GL_ARB_base_instance");
+        if (allowIndirect && getProcAddress && multiDrawIndirect && baseInstance)
+        {
+            mMultiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTPROC)getProcAddress("glMultiDrawElementsIndirect");
+        }
+        if (mMultiDrawElementsIndirect)
+        {
+            glGenBuffers(1, &mIndirectBuffer);
+        }
+    }
+
+    void release()
+    {
+        if (0 < mIndirectBuffer)
+        {
+            glDeleteBuffers(1, &mIndirectBuffer);
+        }
+        mIndirectBuffer = 0;
+        mMultiDrawElementsIndirect = nullptr;
+        mInstanceBuffer.release();
+    }
+
+    // Groups the objects by mesh with a parallel counting sort: per chunk histograms, one prefix
+    // sum over meshes and chunks, then every chunk scatters its objects to their slots.
+    // Objects keep their order within a mesh.
+    void build(MeshBatchLayout const &batch, std::vector<MultiDrawObject> const &objects, JobSystem *jobs = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        const std::size_t meshCount = batch.meshes.size();
+        const std::size_t chunkCount = (objects.size() + chunkSize - 1) / chunkSize;
+        mChunkOffsets.assign(chunkCount * meshCount, 0);
+        mInstances.resize(objects.size());
+
+        forChunks(jobs, chunkCount, [&](std::size_t chunk)
+                  {
+            std::size_t *counts = &mChunkOffsets[chunk * meshCount];
+            std::size_t end = std::min(objects.size(), (chunk + 1) * chunkSize);
+            for (std::size_t i = chunk * chunkSize; i < end; i++)
+            {
+                counts[objects[i].mesh]++;
+            } });
+
+        // Offsets in mesh major order, so each mesh ends up contiguous
+        mCommands.clear();
+        std::size_t offset = 0;
+        for (std::size_t mesh = 0; mesh < meshCount; mesh++)
+        {
+            std::size_t first = offset;
+            for (std::size_t chunk = 0; chunk < chunkCount; chunk++)
+            {
+                std::size_t count = mChunkOffsets[chunk * meshCount + mesh];
+                mChunkOffsets[chunk * meshCount + mesh] = offset;
+                offset += count;
+            }
+            if (offset > first)
+            {
+                auto const &batched = batch.meshes[mesh];
+                mCommands.push_back({(unsigned int)batched.indexCount, (unsigned int)(offset - first), (unsigned int)batched.firstIndex,
+                                     batched.baseVertex, (unsigned int)first});
+            }
+        }
+
+        forChunks(jobs, chunkCount, [&](std::size_t chunk)
+                  {
+            std::size_t *slots = &mChunkOffsets[chunk * meshCount];
+            std::size_t end = std::min(objects.size(), (chunk + 1) * chunkSize);
+            for (std::size_t i = chunk * chunkSize; i < end; i++)
+            {
+                mInstances[slots[objects[i].mesh]++] = objects[i].instance;
+            } });
+
+        mStatistics = MultiDrawStatistics();
+        mStatistics.objects = objects.size();
+        mStatistics.commands = mCommands.size();
+        mStatistics.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Draws the pass with the program in use and the vertex array of the batch bound,
+    // locations are the instance attributes of that program
+    void submit(MeshBatchLayout const &batch, InstanceAttributeLocations const &locations)
+    {
+        mInstanceBuffer.upload(mInstances.data(), mInstances.size());
+        mStatistics.drawCalls = 0;
+        if (mCommands.empty())
+        {
+            return;
+        }
+        if (mMultiDrawElementsIndirect)
+        {
+            // baseInstance offsets the instanced attributes, they are bound once from the start
+            mInstanceBuffer.bindAttributes(locations);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mIndirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)(mCommands.size() * sizeof(DrawElementsIndirectCommand)), mCommands.data(), GL_STREAM_DRAW);
+            mMultiDrawElementsIndirect(GL_TRIANGLES, batch.indexType, nullptr, (GLsizei)mCommands.size(), 0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            mStatistics.drawCalls = 1;
+            return;
+        }
+        for (auto const &command : mCommands)
+        {
+            mInstanceBuffer.bindAttributes(locations, command.baseInstance);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, (GLsizei)command.count, batch.indexType,
+                                              (const void *)(command.firstIndex * batch.indexSize()), (GLsizei)command.instanceCount, command.baseVertex);
+            mStatistics.drawCalls++;
+        }
+    }
+
+    bool usesMultiDrawIndirect() const
+    {
+        return nullptr != mMultiDrawElementsIndirect;
+    }
+
+    std::vector<DrawElementsIndirectCommand> const &commands() const
+    {
+        return mCommands;
+    }
+
+    // Instance attributes in draw order
+    std::vector<InstanceData> const &instances() const
+    {
+        return mInstances;
+    }
+
+    MultiDrawStatistics const &statistics() const
+    {
+        return mStatistics;
+    }
+
+private:
+    template <typename Fn>
+    static void forChunks(JobSystem *jobs, std::size_t chunkCount, Fn &&fn)
+    {
+        auto range = [&](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t chunk = begin; chunk < end; chunk++)
+            {
+                fn(chunk);
+            }
+        };
+        if (jobs)
+        {
+            jobs->parallelFor(0, chunkCount, 1, range);
+        }
+        else
+        {
+            range(0, chunkCount);
+        }
+    }
+
+    PFNGLMULTIDRAWELEMENTSINDIRECTPROC mMultiDrawElementsIndirect = nullptr;
+    unsigned int mIndirectBuffer = 0;
+    InstanceBuffer mInstanceBuffer;
+    std::vector<DrawElementsIndirectCommand> mCommands;
+    std::vector<InstanceData> mInstances;
+    // Per chunk and mesh: object count, then the next slot
+    std::vector<std::size_t> mChunkOffsets;
+    MultiDrawStatistics mStatistics;
+};
@@ -0,0 +1,607 @@
+#pragma once
+
+#include "JobSystem.h"
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Gravitational N-body simulation in units where G = 1.
+// Bodies are structure of arrays; every step builds a Barnes-Hut octree over them and
+// integrates with the kick-drift-kick leapfrog, which is symplectic: energy errors stay
+// bounded instead of drifting. The simulation runs at a fixed time step, the renderer
+// interpolates between the last two states.
+
+struct NBodySystem
+{
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> ax, ay, az;
+    std::vector<float> mass;
+
+    std::size_t size() const
+    {
+        return mass.size();
+    }
+
+    std::size_t addBody(glm::vec3 const &position, glm::vec3 const &velocity, float bodyMass)
+    {
+        x.push_back(position.x);
+        y.push_back(position.y);
+        z.push_back(position.z);
+        vx.push_back(velocity.x);
+        vy.push_back(velocity.y);
+        vz.push_back(velocity.z);
+        ax.push_back(0.0f);
+        ay.push_back(0.0f);
+        az.push_back(0.0f);
+        mass.push_back(bodyMass);
+        return mass.size() - 1;
+    }
+
+    glm::vec3 position(std::size_t body) const
+    {
+        return glm::vec3(x[body], y[body], z[body]);
+    }
+
+    glm::vec3 velocity(std::size_t body) const
+    {
+        return glm::vec3(vx[body], vy[body], vz[body]);
+    }
+};
+
+struct GravitySettings
+{
+    // Opening angle: a cell is used as a point mass when its size / distance is below theta
+    float theta = 0.5f;
+    // Plummer softening length, keeps close encounters finite
+    float softening = 0.01f;
+};
+
+namespace detail
+{
+    // Spreads the lowest 21 bits of v so that there are two zero bits between each of them
+    inline std::uint64_t spreadBits(std::uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    struct MortonKey
+    {
+        std::uint64_t code;
+        unsigned int body;
+
+        bool operator<(MortonKey const &other) const
+        {
+            return code < other.code;
+        }
+    };
+
+    // Sorts chunks in parallel, then merges pairs of chunks in parallel rounds
+    inline void parallelSort(std::vector<MortonKey> &keys, JobSystem *jobs)
+    {
+        std::size_t chunkCount = jobs ? jobs->threadCount() * 2 : 1;
+        if (chunkCount <= 1 || keys.size() < 1 << 15)
+        {
+            std::sort(keys.begin(), keys.end());
+            return;
+        }
+        std::size_t chunkSize = (keys.size() + chunkCount - 1) / chunkCount;
+        jobs->parallelFor(0, chunkCount, 1, [&](std::size_t begin, std::size_t end)
+                          {
+            for (std::size_t chunk = begin; chunk < end; chunk++)
+            {
+                std::size_t first = std::min(keys.size(), chunk * chunkSize);
+                std::sort(keys.begin() + first, keys.begin() + std::min(keys.size(), first + chunkSize));
+            } });
+        for (std::size_t width = chunkSize; width < keys.size(); width *= 2)
+        {
+            std::size_t pairCount = (keys.size() + 2 * width - 1) / (2 * width);
+            jobs->parallelFor(0, pairCount, 1, [&](std::size_t begin, std::size_t end)
+                              {
+                for (std::size_t pair = begin; pair < end; pair++)
+                {
+                    std::size_t first = pair * 2 * width;
+                    std::size_t middle = std::min(keys.size(), first + width);
+                    std::size_t last = std::min(keys.size(), first + 2 * width);
+                    std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+                } });
+        }
+    }
+}
+
+// Octree over the bodies, built from their Morton codes.
+// Bodies are copied in Morton order, so the bodies of every cell are contiguous and the
+// children of a cell are found by binary search on the codes. The cells of the first levels
+// are built serially, the subtrees below them in parallel into separate arrays that are then
+// appended to the tree.
+class BarnesHutTree
+{
+public:
+    static constexpr unsigned int maxLeafSize = 8;
+    static constexpr int maxLevel = 21;
+
+    struct Cell
+    {
+        glm::vec3 centerOfMass{0.0f};
+        float mass = 0.0f;
+        glm::vec3 center{0.0f};
+        float halfSize = 0.0f;
+        unsigned int firstChild = 0;
+        unsigned int childCount = 0;
+        unsigned int firstBody = 0;
+        unsigned int bodyCount = 0;
+    };
+
+    void build(NBodySystem const &system, JobSystem *jobs = nullptr)
+    {
+        std::size_t count = system.size();
+        mCells.clear();
+        mOrder.resize(count);
+        mKeys.resize(count);
+        mX.resize(count);
+        mY.resize(count);
+        mZ.resize(count);
+        mMass.resize(count);
+        if (0 == count)
+        {
+            return;
+        }
+
+        // Bounding cube of the bodies
+        glm::vec3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+        for (std::size_t i = 0; i < count; i++)
+        {
+            boundsMin = glm::min(boundsMin, system.position(i));
+            boundsMax = glm::max(boundsMax, system.position(i));
+        }
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        float halfSize = std::max(1e-6f, 0.5f * std::max({boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y, boundsMax.z - boundsMin.z})) * 1.0001f;
+        glm::vec3 origin = center - halfSize;
+        float scale = static_cast<float>((1 << maxLevel) - 1) / (2.0f * halfSize);
+
+        forRange(jobs, count, [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                glm::vec3 cell = (system.position(i) - origin) * scale;
+                mKeys[i].code = detail::spreadBits(static_cast<std::uint64_t>(cell.x)) | detail::spreadBits(static_cast<std::uint64_t>(cell.y)) << 1 |
+                                detail::spreadBits(static_cast<std::uint64_t>(cell.z)) << 2;
+                mKeys[i].body = static_cast<unsigned int>(i);
+            } });
+        detail::parallelSort(mKeys, jobs);
+        forRange(jobs, count, [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                unsigned int body = mKeys[i].body;
+                mOrder[i] = body;
+                mX[i] = system.x[body];
+                mY[i] = system.y[body];
+                mZ[i] = system.z[body];
+                mMass[i] = system.mass[body];
+            } });
+
+        // Cells of the first two levels serially, their subtrees in parallel
+        int parallelLevel = jobs && jobs->threadCount() > 1 ? 2 : maxLevel + 1;
+        std::vector<Subtree> subtrees;
+        mCells.emplace_back();
+        mCells[0].center = center;
+        mCells[0].halfSize = halfSize;
+        buildCell(mCells, 0, 0, static_cast<unsigned int>(count), 0, parallelLevel, &subtrees);
+        if (!subtrees.empty())
+        {
+            std::vector<std::vector<Cell>> built(subtrees.size());
+            jobs->parallelFor(0, subtrees.size(), 1, [&](std::size_t begin, std::size_t end)
+                              {
+                for (std::size_t i = begin; i < end; i++)
+                {
+                    Subtree const &subtree = subtrees[i];
+                    built[i].push_back(mCells[subtree.cell]);
+                    buildCell(built[i], 0, subtree.firstBody, subtree.bodyCount, subtree.level, maxLevel + 1, nullptr);
+                } });
+            // Local cell j > 0 of a subtree goes to base + j - 1, its root replaces the placeholder
+            for (std::size_t i = 0; i < subtrees.size(); i++)
+            {
+                unsigned int base = static_cast<unsigned int>(mCells.size());
+                for (std::size_t j = 0; j < built[i].size(); j++)
+                {
+                    Cell cell = built[i][j];
+                    if (cell.childCount > 0)
+                    {
+                        cell.firstChild = base + cell.firstChild - 1;
+                    }
+                    if (0 == j)
+                    {
+                        mCells[subtrees[i].cell] = cell;
+                    }
+                    else
+                    {
+                        mCells.push_back(cell);
+                    }
+                }
+            }
+            // The serial cells were summarized before their subtrees existed
+            summarizeAbove(0, 0, parallelLevel);
+        }
+    }
+
+    // Acceleration caused by all the bodies at a position
+    glm::vec3 acceleration(glm::vec3 const &position, GravitySettings const &settings) const
+    {
+        glm::vec3 result(0.0f);
+        if (mCells.empty())
+        {
+            return result;
+        }
+        float softening2 = settings.softening * settings.softening;
+        float theta2 = settings.theta * settings.theta;
+
+        unsigned int stack[8 * (maxLevel + 2)];
+        int stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize > 0)
+        {
+            Cell const &cell = mCells[stack[--stackSize]];
+            glm::vec3 offset = cell.centerOfMass - position;
+            float distance2 = glm::dot(offset, offset);
+            if (0 == cell.childCount)
+            {
+                for (unsigned int i = cell.firstBody; i < cell.firstBody + cell.bodyCount; i++)
+                {
+                    float dx = mX[i] - position.x, dy = mY[i] - position.y, dz = mZ[i] - position.z;
+                    float r2 = dx * dx + dy * dy + dz * dz + softening2;
+                    float inverseR = 1.0f / std::sqrt(r2);
+                    float factor = mMass[i] * inverseR * inverseR * inverseR;
+                    result += glm::vec3(dx, dy, dz) * factor;
+                }
+            }
+            else if (4.0f * cell.halfSize * cell.halfSize < theta2 * distance2)
+            {
+                // Far enough to be seen as a point mass
+                float inverseR = 1.0f / std::sqrt(distance2 + softening2);
+                result += offset * (cell.mass * inverseR * inverseR * inverseR);
+            }
+            else
+            {
+                for (unsigned int child = 0; child < cell.childCount; child++)
+                {
+                    stack[stackSize++] = cell.firstChild + child;
+                }
+            }
+        }
+        return result;
+    }
+
+    // Accelerations of every body, in Morton order so neighbouring bodies walk the same cells
+    void computeAccelerations(NBodySystem &system, GravitySettings const &settings, JobSystem *jobs = nullptr) const
+    {
+        forRange(jobs, mOrder.size(), [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                glm::vec3 a = acceleration(glm::vec3(mX[i], mY[i], mZ[i]), settings);
+                unsigned int body = mOrder[i];
+                system.ax[body] = a.x;
+                system.ay[body] = a.y;
+                system.az[body] = a.z;
+            } });
+    }
+
+    std::vector<Cell> const &cells() const
+    {
+        return mCells;
+    }
+
+private:
+    struct Subtree
+    {
+        unsigned int cell;
+        unsigned int firstBody;
+        unsigned int bodyCount;
+        int level;
+    };
+
+    template <typename Fn>
+    static void forRange(JobSystem *jobs, std::size_t count, Fn &&fn)
+    {
+        if (jobs)
+        {
+            jobs->parallelFor(0, count, 1024, fn);
+        }
+        else
+        {
+            fn(std::size_t(0), count);
+        }
+    }
+
+    // Splits the bodies [firstBody, firstBody + bodyCount) of the cell at index into its octants.
+    // Cells at stopLevel are recorded in subtrees instead of being split.
+    void buildCell(std::vector<Cell> &cells, unsigned int index, unsigned int firstBody, unsigned int bodyCount, int level, int stopLevel,
+                   std::vector<Subtree> *subtrees) const
+    {
+        cells[index].firstBody = firstBody;
+        cells[index].bodyCount = bodyCount;
+        cells[index].childCount = 0;
+        if (bodyCount <= maxLeafSize || level >= maxLevel)
+        {
+            summarize(cells, index);
+            return;
+        }
+        if (level >= stopLevel)
+        {
+            subtrees->push_back(Subtree{index, firstBody, bodyCount, level});
+            return;
+        }
+
+        // Octant of a body at this level: the next 3 bits of its code
+        int shift = 3 * (maxLevel - 1 - level);
+        unsigned int end = firstBody + bodyCount;
+        unsigned int childBegin[9];
+        for (unsigned int octant = 0; octant < 8; octant++)
+        {
+            auto first = std::partition_point(mKeys.begin() + firstBody, mKeys.begin() + end, [shift, octant](detail::MortonKey const &key)
+                                              { return ((key.code >> shift) & 7) < octant; });
+            childBegin[octant] = static_cast<unsigned int>(first - mKeys.begin());
+        }
+        childBegin[8] = end;
+
+        unsigned int firstChild = static_cast<unsigned int>(cells.size());
+        unsigned int childCount = 0;
+        float childHalfSize = cells[index].halfSize * 0.5f;
+        glm::vec3 center = cells[index].center;
+        for (unsigned int octant = 0; octant < 8; octant++)
+        {
+            if (childBegin[octant] == childBegin[octant + 1])
+            {
+                continue;
+            }
+            Cell child;
+            child.halfSize = childHalfSize;
+            child.center = center + glm::vec3(octant & 1 ? childHalfSize : -childHalfSize, octant & 2 ? childHalfSize : -childHalfSize,
+                                              octant & 4 ? childHalfSize : -childHalfSize);
+            child.firstBody = childBegin[octant];
+            child.bodyCount = childBegin[octant + 1] - childBegin[octant];
+            cells.push_back(child);
+            childCount++;
+        }
+        cells[index].firstChild = firstChild;
+        cells[index].childCount = childCount;
+        for (unsigned int child = 0; child < childCount; child++)
+        {
+            Cell const &childCell = cells[firstChild + child];
+            buildCell(cells, firstChild + child, childCell.firstBody, childCell.bodyCount, level + 1, stopLevel, subtrees);
+        }
+        summarize(cells, index);
+    }
+
+    // Mass and center of mass of a cell from its children or bodies
+    void summarize(std::vector<Cell> &cells, unsigned int index) const
+    {
+        Cell &cell = cells[index];
+        float mass = 0.0f;
+        glm::vec3 weighted(0.0f);
+        if (0 == cell.childCount)
+        {
+            for (unsigned int i = cell.firstBody; i < cell.firstBody + cell.bodyCount; i++)
+            {
+                mass += mMass[i];
+                weighted += glm::vec3(mX[i], mY[i], mZ[i]) * mMass[i];
+            }
+        }
+        else
+        {
+            for (unsigned int child = cell.firstChild; child < cell.firstChild + cell.childCount; child++)
+            {
+                mass += cells[child].mass;
+                weighted += cells[child].centerOfMass * cells[child].mass;
+            }
+        }
+        cell.mass = mass;
+        cell.centerOfMass = mass > 0.0f ? weighted / mass : cell.center;
+    }
+
+    // Summarizes again the cells above stopLevel, bottom up
+    void summarizeAbove(unsigned int index, int level, int stopLevel)
+    {
+        if (level >= stopLevel)
+        {
+            return;
+        }
+        Cell const &cell = mCells[index];
+        for (unsigned int child = cell.firstChild; child < cell.firstChild + cell.childCount; child++)
+        {
+            summarizeAbove(child, level + 1, stopLevel);
+        }
+        summarize(mCells, index);
+    }
+
+    std::vector<Cell> mCells;
+    std::vector<detail::MortonKey> mKeys;
+    // Body index of each slot, and the bodies in Morton order
+    std::vector<unsigned int> mOrder;
+    std::vector<float> mX, mY, mZ, mMass;
+};
+
+// O(n^2) reference: every body against every other body
+inline void computeAccelerationsDirect(NBodySystem &system, GravitySettings const &settings, JobSystem *jobs = nullptr)
+{
+    float softening2 = settings.softening * settings.softening;
+    auto range = [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; i++)
+        {
+            float ax = 0.0f, ay = 0.0f, az = 0.0f;
+            float px = system.x[i], py = system.y[i], pz = system.z[i];
+            for (std::size_t j = 0; j < system.size(); j++)
+            {
+                float dx = system.x[j] - px, dy = system.y[j] - py, dz = system.z[j] - pz;
+                float r2 = dx * dx + dy * dy + dz * dz + softening2;
+                float inverseR = 1.0f / std::sqrt(r2);
+                float factor = system.mass[j] * inverseR * inverseR * inverseR;
+                ax += dx * factor;
+                ay += dy * factor;
+                az += dz * factor;
+            }
+            system.ax[i] = ax;
+            system.ay[i] = ay;
+            system.az[i] = az;
+        }
+    };
+    if (jobs)
+    {
+        jobs->parallelFor(0, system.size(), 64, range);
+    }
+    else
+    {
+        range(0, system.size());
+    }
+}
+
+// Kinetic plus potential energy, O(n^2), to check the integrator
+inline double totalEnergy(NBodySystem const &system, GravitySettings const &settings)
+{
+    double kinetic = 0.0, potential = 0.0;
+    double softening2 = double(settings.softening) * settings.softening;
+    for (std::size_t i = 0; i < system.size(); i++)
+    {
+        glm::vec3 v = system.velocity(i);
+        kinetic += 0.5 * system.mass[i] * glm::dot(v, v);
+        for (std::size_t j = i + 1; j < system.size(); j++)
+        {
+            glm::vec3 d = system.position(j) - system.position(i);
+            potential -= double(system.mass[i]) * system.mass[j] / std::sqrt(glm::dot(d, d) + softening2);
+        }
+    }
+    return kinetic + potential;
+}
+
+// Fixed time step leapfrog integration decoupled from the frame rate.
+// advance() runs as many steps as the elapsed time allows, interpolatedPosition() blends the
+// previous and current positions by the time left over, so rendering is smooth at any frame rate.
+class NBodySimulation
+{
+public:
+    NBodySystem bodies;
+    GravitySettings settings;
+    // Seconds of simulated time per step
+    double timeStep = 1.0 / 240.0;
+    // Steps per advance() call at most, beyond that the simulation slows down instead of stalling
+    int maxStepsPerAdvance = 16;
+    JobSystem *jobs = nullptr;
+
+    // Computes the initial accelerations, call it once the bodies are added
+    void start()
+    {
+        mTree.build(bodies, jobs);
+        mTree.computeAccelerations(bodies, settings, jobs);
+        savePrevious();
+        mAccumulator = 0.0;
+    }
+
+    // One kick-drift-kick step
+    void step()
+    {
+        float dt = static_cast<float>(timeStep);
+        savePrevious();
+        forRange(bodies.size(), [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                bodies.vx[i] += 0.5f * dt * bodies.ax[i];
+                bodies.vy[i] += 0.5f * dt * bodies.ay[i];
+                bodies.vz[i] += 0.5f * dt * bodies.az[i];
+                bodies.x[i] += dt * bodies.vx[i];
+                bodies.y[i] += dt * bodies.vy[i];
+                bodies.z[i] += dt * bodies.vz[i];
+            } });
+        mTree.build(bodies, jobs);
+        mTree.computeAccelerations(bodies, settings, jobs);
+        forRange(bodies.size(), [&](std::size_t begin, std::size_t end)
+                 {
+            for (std::size_t i = begin; i < end; i++)
+            {
+                bodies.vx[i] += 0.5f * dt * bodies.ax[i];
+                bodies.vy[i] += 0.5f * dt * bodies.ay[i];
+                bodies.vz[i] += 0.5f * dt * bodies.az[i];
+            } });
+        mTime += timeStep;
+    }
+
+    // Advance by the real time elapsed since the last call, returns the number of steps taken
+    int advance(double elapsedSeconds)
+    {
+        mAccumulator += elapsedSeconds;
+        int steps = 0;
+        while (mAccumulator >= timeStep && steps < maxStepsPerAdvance)
+        {
+            step();
+            mAccumulator -= timeStep;
+            steps++;
+        }
+        // Drop the time that could not be simulated
+        mAccumulator = std::min(mAccumulator, timeStep);
+        return steps;
+    }
+
+    // Fraction of a step between the previous and the current state
+    float interpolationFactor() const
+    {
+        return static_cast<float>(std::min(1.0, mAccumulator / timeStep));
+    }
+
+    glm::vec3 interpolatedPosition(std::size_t body) const
+    {
+        glm::vec3 previous(mPreviousX[body], mPreviousY[body], mPreviousZ[body]);
+        return previous + (bodies.position(body) - previous) * interpolationFactor();
+    }
+
+    // Simulated time of the current state
+    double time() const
+    {
+        return mTime;
+    }
+
+    BarnesHutTree const &tree() const
+    {
+        return mTree;
+    }
+
+private:
+    template <typename Fn>
+    void forRange(std::size_t count, Fn &&fn)
+    {
+        if (jobs)
+        {
+            jobs->parallelFor(0, count, 4096, fn);
+        }
+        else
+        {
+            fn(std::size_t(0), count);
+        }
+    }
+
+    void savePrevious()
+    {
+        mPreviousX = bodies.x;
+        mPreviousY = bodies.y;
+        mPreviousZ = bodies.z;
+    }
+
+    BarnesHutTree mTree;
+    std::vector<float> mPreviousX, mPreviousY, mPreviousZ;
+    double mAccumulator = 0.0;
+    double mTime = 0.0;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include "GlExtensions.h"
+#include "ShaderProgram.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile, not part of the GL 3.3 loader
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+#ifndef GL_KHR_parallel_shader_compile
+typedef void(APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+
+using ProgramHandle = std::size_t;
+
+struct ProgramManagerStatistics
+{
+    std::size_t submitted = 0;
+    std::size_t ready = 0;
+    // Longest time from submit() to a program being seen ready, including the work the
+    // application did in between
+    double slowestMilliseconds = 0.0;
+};
+
+// Compiles and links every program as soon as it is submitted, without waiting for any of them,
+// so the driver works on them while the application goes on with its setup.
+// With KHR_parallel_shader_compile, ready() polls GL_COMPLETION_STATUS_KHR and never blocks, the
+// frame can be drawn with a fallback program until the real one is done. Without it the status
+// query waits for the driver, so ready() blocks the first time, as program() always may.
+// Compile and link errors are only seen, and thrown, when a program is first asked for.
+class ProgramManager
+{
+public:
+    ProgramManager() = default;
+    ProgramManager(ProgramManager const &) = delete;
+    ProgramManager &operator=(ProgramManager const &) = delete;
+
+    ~ProgramManager()
+    {
+        release();
+    }
+
+    // getProcAddress (glfwGetProcAddress) finds the extension functions. Programs are loaded from and
+    // stored to cacheDirectory when it is not empty.
+    void create(GLADloadproc getProcAddress, std::filesystem::path const &cacheDirectory = {}, bool allowParallel = true)
+    {
+        release();
+        if (!cacheDirectory.empty())
+        {
+            mCache = std::make_unique<ProgramBinaryCache>(cacheDirectory, getProcAddress);
+        }
+        if (allowParallel && getProcAddress && (hasGlExtension("GL_KHR_parallel_shader_compile") || hasGlExtension("GL_ARB_parallel_shader_compile")))
+        {
+            mParallel = true;
+            // The ARB variant names it glMaxShaderCompilerThreadsARB, same signature
+            auto maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getProcAddress("glMaxShaderCompilerThreadsKHR");
+            if (!maxShaderCompilerThreads)
+            {
+                maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)getProcAddress("glMaxShaderCompilerThreadsARB");
+            }
+            // Let the driver pick the number of threads
+            if (maxShaderCompilerThreads)
+            {
+                maxShaderCompilerThreads(0xFFFFFFFFu);
+            }
+        }
+    }
+
+    // Deletes every program, the handles become invalid
+    void release()
+    {
+        for (auto &entry : mPrograms)
+        {
+            deleteShaders(entry);
+            if (0 != entry.program)
+            {
+                glDeleteProgram(entry.program);
+            }
+        }
+        mPrograms.clear();
+        mCache.reset();
+        mParallel = false;
+        mStatistics = ProgramManagerStatistics();
+    }
+
+    // Starts compiling and linking, a program in the cache is ready right away
+    ProgramHandle submit(const char *vertexSource, const char *fragmentSource)
+    {
+        Entry entry;
+        entry.vertexSource = vertexSource;
+        entry.fragmentSource = fragmentSource;
+        entry.submitTime = std::chrono::steady_clock::now();
+        if (mCache)
+        {
+            entry.program = mCache->load(vertexSource, fragmentSource);
+        }
+        if (0 != entry.program)
+        {
+            entry.ready = true;
+            mStatistics.ready++;
+        }
+        else
+        {
+            entry.vertexShader = submitShader(GL_VERTEX_SHADER, vertexSource);
+            entry.fragmentShader = submitShader(GL_FRAGMENT_SHADER, fragmentSource);
+            entry.program = glCreateProgram();
+            glAttachShader(entry.program, entry.vertexShader);
+            glAttachShader(entry.program, entry.fragmentShader);
+            if (mCache)
+            {
+                mCache->prepareLink(entry.program);
+            }
+            glLinkProgram(entry.program);
+            entry.submitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.submitTime).count();
+        }
+        mPrograms.push_back(std::move(entry));
+        mStatistics.submitted++;
+        return mPrograms.size() - 1;
+    }
+
+    // Whether the program can be used. Never blocks with parallel compile, throws when it failed.
+    bool ready(ProgramHandle handle)
+    {
+        Entry &entry = mPrograms.at(handle);
+        if (!entry.ready && mParallel)
+        {
+            GLint complete = 0;
+            glGetProgramiv(entry.program, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete)
+            {
+                entry.seenPending = true;
+                return false;
+            }
+        }
+        finish(entry);
+        return true;
+    }
+
+    bool allReady()
+    {
+        for (ProgramHandle handle = 0; handle < mPrograms.size(); handle++)
+        {
+            if (!ready(handle))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The linked program, waits for the driver if needed. Throws when it failed.
+    unsigned int program(ProgramHandle handle)
+    {
+        Entry &entry = mPrograms.at(handle);
+        finish(entry);
+        return entry.program;
+    }
+
+    // The program when it is ready, fallback until then
+    unsigned int programOr(ProgramHandle handle, unsigned int fallback)
+    {
+        return ready(handle) ? mPrograms[handle].program : fallback;
+    }
+
+    bool parallel() const
+    {
+        return mParallel;
+    }
+
+    ProgramBinaryCache const *cache() const
+    {
+        return mCache.get();
+    }
+
+    ProgramManagerStatistics const &statistics() const
+    {
+        return mStatistics;
+    }
+
+private:
+    struct Entry
+    {
+        std::string vertexSource;
+        std::string fragmentSource;
+        unsigned int vertexShader = 0;
+        unsigned int fragmentShader = 0;
+        unsigned int program = 0;
+        bool ready = false;
+        // Compile or link log of a program that failed, thrown every time it is asked for
+        std::string error;
+        std::chrono::steady_clock::time_point submitTime;
+        // Time spent in the compile and link calls of submit()
+        double submitMilliseconds = 0.0;
+        // A completion poll found the program still compiling
+        bool seenPending = false;
+    };
+
+    static unsigned int submitShader(unsigned int type, std::string const &source)
+    {
+        unsigned int shader = glCreateShader(type);
+        const char *text = source.c_str();
+        glShaderSource(shader, 1, &text, nullptr);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    static void deleteShaders(Entry &entry)
+    {
+        for (unsigned int *shader : {&entry.vertexShader, &entry.fragmentShader})
+        {
+            if (0 == *shader)
+            {
+                continue;
+            }
+            if (0 != entry.program)
+            {
+                glDetachShader(entry.program, *shader);
+            }
+            glDeleteShader(*shader);
+            *shader = 0;
+        }
+    }
+
+    // First look at the link status, blocks until the driver is done with the program
+    void finish(Entry &entry)
+    {
+        if (!entry.error.empty())
+        {
+            throw std::runtime_error(entry.error);
+        }
+        if (entry.ready)
+        {
+            return;
+        }
+        std::string infoLog;
+        auto waitStart = std::chrono::steady_clock::now();
+        bool linked = programLinked(entry.program, &infoLog);
+        auto waitEnd = std::chrono::steady_clock::now();
+        if (!linked)
+        {
+            // A stage that failed to compile says more than the link log
+            entry.error = "Failed to link program " + infoLog;
+            for (auto stage : {std::make_pair(entry.vertexShader, GL_VERTEX_SHADER), std::make_pair(entry.fragmentShader, GL_FRAGMENT_SHADER)})
+            {
+                if (!shaderCompiled(stage.first, &infoLog))
+                {
+                    entry.error = std::string("Failed to compile ") + shaderStageName(stage.second) + " shader " + infoLog;
+                    break;
+                }
+            }
+            deleteShaders(entry);
+            glDeleteProgram(entry.program);
+            entry.program = 0;
+            throw std::runtime_error(entry.error);
+        }
+        deleteShaders(entry);
+        entry.ready = true;
+
+        double latencyMilliseconds = std::chrono::duration<double, std::milli>(waitEnd - entry.submitTime).count();
+        mStatistics.ready++;
+        mStatistics.slowestMilliseconds = std::max(mStatistics.slowestMilliseconds, latencyMilliseconds);
+        // The compile time a cached binary saves. When a poll saw the program still compiling, it took
+        // about as long as it took to be seen ready. Otherwise it is the time spent in the GL calls of
+        // submit() and waiting for the link status here; whatever the driver did in the background
+        // while the application was busy is not counted.
+        double compileMilliseconds = entry.seenPending ? latencyMilliseconds
+                                                       : entry.submitMilliseconds + std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+        if (mCache)
+        {
+            mCache->store(entry.vertexSource.c_str(), entry.fragmentSource.c_str(), entry.program, compileMilliseconds);
+        }
+    }
+
+    std::vector<Entry> mPrograms;
+    std::unique_ptr<ProgramBinaryCache> mCache;
+    bool mParallel = false;
+    ProgramManagerStatistics mStatistics;
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "GlStateCache.h"
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Everything needed to replay one indexed draw on the GL thread
+struct DrawCommand
+{
+    unsigned int program = 0;
+    unsigned int vertexArray = 0;
+    // GL_TEXTURE_2D on unit 0, none when 0
+    unsigned int texture = 0;
+    unsigned int indexType = GL_UNSIGNED_INT;
+    unsigned int indexCount = 0;
+    int baseVertex = 0;
+    // Byte offset of the first index in the element buffer
+    std::size_t indexOffset = 0;
+    glm::mat4 world = glm::mat4(1.0f);
+    glm::vec4 color = glm::vec4(1.0f);
+};
+
+// Layout of the 64 bit sort key, most significant first:
+//   pass (4) | blended (1) | opaque:  program (12) | texture (12) | vertex array (11) | depth (24)
+//                          | blended: depth (24, far first) | program (12) | texture (12) | vertex array (11)
+// Opaque packets are grouped by state, then drawn front to back for early depth rejection.
+// Blended packets must be drawn back to front whatever their state costs.
+// Names wider than their field only share a group with another name, the draws stay correct.
+namespace sortkey
+{
+    constexpr unsigned int passBits = 4;
+    constexpr unsigned int programBits = 12;
+    constexpr unsigned int textureBits = 12;
+    constexpr unsigned int vertexArrayBits = 11;
+    constexpr unsigned int depthBits = 24;
+    constexpr std::uint64_t blendedBit = std::uint64_t(1) << 59;
+
+    constexpr std::uint64_t field(unsigned int value, unsigned int bits, unsigned int shift)
+    {
+        return (std::uint64_t(value) & ((std::uint64_t(1) << bits) - 1)) << shift;
+    }
+
+    // depth in [0, 1], 0 is the nearest
+    inline unsigned int quantizeDepth(float depth)
+    {
+        depth = std::min(1.0f, std::max(0.0f, depth));
+        return (unsigned int)(depth * (float)((1u << depthBits) - 1) + 0.5f);
+    }
+
+    inline std::uint64_t opaque(unsigned int pass, unsigned int program, unsigned int texture, unsigned int vertexArray, float depth)
+    {
+        return field(pass, passBits, 60) | field(program, programBits, 47) | field(texture, textureBits, 35) |
+               field(vertexArray, vertexArrayBits, 24) | field(quantizeDepth(depth), depthBits, 0);
+    }
+
+    inline std::uint64_t blended(unsigned int pass, unsigned int program, unsigned int texture, unsigned int vertexArray, float depth)
+    {
+        unsigned int farFirst = ((1u << depthBits) - 1) - quantizeDepth(depth);
+        return field(pass, passBits, 60) | blendedBit | field(farFirst, depthBits, 35) | field(program, programBits, 23) |
+               field(texture, textureBits, 11) | field(vertexArray, vertexArrayBits, 0);
+    }
+
+    inline bool isBlended(std::uint64_t key)
+    {
+        return 0 != (key & blendedBit);
+    }
+}
+
+// A recorded draw, sorted by key and pointing back at its command
+struct RenderPacket
+{
+    std::uint64_t key;
+    unsigned int list;
+    unsigned int command;
+};
+
+struct RenderQueueStatistics
+{
+    std::size_t packets = 0;
+    std::size_t lists = 0;
+    // Radix passes actually run, a byte that is the same for every key is skipped
+    std::size_t sortPasses = 0;
+    double sortMilliseconds = 0.0;
+    double submitMilliseconds = 0.0;
+};
+
+// Command queue recorded from any thread and replayed in sort key order on the GL thread.
+// Each recording thread or job takes its own list with acquireList() and records without locks.
+// sort() radix sorts the packets of all the lists, submit() replays them through a GlStateCache,
+// so state only changes between groups.
+class RenderQueue
+{
+public:
+    class CommandList
+    {
+    public:
+        void draw(std::uint64_t key, DrawCommand const &command)
+        {
+            mKeys.push_back(key);
+            mCommands.push_back(command);
+        }
+
+        std::size_t size() const
+        {
+            return mCommands.size();
+        }
+
+    private:
+        friend class RenderQueue;
+        std::vector<std::uint64_t> mKeys;
+        std::vector<DrawCommand> mCommands;
+    };
+
+    // Starts a new frame, the lists keep their memory
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for (std::size_t i = 0; i < mListCount; i++)
+        {
+            mLists[i]->mKeys.clear();
+            mLists[i]->mCommands.clear();
+        }
+        mListCount = 0;
+        mPackets.clear();
+    }
+
+    // Thread safe, the list belongs to the caller until the next reset()
+    CommandList &acquireList()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mListCount == mLists.size())
+        {
+            mLists.push_back(std::make_unique<CommandList>());
+        }
+        return *mLists[mListCount++];
+    }
+
+    // LSD radix sort, one byte per pass, stable so equal keys keep their recording order within a list
+    void sort()
+    {
+        auto start = std::chrono::steady_clock::now();
+        mPackets.clear();
+        std::size_t total = 0;
+        for (std::size_t list = 0; list < mListCount; list++)
+        {
+            total += mLists[list]->size();
+        }
+        mPackets.reserve(total);
+        for (std::size_t list = 0; list < mListCount; list++)
+        {
+            auto const &keys = mLists[list]->mKeys;
+            for (std::size_t i = 0; i < keys.size(); i++)
+            {
+                mPackets.push_back({keys[i], (unsigned int)list, (unsigned int)i});
+            }
+        }
+
+        // All the histograms in one read of the keys
+        std::size_t counts[8][256] = {};
+        for (auto const &packet : mPackets)
+        {
+            for (int digit = 0; digit < 8; digit++)
+            {
+                counts[digit][(packet.key >> (digit * 8)) & 0xff]++;
+            }
+        }
+
+        mStatistics = RenderQueueStatistics();
+        mScratch.resize(mPackets.size());
+        for (int digit = 0; digit < 8; digit++)
+        {
+            std::size_t *count = counts[digit];
+            if (mPackets.empty() || count[(mPackets[0].key >> (digit * 8)) & 0xff] == mPackets.size())
+            {
+                continue;
+            }
+            std::size_t offset = 0;
+            for (int bucket = 0; bucket < 256; bucket++)
+            {
+                std::size_t bucketCount = count[bucket];
+                count[bucket] = offset;
+                offset += bucketCount;
+            }
+            for (auto const &packet : mPackets)
+            {
+                mScratch[count[(packet.key >> (digit * 8)) & 0xff]++] = packet;
+            }
+            mPackets.swap(mScratch);
+            mStatistics.sortPasses++;
+        }
+
+        mStatistics.packets = mPackets.size();
+        mStatistics.lists = mListCount;
+        mStatistics.sortMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Replays the sorted packets. setUniforms(command) sets the per draw uniforms of the bound program.
+    // Blending is enabled for the blended packets only, the blend function is left to the caller.
+    template <typename Fn>
+    void submit(GlStateCache &state, Fn &&setUniforms)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (auto const &packet : mPackets)
+        {
+            DrawCommand const &command = this->command(packet);
+            state.setEnabled(GL_BLEND, sortkey::isBlended(packet.key));
+            state.useProgram(command.program);
+            state.bindVertexArray(command.vertexArray);
+            if (0 != command.texture)
+            {
+                state.bindTexture(0, GL_TEXTURE_2D, command.texture);
+            }
+            setUniforms(command);
+            glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)command.indexCount, command.indexType, (const void *)command.indexOffset, command.baseVertex);
+        }
+        mStatistics.submitMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Packets in draw order, after sort()
+    std::vector<RenderPacket> const &packets() const
+    {
+        return mPackets;
+    }
+
+    DrawCommand const &command(RenderPacket const &packet) const
+    {
+        return mLists[packet.list]->mCommands[packet.command];
+    }
+
+    RenderQueueStatistics const &statistics() const
+    {
+        return mStatistics;
+    }
+
+private:
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<CommandList>> mLists;
+    std::size_t mListCount = 0;
+    std::vector<RenderPacket> mPackets;
+    std::vector<RenderPacket> mScratch;
+    RenderQueueStatistics mStatistics;
+};
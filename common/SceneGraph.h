@@ -0,0 +1,422 @@
+#pragma once
+
+#include "AffineTransform.h"
+#include "JobSystem.h"
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+// Handle of a node in a TransformHierarchy, stays valid when the nodes are reordered
+using TransformNode = unsigned int;
+constexpr TransformNode noParentNode = std::numeric_limits<TransformNode>::max();
+
+// Work done by the last TransformHierarchy::updateWorldTransforms call
+struct TransformUpdateStatistics
+{
+    // Changed nodes and recomputed nodes looked at, unchanged subtrees are never visited
+    std::size_t nodesVisited = 0;
+    // Nodes whose world transformation was recomputed
+    std::size_t nodesUpdated = 0;
+};
+
+// Flat transform hierarchy.
+// Local TRS, parent links and affine world transformations live in contiguous arrays sorted by depth,
+// then by parent, so every parent precedes its children and the children of a node are contiguous.
+// The nodes of a subtree at any depth then form one [begin, end) range, and all world transforms are
+// updated depth by depth over those ranges, before any draw call is issued.
+// Only nodes whose local transformation changed since the last update, and their descendants,
+// are visited and recomputed: a static scene costs nothing to update.
+class TransformHierarchy
+{
+public:
+    TransformNode addNode(TransformNode parent = noParentNode, glm::vec3 const &translation = glm::vec3(0.0f),
+                          glm::quat const &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3 const &scale = glm::vec3(1.0f))
+    {
+        unsigned int parentIndex = noParentNode;
+        unsigned int depth = 0;
+        if (noParentNode != parent)
+        {
+            parentIndex = indexOf(parent);
+            depth = mDepth[parentIndex] + 1;
+        }
+        // Nodes are appended, so the order only breaks when a shallower node follows a deeper one,
+        // or a node of the same depth has an earlier parent than the last one
+        if (!mDepth.empty() && (depth < mDepth.back() || (depth == mDepth.back() && parentIndex < mParent.back())))
+        {
+            mNeedsSort = true;
+        }
+        mChildRangesStale = true;
+
+        TransformNode node = (TransformNode)mNodeToIndex.size();
+        mNodeToIndex.push_back((unsigned int)mParent.size());
+        mIndexToNode.push_back(node);
+        mTranslation.push_back(translation);
+        mRotation.push_back(rotation);
+        mScale.push_back(scale);
+        mParent.push_back(parentIndex);
+        mDepth.push_back(depth);
+        mWorld.emplace_back();
+        mLocalChanged.push_back(0);
+        mWorldChangedAt.push_back(0);
+        mChildBegin.push_back(0);
+        mChildEnd.push_back(0);
+        markChanged(mParent.size() - 1);
+        return node;
+    }
+
+    std::size_t size() const
+    {
+        return mParent.size();
+    }
+
+    void setLocalTranslation(TransformNode node, glm::vec3 const &translation)
+    {
+        unsigned int index = indexOf(node);
+        if (mTranslation[index] != translation)
+        {
+            mTranslation[index] = translation;
+            markChanged(index);
+        }
+    }
+
+    void setLocalRotation(TransformNode node, glm::quat const &rotation)
+    {
+        unsigned int index = indexOf(node);
+        if (mRotation[index] != rotation)
+        {
+            mRotation[index] = rotation;
+            markChanged(index);
+        }
+    }
+
+    void setLocalScale(TransformNode node, glm::vec3 const &scale)
+    {
+        unsigned int index = indexOf(node);
+        if (mScale[index] != scale)
+        {
+            mScale[index] = scale;
+            markChanged(index);
+        }
+    }
+
+    AffineTransform const &worldAffine(TransformNode node) const
+    {
+        return mWorld[indexOf(node)];
+    }
+
+    // World transformation as a matrix, ready for glUniformMatrix4fv
+    glm::mat4 worldTransform(TransformNode node) const
+    {
+        return worldAffine(node).toMat4();
+    }
+
+    // True if the world transformation of the node was recomputed by the last update
+    bool worldChanged(TransformNode node) const
+    {
+        return mWorldChangedAt[indexOf(node)] == mUpdateCount;
+    }
+
+    // Mark every node as changed, the next update recomputes all the world transformations
+    void invalidate()
+    {
+        std::fill(mLocalChanged.begin(), mLocalChanged.end(), (unsigned char)1);
+        mChangedNodes.clear();
+        mUpdateAll = true;
+    }
+
+    // Recompute the world transformations of the changed nodes and their descendants.
+    // Depths are processed in order, so a parent is always recomputed before its children.
+    void updateWorldTransforms()
+    {
+        beginUpdate();
+        updateChangedSubtrees([this](std::vector<NodeRange> const &ranges)
+                              {
+            for (auto const &range : ranges)
+            {
+                updateRange(range.begin, range.end);
+            } });
+        endUpdate();
+    }
+
+    // Same result, with the ranges of each depth spread over the threads of the job system.
+    // Nodes of the same depth only read the world transformations of the previous depths.
+    void updateWorldTransforms(JobSystem &jobs, std::size_t grainSize = 4096)
+    {
+        beginUpdate();
+        updateChangedSubtrees([&](std::vector<NodeRange> const &ranges)
+                              {
+            for (auto const &range : ranges)
+            {
+                jobs.parallelFor(range.begin, range.end, grainSize, [this](std::size_t begin, std::size_t end)
+                                 { updateRange(begin, end); });
+            } });
+        endUpdate();
+    }
+
+    TransformUpdateStatistics const &lastUpdateStatistics() const
+    {
+        return mStatistics;
+    }
+
+private:
+    struct NodeRange
+    {
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    unsigned int indexOf(TransformNode node) const
+    {
+        if (node >= mNodeToIndex.size())
+        {
+            throw std::out_of_range("Invalid transform node");
+        }
+        return mNodeToIndex[node];
+    }
+
+    void beginUpdate()
+    {
+        if (mNeedsSort)
+        {
+            sortByDepth();
+        }
+        if (mChildRangesStale)
+        {
+            buildChildRanges();
+        }
+        ++mUpdateCount;
+        mStatistics = TransformUpdateStatistics();
+    }
+
+    void endUpdate()
+    {
+        mChangedNodes.clear();
+        mUpdateAll = false;
+    }
+
+    static void appendRange(std::vector<NodeRange> &ranges, NodeRange range)
+    {
+        if (!ranges.empty() && ranges.back().end == range.begin)
+        {
+            ranges.back().end = range.end;
+        }
+        else
+        {
+            ranges.push_back(range);
+        }
+    }
+
+    // Walk the subtrees of the changed nodes depth by depth and hand the sorted, disjoint ranges
+    // of each depth to updateDepth. A changed node inside the subtree of another one is skipped,
+    // it is recomputed with that subtree.
+    template <typename UpdateDepth>
+    void updateChangedSubtrees(UpdateDepth &&updateDepth)
+    {
+        std::vector<NodeRange> &ranges = mRanges;
+        std::vector<NodeRange> &next = mNextRanges;
+        ranges.clear();
+        if (mUpdateAll && mRootCount > 0)
+        {
+            ranges.push_back({0, mRootCount});
+        }
+        // Indices are sorted by depth, so this also sorts the changed nodes by depth
+        std::sort(mChangedNodes.begin(), mChangedNodes.end());
+
+        std::size_t changed = 0;
+        while (!ranges.empty() || changed < mChangedNodes.size())
+        {
+            const unsigned int depth = ranges.empty() ? mDepth[mChangedNodes[changed]] : mDepth[ranges.front().begin];
+
+            // Merge the changed nodes of this depth that are not already covered by a range
+            next.clear();
+            auto range = ranges.begin();
+            for (; changed < mChangedNodes.size() && mDepth[mChangedNodes[changed]] == depth; ++changed)
+            {
+                std::size_t index = mChangedNodes[changed];
+                ++mStatistics.nodesVisited;
+                while (range != ranges.end() && range->end <= index)
+                {
+                    appendRange(next, *range++);
+                }
+                if (range == ranges.end() || index < range->begin)
+                {
+                    appendRange(next, {index, index + 1});
+                }
+            }
+            for (; range != ranges.end(); ++range)
+            {
+                appendRange(next, *range);
+            }
+            ranges.swap(next);
+
+            updateDepth(ranges);
+
+            // The children of a range are the range between the children of its first and last node
+            next.clear();
+            for (auto const &updated : ranges)
+            {
+                mStatistics.nodesUpdated += updated.end - updated.begin;
+                NodeRange children{mChildBegin[updated.begin], mChildEnd[updated.end - 1]};
+                if (children.begin < children.end)
+                {
+                    appendRange(next, children);
+                }
+            }
+            ranges.swap(next);
+        }
+        mStatistics.nodesVisited += mStatistics.nodesUpdated;
+    }
+
+    // Recompute the world transformations of [begin, end)
+    void updateRange(std::size_t begin, std::size_t end)
+    {
+        for (std::size_t index = begin; index < end; ++index)
+        {
+            unsigned int parent = mParent[index];
+            auto local = AffineTransform::fromTranslationRotationScale(mTranslation[index], mRotation[index], mScale[index]);
+            mWorld[index] = noParentNode == parent ? local : mWorld[parent] * local;
+            mWorldChangedAt[index] = mUpdateCount;
+            mLocalChanged[index] = 0;
+        }
+    }
+
+    void markChanged(std::size_t index)
+    {
+        if (!mLocalChanged[index])
+        {
+            mLocalChanged[index] = 1;
+            mChangedNodes.push_back((unsigned int)index);
+        }
+    }
+
+    // Children of node i are [mChildBegin[i], mChildEnd[i]); for a leaf both are where its children would go.
+    // Parent indices never decrease along the sorted arrays, so one sweep finds all the ranges.
+    void buildChildRanges()
+    {
+        const std::size_t count = mParent.size();
+        mRootCount = 0;
+        while (mRootCount < count && noParentNode == mParent[mRootCount])
+        {
+            ++mRootCount;
+        }
+        std::size_t child = mRootCount;
+        for (std::size_t index = 0; index < count; ++index)
+        {
+            mChildBegin[index] = (unsigned int)child;
+            while (child < count && mParent[child] == index)
+            {
+                ++child;
+            }
+            mChildEnd[index] = (unsigned int)child;
+        }
+        mChildRangesStale = false;
+    }
+
+    template <typename T>
+    static void permute(std::vector<T> &values, std::vector<unsigned int> const &order)
+    {
+        std::vector<T> sorted;
+        sorted.reserve(values.size());
+        for (auto index : order)
+        {
+            sorted.push_back(values[index]);
+        }
+        values.swap(sorted);
+    }
+
+    // Sort all the arrays by depth, then by parent, keeping the node handles valid.
+    // This is a breadth first order: the roots, then the children of each node in turn.
+    void sortByDepth()
+    {
+        const std::size_t count = mParent.size();
+        std::vector<unsigned int> childCount(count + 1, 0);
+        for (auto parent : mParent)
+        {
+            if (noParentNode != parent)
+            {
+                ++childCount[parent + 1];
+            }
+        }
+        std::partial_sum(childCount.begin(), childCount.end(), childCount.begin());
+        std::vector<unsigned int> children(childCount.back());
+        std::vector<unsigned int> childInsert(childCount.begin(), childCount.end() - 1);
+        std::vector<unsigned int> order;
+        order.reserve(count);
+        for (unsigned int index = 0; index < count; ++index)
+        {
+            if (noParentNode == mParent[index])
+            {
+                order.push_back(index);
+            }
+            else
+            {
+                children[childInsert[mParent[index]]++] = index;
+            }
+        }
+        for (std::size_t next = 0; next < order.size(); ++next)
+        {
+            order.insert(order.end(), children.begin() + childCount[order[next]], children.begin() + childCount[order[next] + 1]);
+        }
+
+        std::vector<unsigned int> newIndex(order.size());
+        for (unsigned int index = 0; index < order.size(); ++index)
+        {
+            newIndex[order[index]] = index;
+        }
+
+        permute(mTranslation, order);
+        permute(mRotation, order);
+        permute(mScale, order);
+        permute(mDepth, order);
+        permute(mWorld, order);
+        permute(mParent, order);
+        permute(mIndexToNode, order);
+        permute(mWorldChangedAt, order);
+        for (auto &parent : mParent)
+        {
+            if (noParentNode != parent)
+            {
+                parent = newIndex[parent];
+            }
+        }
+        for (unsigned int index = 0; index < mIndexToNode.size(); ++index)
+        {
+            mNodeToIndex[mIndexToNode[index]] = index;
+        }
+        mNeedsSort = false;
+        // The changed node indices are meaningless in the new order
+        invalidate();
+    }
+
+    std::vector<glm::vec3> mTranslation;
+    std::vector<glm::quat> mRotation;
+    std::vector<glm::vec3> mScale;
+    std::vector<unsigned int> mParent;
+    std::vector<unsigned int> mDepth;
+    std::vector<AffineTransform> mWorld;
+    std::vector<unsigned int> mNodeToIndex;
+    std::vector<TransformNode> mIndexToNode;
+    // Local transformation changed since the last update
+    std::vector<unsigned char> mLocalChanged;
+    // Update in which the world transformation was last recomputed
+    std::vector<unsigned int> mWorldChangedAt;
+    std::vector<unsigned int> mChildBegin;
+    std::vector<unsigned int> mChildEnd;
+    // Nodes whose local transformation changed since the last update, each listed once
+    std::vector<unsigned int> mChangedNodes;
+    // Ranges of the depth being updated and of the next one, kept to reuse their memory
+    std::vector<NodeRange> mRanges;
+    std::vector<NodeRange> mNextRanges;
+    std::size_t mRootCount = 0;
+    unsigned int mUpdateCount = 0;
+    TransformUpdateStatistics mStatistics;
+    bool mNeedsSort = false;
+    bool mChildRangesStale = false;
+    bool mUpdateAll = false;
+};
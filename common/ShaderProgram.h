@@ -0,0 +1,368 @@
+#pragma once
+
+#include "GlExtensions.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// GL 4.1 / ARB_get_program_binary, not part of the GL 3.3 loader
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_ARB_get_program_binary
+typedef void(APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void(APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void(APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+#endif
+
+// Whether the shader compiled, with the info log of the failure
+inline bool shaderCompiled(unsigned int shader, std::string *infoLog = nullptr)
+{
+    int success = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success && infoLog)
+    {
+        int logLength = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &logLength);
+        infoLog->assign(logLength > 1 ? logLength : 1, '\0');
+        glGetShaderInfoLog(shader, (GLsizei)infoLog->size(), nullptr, &(*infoLog)[0]);
+        infoLog->resize(std::strlen(infoLog->c_str()));
+    }
+    return 0 != success;
+}
+
+inline const char *shaderStageName(unsigned int type)
+{
+    return GL_VERTEX_SHADER == type ? "vertex" : "fragment";
+}
+
+// Compile one shader stage, throws with the whole info log on failure
+inline unsigned int compileShader(unsigned int type, const char *source)
+{
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    std::string infoLog;
+    if (!shaderCompiled(shader, &infoLog))
+    {
+        glDeleteShader(shader);
+        throw std::runtime_error(std::string("Failed to compile ") + shaderStageName(type) + " shader " + infoLog);
+    }
+    return shader;
+}
+
+// Whether the program linked, or was loaded from a binary, with the info log of the failure
+inline bool programLinked(unsigned int program, std::string *infoLog = nullptr)
+{
+    int success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success && infoLog)
+    {
+        int logLength = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &logLength);
+        infoLog->assign(logLength > 1 ? logLength : 1, '\0');
+        glGetProgramInfoLog(program, (GLsizei)infoLog->size(), nullptr, &(*infoLog)[0]);
+        infoLog->resize(std::strlen(infoLog->c_str()));
+    }
+    return 0 != success;
+}
+
+// Compile and link a vertex and fragment shader program, throws on failure.
+// beforeLink runs on the program once the shaders are attached, to set program parameters.
+template <typename Fn>
+unsigned int createProgram(const char *vertexSource, const char *fragmentSource, Fn &&beforeLink)
+{
+    unsigned int vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource);
+    unsigned int fragmentShader = 0;
+    try
+    {
+        fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    }
+    catch (...)
+    {
+        glDeleteShader(vertexShader);
+        throw;
+    }
+
+    unsigned int program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    beforeLink(program);
+    glLinkProgram(program);
+    // The program keeps the compiled code, the shaders are no longer needed
+    glDetachShader(program, vertexShader);
+    glDetachShader(program, fragmentShader);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    std::string infoLog;
+    if (!programLinked(program, &infoLog))
+    {
+        glDeleteProgram(program);
+        throw std::runtime_error("Failed to link program " + infoLog);
+    }
+    return program;
+}
+
+inline unsigned int createProgram(const char *vertexSource, const char *fragmentSource)
+{
+    return createProgram(vertexSource, fragmentSource, [](unsigned int) {});
+}
+
+// 64-bit FNV-1a hash of the shader sources and of the driver that compiled them,
+// a binary is only valid for the exact same renderer and driver version
+inline std::uint64_t programBinaryHash(const char *vertexSource, const char *fragmentSource)
+{
+    std::uint64_t value = 14695981039346656037ull;
+    auto hashText = [&value](const char *text)
+    {
+        for (auto bytes = reinterpret_cast<const unsigned char *>(text ? text : ""); *bytes; ++bytes)
+        {
+            value = (value ^ *bytes) * 1099511628211ull;
+        }
+        // Separator, so moving text from one string to the next changes the hash
+        value = (value ^ 0xff) * 1099511628211ull;
+    };
+    hashText(vertexSource);
+    hashText(fragmentSource);
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+    {
+        hashText(reinterpret_cast<const char *>(glGetString(name)));
+    }
+    return value;
+}
+
+// On-disk layout of a cached program: ProgramBinaryHeader | binary
+struct ProgramBinaryHeader
+{
+    static constexpr std::uint32_t magicValue = 0x4E494250u; // "PBIN"
+    static constexpr std::uint32_t currentVersion = 1;
+
+    std::uint32_t magic = magicValue;
+    std::uint32_t version = currentVersion;
+    std::uint64_t keyHash = 0;
+    std::uint32_t binaryFormat = 0;
+    std::uint32_t binarySize = 0;
+    // What compiling and linking took, to report the time a load saves
+    double compileMilliseconds = 0.0;
+};
+
+struct ShaderCacheStatistics
+{
+    std::size_t loaded = 0;
+    std::size_t compiled = 0;
+    std::size_t stored = 0;
+    double milliseconds = 0.0;
+    double savedMilliseconds = 0.0;
+};
+
+// Directory of linked program binaries keyed by their sources and the driver.
+// createProgram() loads the binary with glProgramBinary when there is a valid one, and otherwise
+// compiles, links and stores the result of glGetProgramBinary for the next run.
+// Without GL 4.1 or ARB_get_program_binary, or when the driver offers no binary format, it only compiles.
+class ProgramBinaryCache
+{
+public:
+    // getProcAddress (glfwGetProcAddress) finds the program binary functions
+    ProgramBinaryCache(std::filesystem::path directory, GLADloadproc getProcAddress)
+        : mDirectory(std::move(directory))
+    {
+        GLint formatCount = 0;
+        if (getProcAddress && (hasGlVersion(4, 1) || hasGlExtension("GL_ARB_get_program_binary")))
+        {
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        }
+        if (formatCount > 0)
+        {
+            mGetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)getProcAddress("glGetProgramBinary");
+            mProgramBinary = (PFNGLPROGRAMBINARYPROC)getProcAddress("glProgramBinary");
+            mProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)getProcAddress("glProgramParameteri");
+        }
+        if (!mGetProgramBinary || !mProgramBinary || !mProgramParameteri)
+        {
+            mGetProgramBinary = nullptr;
+            mProgramBinary = nullptr;
+            mProgramParameteri = nullptr;
+        }
+    }
+
+    bool supported() const
+    {
+        return nullptr != mProgramBinary;
+    }
+
+    std::filesystem::path filePath(std::uint64_t keyHash) const
+    {
+        char hashText[17];
+        std::snprintf(hashText, sizeof(hashText), "%016llx", (unsigned long long)keyHash);
+        return mDirectory / (std::string("program_") + hashText + ".bin");
+    }
+
+    // Load the program from the cache, or compile, link and cache it. Throws when compiling fails.
+    unsigned int createProgram(const char *vertexSource, const char *fragmentSource)
+    {
+        unsigned int program = load(vertexSource, fragmentSource);
+        if (0 != program)
+        {
+            return program;
+        }
+        auto start = std::chrono::steady_clock::now();
+        program = ::createProgram(vertexSource, fragmentSource, [this](unsigned int linked)
+                                  { prepareLink(linked); });
+        store(vertexSource, fragmentSource, program, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        return program;
+    }
+
+    // The linked program from the cache, 0 when it has to be compiled
+    unsigned int load(const char *vertexSource, const char *fragmentSource)
+    {
+        if (!supported())
+        {
+            return 0;
+        }
+        auto start = std::chrono::steady_clock::now();
+        double compileMilliseconds = 0.0;
+        unsigned int program = loadBinary(programBinaryHash(vertexSource, fragmentSource), compileMilliseconds);
+        if (0 != program)
+        {
+            double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            mStatistics.loaded++;
+            mStatistics.milliseconds += loadMilliseconds;
+            mStatistics.savedMilliseconds += std::max(0.0, compileMilliseconds - loadMilliseconds);
+        }
+        return program;
+    }
+
+    // Call before glLinkProgram on a program that will be stored, or the driver may not keep its binary
+    void prepareLink(unsigned int program) const
+    {
+        if (supported())
+        {
+            mProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+    }
+
+    // Count a program compiled and linked in compileMilliseconds, and store its binary for the next run
+    void store(const char *vertexSource, const char *fragmentSource, unsigned int program, double compileMilliseconds)
+    {
+        mStatistics.compiled++;
+        mStatistics.milliseconds += compileMilliseconds;
+        if (supported() && storeBinary(programBinaryHash(vertexSource, fragmentSource), program, compileMilliseconds))
+        {
+            mStatistics.stored++;
+        }
+    }
+
+    ShaderCacheStatistics const &statistics() const
+    {
+        return mStatistics;
+    }
+
+    // e.g. "Shader cache: 2 loaded, 0 compiled in 1.2 ms, 41.5 ms saved"
+    std::string summary() const
+    {
+        char text[160];
+        std::snprintf(text, sizeof(text), "Shader cache: %zu loaded, %zu compiled in %.1f ms, %.1f ms saved%s", mStatistics.loaded,
+                      mStatistics.compiled, mStatistics.milliseconds, mStatistics.savedMilliseconds, supported() ? "" : " (no program binary support)");
+        return text;
+    }
+
+private:
+    // Returns the linked program, 0 on a miss, an out of date file or a binary the driver rejects
+    unsigned int loadBinary(std::uint64_t keyHash, double &compileMilliseconds) const
+    {
+        MappedFile file;
+        if (!file.open(filePath(keyHash).string()) || file.size() < sizeof(ProgramBinaryHeader))
+        {
+            return 0;
+        }
+        ProgramBinaryHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        if (header.magic != ProgramBinaryHeader::magicValue || header.version != ProgramBinaryHeader::currentVersion ||
+            header.keyHash != keyHash || 0 == header.binarySize || sizeof(header) + header.binarySize > file.size())
+        {
+            return 0;
+        }
+
+        unsigned int program = glCreateProgram();
+        mProgramBinary(program, header.binaryFormat, file.data() + sizeof(header), (GLsizei)header.binarySize);
+        if (!programLinked(program))
+        {
+            glDeleteProgram(program);
+            return 0;
+        }
+        compileMilliseconds = header.compileMilliseconds;
+        return program;
+    }
+
+    // Write the program binary to the cache, returns false if the file could not be written
+    bool storeBinary(std::uint64_t keyHash, unsigned int program, double compileMilliseconds) const
+    {
+        GLint binarySize = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+        if (binarySize <= 0)
+        {
+            return false;
+        }
+        std::vector<char> binary((std::size_t)binarySize);
+        GLsizei length = 0;
+        GLenum binaryFormat = 0;
+        mGetProgramBinary(program, binarySize, &length, &binaryFormat, binary.data());
+        if (length <= 0)
+        {
+            return false;
+        }
+
+        ProgramBinaryHeader header;
+        header.keyHash = keyHash;
+        header.binaryFormat = binaryFormat;
+        header.binarySize = (std::uint32_t)length;
+        header.compileMilliseconds = compileMilliseconds;
+
+        std::error_code error;
+        std::filesystem::create_directories(mDirectory, error);
+        // Write next to the final file and rename, so a reader never maps a partial file
+        auto finalPath = filePath(keyHash);
+        auto temporaryPath = finalPath;
+        temporaryPath += ".tmp";
+        {
+            std::ofstream stream(temporaryPath, std::ios::binary | std::ios::trunc);
+            if (!stream)
+            {
+                return false;
+            }
+            stream.write(reinterpret_cast<const char *>(&header), sizeof(header));
+            stream.write(binary.data(), length);
+            if (!stream)
+            {
+                stream.close();
+                std::filesystem::remove(temporaryPath, error);
+                return false;
+            }
+        }
+        std::filesystem::rename(temporaryPath, finalPath, error);
+        return !error;
+    }
+
+    std::filesystem::path mDirectory;
+    PFNGLGETPROGRAMBINARYPROC mGetProgramBinary = nullptr;
+    PFNGLPROGRAMBINARYPROC mProgramBinary = nullptr;
+    PFNGLPROGRAMPARAMETERIPROC mProgramParameteri = nullptr;
+    ShaderCacheStatistics mStatistics;
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// std140 layout rules (GL 3.3 spec, 7.6.2.2) evaluated at compile time, to check the C++ structs
+// uploaded with one memcpy against the blocks declared in GLSL:
+//   struct DrawData { glm::mat4 model; glm::vec4 color; };
+//   using DrawDataLayout = std140::Layout<glm::mat4, glm::vec4>;
+//   static_assert(offsetof(DrawData, color) == DrawDataLayout::offsets[1], "...");
+namespace std140
+{
+    constexpr std::size_t alignUp(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Base alignment, size and GL type of a block member. Types whose C++ layout cannot match
+    // std140 (glm::mat2, glm::mat3, arrays of scalars) are left undefined on purpose.
+    template <typename T>
+    struct Member;
+
+    template <std::size_t Alignment, std::size_t Size, GLenum Type>
+    struct MemberTraits
+    {
+        static constexpr std::size_t alignment = Alignment;
+        static constexpr std::size_t size = Size;
+        static constexpr GLenum type = Type;
+    };
+
+    template <> struct Member<float> : MemberTraits<4, 4, GL_FLOAT> {};
+    template <> struct Member<int> : MemberTraits<4, 4, GL_INT> {};
+    template <> struct Member<unsigned int> : MemberTraits<4, 4, GL_UNSIGNED_INT> {};
+    template <> struct Member<glm::vec2> : MemberTraits<8, 8, GL_FLOAT_VEC2> {};
+    template <> struct Member<glm::vec3> : MemberTraits<16, 12, GL_FLOAT_VEC3> {};
+    template <> struct Member<glm::vec4> : MemberTraits<16, 16, GL_FLOAT_VEC4> {};
+    template <> struct Member<glm::ivec2> : MemberTraits<8, 8, GL_INT_VEC2> {};
+    template <> struct Member<glm::ivec4> : MemberTraits<16, 16, GL_INT_VEC4> {};
+    template <> struct Member<glm::mat4> : MemberTraits<16, 64, GL_FLOAT_MAT4> {};
+
+    // Array elements are 16 byte aligned, only vec4 and mat4 elements have the same stride in C++
+    template <typename T, std::size_t N>
+    struct Member<T[N]> : MemberTraits<16, alignUp(Member<T>::size, 16) * N, Member<T>::type>
+    {
+        static_assert(sizeof(T) == alignUp(Member<T>::size, 16), "std140 array elements are padded to 16 bytes, use vec4 or mat4 elements");
+    };
+
+    template <typename... Members>
+    constexpr std::array<std::size_t, sizeof...(Members)> memberOffsets()
+    {
+        constexpr std::size_t alignments[] = {Member<Members>::alignment...};
+        constexpr std::size_t sizes[] = {Member<Members>::size...};
+        std::array<std::size_t, sizeof...(Members)> offsets{};
+        std::size_t offset = 0;
+        for (std::size_t i = 0; i < sizeof...(Members); ++i)
+        {
+            offset = alignUp(offset, alignments[i]);
+            offsets[i] = offset;
+            offset += sizes[i];
+        }
+        return offsets;
+    }
+
+    // Offsets of the members of a block in declaration order, and its size rounded to a vec4
+    template <typename... Members>
+    struct Layout
+    {
+        static constexpr std::size_t count = sizeof...(Members);
+        static constexpr std::array<std::size_t, count> offsets = memberOffsets<Members...>();
+        static constexpr std::array<GLenum, count> types = {Member<Members>::type...};
+        static constexpr std::size_t size = alignUp(offsets[count - 1] + std::array<std::size_t, count>{Member<Members>::size...}[count - 1], 16);
+    };
+}
+
+struct ActiveUniform
+{
+    // Without the [0] of arrays
+    std::string name;
+    GLenum type = 0;
+    // Array length, 1 otherwise
+    int size = 1;
+    // -1 for the members of a block
+    int location = -1;
+    // -1 outside of a block
+    int blockIndex = -1;
+    int offset = -1;
+    int arrayStride = 0;
+    int matrixStride = 0;
+};
+
+struct ActiveAttribute
+{
+    std::string name;
+    GLenum type = 0;
+    int size = 1;
+    int location = -1;
+};
+
+struct ActiveUniformBlock
+{
+    std::string name;
+    unsigned int index = 0;
+    int dataSize = 0;
+    int binding = 0;
+};
+
+// Active uniforms, attributes and uniform blocks of a linked program. Lookups by name throw when the
+// name is not active, instead of handing -1 to GL where the draw silently goes wrong.
+// Names the compiler optimized away are not active either.
+class ProgramReflection
+{
+public:
+    explicit ProgramReflection(unsigned int program)
+        : mProgram(program)
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<char> name((std::size_t)maxLength + 1);
+        std::vector<GLuint> indices;
+        for (GLint i = 0; i < count; i++)
+        {
+            ActiveUniform uniform;
+            GLsizei length = 0;
+            glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, name.data());
+            uniform.location = glGetUniformLocation(program, name.data());
+            uniform.name = trimArraySuffix(std::string(name.data(), (std::size_t)length));
+            mUniforms.push_back(uniform);
+            indices.push_back((GLuint)i);
+        }
+        if (count > 0)
+        {
+            std::vector<GLint> values((std::size_t)count);
+            const std::pair<GLenum, int ActiveUniform::*> properties[] = {{GL_UNIFORM_BLOCK_INDEX, &ActiveUniform::blockIndex},
+                                                                          {GL_UNIFORM_OFFSET, &ActiveUniform::offset},
+                                                                          {GL_UNIFORM_ARRAY_STRIDE, &ActiveUniform::arrayStride},
+                                                                          {GL_UNIFORM_MATRIX_STRIDE, &ActiveUniform::matrixStride}};
+            for (auto const &property : properties)
+            {
+                glGetActiveUniformsiv(program, count, indices.data(), property.first, values.data());
+                for (GLint i = 0; i < count; i++)
+                {
+                    mUniforms[i].*property.second = values[i];
+                }
+            }
+        }
+
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.assign((std::size_t)maxLength + 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            ActiveAttribute attribute;
+            GLsizei length = 0;
+            glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), &length, &attribute.size, &attribute.type, name.data());
+            attribute.name.assign(name.data(), (std::size_t)length);
+            // Built-in inputs such as gl_VertexID have no location
+            attribute.location = glGetAttribLocation(program, name.data());
+            mAttributes.push_back(attribute);
+        }
+
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.assign((std::size_t)maxLength + 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            ActiveUniformBlock block;
+            GLsizei length = 0;
+            glGetActiveUniformBlockName(program, (GLuint)i, (GLsizei)name.size(), &length, name.data());
+            block.name.assign(name.data(), (std::size_t)length);
+            block.index = (unsigned int)i;
+            glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            glGetActiveUniformBlockiv(program, (GLuint)i, GL_UNIFORM_BLOCK_BINDING, &block.binding);
+            mUniformBlocks.push_back(block);
+        }
+    }
+
+    // nullptr when the uniform is not active
+    ActiveUniform const *findUniform(std::string const &name) const
+    {
+        for (auto const &uniform : mUniforms)
+        {
+            if (uniform.name == name)
+            {
+                return &uniform;
+            }
+        }
+        return nullptr;
+    }
+
+    ActiveAttribute const *findAttribute(std::string const &name) const
+    {
+        for (auto const &attribute : mAttributes)
+        {
+            if (attribute.name == name)
+            {
+                return &attribute;
+            }
+        }
+        return nullptr;
+    }
+
+    ActiveUniformBlock const *findUniformBlock(std::string const &name) const
+    {
+        for (auto const &block : mUniformBlocks)
+        {
+            if (block.name == name)
+            {
+                return &block;
+            }
+        }
+        return nullptr;
+    }
+
+    // Location of a uniform outside of any block
+    int uniformLocation(std::string const &name) const
+    {
+        auto uniform = findUniform(name);
+        if (!uniform || uniform->location < 0)
+        {
+            throw std::runtime_error("Program has no active uniform " + name);
+        }
+        return uniform->location;
+    }
+
+    // Location of a uniform the program may not use, -1 then, which glUniform* ignores
+    int optionalUniformLocation(std::string const &name) const
+    {
+        auto uniform = findUniform(name);
+        return uniform ? uniform->location : -1;
+    }
+
+    unsigned int attributeLocation(std::string const &name) const
+    {
+        auto attribute = findAttribute(name);
+        if (!attribute || attribute->location < 0)
+        {
+            throw std::runtime_error("Program has no active attribute " + name);
+        }
+        return (unsigned int)attribute->location;
+    }
+
+    // Location of an attribute the program may not use, -1 then
+    int optionalAttributeLocation(std::string const &name) const
+    {
+        auto attribute = findAttribute(name);
+        return attribute ? attribute->location : -1;
+    }
+
+    ActiveUniformBlock const &uniformBlock(std::string const &name) const
+    {
+        auto block = findUniformBlock(name);
+        if (!block)
+        {
+            throw std::runtime_error("Program has no active uniform block " + name);
+        }
+        return *block;
+    }
+
+    // Connect a block to a binding point of glBindBufferRange
+    void bindUniformBlock(std::string const &name, unsigned int bindingPoint)
+    {
+        auto const &block = uniformBlock(name);
+        glUniformBlockBinding(mProgram, block.index, bindingPoint);
+        mUniformBlocks[block.index].binding = (int)bindingPoint;
+    }
+
+    // Throws unless the block declared in GLSL has the members, types and offsets of the std140::Layout,
+    // in order, and fits in it. Every member of a std140 block is active, a missing one is a wrong name.
+    template <typename BlockLayout>
+    void checkUniformBlock(std::string const &name, std::initializer_list<const char *> memberNames) const
+    {
+        if (memberNames.size() != BlockLayout::count)
+        {
+            throw std::invalid_argument("Uniform block " + name + ": one member name is needed per layout member");
+        }
+        auto const &block = uniformBlock(name);
+        if ((std::size_t)block.dataSize > BlockLayout::size)
+        {
+            throw std::runtime_error("Uniform block " + name + " is " + std::to_string(block.dataSize) + " bytes, larger than its C++ layout of " +
+                                     std::to_string(BlockLayout::size));
+        }
+        std::size_t member = 0;
+        for (auto memberName : memberNames)
+        {
+            auto uniform = findUniform(memberName);
+            if (!uniform || uniform->blockIndex != (int)block.index)
+            {
+                throw std::runtime_error("Uniform block " + name + " has no member " + memberName);
+            }
+            if ((std::size_t)uniform->offset != BlockLayout::offsets[member] || uniform->type != BlockLayout::types[member])
+            {
+                throw std::runtime_error("Uniform block " + name + ": " + memberName + " is at offset " + std::to_string(uniform->offset) +
+                                         " in GLSL and " + std::to_string(BlockLayout::offsets[member]) + " in C++, or has another type");
+            }
+            member++;
+        }
+    }
+
+    std::vector<ActiveUniform> const &uniforms() const
+    {
+        return mUniforms;
+    }
+
+    std::vector<ActiveAttribute> const &attributes() const
+    {
+        return mAttributes;
+    }
+
+    std::vector<ActiveUniformBlock> const &uniformBlocks() const
+    {
+        return mUniformBlocks;
+    }
+
+private:
+    static std::string trimArraySuffix(std::string name)
+    {
+        if (name.size() > 3 && 0 == name.compare(name.size() - 3, 3, "[0]"))
+        {
+            name.resize(name.size() - 3);
+        }
+        return name;
+    }
+
+    unsigned int mProgram;
+    std::vector<ActiveUniform> mUniforms;
+    std::vector<ActiveAttribute> mAttributes;
+    std::vector<ActiveUniformBlock> mUniformBlocks;
+};
@@ -0,0 +1,365 @@
+#pragma once
+
+#include "FrustumCulling.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// Work and time of the last query of a SphereBvh
+struct BvhQueryStatistics
+{
+    std::size_t nodesVisited = 0;
+    std::size_t spheresTested = 0;
+    std::size_t visible = 0;
+    std::size_t culled = 0;
+    double milliseconds = 0.0;
+};
+
+struct BvhRayHit
+{
+    // Index of the sphere given to build()
+    unsigned int sphere = 0;
+    float distance = 0.0f;
+};
+
+// Bounding volume hierarchy over moving bounding spheres.
+// The tree is built top-down with median splits in count, so a subtree of n spheres always takes
+// the same number of nodes: any subtree can be rebuilt in place. Nodes are stored depth first, a
+// left child directly follows its parent, which lets refit() walk the nodes backwards.
+// Each frame the spheres move, refit() updates the boxes without changing the topology, and
+// rebuildIncrementally() rebuilds the subtree whose boxes grew the most since it was built,
+// so the quality of the tree is restored a little every frame instead of with full rebuilds.
+// Leaves keep their spheres as separate x, y, z and radius arrays for the SIMD frustum test.
+class SphereBvh
+{
+public:
+    static constexpr unsigned int maxLeafSize = 8;
+    static constexpr unsigned int noNode = std::numeric_limits<unsigned int>::max();
+
+    struct Node
+    {
+        BoundingBox bounds;
+        unsigned int firstSphere = 0;
+        unsigned int sphereCount = 0;
+        // Left child is the next node, leaves have no right child
+        unsigned int rightChild = noNode;
+        unsigned int parent = noNode;
+
+        bool isLeaf() const
+        {
+            return noNode == rightChild;
+        }
+    };
+
+    void build(std::vector<BoundingSphere> const &spheres)
+    {
+        mSpheres = spheres;
+        mOrder.resize(spheres.size());
+        for (unsigned int i = 0; i < mOrder.size(); i++)
+        {
+            mOrder[i] = i;
+        }
+        mNodes.assign(nodeCount(static_cast<unsigned int>(spheres.size())), Node());
+        mBuildArea.assign(mNodes.size(), 0.0f);
+        mX.resize(spheres.size());
+        mY.resize(spheres.size());
+        mZ.resize(spheres.size());
+        mRadius.resize(spheres.size());
+        if (!spheres.empty())
+        {
+            buildSubtree(0, noNode, 0, static_cast<unsigned int>(spheres.size()));
+        }
+    }
+
+    // Same spheres at new positions, the topology is kept and the boxes are recomputed
+    void refit(std::vector<BoundingSphere> const &spheres)
+    {
+        if (spheres.size() != mSpheres.size())
+        {
+            build(spheres);
+            return;
+        }
+        mSpheres = spheres;
+        for (std::size_t i = 0; i < mOrder.size(); i++)
+        {
+            gather(i);
+        }
+        // Children follow their parents, walking backwards visits them first
+        for (std::size_t node = mNodes.size(); node-- > 0;)
+        {
+            updateBounds(static_cast<unsigned int>(node));
+        }
+    }
+
+    // Rebuild the subtree of at most maxSpheres spheres whose boxes grew the most since they were
+    // built. Returns the number of spheres rebuilt, 0 when no subtree grew more than minGrowth.
+    std::size_t rebuildIncrementally(std::size_t maxSpheres = 1024, float minGrowth = 1.25f)
+    {
+        unsigned int worst = noNode;
+        float worstCost = 0.0f;
+        for (unsigned int node = 0; node < mNodes.size(); node++)
+        {
+            Node const &current = mNodes[node];
+            bool candidate = current.sphereCount <= maxSpheres &&
+                             (noNode == current.parent || mNodes[current.parent].sphereCount > maxSpheres);
+            if (!candidate)
+            {
+                continue;
+            }
+            float area = current.bounds.halfArea();
+            // Growth of the surface area heuristic cost of the subtree
+            float cost = (area - mBuildArea[node]) * current.sphereCount;
+            if (area > minGrowth * mBuildArea[node] && cost > worstCost)
+            {
+                worst = node;
+                worstCost = cost;
+            }
+        }
+        if (noNode == worst)
+        {
+            return 0;
+        }
+
+        Node const &root = mNodes[worst];
+        buildSubtree(worst, root.parent, root.firstSphere, root.sphereCount);
+        for (unsigned int node = mNodes[worst].parent; noNode != node; node = mNodes[node].parent)
+        {
+            updateBounds(node);
+        }
+        return mNodes[worst].sphereCount;
+    }
+
+    // Appends the indices of the spheres intersecting the frustum to visible
+    BvhQueryStatistics cull(Frustum const &frustum, std::vector<unsigned int> &visible, SimdLevel maxLevel = SimdLevel::Avx2) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        BvhQueryStatistics statistics;
+        CullSpheresKernel kernel = selectCullSpheresKernel(maxLevel);
+        std::size_t firstVisible = visible.size();
+        unsigned char leafVisible[maxLeafSize];
+
+        unsigned int stack[64];
+        int stackSize = 0;
+        if (!mNodes.empty())
+        {
+            stack[stackSize++] = 0;
+        }
+        while (stackSize > 0)
+        {
+            Node const &node = mNodes[stack[--stackSize]];
+            ++statistics.nodesVisited;
+            FrustumTest test = frustum.test(node.bounds);
+            if (FrustumTest::Outside == test)
+            {
+                continue;
+            }
+            if (FrustumTest::Inside == test)
+            {
+                // Every sphere below is visible, no need to test them
+                visible.insert(visible.end(), mOrder.begin() + node.firstSphere, mOrder.begin() + node.firstSphere + node.sphereCount);
+                continue;
+            }
+            if (node.isLeaf())
+            {
+                unsigned int first = node.firstSphere;
+                kernel(frustum, &mX[first], &mY[first], &mZ[first], &mRadius[first], node.sphereCount, leafVisible);
+                statistics.spheresTested += node.sphereCount;
+                for (unsigned int i = 0; i < node.sphereCount; i++)
+                {
+                    if (leafVisible[i])
+                    {
+                        visible.push_back(mOrder[first + i]);
+                    }
+                }
+                continue;
+            }
+            stack[stackSize++] = node.rightChild;
+            stack[stackSize++] = static_cast<unsigned int>(&node - mNodes.data()) + 1;
+        }
+
+        statistics.visible = visible.size() - firstVisible;
+        statistics.culled = mSpheres.size() - statistics.visible;
+        statistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return statistics;
+    }
+
+    // Closest sphere hit by the ray, false when the ray misses every sphere
+    bool raycast(Ray const &ray, BvhRayHit &hit, BvhQueryStatistics *statistics = nullptr) const
+    {
+        auto start = std::chrono::steady_clock::now();
+        BvhQueryStatistics queryStatistics;
+        glm::vec3 inverseDirection = 1.0f / ray.direction;
+        float closest = std::numeric_limits<float>::max();
+        bool found = false;
+
+        unsigned int stack[64];
+        int stackSize = 0;
+        if (!mNodes.empty())
+        {
+            stack[stackSize++] = 0;
+        }
+        while (stackSize > 0)
+        {
+            unsigned int index = stack[--stackSize];
+            Node const &node = mNodes[index];
+            ++queryStatistics.nodesVisited;
+            if (intersectRayBox(ray, inverseDirection, node.bounds, closest) < 0.0f)
+            {
+                continue;
+            }
+            if (node.isLeaf())
+            {
+                for (unsigned int i = node.firstSphere; i < node.firstSphere + node.sphereCount; i++)
+                {
+                    float distance = intersectRaySphere(ray, BoundingSphere{glm::vec3(mX[i], mY[i], mZ[i]), mRadius[i]});
+                    if (distance >= 0.0f && distance < closest)
+                    {
+                        closest = distance;
+                        hit.sphere = mOrder[i];
+                        hit.distance = distance;
+                        found = true;
+                    }
+                }
+                queryStatistics.spheresTested += node.sphereCount;
+                continue;
+            }
+            // Visit the nearer child first so the closest hit prunes the other one
+            unsigned int nearChild = index + 1;
+            unsigned int farChild = node.rightChild;
+            if (intersectRayBox(ray, inverseDirection, mNodes[farChild].bounds, closest) >= 0.0f &&
+                glm::dot(mNodes[farChild].bounds.min + mNodes[farChild].bounds.max - mNodes[nearChild].bounds.min - mNodes[nearChild].bounds.max, ray.direction) < 0.0f)
+            {
+                std::swap(nearChild, farChild);
+            }
+            stack[stackSize++] = farChild;
+            stack[stackSize++] = nearChild;
+        }
+
+        queryStatistics.visible = found ? 1 : 0;
+        queryStatistics.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (statistics)
+        {
+            *statistics = queryStatistics;
+        }
+        return found;
+    }
+
+    std::vector<Node> const &nodes() const
+    {
+        return mNodes;
+    }
+
+    // Surface area heuristic cost of the tree relative to right after it was built, 1 is as good as new
+    float quality() const
+    {
+        double current = 0.0, built = 0.0;
+        for (std::size_t node = 0; node < mNodes.size(); node++)
+        {
+            current += mNodes[node].bounds.halfArea();
+            built += mBuildArea[node];
+        }
+        return built > 0.0 ? static_cast<float>(current / built) : 1.0f;
+    }
+
+private:
+    // Leaves of subtrees of count and count + 1 spheres. The median split only ever produces two
+    // consecutive counts per level, so both are computed together in O(log count).
+    static std::pair<unsigned int, unsigned int> leafCounts(unsigned int count)
+    {
+        if (count <= maxLeafSize)
+        {
+            return {1u, count + 1 <= maxLeafSize ? 1u : 2u};
+        }
+        auto half = leafCounts(count / 2);
+        if (0 == count % 2)
+        {
+            return {2 * half.first, half.first + half.second};
+        }
+        return {half.first + half.second, 2 * half.second};
+    }
+
+    // Nodes of a subtree of count spheres, fixed by the median split
+    static unsigned int nodeCount(unsigned int count)
+    {
+        return 2 * leafCounts(count).first - 1;
+    }
+
+    void gather(std::size_t slot)
+    {
+        BoundingSphere const &sphere = mSpheres[mOrder[slot]];
+        mX[slot] = sphere.center.x;
+        mY[slot] = sphere.center.y;
+        mZ[slot] = sphere.center.z;
+        mRadius[slot] = sphere.radius;
+    }
+
+    void updateBounds(unsigned int index)
+    {
+        Node &node = mNodes[index];
+        node.bounds = BoundingBox();
+        if (node.isLeaf())
+        {
+            for (unsigned int i = node.firstSphere; i < node.firstSphere + node.sphereCount; i++)
+            {
+                node.bounds.extend(BoundingSphere{glm::vec3(mX[i], mY[i], mZ[i]), mRadius[i]});
+            }
+        }
+        else
+        {
+            node.bounds.extend(mNodes[index + 1].bounds);
+            node.bounds.extend(mNodes[node.rightChild].bounds);
+        }
+    }
+
+    // Builds the spheres [first, first + count) of mOrder into the nodes starting at index
+    void buildSubtree(unsigned int index, unsigned int parent, unsigned int first, unsigned int count)
+    {
+        Node &node = mNodes[index];
+        node.parent = parent;
+        node.firstSphere = first;
+        node.sphereCount = count;
+        node.rightChild = noNode;
+        if (count <= maxLeafSize)
+        {
+            for (unsigned int slot = first; slot < first + count; slot++)
+            {
+                gather(slot);
+            }
+        }
+        else
+        {
+            // Split at the median of the centers along the longest axis of their bounds
+            glm::vec3 centerMin(std::numeric_limits<float>::max()), centerMax(-std::numeric_limits<float>::max());
+            for (unsigned int slot = first; slot < first + count; slot++)
+            {
+                centerMin = glm::min(centerMin, mSpheres[mOrder[slot]].center);
+                centerMax = glm::max(centerMax, mSpheres[mOrder[slot]].center);
+            }
+            glm::vec3 extent = centerMax - centerMin;
+            int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+            unsigned int leftCount = count / 2;
+            std::nth_element(mOrder.begin() + first, mOrder.begin() + first + leftCount, mOrder.begin() + first + count,
+                             [this, axis](unsigned int a, unsigned int b)
+                             { return mSpheres[a].center[axis] < mSpheres[b].center[axis]; });
+
+            unsigned int rightChild = index + 1 + nodeCount(leftCount);
+            mNodes[index].rightChild = rightChild;
+            buildSubtree(index + 1, index, first, leftCount);
+            buildSubtree(rightChild, index, first + leftCount, count - leftCount);
+        }
+        updateBounds(index);
+        mBuildArea[index] = mNodes[index].bounds.halfArea();
+    }
+
+    std::vector<BoundingSphere> mSpheres;
+    // Sphere index of each slot, the spheres of a node are the slots [firstSphere, firstSphere + sphereCount)
+    std::vector<unsigned int> mOrder;
+    std::vector<float> mX, mY, mZ, mRadius;
+    std::vector<Node> mNodes;
+    // Half area of the boxes when their subtree was last built
+    std::vector<float> mBuildArea;
+};
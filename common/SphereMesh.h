@@ -0,0 +1,328 @@
+#pragma once
+
+#include "Mesh.h"
+#include <glm/trigonometric.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Version of the sphere generators' output, bump it whenever they change so cached meshes are regenerated
+constexpr std::uint32_t sphereMeshVersion = 1;
+
+namespace detail
+{
+    // Fill the vertices and indices of a UV sphere in a single pass.
+    // The sin/cos of every column angle is the same for all the rings, so it is
+    // precomputed once into per-column tables and each ring only adds one sin/cos pair.
+    template <typename Index>
+    void tessellateSphere(Mesh &mesh, std::vector<Index> &indices, float radius, int numSegmentsInWidth, int numSegmentsInHeight)
+    {
+        const int numColumns = numSegmentsInWidth + 1;
+        std::vector<float> columnCos((std::size_t)numColumns);
+        std::vector<float> columnSin((std::size_t)numColumns);
+
+        const float columnStep = 2.0f * glm::pi<float>() / numSegmentsInWidth;
+        for (int column = 0; column < numSegmentsInWidth; ++column)
+        {
+            columnCos[column] = glm::cos(columnStep * column);
+            columnSin[column] = glm::sin(columnStep * column);
+        }
+        // Close the seam exactly, so the first and last column share the same position
+        columnCos[numSegmentsInWidth] = columnCos[0];
+        columnSin[numSegmentsInWidth] = columnSin[0];
+
+        MeshVertex *vertex = mesh.vertices.data();
+        Index *index = indices.data();
+        const float invWidth = 1.0f / numSegmentsInWidth;
+        const float invHeight = 1.0f / numSegmentsInHeight;
+
+        for (int segmentInHeight = 0; segmentInHeight <= numSegmentsInHeight; ++segmentInHeight)
+        {
+            const float horAngle = glm::pi<float>() * segmentInHeight * invHeight;
+            const float ringCos = glm::cos(horAngle);
+            const float ringSin = glm::sin(horAngle);
+            const float z = radius * ringCos;
+            const float v = segmentInHeight * invHeight;
+
+            for (int segmentInWidth = 0; segmentInWidth <= numSegmentsInWidth; ++segmentInWidth, ++vertex)
+            {
+                const float normalX = ringSin * columnCos[segmentInWidth];
+                const float normalZ = ringSin * columnSin[segmentInWidth];
+
+                // Sphere is built with its poles on the Y axis
+                vertex->position[0] = radius * normalX;
+                vertex->position[1] = z;
+                vertex->position[2] = radius * normalZ;
+                vertex->normal[0] = normalX;
+                vertex->normal[1] = ringCos;
+                vertex->normal[2] = normalZ;
+                vertex->texCoord[0] = segmentInWidth * invWidth;
+                vertex->texCoord[1] = v;
+
+                if (segmentInWidth > 0 && segmentInHeight > 0)
+                {
+                    const Index a = (Index)(numColumns * segmentInHeight + segmentInWidth);
+                    const Index b = (Index)(numColumns * segmentInHeight + segmentInWidth - 1);
+                    const Index c = (Index)(numColumns * (segmentInHeight - 1) + segmentInWidth - 1);
+                    const Index d = (Index)(numColumns * (segmentInHeight - 1) + segmentInWidth);
+
+                    // The first and last rings collapse to the poles, so they only need one triangle per quad
+                    if (segmentInHeight != numSegmentsInHeight)
+                    {
+                        *index++ = a;
+                        *index++ = b;
+                        *index++ = c;
+                    }
+                    if (segmentInHeight != 1)
+                    {
+                        *index++ = a;
+                        *index++ = c;
+                        *index++ = d;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Create a UV sphere centred at the origin, with interleaved position, normal and texture coordinate.
+// 16-bit indices are used when possible and 32-bit indices once the vertex count exceeds 65536.
+inline Mesh createSphere(float radius, int numSegmentsInWidth, int numSegmentsInHeight)
+{
+    if (numSegmentsInWidth < 3 || numSegmentsInHeight < 2)
+    {
+        throw std::invalid_argument("Sphere needs at least 3 segments in width and 2 in height");
+    }
+
+    const std::size_t numVertices = (std::size_t)(numSegmentsInWidth + 1) * (numSegmentsInHeight + 1);
+    const std::size_t numIndices = 2 * (std::size_t)numSegmentsInWidth * (numSegmentsInHeight - 1) * 3;
+
+    Mesh mesh;
+    mesh.vertices.resize(numVertices);
+    resizeIndices(mesh, numIndices);
+    visitIndices(mesh, [&](auto &indices)
+                 { detail::tessellateSphere(mesh, indices, radius, numSegmentsInWidth, numSegmentsInHeight); });
+    return mesh;
+}
+
+namespace detail
+{
+    // Vertex on the sphere in the direction of the given point.
+    // Texture coordinates use the same mapping as the UV sphere: poles on the Y axis.
+    inline MeshVertex makeSphereVertex(glm::vec3 const &direction, float radius)
+    {
+        glm::vec3 normal = glm::normalize(direction);
+        float u = std::atan2(normal.z, normal.x) / (2.0f * glm::pi<float>());
+        float v = std::acos(glm::clamp(normal.y, -1.0f, 1.0f)) / glm::pi<float>();
+        return {{radius * normal.x, radius * normal.y, radius * normal.z},
+                {normal.x, normal.y, normal.z},
+                {u < 0.0f ? u + 1.0f : u, v}};
+    }
+
+    inline glm::vec3 vertexDirection(MeshVertex const &vertex)
+    {
+        return glm::vec3(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+    }
+}
+
+// Create a sphere by subdividing an icosahedron; every level splits each triangle in four.
+// Midpoints are shared between the two triangles of an edge through a hash map on the edge.
+// Vertices are not duplicated along the texture seam, so texture coordinates wrap there.
+inline Mesh createIcoSphere(float radius, int numSubdivisions)
+{
+    if (numSubdivisions < 0 || numSubdivisions > 12)
+    {
+        throw std::invalid_argument("Icosphere subdivision level must be between 0 and 12");
+    }
+
+    const float t = (1.0f + std::sqrt(5.0f)) / 2.0f;
+    const glm::vec3 corners[] = {{-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0}, {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t}, {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}};
+    std::vector<unsigned int> indices = {0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+                                         1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+                                         3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+                                         4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1};
+
+    Mesh mesh;
+    // V = 10 * 4^n + 2 and T = 20 * 4^n
+    const std::size_t finalTriangles = (std::size_t)20 << (2 * numSubdivisions);
+    mesh.vertices.reserve(finalTriangles / 2 + 2);
+    for (auto const &corner : corners)
+    {
+        mesh.vertices.push_back(detail::makeSphereVertex(corner, radius));
+    }
+
+    std::unordered_map<std::uint64_t, unsigned int> midpoints;
+    std::vector<unsigned int> subdivided;
+    for (int level = 0; level < numSubdivisions; ++level)
+    {
+        midpoints.clear();
+        midpoints.reserve(indices.size() / 2);
+        subdivided.clear();
+        subdivided.reserve(indices.size() * 4);
+
+        auto midpoint = [&](unsigned int a, unsigned int b)
+        {
+            const std::uint64_t key = ((std::uint64_t)std::min(a, b) << 32) | std::max(a, b);
+            auto inserted = midpoints.emplace(key, (unsigned int)mesh.vertices.size());
+            if (inserted.second)
+            {
+                auto direction = detail::vertexDirection(mesh.vertices[a]) + detail::vertexDirection(mesh.vertices[b]);
+                mesh.vertices.push_back(detail::makeSphereVertex(direction, radius));
+            }
+            return inserted.first->second;
+        };
+
+        for (std::size_t triangle = 0; triangle < indices.size(); triangle += 3)
+        {
+            const unsigned int a = indices[triangle], b = indices[triangle + 1], c = indices[triangle + 2];
+            const unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            subdivided.insert(subdivided.end(), {a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca});
+        }
+        indices.swap(subdivided);
+    }
+
+    assignIndices(mesh, std::move(indices));
+    return mesh;
+}
+
+// Create a sphere by projecting a cube, subdivided into a grid on each face, onto the sphere.
+// Vertices on the cube edges and corners are shared between faces through a hash map on their
+// lattice position; the face interiors are unique and appended directly.
+inline Mesh createCubeSphere(float radius, int numSegmentsPerFace)
+{
+    if (numSegmentsPerFace < 1 || numSegmentsPerFace > 4096)
+    {
+        throw std::invalid_argument("Cube sphere needs between 1 and 4096 segments per face");
+    }
+
+    const int n = numSegmentsPerFace;
+    const std::size_t numVertices = 6 * (std::size_t)n * n + 2;
+    Mesh mesh;
+    mesh.vertices.reserve(numVertices);
+    std::vector<unsigned int> indices;
+    indices.reserve(6 * (std::size_t)n * n * 6);
+
+    // Face normal and the two axes spanning the face, with cross(axisU, axisV) == normal
+    // so the triangles wind counter-clockwise seen from outside
+    const glm::ivec3 normals[] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+    const glm::ivec3 axesU[] = {{0, 1, 0}, {0, 0, 1}, {0, 0, 1}, {1, 0, 0}, {1, 0, 0}, {0, 1, 0}};
+
+    std::unordered_map<std::uint64_t, unsigned int> sharedVertices;
+    std::vector<unsigned int> faceVertices((std::size_t)(n + 1) * (n + 1));
+    for (int face = 0; face < 6; ++face)
+    {
+        const glm::ivec3 normal = normals[face];
+        const glm::ivec3 axisU = axesU[face];
+        const glm::ivec3 axisV(normal.y * axisU.z - normal.z * axisU.y, normal.z * axisU.x - normal.x * axisU.z, normal.x * axisU.y - normal.y * axisU.x);
+
+        for (int j = 0; j <= n; ++j)
+        {
+            for (int i = 0; i <= n; ++i)
+            {
+                // Position on the cube lattice, in [0, 2n] on every axis
+                const glm::ivec3 lattice = (normal + glm::ivec3(1)) * n + axisU * (2 * i - n) + axisV * (2 * j - n);
+                const glm::vec3 direction = glm::vec3(lattice) / (float)n - glm::vec3(1.0f);
+                auto &vertexIndex = faceVertices[(std::size_t)j * (n + 1) + i];
+                if (0 < i && i < n && 0 < j && j < n)
+                {
+                    vertexIndex = (unsigned int)mesh.vertices.size();
+                    mesh.vertices.push_back(detail::makeSphereVertex(direction, radius));
+                    continue;
+                }
+                const std::uint64_t key = ((std::uint64_t)lattice.x << 42) | ((std::uint64_t)lattice.y << 21) | (std::uint64_t)lattice.z;
+                auto inserted = sharedVertices.emplace(key, (unsigned int)mesh.vertices.size());
+                if (inserted.second)
+                {
+                    mesh.vertices.push_back(detail::makeSphereVertex(direction, radius));
+                }
+                vertexIndex = inserted.first->second;
+            }
+        }
+
+        for (int j = 0; j < n; ++j)
+        {
+            for (int i = 0; i < n; ++i)
+            {
+                const unsigned int a = faceVertices[(std::size_t)j * (n + 1) + i];
+                const unsigned int b = faceVertices[(std::size_t)j * (n + 1) + i + 1];
+                const unsigned int c = faceVertices[(std::size_t)(j + 1) * (n + 1) + i + 1];
+                const unsigned int d = faceVertices[(std::size_t)(j + 1) * (n + 1) + i];
+                indices.insert(indices.end(), {a, b, c, a, c, d});
+            }
+        }
+    }
+
+    assignIndices(mesh, std::move(indices));
+    return mesh;
+}
+
+namespace detail
+{
+    // Closest point of the triangle to the origin (Ericson, "Real-Time Collision Detection" 5.1.5)
+    inline glm::vec3 closestPointToOrigin(glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c)
+    {
+        const glm::vec3 ab = b - a, ac = c - a, ap = -a;
+        const float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            return a;
+        }
+        const glm::vec3 bp = -b;
+        const float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            return b;
+        }
+        const float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            return a + ab * (d1 / (d1 - d3));
+        }
+        const glm::vec3 cp = -c;
+        const float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            return c;
+        }
+        const float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            return a + ac * (d2 / (d2 - d6));
+        }
+        const float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        {
+            return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+        }
+        const float denominator = 1.0f / (va + vb + vc);
+        return a + ab * (vb * denominator) + ac * (vc * denominator);
+    }
+}
+
+// Largest distance between the mesh surface and the analytic sphere centred at the origin.
+// The vertices lie on the sphere, so the error is the radius minus the closest approach of any triangle.
+inline float measureSphereError(Mesh const &mesh, float radius)
+{
+    float error = 0.0f;
+    visitIndices(mesh, [&](auto const &indices)
+                 {
+        for (std::size_t triangle = 0; triangle + 2 < indices.size(); triangle += 3)
+        {
+            glm::vec3 corners[3];
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                auto const &position = mesh.vertices[indices[triangle + corner]].position;
+                corners[corner] = glm::vec3(position[0], position[1], position[2]);
+            }
+            float distance = glm::length(detail::closestPointToOrigin(corners[0], corners[1], corners[2]));
+            error = std::max(error, radius - distance);
+        } });
+    return error;
+}
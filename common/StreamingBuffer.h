@@ -0,0 +1,254 @@
+#pragma once
+
+#include "GlExtensions.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// GL 4.4 / ARB_buffer_storage, not part of the GL 3.3 loader
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_ARB_buffer_storage
+typedef void(APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+#endif
+
+enum class StreamingMode
+{
+    // Mapped once for its whole life with glBufferStorage (GL 4.4 or ARB_buffer_storage)
+    PersistentMapped,
+    // Every write maps its range with glMapBufferRange, without synchronization
+    UnsynchronizedMap
+};
+
+inline const char *streamingModeName(StreamingMode mode)
+{
+    return StreamingMode::PersistentMapped == mode ? "persistent" : "unsynchronized map";
+}
+
+struct StreamingStatistics
+{
+    std::size_t frames = 0;
+    // Frames that found the GPU still reading their region and had to wait for its fence
+    std::size_t stalls = 0;
+    double stallMilliseconds = 0.0;
+    std::size_t bytesLastFrame = 0;
+    std::size_t peakBytesPerFrame = 0;
+};
+
+// Part of the buffer written this frame, bind it by offset
+struct StreamAllocation
+{
+    unsigned int buffer = 0;
+    std::size_t offset = 0;
+    std::size_t size = 0;
+};
+
+// Ring of framesInFlight regions over one buffer, for data rewritten every frame (uniform blocks,
+// dynamic vertices). The CPU writes the region of frame n while the GPU still reads the regions
+// of frames n - 1 and n - 2. A fence placed at the end of each frame tells when its region is free again,
+// so there is no orphaning and no implicit synchronization in the driver.
+class StreamingBuffer
+{
+public:
+    static constexpr int framesInFlight = 3;
+
+    StreamingBuffer() = default;
+    StreamingBuffer(StreamingBuffer const &) = delete;
+    StreamingBuffer &operator=(StreamingBuffer const &) = delete;
+
+    ~StreamingBuffer()
+    {
+        release();
+    }
+
+    // Allocates bytesPerFrame for each frame in flight. getProcAddress (glfwGetProcAddress) is used to
+    // find glBufferStorage; without it, or with allowPersistent false, writes map their range instead.
+    void create(std::size_t bytesPerFrame, GLADloadproc getProcAddress, bool allowPersistent = true)
+    {
+        release();
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        mUniformAlignment = (std::size_t)std::max(alignment, 1);
+        mRegionSize = alignUp(bytesPerFrame, mUniformAlignment);
+
+        auto bufferStorage = allowPersistent && getProcAddress && (hasGlVersion(4, 4) || hasGlExtension("GL_ARB_buffer_storage"))
+                                 ? (PFNGLBUFFERSTORAGEPROC)getProcAddress("glBufferStorage")
+                                 : nullptr;
+        glGenBuffers(1, &mBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+        GLsizeiptr size = (GLsizeiptr)(mRegionSize * framesInFlight);
+        if (bufferStorage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            bufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+            mMapped = static_cast<unsigned char *>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        }
+        if (mMapped)
+        {
+            mMode = StreamingMode::PersistentMapped;
+        }
+        else
+        {
+            // Buffer storage is immutable, a failed mapping needs a fresh buffer
+            if (bufferStorage)
+            {
+                glDeleteBuffers(1, &mBuffer);
+                glGenBuffers(1, &mBuffer);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+            }
+            glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            mMode = StreamingMode::UnsynchronizedMap;
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mStatistics = StreamingStatistics();
+    }
+
+    void release()
+    {
+        for (auto &fence : mFences)
+        {
+            if (fence)
+            {
+                glDeleteSync(fence);
+            }
+            fence = nullptr;
+        }
+        if (0 < mBuffer)
+        {
+            if (mMapped)
+            {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &mBuffer);
+        }
+        mBuffer = 0;
+        mMapped = nullptr;
+    }
+
+    // Moves to the next region, waiting for the GPU when it has not finished the frame that used it last
+    void beginFrame()
+    {
+        mRegion = (mRegion + 1) % framesInFlight;
+        mOffset = 0;
+        GLsync &fence = mFences[mRegion];
+        if (fence)
+        {
+            if (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, 0, 0))
+            {
+                auto start = std::chrono::steady_clock::now();
+                GLenum result = GL_TIMEOUT_EXPIRED;
+                while (GL_TIMEOUT_EXPIRED == result)
+                {
+                    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                }
+                mStatistics.stalls++;
+                mStatistics.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            }
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    // Fences the region once every draw reading it has been submitted
+    void endFrame()
+    {
+        mFences[mRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mStatistics.frames++;
+        mStatistics.bytesLastFrame = mOffset;
+        mStatistics.peakBytesPerFrame = std::max(mStatistics.peakBytesPerFrame, mOffset);
+    }
+
+    // Copies size bytes into the region of the frame, at an offset that is a multiple of alignment
+    StreamAllocation write(void const *data, std::size_t size, std::size_t alignment)
+    {
+        std::size_t offset = alignUp(mOffset, std::max<std::size_t>(alignment, 1));
+        if (offset + size > mRegionSize)
+        {
+            throw std::runtime_error("Streaming buffer region of " + std::to_string(mRegionSize) + " bytes is full");
+        }
+        mOffset = offset + size;
+
+        StreamAllocation allocation{mBuffer, mRegion * mRegionSize + offset, size};
+        if (StreamingMode::PersistentMapped == mMode)
+        {
+            std::memcpy(mMapped + allocation.offset, data, size);
+        }
+        else
+        {
+            // The fences already keep the GPU out of this range
+            glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+            void *mapped = glMapBufferRange(GL_COPY_WRITE_BUFFER, (GLintptr)allocation.offset, (GLsizeiptr)size,
+                                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (mapped)
+            {
+                std::memcpy(mapped, data, size);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        return allocation;
+    }
+
+    // Contents of a std140 uniform block
+    template <typename Block>
+    StreamAllocation writeUniformBlock(Block const &block)
+    {
+        return write(&block, sizeof(Block), mUniformAlignment);
+    }
+
+    // Vertices, to use with the offset of the allocation in glVertexAttribPointer
+    template <typename Vertex>
+    StreamAllocation writeVertices(Vertex const *vertices, std::size_t count)
+    {
+        return write(vertices, count * sizeof(Vertex), sizeof(Vertex));
+    }
+
+    static void bindUniformBlock(unsigned int bindingPoint, StreamAllocation const &allocation)
+    {
+        glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, allocation.buffer, (GLintptr)allocation.offset, (GLsizeiptr)allocation.size);
+    }
+
+    StreamingMode mode() const
+    {
+        return mMode;
+    }
+
+    StreamingStatistics const &statistics() const
+    {
+        return mStatistics;
+    }
+
+    unsigned int buffer() const
+    {
+        return mBuffer;
+    }
+
+private:
+    static std::size_t alignUp(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    unsigned int mBuffer = 0;
+    unsigned char *mMapped = nullptr;
+    StreamingMode mMode = StreamingMode::UnsynchronizedMap;
+    std::size_t mRegionSize = 0;
+    std::size_t mUniformAlignment = 256;
+    std::size_t mRegion = 0;
+    std::size_t mOffset = 0;
+    GLsync mFences[framesInFlight] = {};
+    StreamingStatistics mStatistics;
+};
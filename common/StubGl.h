@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// GL loader for the benchmarks that check GL code without a GPU or window.
+// The stub answers the version, extension and integer queries of glad and the common code; each
+// benchmark registers the other entry points it needs, the ones it does not register load as null.
+struct StubGl
+{
+    // Read when glad loads the stub
+    std::string version = "3.3.0 stub";
+    // glad wants at least one extension
+    std::vector<std::string> extensions = {"GL_stub_extension"};
+    // glGetIntegerv answers for anything but GL_NUM_EXTENSIONS, 1 when not listed
+    std::map<GLenum, GLint> integers;
+    // Registered by the benchmark, looked up before the queries above
+    std::vector<std::pair<const char *, void *>> entryPoints;
+};
+
+inline StubGl &stubGl()
+{
+    static StubGl stub;
+    return stub;
+}
+
+inline const GLubyte *APIENTRY stubGlGetString(GLenum name)
+{
+    return reinterpret_cast<const GLubyte *>(GL_VERSION == name ? stubGl().version.c_str() : "stub");
+}
+
+inline void APIENTRY stubGlGetIntegerv(GLenum name, GLint *value)
+{
+    auto const &stub = stubGl();
+    if (GL_NUM_EXTENSIONS == name)
+    {
+        *value = (GLint)stub.extensions.size();
+        return;
+    }
+    auto integer = stub.integers.find(name);
+    *value = stub.integers.end() == integer ? 1 : integer->second;
+}
+
+inline const GLubyte *APIENTRY stubGlGetStringi(GLenum, GLuint index)
+{
+    auto const &extensions = stubGl().extensions;
+    return index < extensions.size() ? reinterpret_cast<const GLubyte *>(extensions[index].c_str()) : nullptr;
+}
+
+// For gladLoadGLLoader and the create() functions that take a GLADloadproc
+inline void *stubGlGetProcAddress(const char *name)
+{
+    for (auto const &entryPoint : stubGl().entryPoints)
+    {
+        if (0 == std::strcmp(entryPoint.first, name))
+        {
+            return entryPoint.second;
+        }
+    }
+    static const std::pair<const char *, void *> queries[] = {
+        {"glGetString", (void *)stubGlGetString}, {"glGetIntegerv", (void *)stubGlGetIntegerv}, {"glGetStringi", (void *)stubGlGetStringi}};
+    for (auto const &query : queries)
+    {
+        if (0 == std::strcmp(query.first, name))
+        {
+            return query.second;
+        }
+    }
+    return nullptr;
+}
+
+// Registers the entry points of a benchmark and loads glad with the stub, false when glad refuses it.
+// Set the version and extensions of stubGl() first, they are read while loading.
+inline bool loadStubGl(std::initializer_list<std::pair<const char *, void *>> entryPoints)
+{
+    stubGl().entryPoints.assign(entryPoints.begin(), entryPoints.end());
+    return 0 != gladLoadGLLoader((GLADloadproc)stubGlGetProcAddress);
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "GlStateCache.h"
+#include "MappedFile.h"
+#include "StreamingBuffer.h"
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using TextureHandle = std::size_t;
+
+struct TextureLoaderStatistics
+{
+    std::size_t requested = 0;
+    std::size_t ready = 0;
+    std::size_t failed = 0;
+    // Bytes copied into the upload ring by the last update(), at most the budget
+    std::size_t bytesLastFrame = 0;
+    // Time the decode threads spent reading and decoding, summed over the threads
+    double decodeMilliseconds = 0.0;
+    // Longest time from load() to a texture being ready
+    double slowestMilliseconds = 0.0;
+};
+
+// Loads textures without stalling the GL thread.
+// Decode threads read and decode the files with stb_image, flipped so the first row is the bottom one
+// as GL expects. JPEG rows are written straight into the decoded image, which saves stb_image its own
+// full-size copy; other formats keep the image stb_image allocates. Once per frame, update() copies
+// decoded rows into a ring of pixel unpack buffers, no more than bytesPerFrame of them, and
+// glTexSubImage2D sources them from there, so the GL thread only pays for a bounded memcpy and the
+// driver copies to the texture asynchronously. A large image takes several frames.
+// Until a texture is complete, texture() returns a 1x1 grey placeholder, the draws go on with it.
+// The decode threads stop decoding while more than maxDecodedBytes wait for their upload.
+class TextureLoader
+{
+public:
+    TextureLoader() = default;
+    TextureLoader(TextureLoader const &) = delete;
+    TextureLoader &operator=(TextureLoader const &) = delete;
+
+    ~TextureLoader()
+    {
+        release();
+    }
+
+    // Textures are bound through state, which must outlive the loader. threadCount 0 uses every
+    // hardware thread but the GL one, and at least one.
+    void create(GLADloadproc getProcAddress, GlStateCache &state, std::size_t bytesPerFrame, unsigned int threadCount = 0,
+                std::size_t maxDecodedBytes = 256 * 1024 * 1024)
+    {
+        release();
+        mState = &state;
+        mBudget = bytesPerFrame;
+        mMaxDecodedBytes = maxDecodedBytes;
+        mUploadBuffer.create(bytesPerFrame, getProcAddress);
+
+        const unsigned char grey[4] = {128, 128, 128, 255};
+        glGenTextures(1, &mPlaceholder);
+        mState->bindTexture(0, GL_TEXTURE_2D, mPlaceholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+
+        if (0 == threadCount)
+        {
+            threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        }
+        mStop = false;
+        for (unsigned int i = 0; i < threadCount; i++)
+        {
+            mThreads.emplace_back([this]
+                                  { decodeLoop(); });
+        }
+    }
+
+    // Stops the decode threads and deletes every texture, the handles become invalid
+    void release()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+            mRequests.clear();
+        }
+        mWakeUp.notify_all();
+        for (std::thread &thread : mThreads)
+        {
+            thread.join();
+        }
+        mThreads.clear();
+        mDecoded.clear();
+        mUploads.clear();
+        mDecodedBytes = 0;
+
+        for (auto &entry : mTextures)
+        {
+            if (0 != entry.texture)
+            {
+                deleteTexture(entry.texture);
+            }
+        }
+        mTextures.clear();
+        if (0 != mPlaceholder)
+        {
+            deleteTexture(mPlaceholder);
+        }
+        mPlaceholder = 0;
+        mUploadBuffer.release();
+        mStatistics = TextureLoaderStatistics();
+    }
+
+    // Queues the file for decoding and returns at once, texture() is the placeholder until it is ready
+    TextureHandle load(std::string const &filePath)
+    {
+        Entry entry;
+        entry.filePath = filePath;
+        entry.loadTime = std::chrono::steady_clock::now();
+        mTextures.push_back(std::move(entry));
+        TextureHandle handle = mTextures.size() - 1;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mRequests.push_back({handle, filePath});
+        }
+        mWakeUp.notify_one();
+        mStatistics.requested++;
+        return handle;
+    }
+
+    // Once per frame on the GL thread: uploads up to the byte budget of decoded rows
+    void update()
+    {
+        mUploadBuffer.beginFrame();
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            while (!mDecoded.empty())
+            {
+                mUploads.push_back(std::move(mDecoded.front()));
+                mDecoded.pop_front();
+            }
+        }
+
+        std::size_t used = 0;
+        bool bound = false;
+        // RGB rows are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (!mUploads.empty())
+        {
+            Decoded &image = mUploads.front();
+            Entry &entry = mTextures[image.handle];
+            if (!image.pixels)
+            {
+                fail(entry, image.error);
+                finishUpload();
+                continue;
+            }
+            std::size_t rowBytes = (std::size_t)image.width * (std::size_t)image.components;
+            if (rowBytes > mBudget)
+            {
+                fail(entry, "Rows of " + entry.filePath + " are larger than the upload budget of " + std::to_string(mBudget) + " bytes");
+                finishUpload();
+                continue;
+            }
+            std::size_t offset = alignUp(used, 4);
+            std::size_t rows = std::min<std::size_t>((std::size_t)image.height - image.uploadedRows, offset < mBudget ? (mBudget - offset) / rowBytes : 0);
+            if (0 == rows)
+            {
+                break;
+            }
+
+            GLenum format = 4 == image.components ? GL_RGBA : GL_RGB;
+            if (0 == entry.texture)
+            {
+                // Storage without pixels, a null pointer would be an offset in a bound unpack buffer
+                if (bound)
+                {
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    bound = false;
+                }
+                glGenTextures(1, &entry.texture);
+                mState->bindTexture(0, GL_TEXTURE_2D, entry.texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+                glTexImage2D(GL_TEXTURE_2D, 0, 4 == image.components ? GL_RGBA8 : GL_RGB8, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+            }
+            mState->bindTexture(0, GL_TEXTURE_2D, entry.texture);
+            if (!bound)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mUploadBuffer.buffer());
+                bound = true;
+            }
+
+            StreamAllocation allocation = mUploadBuffer.write(image.pixels.get() + image.uploadedRows * rowBytes, rows * rowBytes, 4);
+            used = offset + rows * rowBytes;
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, image.uploadedRows, image.width, (GLsizei)rows, format, GL_UNSIGNED_BYTE,
+                            (const void *)allocation.offset);
+            image.uploadedRows += (int)rows;
+            if (image.uploadedRows == image.height)
+            {
+                glGenerateMipmap(GL_TEXTURE_2D);
+                entry.ready = true;
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - entry.loadTime).count();
+                mStatistics.ready++;
+                mStatistics.slowestMilliseconds = std::max(mStatistics.slowestMilliseconds, milliseconds);
+                finishUpload();
+            }
+        }
+        if (bound)
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        mUploadBuffer.endFrame();
+        mStatistics.bytesLastFrame = used;
+    }
+
+    // Whether the texture is complete, throws when it could not be loaded
+    bool ready(TextureHandle handle) const
+    {
+        Entry const &entry = mTextures.at(handle);
+        if (!entry.error.empty())
+        {
+            throw std::runtime_error(entry.error);
+        }
+        return entry.ready;
+    }
+
+    bool allReady() const
+    {
+        for (TextureHandle handle = 0; handle < mTextures.size(); handle++)
+        {
+            if (!ready(handle))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The texture once it is complete, the placeholder until then and when it failed
+    unsigned int texture(TextureHandle handle) const
+    {
+        Entry const &entry = mTextures.at(handle);
+        return entry.ready ? entry.texture : mPlaceholder;
+    }
+
+    unsigned int placeholder() const
+    {
+        return mPlaceholder;
+    }
+
+    TextureLoaderStatistics statistics() const
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mStatistics;
+    }
+
+private:
+    struct Entry
+    {
+        std::string filePath;
+        unsigned int texture = 0;
+        bool ready = false;
+        std::string error;
+        std::chrono::steady_clock::time_point loadTime;
+    };
+
+    struct Request
+    {
+        TextureHandle handle;
+        std::string filePath;
+    };
+
+    // Pixels allocated by stb_image, or by decode() for a JPEG decoded into them
+    struct FreeImage
+    {
+        // Not a member initializer, a nested class only gets those once TextureLoader is complete
+        FreeImage() : ownedByStb(true)
+        {
+        }
+        bool ownedByStb;
+        void operator()(unsigned char *pixels) const
+        {
+            if (ownedByStb)
+            {
+                stbi_image_free(pixels);
+            }
+            else
+            {
+                delete[] pixels;
+            }
+        }
+    };
+
+    // Rows bottom first, tightly packed. No pixels when the file could not be read or decoded.
+    struct Decoded
+    {
+        TextureHandle handle = 0;
+        std::unique_ptr<unsigned char, FreeImage> pixels;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        int uploadedRows = 0;
+        std::string error;
+    };
+
+    static std::size_t alignUp(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    static std::size_t imageBytes(Decoded const &image)
+    {
+        return (std::size_t)image.width * (std::size_t)image.height * (std::size_t)image.components;
+    }
+
+    // Starts with a JPEG start of image marker
+    static bool isJpeg(MappedFile const &file)
+    {
+        return file.size() >= 2 && 0xFF == file.data()[0] && 0xD8 == file.data()[1];
+    }
+
+    static Decoded decode(Request const &request)
+    {
+        Decoded image;
+        image.handle = request.handle;
+        MappedFile file;
+        if (!file.open(request.filePath))
+        {
+            image.error = "Failed to read image " + request.filePath;
+            return image;
+        }
+        // 3 components stay RGB, grey and grey alpha are expanded to RGBA
+        int components = 0;
+        if (stbi_info_from_memory(file.data(), (int)file.size(), &image.width, &image.height, &components))
+        {
+            image.components = 3 == components ? 3 : 4;
+            if (isJpeg(file))
+            {
+                // The JPEG decoder writes its rows into the caller's memory, flipped, without a
+                // full-size image of its own. The other decoders would only add a copy into it.
+                std::size_t size = imageBytes(image);
+                image.pixels.get_deleter().ownedByStb = false;
+                image.pixels.reset(new (std::nothrow) unsigned char[size]);
+                if (!image.pixels)
+                {
+                    image.error = "Out of memory for image " + request.filePath;
+                    return image;
+                }
+                if (!stbi_load_from_memory_into(file.data(), (int)file.size(), image.pixels.get(), size, image.width * image.components, 1,
+                                                &image.width, &image.height, &components, image.components))
+                {
+                    image.pixels.reset();
+                }
+            }
+            else
+            {
+                stbi_set_flip_vertically_on_load_thread(1);
+                image.pixels.reset(stbi_load_from_memory(file.data(), (int)file.size(), &image.width, &image.height, &components, image.components));
+            }
+        }
+        if (!image.pixels)
+        {
+            image.error = "Failed to load image " + request.filePath + ": " + stbi_failure_reason();
+        }
+        return image;
+    }
+
+    void decodeLoop()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        while (true)
+        {
+            mWakeUp.wait(lock, [this]
+                         { return mStop || (!mRequests.empty() && mDecodedBytes < mMaxDecodedBytes); });
+            if (mStop)
+            {
+                return;
+            }
+            Request request = std::move(mRequests.front());
+            mRequests.pop_front();
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            Decoded image = decode(request);
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            lock.lock();
+            mStatistics.decodeMilliseconds += milliseconds;
+            mDecodedBytes += imageBytes(image);
+            mDecoded.push_back(std::move(image));
+        }
+    }
+
+    void fail(Entry &entry, std::string const &error)
+    {
+        entry.error = error;
+        mStatistics.failed++;
+    }
+
+    // Drops the front upload and lets the decode threads go on when they were waiting for room
+    void finishUpload()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDecodedBytes -= imageBytes(mUploads.front());
+        }
+        mUploads.pop_front();
+        mWakeUp.notify_all();
+    }
+
+    void deleteTexture(unsigned int &texture)
+    {
+        mState->forgetTexture(texture);
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+
+    GlStateCache *mState = nullptr;
+    std::size_t mBudget = 0;
+    StreamingBuffer mUploadBuffer;
+    unsigned int mPlaceholder = 0;
+    // Only touched by the GL thread
+    std::vector<Entry> mTextures;
+    std::deque<Decoded> mUploads;
+
+    // Shared with the decode threads
+    mutable std::mutex mMutex;
+    std::condition_variable mWakeUp;
+    std::deque<Request> mRequests;
+    std::deque<Decoded> mDecoded;
+    std::size_t mDecodedBytes = 0;
+    std::size_t mMaxDecodedBytes = 0;
+    bool mStop = false;
+    std::vector<std::thread> mThreads;
+    TextureLoaderStatistics mStatistics;
+};
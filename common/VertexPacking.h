@@ -0,0 +1,193 @@
+#pragma once
+
+#include "Mesh.h"
+#include <glm/gtc/packing.hpp>
+#include <glm/packing.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Version of the packed vertex layout and encoding, bump it whenever they change so cached meshes are regenerated
+constexpr std::uint32_t vertexPackingVersion = 1;
+
+// Compressed vertex, 16 bytes instead of the 32 bytes of MeshVertex:
+//  - position: snorm16 x4 relative to the mesh bounds (w is unused)
+//  - normal:   octahedral encoding, snorm16 x2
+//  - texCoord: half float x2
+// The fields hold the packed GLM values, which match the GL attribute layout on little-endian targets.
+struct PackedVertex
+{
+    std::uint64_t position;
+    std::uint32_t normal;
+    std::uint32_t texCoord;
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay tightly packed");
+
+// Box the quantized positions are relative to
+struct QuantizationBounds
+{
+    glm::vec3 center{0.0f};
+    glm::vec3 halfExtent{1.0f};
+
+    // Maps the snorm positions back to object space, multiply it into the model transformation
+    glm::mat4 decodeMatrix() const
+    {
+        return glm::scale(glm::translate(glm::mat4(1.0f), center), halfExtent);
+    }
+};
+
+// One attribute of a vertex format, as passed to glVertexAttribPointer
+struct VertexAttributeFormat
+{
+    const char *name;
+    int size;
+    unsigned int type;
+    unsigned char normalized;
+    std::size_t offset;
+};
+
+struct VertexFormat
+{
+    std::size_t stride;
+    std::vector<VertexAttributeFormat> attributes;
+};
+
+inline VertexFormat meshVertexFormat()
+{
+    return {sizeof(MeshVertex),
+            {{"aPos", 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, position)},
+             {"aNormal", 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, normal)},
+             {"aTexCoord", 2, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, texCoord)}}};
+}
+
+inline VertexFormat packedVertexFormat()
+{
+    return {sizeof(PackedVertex),
+            {{"aPos", 3, GL_SHORT, GL_TRUE, offsetof(PackedVertex, position)},
+             {"aNormal", 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal)},
+             {"aTexCoord", 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord)}}};
+}
+
+// Set up the attributes of the bound vertex array and array buffer.
+// Attributes the program does not use are skipped.
+inline void applyVertexFormat(VertexFormat const &format, unsigned int program)
+{
+    for (auto const &attribute : format.attributes)
+    {
+        auto location = glGetAttribLocation(program, attribute.name);
+        if (location < 0)
+        {
+            continue;
+        }
+        glVertexAttribPointer((GLuint)location, attribute.size, attribute.type, attribute.normalized, (GLsizei)format.stride, (void *)attribute.offset);
+        glEnableVertexAttribArray((GLuint)location);
+    }
+}
+
+// GLSL function decoding the normal of a packed vertex, append it to the shader source
+constexpr const char *octahedralDecodeGlsl = "vec3 octahedralDecode(vec2 e)\n"
+                                             "{\n"
+                                             "   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+                                             "   if (n.z < 0.0)\n"
+                                             "      n.xy = (1.0 - abs(n.yx)) * mix(vec2(-1.0), vec2(1.0), greaterThanEqual(n.xy, vec2(0.0)));\n"
+                                             "   return normalize(n);\n"
+                                             "}\n";
+
+// Project a unit vector onto the octahedron and unfold it into [-1, 1]^2
+inline glm::vec2 octahedralEncode(glm::vec3 const &normal)
+{
+    glm::vec2 encoded = glm::vec2(normal) / (std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z));
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 signs(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+        encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) * signs;
+    }
+    return encoded;
+}
+
+inline glm::vec3 octahedralDecode(glm::vec2 const &encoded)
+{
+    glm::vec3 normal(encoded, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+    if (normal.z < 0.0f)
+    {
+        glm::vec2 signs(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) * signs;
+        normal.x = folded.x;
+        normal.y = folded.y;
+    }
+    return glm::normalize(normal);
+}
+
+inline QuantizationBounds computeQuantizationBounds(const MeshVertex *vertices, std::size_t vertexCount)
+{
+    QuantizationBounds bounds;
+    if (0 == vertexCount)
+    {
+        return bounds;
+    }
+    glm::vec3 minimum(vertices[0].position[0], vertices[0].position[1], vertices[0].position[2]);
+    glm::vec3 maximum = minimum;
+    for (std::size_t i = 1; i < vertexCount; ++i)
+    {
+        glm::vec3 position(vertices[i].position[0], vertices[i].position[1], vertices[i].position[2]);
+        minimum = glm::min(minimum, position);
+        maximum = glm::max(maximum, position);
+    }
+    bounds.center = 0.5f * (minimum + maximum);
+    // Flat meshes still need a non zero scale on every axis
+    bounds.halfExtent = glm::max(0.5f * (maximum - minimum), glm::vec3(1e-6f));
+    return bounds;
+}
+
+inline PackedVertex packVertex(MeshVertex const &vertex, QuantizationBounds const &bounds)
+{
+    glm::vec3 position(vertex.position[0], vertex.position[1], vertex.position[2]);
+    glm::vec3 normal(vertex.normal[0], vertex.normal[1], vertex.normal[2]);
+
+    PackedVertex packed;
+    packed.position = glm::packSnorm4x16(glm::vec4((position - bounds.center) / bounds.halfExtent, 0.0f));
+    packed.normal = glm::packSnorm2x16(octahedralEncode(normal));
+    packed.texCoord = glm::packHalf2x16(glm::vec2(vertex.texCoord[0], vertex.texCoord[1]));
+    return packed;
+}
+
+inline MeshVertex unpackVertex(PackedVertex const &packed, QuantizationBounds const &bounds)
+{
+    glm::vec3 position = bounds.center + glm::vec3(glm::unpackSnorm4x16(packed.position)) * bounds.halfExtent;
+    glm::vec3 normal = octahedralDecode(glm::unpackSnorm2x16(packed.normal));
+    glm::vec2 texCoord = glm::unpackHalf2x16(packed.texCoord);
+    return {{position.x, position.y, position.z}, {normal.x, normal.y, normal.z}, {texCoord.x, texCoord.y}};
+}
+
+// Packed copy of the vertices of a mesh, the indices are unchanged
+struct PackedVertices
+{
+    std::vector<PackedVertex> vertices;
+    QuantizationBounds bounds;
+
+    std::size_t vertexDataSize() const
+    {
+        return vertices.size() * sizeof(PackedVertex);
+    }
+};
+
+inline PackedVertices packVertices(const MeshVertex *vertices, std::size_t vertexCount)
+{
+    PackedVertices packed;
+    packed.bounds = computeQuantizationBounds(vertices, vertexCount);
+    packed.vertices.resize(vertexCount);
+    for (std::size_t i = 0; i < vertexCount; ++i)
+    {
+        packed.vertices[i] = packVertex(vertices[i], packed.bounds);
+    }
+    return packed;
+}
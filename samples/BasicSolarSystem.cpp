@@ -4,11 +4,27 @@
 #include <glm/mat4x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <glm/gtc/matrix_inverse.hpp>
+#include <SphereMesh.h>
+#include <MeshCache.h>
+#include <MeshLod.h>
+#include <MeshOptimizer.h>
+#include <VertexPacking.h>
+#include <SceneGraph.h>
+#include <JobSystem.h>
+#include <SphereBvh.h>
+#include <NBody.h>
+#include <MultiDrawIndirect.h>
+#include <RenderQueue.h>
+#include <ProgramManager.h>
+#include <ShaderReflection.h>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <stdexcept>
 #include <cmath>
+#include <string>
 #include <vector>
 
 auto constexpr screenWidth = 800;
@@ -19,21 +35,101 @@ unsigned int geometryVertexBuffer = 0;
 unsigned int geometryIndexBuffer = 0;
 unsigned int geometryVertexArrayObject = 0;
 
+// Program, vertex array and polygon mode changes go through the cache, which drops the redundant ones
+GlStateCache glState;
+// Per object draws are recorded from the jobs, sorted by state then front to back, and replayed here
+RenderQueue renderQueue;
+
+// Time to the first frame is measured from the start of the program
+const auto startTime = std::chrono::steady_clock::now();
+
 // Shader variables
+// The driver compiles the programs while the rest of the setup runs. Until they are ready the planets
+// are drawn one by one with the fallback program, which is compiled right away, and the asteroids wait.
+// Run with --no-parallel-shaders to wait for them instead, even with KHR_parallel_shader_compile.
+bool parallelShaderCompile = true;
+ProgramManager programs;
+ProgramHandle shaderProgramHandle = 0;
+ProgramHandle instancedProgramHandle = 0;
+unsigned int fallbackProgram = 0;
+// 0 until ready
 unsigned int shaderProgram = 0;
-unsigned int vertexColorShaderVar = 0;
-unsigned int modelShaderVar = 0;
+// Program of the per object draws, the fallback until shaderProgram is ready
+unsigned int meshProgram = 0;
+int vertexColorShaderVar = -1;
+int modelShaderVar = -1;
+
+// Instanced drawing: the same buffers seen through a second vertex array with the instance attributes.
+// Press I to switch between one draw per object and one multi-draw for the whole frame.
+bool instancedRendering = true;
+unsigned int instancedShaderProgram = 0;
+int instancedDecodeShaderVar = -1;
+InstanceAttributeLocations instancedAttributes;
+unsigned int instancedVertexArrayObject = 0;
+MultiDrawPass multiDrawPass;
+std::vector<MultiDrawObject> frameObjects;
+InstanceStatistics instanceStatistics;
 
 // Geometry
-std::vector<float> sphereVertices;
-std::vector<float> sphereNormals;
-std::vector<float> sphereTextCoords;
-std::vector<short> sphereIndices;
+LodChain sphereLods;
+// The sphere levels of detail followed by the asteroid shapes, in one vertex and index buffer
+MeshBatchLayout sceneMeshes;
+std::size_t icoSphereMesh = 0;
+std::size_t cubeSphereMesh = 0;
+QuantizationBounds sphereBounds;
+LodSettings lodSettings;
+LodStatistics lodStatistics;
+glm::vec2 viewportSize(screenWidth, screenHeight);
 
 // Position of the Sun
 float sunPositionX = 0.0f;
 float sunPositionY = 0.0f;
 
+// Transform hierarchy
+// CPU work of a frame fans out over these threads, the main thread only submits GL commands
+JobSystem jobs;
+TransformHierarchy solarSystem;
+TransformNode sunNode = noParentNode;
+TransformNode sunSpinNode = noParentNode;
+TransformNode earthOrbitNode = noParentNode;
+TransformNode earthNode = noParentNode;
+TransformNode moonOrbitNode = noParentNode;
+TransformNode moonNode = noParentNode;
+TransformNode marsOrbitNode = noParentNode;
+TransformNode marsNode = noParentNode;
+
+// Bodies drawn each frame, culled and picked through a BVH over their bounding spheres
+struct Body
+{
+    TransformNode node;
+    glm::vec3 color;
+    const char *name;
+    int lodLevel;
+};
+std::vector<Body> bodies;
+
+// Gravity moves the bodies, in the frame of the Sun with G = 1 and times in seconds.
+// The Earth goes around the Sun in about 12 seconds. The Moon orbits much closer than drawn,
+// further out the Sun would pull it away from the Earth.
+NBodySimulation gravity;
+std::size_t sunBody = 0, earthBody = 0, moonBody = 0, marsBody = 0;
+constexpr float sunMass = 274.0f;
+constexpr float moonDistance = 0.7f;
+constexpr float moonDistanceScale = 4.0f / moonDistance;
+std::vector<BoundingSphere> bodySpheres;
+SphereBvh bodyBvh;
+std::vector<unsigned int> visibleBodies;
+BvhQueryStatistics cullStatistics;
+BvhQueryStatistics pickStatistics;
+int pickedBody = -1;
+
+// Asteroid belt beyond Mars, test particles on circular orbits around the Sun
+constexpr std::size_t asteroidCount = 100000;
+std::vector<float> asteroidDistance, asteroidPhase, asteroidScale;
+std::vector<InstanceData> asteroidInstances;
+std::vector<int> asteroidLodLevels;
+std::vector<std::size_t> asteroidMeshes;
+
 const char *vertexShaderSource = "#version 330 core\n"
                                  "layout (location = 0) in vec3 aPos;\n"
                                  "uniform mat4 uTransform;\n"
@@ -50,10 +146,65 @@ const char *fragmentShaderSource = "#version 330 core\n"
                                    "   FragColor = uFillColor;\n"
                                    "}\n\0";
 
+// Same as above with the transformation and color of each instance as attributes
+const std::string instancedVertexShaderSource = std::string("#version 330 core\n"
+                                                            "layout (location = 0) in vec3 aPos;\n") +
+                                                instanceAttributesGlsl +
+                                                "uniform mat4 uDecode;\n"
+                                                "out vec4 vFillColor;\n"
+                                                "void main()\n"
+                                                "{\n"
+                                                "   gl_Position = aInstanceWorld * uDecode * vec4(aPos, 1.0);\n"
+                                                "   vFillColor = aInstanceColor;\n"
+                                                "}\n";
+
+const char *instancedFragmentShaderSource = "#version 330 core\n"
+                                            "in vec4 vFillColor;\n"
+                                            "out vec4 FragColor;\n"
+                                            "void main()\n"
+                                            "{\n"
+                                            "   FragColor = vFillColor;\n"
+                                            "}\n\0";
+
+// Grey bodies until the real programs are ready
+const char *fallbackFragmentShaderSource = "#version 330 core\n"
+                                           "out vec4 FragColor;\n"
+                                           "void main()\n"
+                                           "{\n"
+                                           "   FragColor = vec4(0.5, 0.5, 0.5, 1.0);\n"
+                                           "}\n\0";
+
 // Whenever the window size changed this callback function executes
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    viewportSize = glm::vec2(width, height);
+}
+
+// Pick the body under the cursor on a left click
+void mouse_button_callback(GLFWwindow *window, int button, int action, int /*mods*/)
+{
+    if (GLFW_MOUSE_BUTTON_LEFT != button || GLFW_PRESS != action)
+    {
+        return;
+    }
+    double cursorX, cursorY;
+    glfwGetCursorPos(window, &cursorX, &cursorY);
+    int width, height;
+    glfwGetWindowSize(window, &width, &height);
+    // The bodies are drawn without camera, world space is clip space
+    Ray ray = rayFromScreen(glm::vec2(cursorX, cursorY), glm::vec2(width, height), glm::mat4(1.0f));
+    BvhRayHit hit;
+    pickedBody = bodyBvh.raycast(ray, hit, &pickStatistics) ? (int)hit.sphere : -1;
+}
+
+// Switch the drawing mode on I
+void key_callback(GLFWwindow * /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
+{
+    if (GLFW_KEY_I == key && GLFW_PRESS == action)
+    {
+        instancedRendering = !instancedRendering;
+    }
 }
 
 // Process the keyboard events
@@ -103,133 +254,89 @@ GLFWwindow *createAndConfigureWindow()
     return window;
 }
 
-void createSphere(float radius, int numSegmentsInWidth, int numSegmentsInHeight)
+// Program of the per object draws, with its shader variables
+void useMeshProgram(unsigned int program)
 {
-    int numVertices = (numSegmentsInWidth + 1) * (numSegmentsInHeight + 1);
-    int numIndices = 2 * numSegmentsInWidth * (numSegmentsInHeight - 1) * 3;
-    int numUvs = (numSegmentsInHeight + 1) * (numSegmentsInWidth + 1) * 2;
-
-    sphereVertices.resize((unsigned int)(numVertices * 3));
-    sphereNormals.resize((unsigned int)(numVertices * 3));
-    sphereIndices.resize((unsigned int)numIndices);
-
-    int segmentInWidth, segmentInHeight;
-    int vertIndex = 0, index = 0;
-    const float normLen = 1.0f / radius;
+    meshProgram = program;
+    ProgramReflection reflection(program);
+    // The grey fallback has no fill color
+    vertexColorShaderVar = reflection.optionalUniformLocation("uFillColor");
+    modelShaderVar = reflection.uniformLocation("uTransform");
+}
 
-    for (segmentInHeight = 0; segmentInHeight <= numSegmentsInHeight; ++segmentInHeight)
+// Switch to the real programs once the driver has them ready, never waits with parallel shader compile
+void updatePrograms()
+{
+    if (0 == shaderProgram && programs.ready(shaderProgramHandle))
     {
-        float horAngle = (float)glm::pi<float>() * segmentInHeight / numSegmentsInHeight;
-        float z = radius * (float)cos(horAngle);
-        float ringRadius = radius * (float)sin(horAngle);
-
-        for (segmentInWidth = 0; segmentInWidth <= numSegmentsInWidth; ++segmentInWidth)
-        {
-            float verAngle = 2.0f * (float)glm::pi<float>() * segmentInWidth / numSegmentsInWidth;
-            float x = ringRadius * (float)cos(verAngle);
-            float y = ringRadius * (float)sin(verAngle);
-
-            sphereNormals[vertIndex] = x * normLen;
-            sphereVertices[vertIndex++] = x;
-            sphereNormals[vertIndex] = z * normLen;
-            sphereVertices[vertIndex++] = z;
-            sphereNormals[vertIndex] = y * normLen;
-            sphereVertices[vertIndex++] = y;
-
-            if (segmentInWidth > 0 && segmentInHeight > 0)
-            {
-                int a = ((numSegmentsInWidth + 1) * segmentInHeight + segmentInWidth);
-                int b = ((numSegmentsInWidth + 1) * segmentInHeight + segmentInWidth - 1);
-                int c = ((numSegmentsInWidth + 1) * (segmentInHeight - 1) + segmentInWidth - 1);
-                int d = ((numSegmentsInWidth + 1) * (segmentInHeight - 1) + segmentInWidth);
-
-                if (segmentInHeight == numSegmentsInHeight)
-                {
-                    sphereIndices[index++] = (short)a;
-                    sphereIndices[index++] = (short)c;
-                    sphereIndices[index++] = (short)d;
-                }
-                else if (segmentInHeight == 1)
-                {
-                    sphereIndices[index++] = (short)a;
-                    sphereIndices[index++] = (short)b;
-                    sphereIndices[index++] = (short)c;
-                }
-                else
-                {
-                    sphereIndices[index++] = (short)a;
-                    sphereIndices[index++] = (short)b;
-                    sphereIndices[index++] = (short)c;
-                    sphereIndices[index++] = (short)a;
-                    sphereIndices[index++] = (short)c;
-                    sphereIndices[index++] = (short)d;
-                }
-            }
-        }
+        shaderProgram = programs.program(shaderProgramHandle);
+        useMeshProgram(shaderProgram);
     }
-
-    sphereTextCoords.resize((unsigned int)numUvs);
-
-    numUvs = 0;
-    for (segmentInHeight = 0; segmentInHeight <= numSegmentsInHeight; ++segmentInHeight)
+    if (0 == instancedShaderProgram && programs.ready(instancedProgramHandle))
     {
-        for (segmentInWidth = 0; segmentInWidth <= numSegmentsInWidth; ++segmentInWidth)
-        {
-            sphereTextCoords[numUvs++] = (float)segmentInWidth / numSegmentsInWidth;
-            sphereTextCoords[numUvs++] = (float)segmentInHeight / numSegmentsInHeight;
-        }
+        instancedShaderProgram = programs.program(instancedProgramHandle);
+        ProgramReflection reflection(instancedShaderProgram);
+        instancedDecodeShaderVar = reflection.uniformLocation("uDecode");
+        instancedAttributes = InstanceAttributeLocations(reflection);
     }
 }
 
-void setupTriangle()
+// Milliseconds since the start of the program
+double elapsedSinceStart()
 {
-    // Build and compile shader program
-    // Vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile vertex shader " + std::string(infoLog));
-    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
 
-    // Fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile fragment shader " + std::string(infoLog));
-    }
+void setupTriangle()
+{
+    // The fallback program first, so the driver does not queue it behind the others
+    fallbackProgram = createProgram(vertexShaderSource, fallbackFragmentShaderSource);
+    useMeshProgram(fallbackProgram);
+
+    // Submit the shader programs and go on, later runs load the linked binaries from the cache
+    programs.create((GLADloadproc)glfwGetProcAddress, "cache", parallelShaderCompile);
+    shaderProgramHandle = programs.submit(vertexShaderSource, fragmentShaderSource);
+    instancedProgramHandle = programs.submit(instancedVertexShaderSource.c_str(), instancedFragmentShaderSource);
+
+    // The sphere levels of detail, then the icosphere and cube sphere asteroid shapes, batched with
+    // compressed vertices (16 bytes instead of 32). Only the first run tessellates, optimizes and packs
+    // them, later runs upload straight from the mapped cache file.
+    constexpr float sphereRadius = 2.0f;
+    const int lodSegments[] = {64, 40, 20, 12, 8};
+    constexpr int icoSphereSubdivisions = 1;
+    constexpr int cubeSphereSubdivisions = 2;
+    MeshCache meshCache("cache");
+    MeshCacheKey sceneKey("sceneMeshes", {sphereMeshVersion, meshOptimizerVersion, vertexPackingVersion},
+                          {sphereRadius, (float)lodSegments[0], (float)lodSegments[1], (float)lodSegments[2], (float)lodSegments[3],
+                           (float)lodSegments[4], (float)icoSphereSubdivisions, (float)cubeSphereSubdivisions});
+    auto cachedScene = meshCache.loadOrCreateBatch(sceneKey, [&]
+                                                   {
+        std::vector<Mesh> meshes;
+        for (auto segments : lodSegments)
+        {
+            meshes.push_back(createSphere(sphereRadius, segments, segments));
+            optimizeMesh(meshes.back());
+        }
+        meshes.push_back(createIcoSphere(sphereRadius, icoSphereSubdivisions));
+        meshes.push_back(createCubeSphere(sphereRadius, cubeSphereSubdivisions));
+        std::vector<MeshView> meshViews;
+        for (auto const &mesh : meshes)
+        {
+            meshViews.push_back(makeMeshView(mesh));
+        }
+        return buildMeshBatch(meshViews); });
+    auto const &scene = cachedScene.view;
+    sceneMeshes = scene.layout;
+    sphereBounds = scene.bounds;
 
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
+    std::vector<float> levelErrors;
+    for (auto segments : lodSegments)
     {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        throw std::runtime_error("Failed to link program " + std::string(infoLog));
+        levelErrors.push_back(sphereTessellationError(sphereRadius, segments, segments));
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    // Get the shader variables
-    vertexColorShaderVar = glGetUniformLocation(shaderProgram, "uFillColor");
-    modelShaderVar = glGetUniformLocation(shaderProgram, "uTransform");
-
-    createSphere(2, 20, 20);
+    sphereLods = buildLodChain(sceneMeshes, 0, levelErrors, sphereRadius);
+    icoSphereMesh = levelErrors.size();
+    cubeSphereMesh = icoSphereMesh + 1;
 
     glGenVertexArrays(1, &geometryVertexArrayObject);
     glBindVertexArray(geometryVertexArrayObject);
@@ -237,127 +344,322 @@ void setupTriangle()
     // Create and bind buffer of vertex
     glGenBuffers(1, &geometryVertexBuffer);
     glBindBuffer(GL_ARRAY_BUFFER, geometryVertexBuffer);
-    glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(sphereVertices[0]), sphereVertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, scene.vertexDataSize(), scene.vertices, GL_STATIC_DRAW);
 
     // Create and bind buffer of vertex indices
     glGenBuffers(1, &geometryIndexBuffer);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometryIndexBuffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(sphereIndices[0]), sphereIndices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, scene.indexDataSize(), scene.indices, GL_STATIC_DRAW);
 
-    // Set the binded vertex array to vertex position attribute
-    auto aPos = glGetAttribLocation(shaderProgram, "aPos");
-    glVertexAttribPointer(aPos, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-    // Enable the vertex attribute array
-    glEnableVertexAttribArray(aPos);
+    // Set the vertex attributes used by the shader. aPos is at location 0 in every program,
+    // the fallback one can be asked without waiting for the others.
+    applyVertexFormat(packedVertexFormat(), fallbackProgram);
+
+    // The instanced vertex array shares the sphere buffers, the instance attributes are set when drawing
+    glGenVertexArrays(1, &instancedVertexArrayObject);
+    glBindVertexArray(instancedVertexArrayObject);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometryIndexBuffer);
+    applyVertexFormat(packedVertexFormat(), fallbackProgram);
 
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    multiDrawPass.create((GLADloadproc)glfwGetProcAddress);
 }
 
-glm::mat4 drawPlanet(glm::mat4 const &parentTransformation, glm::mat4 const &initialTransformation, float const &rotation, float const &revolution, glm::vec3 const &fillColor)
+// Build the transform hierarchy of the bodies and their gravity simulation.
+// The orbit node of a body holds its position relative to the Sun, its own node spins around its axis.
+void setupSolarSystem()
 {
-    // Set the set shader program
-    glUseProgram(shaderProgram);
-
-    // Set the fill color to the shader
-    glUniform4f(vertexColorShaderVar, fillColor[0], fillColor[1], fillColor[2], 1.0f);
-
-    // Set the initial transformation
-    auto modelTransformation{initialTransformation};
-
-    // Get the current translation
-    auto modelPosition = glm::translate(glm::mat4(1.0f), glm::vec3(modelTransformation[3]));
-    // Move the model to the world origin
-    modelTransformation = glm::inverse(modelPosition) * modelTransformation;
-
-    // Rotate on its own axis
-    auto modelRotation = glm::rotate(glm::mat4(1.0f), glm::radians(rotation), glm::vec3(0.0, 0.0, 1.0));
-    modelTransformation = modelRotation * modelTransformation;
+    constexpr float scale = 1.0f / 25.0f;
+    auto noRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+
+    // Sun - Can be moved using the arrow keys (LEFT, RIGHT, UP and DOWN)
+    sunNode = solarSystem.addNode(noParentNode, glm::vec3(sunPositionX, sunPositionY, 0.0f), noRotation, glm::vec3(scale));
+    sunSpinNode = solarSystem.addNode(sunNode);
+
+    // Earth around the Sun
+    earthOrbitNode = solarSystem.addNode(sunNode, glm::vec3(10.0f, 0.0f, 0.0f));
+    earthNode = solarSystem.addNode(earthOrbitNode);
+
+    // Moon around the Earth, scaled down a bit
+    moonOrbitNode = solarSystem.addNode(earthOrbitNode, glm::vec3(4.0f, 0.0f, 0.0f));
+    moonNode = solarSystem.addNode(moonOrbitNode, glm::vec3(0.0f), noRotation, glm::vec3(0.5f));
+
+    // Mars around the Sun, scaled up a bit
+    marsOrbitNode = solarSystem.addNode(sunNode, glm::vec3(18.0f, 0.0f, 0.0f));
+    marsNode = solarSystem.addNode(marsOrbitNode, glm::vec3(0.0f), noRotation, glm::vec3(1.5f));
+
+    bodies = {{sunSpinNode, glm::vec3(1.0f, 1.0f, 0.0f), "Sun", 0},
+              {earthNode, glm::vec3(0.0f, 0.0f, 1.0f), "Earth", 0},
+              {moonNode, glm::vec3(0.8f, 0.8f, 0.8f), "Moon", 0},
+              {marsNode, glm::vec3(1.0f, 0.0f, 0.0f), "Mars", 0}};
+    bodySpheres.resize(bodies.size());
+
+    // Circular orbits to start with, the Sun moves against the planets so the system stays in place
+    auto circularSpeed = [](float centralMass, float distance)
+    { return std::sqrt(centralMass / distance); };
+    constexpr float earthMass = 0.03f * sunMass;
+    constexpr float moonMass = 0.01f * earthMass;
+    constexpr float marsMass = 0.003f * sunMass;
+    glm::vec3 earthVelocity(0.0f, circularSpeed(sunMass, 10.0f), 0.0f);
+    glm::vec3 moonVelocity = earthVelocity + glm::vec3(0.0f, circularSpeed(earthMass, moonDistance), 0.0f);
+    glm::vec3 marsVelocity(0.0f, circularSpeed(sunMass, 18.0f), 0.0f);
+    glm::vec3 sunVelocity = -(earthVelocity * earthMass + moonVelocity * moonMass + marsVelocity * marsMass) / sunMass;
+    sunBody = gravity.bodies.addBody(glm::vec3(0.0f), sunVelocity, sunMass);
+    earthBody = gravity.bodies.addBody(glm::vec3(10.0f, 0.0f, 0.0f), earthVelocity, earthMass);
+    moonBody = gravity.bodies.addBody(glm::vec3(10.0f + moonDistance, 0.0f, 0.0f), moonVelocity, moonMass);
+    marsBody = gravity.bodies.addBody(glm::vec3(18.0f, 0.0f, 0.0f), marsVelocity, marsMass);
+    gravity.jobs = &jobs;
+    gravity.start();
+
+    // Asteroids between 20 and 23, smaller than the Moon
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (std::size_t i = 0; i < asteroidCount; ++i)
+    {
+        asteroidDistance.push_back(20.0f + 3.0f * uniform(random));
+        asteroidPhase.push_back(6.2831853f * uniform(random));
+        asteroidScale.push_back(0.05f + 0.1f * uniform(random));
+    }
+    asteroidInstances.resize(asteroidCount);
+    asteroidLodLevels.assign(asteroidCount, 0);
+    asteroidMeshes.assign(asteroidCount, 0);
+}
 
-// Do scale based on the origin - Only to try out pivot based scaling
-// Enable if required
-#if 0
-        auto modelScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.5f));
-        modelTransformation = modelScale * modelTransformation;
-#endif
+// World transformations and meshes of the asteroids at a simulated time.
+// A third of them are UV spheres with a level of detail, the others icospheres and cube spheres.
+void updateAsteroids(float time)
+{
+    glm::mat4 sunWorld = solarSystem.worldTransform(sunNode);
+    glm::vec4 color(0.6f, 0.5f, 0.4f, 1.0f);
+    jobs.parallelFor(0, asteroidCount, 4096, [&](std::size_t begin, std::size_t end)
+                     {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            float distance = asteroidDistance[i];
+            float angle = asteroidPhase[i] + time * std::sqrt(sunMass / (distance * distance * distance));
+            glm::mat4 local = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(distance * std::cos(angle), distance * std::sin(angle), 0.0f)),
+                                         glm::vec3(asteroidScale[i]));
+            asteroidInstances[i] = InstanceData{sunWorld * local, color};
+            if (0 == i % 3)
+            {
+                asteroidLodLevels[i] = selectLodLevel(sphereLods, projectedSphereRadius(asteroidInstances[i].world, sphereLods.boundingRadius, viewportSize),
+                                                      lodSettings, asteroidLodLevels[i]);
+                asteroidMeshes[i] = asteroidLodLevels[i];
+            }
+            else
+            {
+                asteroidMeshes[i] = 1 == i % 3 ? icoSphereMesh : cubeSphereMesh;
+            }
+        } });
+}
 
-    // Translate the model back to the original position
-    modelTransformation = modelPosition * modelTransformation;
+// Rotation around the Z axis
+glm::quat rotationZ(float degrees)
+{
+    return glm::angleAxis(glm::radians(degrees), glm::vec3(0.0f, 0.0f, 1.0f));
+}
 
-    // Revolution
-    auto modelRevolution = glm::rotate(glm::mat4(1.0f), glm::radians(revolution), glm::vec3(0.0, 0.0, 1.0));
-    modelTransformation = modelRevolution * modelTransformation;
+// Record the draw of a scene mesh, thread safe as long as every thread has its own list
+void recordMesh(RenderQueue::CommandList &list, glm::mat4 const &worldTransform, glm::vec3 const &fillColor, std::size_t mesh)
+{
+    auto const &batched = sceneMeshes.meshes[mesh];
+    DrawCommand command;
+    command.program = meshProgram;
+    command.vertexArray = geometryVertexArrayObject;
+    command.indexType = sceneMeshes.indexType;
+    command.indexCount = (unsigned int)batched.indexCount;
+    command.baseVertex = batched.baseVertex;
+    command.indexOffset = batched.firstIndex * sceneMeshes.indexSize();
+    // Positions are quantized to the sphere bounds, decode them as part of the transformation
+    command.world = worldTransform * sphereBounds.decodeMatrix();
+    command.color = glm::vec4(fillColor, 1.0f);
+    // Without camera the depth is the clip space z of the center, from -1 (nearest) to 1
+    list.draw(sortkey::opaque(0, command.program, 0, command.vertexArray, (worldTransform[3].z + 1.0f) * 0.5f), command);
+}
 
-    // Final transformation = Parent transformation * Model transformation
-    auto worldTransform = parentTransformation * modelTransformation;
+// Set the per object shader variables, the program and vertex array are bound by the queue
+void setMeshUniforms(DrawCommand const &command)
+{
+    glUniform4fv(vertexColorShaderVar, 1, glm::value_ptr(command.color));
+    glUniformMatrix4fv(modelShaderVar, 1, GL_FALSE, glm::value_ptr(command.world));
+}
 
-    glUniformMatrix4fv(modelShaderVar, 1, GL_FALSE, glm::value_ptr(worldTransform));
+void recordPlanet(RenderQueue::CommandList &list, glm::mat4 const &worldTransform, glm::vec3 const &fillColor, int &lodLevel)
+{
+    // Select the level of detail from the size of the planet on screen
+    lodLevel = selectLodLevel(sphereLods, projectedSphereRadius(worldTransform, sphereLods.boundingRadius, viewportSize), lodSettings, lodLevel);
+    lodStatistics.record(sphereLods, lodLevel);
+    recordMesh(list, worldTransform, fillColor, lodLevel);
+}
 
-    glBindVertexArray(geometryVertexArrayObject);
-    glDrawElements(GL_TRIANGLES, sphereIndices.size(), GL_UNSIGNED_SHORT, nullptr);
+// Draw the visible bodies and the asteroids, every mesh instanced, all in one multi-draw when available
+void drawInstanced()
+{
+    std::size_t bodyCount = visibleBodies.size();
+    frameObjects.resize(bodyCount + asteroidCount);
+    for (std::size_t i = 0; i < bodyCount; ++i)
+    {
+        auto &body = bodies[visibleBodies[i]];
+        auto const &world = solarSystem.worldTransform(body.node);
+        auto color = (int)visibleBodies[i] == pickedBody ? glm::vec3(1.0f) : body.color;
+        body.lodLevel = selectLodLevel(sphereLods, projectedSphereRadius(world, sphereLods.boundingRadius, viewportSize), lodSettings, body.lodLevel);
+        frameObjects[i] = MultiDrawObject{(std::size_t)body.lodLevel, InstanceData{world, glm::vec4(color, 1.0f)}};
+    }
+    jobs.parallelFor(0, asteroidCount, 4096, [&](std::size_t begin, std::size_t end)
+                     {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            frameObjects[bodyCount + i] = MultiDrawObject{asteroidMeshes[i], asteroidInstances[i]};
+        } });
+    multiDrawPass.build(sceneMeshes, frameObjects, &jobs);
 
-    glBindVertexArray(0);
+    // Program, decoding and vertex array are set once for all the objects
+    glState.useProgram(instancedShaderProgram);
+    glUniformMatrix4fv(instancedDecodeShaderVar, 1, GL_FALSE, glm::value_ptr(sphereBounds.decodeMatrix()));
+    glState.bindVertexArray(instancedVertexArrayObject);
+    multiDrawPass.submit(sceneMeshes, instancedAttributes);
 
-    return worldTransform;
+    for (auto const &object : frameObjects)
+    {
+        if (object.mesh < sphereLods.levels.size())
+        {
+            lodStatistics.record(sphereLods, (int)object.mesh);
+        }
+    }
+    instanceStatistics.instances = multiDrawPass.statistics().objects;
+    instanceStatistics.drawCalls = multiDrawPass.statistics().drawCalls;
 }
 
 void render(GLFWwindow *window)
 {
     // Draw the sphere as wire frame, to see the rotation
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    glState.polygonMode(GL_LINE);
 
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
         // Process keyboard input
         processInput(window);
+        updatePrograms();
+        glState.beginFrame();
+
+        // Step the simulation by the time since the last frame, so the motion does not depend on the frame rate
+        static double lastFrameTime = glfwGetTime();
+        double frameTime = glfwGetTime();
+        gravity.advance(frameTime - lastFrameTime);
+        lastFrameTime = frameTime;
+
+        // Positions between the last two steps relative to the Sun, spins from the simulated time
+        glm::vec3 sunPosition = gravity.interpolatedPosition(sunBody);
+        glm::vec3 earthPosition = gravity.interpolatedPosition(earthBody) - sunPosition;
+        glm::vec3 moonOffset = gravity.interpolatedPosition(moonBody) - sunPosition - earthPosition;
+        float time = static_cast<float>(gravity.time());
+
+        solarSystem.setLocalTranslation(sunNode, glm::vec3(sunPositionX, sunPositionY, 0.0f));
+        solarSystem.setLocalRotation(sunSpinNode, rotationZ(30.0f * time));
+
+        solarSystem.setLocalTranslation(earthOrbitNode, earthPosition);
+        solarSystem.setLocalRotation(earthNode, rotationZ(60.0f * time));
+
+        solarSystem.setLocalTranslation(moonOrbitNode, moonOffset * moonDistanceScale);
+        solarSystem.setLocalRotation(moonNode, rotationZ(60.0f * time));
+
+        solarSystem.setLocalTranslation(marsOrbitNode, gravity.interpolatedPosition(marsBody) - sunPosition);
+        solarSystem.setLocalRotation(marsNode, rotationZ(60.0f * time));
+
+        // Update the world transformations of the animated bodies before drawing
+        solarSystem.updateWorldTransforms(jobs);
+
+        // Move the bounding spheres, the BVH keeps its topology and is rebuilt a little when it degrades
+        for (std::size_t i = 0; i < bodies.size(); ++i)
+        {
+            bodySpheres[i] = transformBoundingSphere(solarSystem.worldTransform(bodies[i].node), sphereLods.boundingRadius);
+        }
+        bodyBvh.refit(bodySpheres);
+        bodyBvh.rebuildIncrementally();
+
+        // Only the bodies inside the view volume are drawn, without camera it is the clip volume
+        visibleBodies.clear();
+        cullStatistics = bodyBvh.cull(Frustum::fromViewProjection(glm::mat4(1.0f)), visibleBodies);
 
         // Set color for the window
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
+        lodStatistics.reset();
+
+        // Sun - YELLOW, Earth - BLUE, Moon - GREY, Mars - RED, the picked body is WHITE, asteroids - BROWN
+        updateAsteroids(time);
+        instanceStatistics = InstanceStatistics();
+        if (instancedRendering && 0 != instancedShaderProgram)
+        {
+            drawInstanced();
+        }
+        else
+        {
+            renderQueue.reset();
+            auto &bodyList = renderQueue.acquireList();
+            for (auto index : visibleBodies)
+            {
+                auto &body = bodies[index];
+                auto color = (int)index == pickedBody ? glm::vec3(1.0f) : body.color;
+                recordPlanet(bodyList, solarSystem.worldTransform(body.node), color, body.lodLevel);
+            }
+            // One draw per asteroid would hold back the first frames, they wait for the instanced program
+            std::size_t drawnAsteroids = 0 != instancedShaderProgram ? asteroidCount : 0;
+            jobs.parallelFor(0, drawnAsteroids, 4096, [&](std::size_t begin, std::size_t end)
+                             {
+                auto &asteroidList = renderQueue.acquireList();
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    recordMesh(asteroidList, asteroidInstances[i].world, glm::vec3(asteroidInstances[i].color), asteroidMeshes[i]);
+                } });
+            for (std::size_t i = 0; i < drawnAsteroids; ++i)
+            {
+                if (asteroidMeshes[i] < sphereLods.levels.size())
+                {
+                    lodStatistics.record(sphereLods, (int)asteroidMeshes[i]);
+                }
+            }
+            renderQueue.sort();
+            renderQueue.submit(glState, setMeshUniforms);
+            instanceStatistics.instances = instanceStatistics.drawCalls = visibleBodies.size() + drawnAsteroids;
+        }
 
-        constexpr float scale = 1.0f / 25.0f;
-        auto initialScale = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale));
-        // Draw Sun - YELLOW
-        // We can move the Sun using the arrow keys (LEFT, RIGHT, UP and DOWN)
-        auto sunTranslation = glm::translate(glm::mat4(1.0f), glm::vec3(sunPositionX, sunPositionY, 0.0f));
-        auto sunTransformation = sunTranslation * initialScale;
-        static float sunRotation = 0.0f;
-        sunRotation += 0.5f;
-        auto sunWorldTransformation = drawPlanet(glm::mat4(1.0f), sunTransformation, sunRotation, 0.0f, glm::vec3(1.0f, 1.0f, 0.0f));
-
-        // Draw Earth as Sun as parent - EARTH
-        auto earthTransformation = glm::translate(glm::mat4(1.0f), glm::vec3(10.0f, 0.0f, 0.0f));
-        static float earthRotation = 0.0f;
-        earthRotation += 1.0f;
-        static float earthRevolution = 0.0f;
-        earthRevolution += 0.5f;
-        auto earthWorldTransformation = drawPlanet(sunWorldTransformation, earthTransformation, earthRotation, earthRevolution, glm::vec3(0.0f, 0.0f, 1.0f));
-
-        // Draw Moon as Earth as parent - GREY
-        auto moonTranslation = glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 0.0f, 0.0f));
-        // Scale down the Moon a bit
-        auto moonScale = glm::scale(glm::mat4(1.0f), glm::vec3(0.5f, 0.5f, 0.5f));
-        auto moonTransformation = moonTranslation * moonScale;
-        static float moonRotation = 0.0f;
-        moonRotation += 1.0f;
-        static float moonRevolution = 0.0f;
-        moonRevolution += 0.5f;
-        auto moonWorldTransformation = drawPlanet(earthWorldTransformation, moonTransformation, moonRotation, moonRevolution, glm::vec3(0.8f, 0.8f, 0.8f));
-
-        // Draw Mars as Sun as parent - RED
-        auto marsTranslation = glm::translate(glm::mat4(1.0f), glm::vec3(18.0f, 0.0f, 0.0f));
-        // Scale up the Mars a bit
-        auto marsScale = glm::scale(glm::mat4(1.0f), glm::vec3(1.5f, 1.5f, 1.5f));
-        auto marsTransformation = marsTranslation * marsScale;
-        static float marsRotation = 0.0f;
-        marsRotation += 1.0f;
-        static float marsRevolution = 0.0f;
-        marsRevolution += 0.25f;
-        drawPlanet(sunWorldTransformation, marsTransformation, marsRotation, marsRevolution, glm::vec3(1.0f, 0.0f, 0.0f));
+        // Report the triangles saved by the level of detail selection, the transform updates and the culling once a second
+        static double lastReportTime = 0.0;
+        if (glfwGetTime() - lastReportTime >= 1.0)
+        {
+            lastReportTime = glfwGetTime();
+            std::string drawMode = !instancedRendering || 0 == instancedShaderProgram ? "per object" : multiDrawPass.usesMultiDrawIndirect() ? "multi-draw indirect" : "instanced loop";
+            auto title = "Basic Solar System - triangles: " + std::to_string(lodStatistics.trianglesDrawn) + " drawn, " +
+                         std::to_string(lodStatistics.trianglesSaved()) + " saved by LOD - transforms updated: " +
+                         std::to_string(solarSystem.lastUpdateStatistics().nodesUpdated) + "/" + std::to_string(solarSystem.size()) +
+                         " - visible: " + std::to_string(cullStatistics.visible) + "/" + std::to_string(bodies.size()) +
+                         " (" + std::to_string(cullStatistics.milliseconds) + " ms) - picked: " + (pickedBody >= 0 ? bodies[pickedBody].name : "none") +
+                         " (" + std::to_string(pickStatistics.milliseconds) + " ms) - " + drawMode + ": " +
+                         std::to_string(instanceStatistics.instances) + " objects in " + std::to_string(instanceStatistics.drawCalls) + " draws - GL state: " +
+                         std::to_string(glState.statistics().calls) + " calls, " + std::to_string(glState.statistics().skipped) + " skipped";
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         // Swap buffers
         glfwSwapBuffers(window);
+
+        // Report the time to the first frame, and to the first frame drawn with the real programs
+        static bool firstFrame = true, programsReported = false;
+        if (firstFrame)
+        {
+            firstFrame = false;
+            std::cout << "First frame after " << elapsedSinceStart() << " ms, parallel shader compile "
+                      << (programs.parallel() ? "on" : "off") << (0 != shaderProgram ? "" : ", drawn with the fallback program") << std::endl;
+        }
+        if (!programsReported && 0 != shaderProgram && 0 != instancedShaderProgram)
+        {
+            programsReported = true;
+            std::cout << "Programs ready after " << elapsedSinceStart() << " ms - " << programs.cache()->summary() << std::endl;
+        }
         // Poll IO events
         glfwPollEvents();
     }
@@ -371,6 +673,13 @@ void cleanup()
         glDeleteVertexArrays(1, &vertexArrays);
     }
 
+    if (0 < instancedVertexArrayObject)
+    {
+        auto vertexArrays{instancedVertexArrayObject};
+        glDeleteVertexArrays(1, &vertexArrays);
+    }
+    multiDrawPass.release();
+
     if (0 < geometryIndexBuffer)
     {
         auto elementBuffers{geometryIndexBuffer};
@@ -383,14 +692,24 @@ void cleanup()
         glDeleteBuffers(1, &vertexBuffers);
     }
 
-    if (0 < shaderProgram)
+    programs.release();
+
+    if (0 < fallbackProgram)
     {
-        glDeleteProgram(shaderProgram);
+        glDeleteProgram(fallbackProgram);
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    for (int i = 1; i < argc; ++i)
+    {
+        if (0 == std::strcmp(argv[i], "--no-parallel-shaders"))
+        {
+            parallelShaderCompile = false;
+        }
+    }
+
     auto glfw_window_deleter = [](GLFWwindow *window)
     {
         cleanup();
@@ -405,6 +724,8 @@ int main()
         return 1;
     }
     glfwSetFramebufferSizeCallback(window.get(), framebuffer_size_callback);
+    glfwSetMouseButtonCallback(window.get(), mouse_button_callback);
+    glfwSetKeyCallback(window.get(), key_callback);
 
     // Load all OpenGL function pointers
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -412,6 +733,7 @@ int main()
         throw std::runtime_error("Failed to initialize GLAD");
     }
     setupTriangle();
+    setupSolarSystem();
 
     render(window.get());
 
@@ -1,6 +1,9 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include <GlStateCache.h>
+#include <ShaderProgram.h>
+#include <ShaderReflection.h>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -9,9 +12,12 @@
 auto constexpr screenWidth = 800;
 auto constexpr screenHeight = 600;
 unsigned int shaderProgram = 0;
+int fillColorShaderVar = -1;
 unsigned int geometryVertexBuffer = 0;
 unsigned int geometryIndexBuffer = 0;
 unsigned int geometryVertexArrayObject = 0;
+// Program and vertex array changes go through the cache, which drops the redundant ones
+GlStateCache glState;
 
 const char *vertexShaderSource = "#version 330 core\n"
                                  "layout (location = 0) in vec3 aPos;\n"
@@ -59,46 +65,10 @@ GLFWwindow *createAndConfigureWindow()
 
 void setupTriangle()
 {
-    // Build and compile shader program
-    // Vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile vertex shader " + std::string(infoLog));
-    }
-
-    // Fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile fragment shader " + std::string(infoLog));
-    }
-
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // Build the shader program, later runs load the linked binary from the cache
+    ProgramBinaryCache shaderCache("cache", (GLADloadproc)glfwGetProcAddress);
+    shaderProgram = shaderCache.createProgram(vertexShaderSource, fragmentShaderSource);
+    std::cout << shaderCache.summary() << std::endl;
 
     // Set up vertex data and configure vertex attributes
     const float vertices[] = {
@@ -124,7 +94,9 @@ void setupTriangle()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // Set the binded vertex array to vertex position attribute
-    unsigned int aPos = glGetAttribLocation(shaderProgram, "aPos");
+    ProgramReflection reflection(shaderProgram);
+    fillColorShaderVar = reflection.uniformLocation("uFillColor");
+    auto aPos = reflection.attributeLocation("aPos");
     glVertexAttribPointer(aPos, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     // Enable the vertex attribute array
     glEnableVertexAttribArray(aPos);
@@ -136,7 +108,7 @@ void setupTriangle()
 void drawTriangle()
 {
     // Set the set shader program
-    glUseProgram(shaderProgram);
+    glState.useProgram(shaderProgram);
 
     // Set the fill color to the shader
     // Generate a random value for the color
@@ -144,13 +116,11 @@ void drawTriangle()
     auto redColor = static_cast<float>(cos(timeValue) / 2.0 + 0.5);
     auto greenColor = static_cast<float>(sin(timeValue) / 2.0 + 0.5);
     // Set the fill color to the shader
-    auto vertexColorLocation = glGetUniformLocation(shaderProgram, "uFillColor");
-    glUniform4f(vertexColorLocation, redColor, greenColor, 0.0f, 1.0f);
+    glUniform4f(fillColorShaderVar, redColor, greenColor, 0.0f, 1.0f);
 
-    glBindVertexArray(geometryVertexArrayObject);
+    // The vertex array stays bound for the next frame
+    glState.bindVertexArray(geometryVertexArrayObject);
     glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, 0);
-
-    glBindVertexArray(0);
 }
 
 void render(GLFWwindow *window)
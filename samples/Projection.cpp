@@ -5,10 +5,16 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
+#include <StreamingBuffer.h>
+#include <GlStateCache.h>
+#include <ShaderProgram.h>
+#include <ShaderReflection.h>
+#include <cstddef>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <cmath>
+#include <string>
 
 auto constexpr screenWidth = 800;
 auto constexpr screenHeight = 600;
@@ -16,20 +22,40 @@ auto constexpr screenHeight = 600;
 unsigned int geometryVertexBuffer = 0;
 unsigned int geometryIndexBuffer = 0;
 unsigned int geometryVertexArrayObject = 0;
+// Program and vertex array changes go through the cache, which drops the redundant ones
+GlStateCache glState;
 // Shader variables
 unsigned int shaderProgram = 0;
-unsigned int vertexColorShaderVar = 0;
-unsigned int modelShaderVar = 0;
-unsigned int viewShaderVar = 0;
-unsigned int projectionShaderVar = 0;
+// Per-draw data is one uniform block, written to the streaming buffer and bound by offset
+constexpr unsigned int drawDataBinding = 0;
+StreamingBuffer streamingBuffer;
 // Matrices
 glm::mat4 projection(1.0f);
 
+// std140 layout of the DrawData block
+struct DrawData
+{
+    glm::mat4 model;
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 fillColor;
+};
+using DrawDataLayout = std140::Layout<glm::mat4, glm::mat4, glm::mat4, glm::vec4>;
+static_assert(offsetof(DrawData, model) == DrawDataLayout::offsets[0], "DrawData::model is not at its std140 offset");
+static_assert(offsetof(DrawData, view) == DrawDataLayout::offsets[1], "DrawData::view is not at its std140 offset");
+static_assert(offsetof(DrawData, projection) == DrawDataLayout::offsets[2], "DrawData::projection is not at its std140 offset");
+static_assert(offsetof(DrawData, fillColor) == DrawDataLayout::offsets[3], "DrawData::fillColor is not at its std140 offset");
+static_assert(sizeof(DrawData) == DrawDataLayout::size, "DrawData is not the size of its std140 block");
+
 const char *vertexShaderSource = "#version 330 core\n"
                                  "layout (location = 0) in vec3 aPos;\n"
-                                 "uniform mat4 uModel;\n"
-                                 "uniform mat4 uView;\n"
-                                 "uniform mat4 uProjection;\n"
+                                 "layout (std140) uniform DrawData\n"
+                                 "{\n"
+                                 "   mat4 uModel;\n"
+                                 "   mat4 uView;\n"
+                                 "   mat4 uProjection;\n"
+                                 "   vec4 uFillColor;\n"
+                                 "};\n"
                                  "void main()\n"
                                  "{\n"
                                  "   gl_Position = uProjection * uView * uModel * vec4(aPos, 1.0);\n"
@@ -37,7 +63,13 @@ const char *vertexShaderSource = "#version 330 core\n"
 
 const char *fragmentShaderSource = "#version 330 core\n"
                                    "out vec4 FragColor;\n"
-                                   "uniform vec4 uFillColor;\n"
+                                   "layout (std140) uniform DrawData\n"
+                                   "{\n"
+                                   "   mat4 uModel;\n"
+                                   "   mat4 uView;\n"
+                                   "   mat4 uProjection;\n"
+                                   "   vec4 uFillColor;\n"
+                                   "};\n"
                                    "void main()\n"
                                    "{\n"
                                    "   FragColor = uFillColor;\n"
@@ -72,53 +104,18 @@ GLFWwindow *createAndConfigureWindow()
 
 void setupTriangle()
 {
-    // Build and compile shader program
-    // Vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile vertex shader " + std::string(infoLog));
-    }
-
-    // Fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile fragment shader " + std::string(infoLog));
-    }
+    // Build the shader program, later runs load the linked binary from the cache
+    ProgramBinaryCache shaderCache("cache", (GLADloadproc)glfwGetProcAddress);
+    shaderProgram = shaderCache.createProgram(vertexShaderSource, fragmentShaderSource);
+    std::cout << shaderCache.summary() << std::endl;
 
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        throw std::runtime_error("Failed to link program " + std::string(infoLog));
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // Check the GLSL block against the C++ struct and connect it to its binding point
+    ProgramReflection reflection(shaderProgram);
+    reflection.checkUniformBlock<DrawDataLayout>("DrawData", {"uModel", "uView", "uProjection", "uFillColor"});
+    reflection.bindUniformBlock("DrawData", drawDataBinding);
 
-    // Get the shader variables
-    vertexColorShaderVar = glGetUniformLocation(shaderProgram, "uFillColor");
-    modelShaderVar = glGetUniformLocation(shaderProgram, "uModel");
-    viewShaderVar = glGetUniformLocation(shaderProgram, "uView");
-    projectionShaderVar = glGetUniformLocation(shaderProgram, "uProjection");
+    // Room for a few hundred draws per frame, in each of the frames in flight
+    streamingBuffer.create(64 * 1024, (GLADloadproc)glfwGetProcAddress);
 
     // Set up vertex data and configure vertex attributes
     const float vertices[] = {
@@ -141,8 +138,8 @@ void setupTriangle()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // Set the binded vertex array to vertex position attribute
-    auto aPos = glGetAttribLocation(shaderProgram, "aPos");
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    auto aPos = reflection.attributeLocation("aPos");
+    glVertexAttribPointer(aPos, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     // Enable the vertex attribute array
     glEnableVertexAttribArray(aPos);
 
@@ -153,19 +150,15 @@ void setupTriangle()
 void drawTriangle(glm::mat4 const &modelTransformation, glm::vec3 const &fillColor)
 {
     // Set the set shader program
-    glUseProgram(shaderProgram);
-
-    // Set the fill color to the shader
-    glUniform4f(vertexColorShaderVar, fillColor[0], fillColor[1], fillColor[2], 1.0f);
+    glState.useProgram(shaderProgram);
 
-    glUniformMatrix4fv(modelShaderVar, 1, GL_FALSE, glm::value_ptr(modelTransformation));
-    glUniformMatrix4fv(viewShaderVar, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0f)));
-    glUniformMatrix4fv(projectionShaderVar, 1, GL_FALSE, glm::value_ptr(projection));
+    // Write the transformations and the fill color to the frame's region and bind them
+    DrawData drawData{modelTransformation, glm::mat4(1.0f), projection, glm::vec4(fillColor, 1.0f)};
+    StreamingBuffer::bindUniformBlock(drawDataBinding, streamingBuffer.writeUniformBlock(drawData));
 
-    glBindVertexArray(geometryVertexArrayObject);
+    // The vertex array stays bound for the next draw
+    glState.bindVertexArray(geometryVertexArrayObject);
     glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, nullptr);
-
-    glBindVertexArray(0);
 }
 
 void render(GLFWwindow *window)
@@ -173,6 +166,10 @@ void render(GLFWwindow *window)
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
+        // Wait, if needed, until the GPU is done with the region used three frames ago
+        streamingBuffer.beginFrame();
+        glState.beginFrame();
+
         // Set color for the window
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -189,6 +186,21 @@ void render(GLFWwindow *window)
         auto greenTransformation = greenTranslation * initialScale;
         drawTriangle(greenTransformation, glm::vec3(0.0f, 1.0f, 0.0f));
 
+        streamingBuffer.endFrame();
+
+        // Report how often the CPU waited for the GPU once a second
+        static double lastReportTime = 0.0;
+        if (glfwGetTime() - lastReportTime >= 1.0)
+        {
+            lastReportTime = glfwGetTime();
+            auto const &statistics = streamingBuffer.statistics();
+            auto title = std::string("Projection - streaming: ") + streamingModeName(streamingBuffer.mode()) + ", " +
+                         std::to_string(statistics.bytesLastFrame) + " bytes per frame, " + std::to_string(statistics.stalls) + " stalls in " +
+                         std::to_string(statistics.frames) + " frames (" + std::to_string(statistics.stallMilliseconds) + " ms) - GL state: " + std::to_string(glState.statistics().calls) + " calls, " +
+                         std::to_string(glState.statistics().skipped) + " skipped";
+            glfwSetWindowTitle(window, title.c_str());
+        }
+
         // Swap buffers
         glfwSwapBuffers(window);
         // Poll IO events
@@ -216,6 +228,8 @@ void cleanup()
         glDeleteBuffers(1, &vertexBuffers);
     }
 
+    streamingBuffer.release();
+
     if (0 < shaderProgram)
     {
         glDeleteProgram(shaderProgram);
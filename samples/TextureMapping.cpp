@@ -5,13 +5,18 @@
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_inverse.hpp>
+// stb_image is compiled here, TextureLoader.h includes it
 #define STB_IMAGE_IMPLEMENTATION
-#include <stb_image.h>
+#include <TextureLoader.h>
+#include <RenderQueue.h>
+#include <ShaderProgram.h>
+#include <ShaderReflection.h>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <cmath>
 #include <filesystem>
+#include <string>
 
 auto constexpr screenWidth = 800;
 auto constexpr screenHeight = 800;
@@ -19,19 +24,27 @@ auto constexpr screenHeight = 800;
 unsigned int vertexBuffer = 0;
 unsigned int elementBuffer = 0;
 unsigned int vertexArray = 0;
-unsigned int textureWall = 0;
-unsigned int textureFace = 0;
+// Program, vertex array, texture and blend changes go through the cache, which drops the redundant ones
+GlStateCache glState;
+// The images are blended, the queue draws them back to front whatever order they are recorded in
+RenderQueue renderQueue;
+// Images are decoded on worker threads and uploaded a few rows per frame, drawn with a placeholder until then
+TextureLoader textureLoader;
+TextureHandle textureWall = 0;
+TextureHandle textureFace = 0;
 // Shader variables
 unsigned int shaderProgram = 0;
-unsigned int textureShaderVar = 0;
+int textureShaderVar = -1;
+int transformShaderVar = -1;
 
 const char *vertexShaderSource = "#version 330 core\n"
                                  "layout (location = 0) in vec3 aPos;\n"
                                  "layout (location = 1) in vec2 aTexCoord;\n"
                                  "out vec2 TexCoord;\n"
+                                 "uniform mat4 uTransform;\n"
                                  "void main()\n"
                                  "{\n"
-                                 "   gl_Position = vec4(aPos, 1.0);\n"
+                                 "   gl_Position = uTransform * vec4(aPos, 1.0);\n"
                                  "   TexCoord = vec2(aTexCoord.x, aTexCoord.y);\n"
                                  "}\0";
 
@@ -71,87 +84,18 @@ GLFWwindow *createAndConfigureWindow()
     return window;
 }
 
-unsigned int  loadImage(std::string const& imageFilePath)
-{
-    unsigned int texture = 0;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-
-    // Texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    // Texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    // OpenGL texture (0,0) is bottom left
-    // Image (0,0) is top left
-    // So we need to flip the image vertically
-    stbi_set_flip_vertically_on_load(true);
-
-    int imageWidth, imageHeight, channels;
-    auto imageData = stbi_load(imageFilePath.c_str(), &imageWidth, &imageHeight, &channels, 0);
-    if (imageData)
-    {
-        // If there is 4 channel in the image, we need to corresponding OpenGL format
-        auto format = (4 == channels ) ? GL_RGBA : GL_RGB;
-        glTexImage2D(GL_TEXTURE_2D, 0, format, imageWidth, imageHeight, 0, format, GL_UNSIGNED_BYTE, imageData);
-        glGenerateMipmap(GL_TEXTURE_2D);
-    }
-    else
-    {
-        throw std::runtime_error("Failed to load image:" + imageFilePath);
-    }
-    stbi_image_free(imageData);
-    return texture;
-}
-
 void setupImageGeometry()
 {
-    // Build and compile shader program
-    // Vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile vertex shader " + std::string(infoLog));
-    }
-
-    // Fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile fragment shader " + std::string(infoLog));
-    }
+    // Build the shader program, later runs load the linked binary from the cache
+    ProgramBinaryCache shaderCache("cache", (GLADloadproc)glfwGetProcAddress);
+    shaderProgram = shaderCache.createProgram(vertexShaderSource, fragmentShaderSource);
+    std::cout << shaderCache.summary() << std::endl;
 
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        throw std::runtime_error("Failed to link program " + std::string(infoLog));
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // Get the shader variables
+    ProgramReflection reflection(shaderProgram);
+    textureShaderVar = reflection.uniformLocation("uTexture");
+    transformShaderVar = reflection.uniformLocation("uTransform");
 
-    textureShaderVar = glGetUniformLocation(shaderProgram, "uTexture");
     // Set up vertex and texture coordinate
     float vertices[] = {
         // vertex             // texture coords
@@ -180,13 +124,13 @@ void setupImageGeometry()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // Set vertex position attribute
-    auto aPos = glGetAttribLocation(shaderProgram, "aPos");
+    auto aPos = reflection.attributeLocation("aPos");
     glVertexAttribPointer(aPos, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *)0);
     // Enable the vertex attribute array
     glEnableVertexAttribArray(aPos);
 
     // Set texture coordinate attribute
-    auto aTexCoord = glGetAttribLocation(shaderProgram, "aTexCoord");
+    auto aTexCoord = reflection.attributeLocation("aTexCoord");
     glVertexAttribPointer(aTexCoord, 2 , GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     // Enable the vertex attribute array
     glEnableVertexAttribArray(aTexCoord);
@@ -195,39 +139,65 @@ void setupImageGeometry()
     glBindVertexArray(0);
 }
 
-void drawImage(unsigned int const& texture)
+// Record the image at the depth z of the clip volume, -1 is the nearest
+void recordImage(RenderQueue::CommandList &list, unsigned int const &texture, float z)
 {
-    // Set the set shader program
-    glUseProgram(shaderProgram);
+    DrawCommand command;
+    command.program = shaderProgram;
+    command.vertexArray = vertexArray;
+    command.texture = texture;
+    command.indexCount = 6;
+    command.world = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, z));
+    list.draw(sortkey::blended(0, command.program, command.texture, command.vertexArray, (z + 1.0f) * 0.5f), command);
+}
 
-    // Active the 0th texture unit
-    glActiveTexture(GL_TEXTURE0);
-    // Bind the texture to the 0th texture unit
-    glBindTexture(GL_TEXTURE_2D, texture);
+// Set the per image shader variables, the program, texture and vertex array are bound by the queue
+void setImageUniforms(DrawCommand const &command)
+{
     // Attach the 0th texture unit to the texture shader variable
-    glUniform1f(textureShaderVar, 0);
-
-    glBindVertexArray(vertexArray);
-    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
-
-    glBindVertexArray(0);
+    glUniform1i(textureShaderVar, 0);
+    glUniformMatrix4fv(transformShaderVar, 1, GL_FALSE, glm::value_ptr(command.world));
 }
 
 void render(GLFWwindow *window)
 {
-    // Enable alpha blending to support transparency
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // Alpha blending to support transparency, the queue enables it for the blended images
+    glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
+        glState.beginFrame();
+        textureLoader.update();
+
         // Set color for the window
         glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        drawImage(textureWall);
-        drawImage(textureFace);
+        // The face is in front of the wall, recorded first it is still drawn last
+        renderQueue.reset();
+        auto &images = renderQueue.acquireList();
+        recordImage(images, textureLoader.texture(textureFace), 0.0f);
+        recordImage(images, textureLoader.texture(textureWall), 0.5f);
+        renderQueue.sort();
+        renderQueue.submit(glState, setImageUniforms);
+
+        static bool texturesReady = false;
+        if (!texturesReady && textureLoader.allReady())
+        {
+            texturesReady = true;
+            std::cout << "Textures ready after " << textureLoader.statistics().slowestMilliseconds << " ms" << std::endl;
+        }
+
+        // Report the state changes made and skipped once a second
+        static double lastReportTime = 0.0;
+        if (glfwGetTime() - lastReportTime >= 1.0)
+        {
+            lastReportTime = glfwGetTime();
+            auto title = "Texture Mapping - GL state: " + std::to_string(glState.statistics().calls) + " calls, " +
+                         std::to_string(glState.statistics().skipped) + " skipped";
+            glfwSetWindowTitle(window, title.c_str());
+        }
 
         // Swap buffers
         glfwSwapBuffers(window);
@@ -243,15 +213,7 @@ void cleanup()
         glDeleteProgram(shaderProgram);
     }
 
-    if (0 < textureFace)
-    {
-        glDeleteTextures(1, &textureFace);
-    }
-
-    if (0 < textureWall)
-    {
-        glDeleteTextures(1, &textureWall);
-    }
+    textureLoader.release();
 
     if (0 < vertexArray)
     {
@@ -295,8 +257,10 @@ int main()
         throw std::runtime_error("Failed to initialize GLAD");
     }
 
-    textureFace = loadImage("../bin/images/face.png");
-    textureWall = loadImage("../bin/images/wall.jpg");
+    // Up to 1 MB of rows per frame, the wall takes two frames
+    textureLoader.create((GLADloadproc)glfwGetProcAddress, glState, 1024 * 1024);
+    textureFace = textureLoader.load("../bin/images/face.png");
+    textureWall = textureLoader.load("../bin/images/wall.jpg");
     setupImageGeometry();
 
     render(window.get());
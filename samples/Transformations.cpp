@@ -4,6 +4,9 @@
 #include <glm/mat4x4.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <GlStateCache.h>
+#include <ShaderProgram.h>
+#include <ShaderReflection.h>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
@@ -15,10 +18,12 @@ auto constexpr screenHeight = 600;
 unsigned int geometryVertexBuffer = 0;
 unsigned int geometryIndexBuffer = 0;
 unsigned int geometryVertexArrayObject = 0;
+// Program and vertex array changes go through the cache, which drops the redundant ones
+GlStateCache glState;
 // Shader variables
 unsigned int shaderProgram = 0;
-unsigned int vertexColorShaderVar = 0;
-unsigned int modelShaderVar = 0;
+int vertexColorShaderVar = -1;
+int modelShaderVar = -1;
 // Matrices
 glm::mat4 modelTransform(1.0f);
 
@@ -67,51 +72,15 @@ GLFWwindow *createAndConfigureWindow()
 
 void setupTriangle()
 {
-    // Build and compile shader program
-    // Vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, nullptr);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile vertex shader " + std::string(infoLog));
-    }
-
-    // Fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // Check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        throw std::runtime_error("Failed to compile fragment shader " + std::string(infoLog));
-    }
-
-    // Link shaders
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // Check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        glGetProgramInfoLog(shaderProgram, 512, nullptr, infoLog);
-        throw std::runtime_error("Failed to link program " + std::string(infoLog));
-    }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    // Build the shader program, later runs load the linked binary from the cache
+    ProgramBinaryCache shaderCache("cache", (GLADloadproc)glfwGetProcAddress);
+    shaderProgram = shaderCache.createProgram(vertexShaderSource, fragmentShaderSource);
+    std::cout << shaderCache.summary() << std::endl;
 
     // Get the shader variables
-    vertexColorShaderVar = glGetUniformLocation(shaderProgram, "uFillColor");
-    modelShaderVar = glGetUniformLocation(shaderProgram, "uTransform");
+    ProgramReflection reflection(shaderProgram);
+    vertexColorShaderVar = reflection.uniformLocation("uFillColor");
+    modelShaderVar = reflection.uniformLocation("uTransform");
 
     // Set up vertex data and configure vertex attributes
     const float vertices[] = {
@@ -134,7 +103,7 @@ void setupTriangle()
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
 
     // Set the binded vertex array to vertex position attribute
-    auto aPos = glGetAttribLocation(shaderProgram, "aPos");
+    auto aPos = reflection.attributeLocation("aPos");
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     // Enable the vertex attribute array
     glEnableVertexAttribArray(aPos);
@@ -149,7 +118,7 @@ void setupTriangle()
 void drawTriangle()
 {
     // Set the set shader program
-    glUseProgram(shaderProgram);
+    glState.useProgram(shaderProgram);
 
     // Set the fill color to the shader
     // Generate a random value for the color
@@ -163,10 +132,9 @@ void drawTriangle()
     modelTransform = glm::rotate(modelTransform, glm::radians(1.0f), glm::vec3(0.0, 1.0, 0.0));
     glUniformMatrix4fv(modelShaderVar, 1, GL_FALSE, glm::value_ptr(modelTransform));
 
-    glBindVertexArray(geometryVertexArrayObject);
+    // The vertex array stays bound for the next frame
+    glState.bindVertexArray(geometryVertexArrayObject);
     glDrawElements(GL_TRIANGLES, 3, GL_UNSIGNED_INT, nullptr);
-
-    glBindVertexArray(0);
 }
 
 void render(GLFWwindow *window)
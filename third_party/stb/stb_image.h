@@ -268,6 +268,14 @@ RECENT REVISION HISTORY:
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
 //
+// On x64 and on x86 with SSE2, AVX2 kernels for the IDCT, the color
+// conversion and the 2x2 chroma upsampling are used on CPUs that have it,
+// also based on a run-time test. They are compiled with a target attribute
+// on GCC/Clang, so no -mavx2 is needed; on MSVC they need /arch:AVX or
+// higher. Define STBI_NO_AVX2 to leave them out. MinGW does not align the
+// stack for AVX, define STBI_MINGW_ENABLE_AVX2 to use them anyway.
+// stbi_set_simd_level() caps the kernels used at run time.
+//
 // If for some reason you do not want to use any of SIMD code, or if
 // you have issues compiling it, you can disable it entirely by
 // defining STBI_NO_SIMD.
@@ -431,6 +439,21 @@ STBIDEF stbi_uc *stbi_load_from_file  (FILE *f, int *x, int *y, int *channels_in
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
 
+// decode into memory the caller owns (a mapped pixel buffer for example) instead of
+// allocating the output. row r of the image goes to output + r * stride_in_bytes, or
+// to row (height - 1 - r) if flip_vertically, whatever stbi_set_flip_vertically_on_load
+// says. desired_channels must be 1..4, as the caller sizes the output: use stbi_info
+// first. fails if stride_in_bytes < width * desired_channels or output_size is too
+// small. JPEG rows are written straight to the output; other formats are decoded to a
+// temporary image that is copied (and flipped) in the same pass. returns 1 on success.
+STBIDEF int stbi_load_from_memory_into   (stbi_uc           const *buffer, int len   , stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk  , void *user, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+STBIDEF int stbi_load_into               (char const *filename, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *channels_in_file, int desired_channels);
+STBIDEF int stbi_load_from_file_into     (FILE *f             , stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *channels_in_file, int desired_channels);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
 STBIDEF int stbi_convert_wchar_to_utf8(char *buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -522,6 +545,34 @@ STBIDEF void stbi_set_unpremultiply_on_load_thread(int flag_true_if_should_unpre
 STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
 STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+// allocator for everything stb_image allocates, including the images stbi_load returns,
+// unless STBI_MALLOC is defined. an image must be freed by stbi_image_free with the
+// allocator that made it still set. reallocate gets NULL, 0 to allocate; deallocate
+// never gets NULL. the struct is copied; NULL restores malloc/realloc/free. the _thread
+// version overrides the global one on the calling thread, like the functions above.
+typedef struct
+{
+   void *(*allocate)  (void *user, size_t size);
+   void *(*reallocate)(void *user, void *p, size_t old_size, size_t new_size);
+   void  (*deallocate)(void *user, void *p);
+   void *user;
+} stbi_allocator;
+
+STBIDEF void stbi_set_allocator(stbi_allocator const *allocator);
+STBIDEF void stbi_set_allocator_thread(stbi_allocator const *allocator);
+
+// the JPEG decoder uses the widest SIMD kernels the build and the CPU support. this caps
+// them, to compare them or to rule one out. returns the level decodes will use, which can
+// be lower than asked for. global; set it before other threads start decoding.
+enum
+{
+   STBI_SIMD_NONE = 0, // generic C
+   STBI_SIMD_SSE2 = 1, // SSE2 on x86, NEON on ARM
+   STBI_SIMD_AVX2 = 2
+};
+
+STBIDEF int stbi_set_simd_level(int max_level);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -676,10 +727,59 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #error "Must define all or none of STBI_MALLOC, STBI_FREE, and STBI_REALLOC (or STBI_REALLOC_SIZED)."
 #endif
 
+static stbi_allocator stbi__allocator_global;
+static int stbi__allocator_global_set;
+
+STBIDEF void stbi_set_allocator(stbi_allocator const *allocator)
+{
+   stbi__allocator_global_set = allocator != NULL;
+   if (allocator) stbi__allocator_global = *allocator;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__allocator  (stbi__allocator_global_set ? &stbi__allocator_global : NULL)
+#else
+static STBI_THREAD_LOCAL stbi_allocator stbi__allocator_local;
+static STBI_THREAD_LOCAL int stbi__allocator_local_set, stbi__allocator_set;
+
+STBIDEF void stbi_set_allocator_thread(stbi_allocator const *allocator)
+{
+   stbi__allocator_local_set = allocator != NULL;
+   if (allocator) stbi__allocator_local = *allocator;
+   stbi__allocator_set = 1;
+}
+
+#define stbi__allocator  (stbi__allocator_set                                                \
+                           ? (stbi__allocator_local_set ? &stbi__allocator_local : NULL)     \
+                           : (stbi__allocator_global_set ? &stbi__allocator_global : NULL))
+#endif // STBI_THREAD_LOCAL
+
 #ifndef STBI_MALLOC
-#define STBI_MALLOC(sz)           malloc(sz)
-#define STBI_REALLOC(p,newsz)     realloc(p,newsz)
-#define STBI_FREE(p)              free(p)
+static void *stbi__allocator_malloc(size_t size)
+{
+   stbi_allocator const *a = stbi__allocator;
+   return a ? a->allocate(a->user, size) : malloc(size);
+}
+
+// only zlib (PNG) and GIF grow their buffers
+#if !defined(STBI_NO_ZLIB) || !defined(STBI_NO_GIF)
+static void *stbi__allocator_realloc(void *p, size_t old_size, size_t new_size)
+{
+   stbi_allocator const *a = stbi__allocator;
+   return a ? a->reallocate(a->user, p, old_size, new_size) : realloc(p, new_size);
+}
+#endif
+
+static void stbi__allocator_free(void *p)
+{
+   stbi_allocator const *a = stbi__allocator;
+   if (!a) free(p);
+   else if (p) a->deallocate(a->user, p);
+}
+
+#define STBI_MALLOC(sz)                    stbi__allocator_malloc(sz)
+#define STBI_REALLOC_SIZED(p,oldsz,newsz)  stbi__allocator_realloc(p,oldsz,newsz)
+#define STBI_FREE(p)                       stbi__allocator_free(p)
 #endif
 
 #ifndef STBI_REALLOC_SIZED
@@ -790,6 +890,78 @@ static int stbi__sse2_available(void)
 #define STBI_SIMD_ALIGN(type, name) type name
 #endif
 
+#if defined(STBI_SSE2) && !defined(STBI_NO_JPEG) && !defined(STBI_NO_AVX2)
+#if defined(__MINGW32__) && !defined(STBI_MINGW_ENABLE_AVX2)
+// MinGW GCC doesn't realign the stack to 32 bytes for spilled AVX registers
+// (gcc bug 54412), and aligned moves to those slots fault.
+#elif defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5)
+#define STBI_AVX2
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && _MSC_VER >= 1900 && defined(__AVX__)
+// without /arch:AVX, MSVC keeps the legacy encoding for the SSE intrinsics
+// the kernels also use, and switching between them costs more than AVX2 saves
+#define STBI_AVX2
+#define STBI__AVX2_TARGET
+#endif
+#endif
+
+#ifdef STBI_AVX2
+#include <immintrin.h>
+#ifndef _MSC_VER
+#include <cpuid.h>
+#endif
+
+static int stbi__avx2_available(void)
+{
+   // AVX2 in CPUID leaf 7, and YMM state saved by the OS (OSXSAVE, then XCR0 bits 1 and 2)
+#ifdef _MSC_VER
+   int info[4];
+   __cpuid(info, 0);
+   if (info[0] < 7) return 0;
+   __cpuid(info, 1);
+   if (((info[2] >> 27) & 3) != 3) return 0; // OSXSAVE, AVX
+   if ((_xgetbv(0) & 6) != 6) return 0;
+   __cpuidex(info, 7, 0);
+   return (info[1] >> 5) & 1;
+#else
+   unsigned int eax, ebx, ecx, edx;
+   if (__get_cpuid_max(0, 0) < 7) return 0;
+   __cpuid(1, eax, ebx, ecx, edx);
+   if (((ecx >> 27) & 3) != 3) return 0; // OSXSAVE, AVX
+   __asm__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+   if ((eax & 6) != 6) return 0;
+   __cpuid_count(7, 0, eax, ebx, ecx, edx);
+   return (ebx >> 5) & 1;
+#endif
+}
+#endif
+
+static int stbi__simd_level_max = STBI_SIMD_AVX2;
+
+// the kernels the JPEG decoder uses
+static int stbi__simd_level(void)
+{
+   int level = STBI_SIMD_NONE;
+#ifndef STBI_NO_JPEG
+#ifdef STBI_SSE2
+   if (stbi__sse2_available()) level = STBI_SIMD_SSE2;
+#endif
+#ifdef STBI_NEON
+   level = STBI_SIMD_SSE2;
+#endif
+#ifdef STBI_AVX2
+   if (level == STBI_SIMD_SSE2 && stbi__avx2_available()) level = STBI_SIMD_AVX2;
+#endif
+#endif
+   return level < stbi__simd_level_max ? level : stbi__simd_level_max;
+}
+
+STBIDEF int stbi_set_simd_level(int max_level)
+{
+   stbi__simd_level_max = max_level;
+   return stbi__simd_level();
+}
+
 #ifndef STBI_MAX_DIMENSIONS
 #define STBI_MAX_DIMENSIONS (1 << 24)
 #endif
@@ -815,6 +987,12 @@ typedef struct
 
    stbi_uc *img_buffer, *img_buffer_end;
    stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+   // caller-owned output of stbi_load_*_into, NULL otherwise. a decoder that
+   // writes its rows there itself returns this pointer as its result
+   stbi_uc *into;
+   size_t into_size;
+   int into_stride, into_flip;
 } stbi__context;
 
 
@@ -824,6 +1002,7 @@ static void stbi__refill_buffer(stbi__context *s);
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
    s->io.read = NULL;
+   s->into = NULL;
    s->read_from_callbacks = 0;
    s->callback_already_read = 0;
    s->img_buffer = s->img_buffer_original = (stbi_uc *) buffer;
@@ -835,6 +1014,7 @@ static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *
 {
    s->io = *c;
    s->io_user_data = user;
+   s->into = NULL;
    s->buflen = sizeof(s->buffer_start);
    s->read_from_callbacks = 1;
    s->callback_already_read = 0;
@@ -1281,6 +1461,54 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
    return (unsigned char *) result;
 }
 
+// first byte of image row 'row' in the caller's output of stbi_load_*_into
+static stbi_uc *stbi__into_row(stbi__context *s, int height, int row)
+{
+   return s->into + (size_t) s->into_stride * (size_t) (s->into_flip ? height - 1 - row : row);
+}
+
+static int stbi__into_fits(stbi__context *s, int w, int h, int n)
+{
+   if (s->into_stride < w * n) return stbi__err("bad stride", "Output rows narrower than the image");
+   if ((size_t) s->into_stride * (size_t) (h - 1) + (size_t) w * n > s->into_size)
+      return stbi__err("output too small", "Output smaller than the image");
+   return 1;
+}
+
+static int stbi__load_into(stbi__context *s, stbi_uc *output, size_t output_size, int stride, int flip, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__result_info ri;
+   void *result;
+   int row;
+
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "desired_channels must be 1 to 4");
+   if (output == NULL) return stbi__err("no output", "Output is NULL");
+   s->into = output;
+   s->into_size = output_size;
+   s->into_stride = stride;
+   s->into_flip = flip;
+
+   result = stbi__load_main(s, x, y, comp, req_comp, &ri, 8);
+   if (result == NULL)
+      return 0;
+   // written in place by the decoder, size already checked
+   if (result == output)
+      return 1;
+
+   if (ri.bits_per_channel != 8) {
+      result = stbi__convert_16_to_8((stbi__uint16 *) result, *x, *y, req_comp);
+      if (result == NULL) return 0;
+   }
+   if (!stbi__into_fits(s, *x, *y, req_comp)) {
+      STBI_FREE(result);
+      return 0;
+   }
+   for (row = 0; row < *y; ++row)
+      memcpy(stbi__into_row(s, *y, row), (stbi_uc *) result + (size_t) row * *x * req_comp, (size_t) *x * req_comp);
+   STBI_FREE(result);
+   return 1;
+}
+
 static stbi__uint16 *stbi__load_and_postprocess_16bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
    stbi__result_info ri;
@@ -1384,6 +1612,29 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
    return result;
 }
 
+STBIDEF int stbi_load_into(char const *filename, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *comp, int req_comp)
+{
+   FILE *f = stbi__fopen(filename, "rb");
+   int result;
+   if (!f) return stbi__err("can't fopen", "Unable to open file");
+   result = stbi_load_from_file_into(f,output,output_size,stride_in_bytes,flip_vertically,x,y,comp,req_comp);
+   fclose(f);
+   return result;
+}
+
+STBIDEF int stbi_load_from_file_into(FILE *f, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *comp, int req_comp)
+{
+   int result;
+   stbi__context s;
+   stbi__start_file(&s,f);
+   result = stbi__load_into(&s,output,output_size,stride_in_bytes,flip_vertically,x,y,comp,req_comp);
+   if (result) {
+      // need to 'unget' all the characters in the IO buffer
+      fseek(f, - (int) (s.img_buffer_end - s.img_buffer), SEEK_CUR);
+   }
+   return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
    stbi__uint16 *result;
@@ -1438,6 +1689,20 @@ STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *u
    return stbi__load_and_postprocess_8bit(&s,x,y,comp,req_comp);
 }
 
+STBIDEF int stbi_load_from_memory_into(stbi_uc const *buffer, int len, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_mem(&s,buffer,len);
+   return stbi__load_into(&s,output,output_size,stride_in_bytes,flip_vertically,x,y,comp,req_comp);
+}
+
+STBIDEF int stbi_load_from_callbacks_into(stbi_io_callbacks const *clbk, void *user, stbi_uc *output, size_t output_size, int stride_in_bytes, int flip_vertically, int *x, int *y, int *comp, int req_comp)
+{
+   stbi__context s;
+   stbi__start_callbacks(&s, (stbi_io_callbacks *) clbk, user);
+   return stbi__load_into(&s,output,output_size,stride_in_bytes,flip_vertically,x,y,comp,req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp)
 {
@@ -2702,6 +2967,165 @@ static void stbi__idct_simd(stbi_uc *out, int out_stride, short data[64])
 
 #endif // STBI_SSE2
 
+#ifdef STBI_AVX2
+// AVX2 version of the sse2 IDCT, with the same arithmetic and so the same
+// results. the 32-bit math covers all 8 columns of a pass in one register
+// instead of two halves; rows and transposes stay 128-bit.
+static STBI__AVX2_TARGET void stbi__idct_avx2(stbi_uc *out, int out_stride, short data[64])
+{
+   __m128i row0, row1, row2, row3, row4, row5, row6, row7;
+   __m128i tmp;
+
+   // dot product constant: even elems=x, odd elems=y
+   #define dct_const(x,y)  _mm256_set1_epi32((int) (((unsigned int) (unsigned short) (y) << 16) | (unsigned short) (x)))
+
+   // out(0) = c0[even]*x + c0[odd]*y   (c0, x, y 16-bit, out 32-bit)
+   // out(1) = c1[even]*x + c1[odd]*y
+   #define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##xy = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16((x),(y))), _mm_unpackhi_epi16((x),(y)), 1); \
+      __m256i out0 = _mm256_madd_epi16(c0##xy, c0); \
+      __m256i out1 = _mm256_madd_epi16(c0##xy, c1)
+
+   // out = in << 12  (in 16-bit, out 32-bit)
+   #define dct_widen(out, in) \
+      __m256i out = _mm256_slli_epi32(_mm256_cvtepi16_epi32(in), 12)
+
+   // butterfly a/b, add bias, then shift by "s" and pack
+   #define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased = _mm256_add_epi32(a, bias); \
+         __m256i sum = _mm256_srai_epi32(_mm256_add_epi32(abiased, b), s); \
+         __m256i dif = _mm256_srai_epi32(_mm256_sub_epi32(abiased, b), s); \
+         __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(sum, dif), 0xd8); \
+         out0 = _mm256_castsi256_si128(packed); \
+         out1 = _mm256_extracti128_si256(packed, 1); \
+      }
+
+   // 8-bit interleave step (for transposes)
+   #define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi8(a, b); \
+      b = _mm_unpackhi_epi8(tmp, b)
+
+   // 16-bit interleave step (for transposes)
+   #define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm_unpacklo_epi16(a, b); \
+      b = _mm_unpackhi_epi16(tmp, b)
+
+   #define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m128i sum04 = _mm_add_epi16(row0, row4); \
+         __m128i dif04 = _mm_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         __m256i x0 = _mm256_add_epi32(t0e, t3e); \
+         __m256i x3 = _mm256_sub_epi32(t0e, t3e); \
+         __m256i x1 = _mm256_add_epi32(t1e, t2e); \
+         __m256i x2 = _mm256_sub_epi32(t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m128i sum17 = _mm_add_epi16(row1, row7); \
+         __m128i sum35 = _mm_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         __m256i x4 = _mm256_add_epi32(y0o, y4o); \
+         __m256i x5 = _mm256_add_epi32(y1o, y5o); \
+         __m256i x6 = _mm256_add_epi32(y2o, y5o); \
+         __m256i x7 = _mm256_add_epi32(y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+   __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+   __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f( 0.765366865f), stbi__f2f(0.5411961f));
+   __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+   __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+   __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f( 0.298631336f), stbi__f2f(-1.961570560f));
+   __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f( 3.072711026f));
+   __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f( 2.053119869f), stbi__f2f(-0.390180644f));
+   __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f( 1.501321110f));
+
+   // rounding biases in column/row passes, see stbi__idct_block for explanation.
+   __m256i bias_0 = _mm256_set1_epi32(512);
+   __m256i bias_1 = _mm256_set1_epi32(65536 + (128<<17));
+
+   // load
+   row0 = _mm_load_si128((const __m128i *) (data + 0*8));
+   row1 = _mm_load_si128((const __m128i *) (data + 1*8));
+   row2 = _mm_load_si128((const __m128i *) (data + 2*8));
+   row3 = _mm_load_si128((const __m128i *) (data + 3*8));
+   row4 = _mm_load_si128((const __m128i *) (data + 4*8));
+   row5 = _mm_load_si128((const __m128i *) (data + 5*8));
+   row6 = _mm_load_si128((const __m128i *) (data + 6*8));
+   row7 = _mm_load_si128((const __m128i *) (data + 7*8));
+
+   // column pass
+   dct_pass(bias_0, 10);
+
+   {
+      // 16bit 8x8 transpose
+      dct_interleave16(row0, row4);
+      dct_interleave16(row1, row5);
+      dct_interleave16(row2, row6);
+      dct_interleave16(row3, row7);
+
+      dct_interleave16(row0, row2);
+      dct_interleave16(row1, row3);
+      dct_interleave16(row4, row6);
+      dct_interleave16(row5, row7);
+
+      dct_interleave16(row0, row1);
+      dct_interleave16(row2, row3);
+      dct_interleave16(row4, row5);
+      dct_interleave16(row6, row7);
+   }
+
+   // row pass
+   dct_pass(bias_1, 17);
+
+   {
+      // pack, then 8bit 8x8 transpose
+      __m128i p0 = _mm_packus_epi16(row0, row1);
+      __m128i p1 = _mm_packus_epi16(row2, row3);
+      __m128i p2 = _mm_packus_epi16(row4, row5);
+      __m128i p3 = _mm_packus_epi16(row6, row7);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      dct_interleave8(p0, p1);
+      dct_interleave8(p2, p3);
+
+      dct_interleave8(p0, p2);
+      dct_interleave8(p1, p3);
+
+      // store
+      _mm_storel_epi64((__m128i *) out, p0); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p0, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p2); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p2, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p1); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p1, 0x4e)); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, p3); out += out_stride;
+      _mm_storel_epi64((__m128i *) out, _mm_shuffle_epi32(p3, 0x4e));
+   }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+}
+
+#endif // STBI_AVX2
+
 #ifdef STBI_NEON
 
 // NEON integer IDCT. should produce bit-identical
@@ -3641,6 +4065,78 @@ static stbi_uc *stbi__resample_row_hv_2_simd(stbi_uc *out, stbi_uc *in_near, stb
 }
 #endif
 
+#ifdef STBI_AVX2
+// the sse2 loop above, 16 pixels at a time
+static STBI__AVX2_TARGET stbi_uc *stbi__resample_row_hv_2_avx2(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
+{
+   int i=0,t0,t1;
+
+   if (w == 1) {
+      out[0] = out[1] = stbi__div4(3*in_near[0] + in_far[0] + 2);
+      return out;
+   }
+
+   t1 = 3*in_near[0] + in_far[0];
+   for (; i < ((w-1) & ~15); i += 16) {
+      // vertical pass, 3*x + y = 4*x + (y - x)
+      __m256i farw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_far + i)));
+      __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (in_near + i)));
+      __m256i diff  = _mm256_sub_epi16(farw, nearw);
+      __m256i nears = _mm256_slli_epi16(nearw, 2);
+      __m256i curr  = _mm256_add_epi16(nears, diff); // current row
+
+      // "prev" and "next" are the current row shifted by 1 pixel. byte shifts
+      // don't cross the 128-bit lanes, so align with the row moved by a lane.
+      __m256i lo0  = _mm256_permute2x128_si256(curr, curr, 0x08); // 0, low half
+      __m256i hi0  = _mm256_permute2x128_si256(curr, curr, 0x81); // high half, 0
+      __m256i prv0 = _mm256_alignr_epi8(curr, lo0, 14);
+      __m256i nxt0 = _mm256_alignr_epi8(hi0, curr, 2);
+      __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+      __m256i next = _mm256_insert_epi16(nxt0, 3*in_near[i+16] + in_far[i+16], 15);
+
+      // horizontal filter, polyphase implementation since it's convenient:
+      // even pixels = 3*cur + prev = cur*4 + (prev - cur)
+      // odd  pixels = 3*cur + next = cur*4 + (next - cur)
+      __m256i bias = _mm256_set1_epi16(8);
+      __m256i curs = _mm256_slli_epi16(curr, 2);
+      __m256i prvd = _mm256_sub_epi16(prev, curr);
+      __m256i nxtd = _mm256_sub_epi16(next, curr);
+      __m256i curb = _mm256_add_epi16(curs, bias);
+      __m256i even = _mm256_add_epi16(prvd, curb);
+      __m256i odd  = _mm256_add_epi16(nxtd, curb);
+
+      // interleave even and odd pixels, then undo scaling. within each lane,
+      // so the pack puts the 32 outputs back in order.
+      __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+      __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+      __m256i de0  = _mm256_srli_epi16(int0, 4);
+      __m256i de1  = _mm256_srli_epi16(int1, 4);
+
+      __m256i outv = _mm256_packus_epi16(de0, de1);
+      _mm256_storeu_si256((__m256i *) (out + i*2), outv);
+
+      // "previous" value for next iter
+      t1 = 3*in_near[i+15] + in_far[i+15];
+   }
+
+   t0 = t1;
+   t1 = 3*in_near[i] + in_far[i];
+   out[i*2] = stbi__div16(3*t1 + t0 + 8);
+
+   for (++i; i < w; ++i) {
+      t0 = t1;
+      t1 = 3*in_near[i]+in_far[i];
+      out[i*2-1] = stbi__div16(3*t0 + t1 + 8);
+      out[i*2  ] = stbi__div16(3*t1 + t0 + 8);
+   }
+   out[w*2-1] = stbi__div4(t1+2);
+
+   STBI_NOTUSED(hs);
+
+   return out;
+}
+#endif
+
 static stbi_uc *stbi__resample_row_generic(stbi_uc *out, stbi_uc *in_near, stbi_uc *in_far, int w, int hs)
 {
    // resample with nearest-neighbor
@@ -3815,6 +4311,97 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 }
 #endif
 
+#ifdef STBI_AVX2
+// the sse2 conversion, 16 pixels at a time. step == 3 is cheap to
+// interleave with byte shuffles, and it's what RGB loads use.
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc *out, stbi_uc const *y, stbi_uc const *pcb, stbi_uc const *pcr, int count, int step)
+{
+   int i = 0;
+
+   if (step == 4 || step == 3) {
+      __m128i signflip  = _mm_set1_epi8(-0x80);
+      __m256i cr_const0 = _mm256_set1_epi16(   (short) ( 1.40200f*4096.0f+0.5f));
+      __m256i cr_const1 = _mm256_set1_epi16( - (short) ( 0.71414f*4096.0f+0.5f));
+      __m256i cb_const0 = _mm256_set1_epi16( - (short) ( 0.34414f*4096.0f+0.5f));
+      __m256i cb_const1 = _mm256_set1_epi16(   (short) ( 1.77200f*4096.0f+0.5f));
+      __m256i y_bias = _mm256_set1_epi16(8); // (y << 8 | 128) >> 4 in the sse2 version
+      __m256i xw = _mm256_set1_epi16(255); // alpha channel
+      // where each byte of 8 rgb pixels comes from, in rg (r0..r7 g0..g7) or in b (b0..b7)
+      __m256i rg_lo = _mm256_setr_epi8(0,8,-1,1,9,-1,2,10,-1,3,11,-1,4,12,-1,5, 0,8,-1,1,9,-1,2,10,-1,3,11,-1,4,12,-1,5);
+      __m256i b_lo  = _mm256_setr_epi8(-1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1, -1,-1,0,-1,-1,1,-1,-1,2,-1,-1,3,-1,-1,4,-1);
+      __m256i rg_hi = _mm256_setr_epi8(13,-1,6,14,-1,7,15,-1,-1,-1,-1,-1,-1,-1,-1,-1, 13,-1,6,14,-1,7,15,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+      __m256i b_hi  = _mm256_setr_epi8(-1,5,-1,-1,6,-1,-1,7,-1,-1,-1,-1,-1,-1,-1,-1, -1,5,-1,-1,6,-1,-1,7,-1,-1,-1,-1,-1,-1,-1,-1);
+
+      for (; i+15 < count; i += 16) {
+         // load, widen to short (cr, cb biased by -128 and left-shifted by 8)
+         __m256i yw  = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i *) (y+i)));
+         __m256i crw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(_mm_xor_si128(_mm_loadu_si128((__m128i *) (pcr+i)), signflip)), 8);
+         __m256i cbw = _mm256_slli_epi16(_mm256_cvtepi8_epi16(_mm_xor_si128(_mm_loadu_si128((__m128i *) (pcb+i)), signflip)), 8);
+
+         // color transform
+         __m256i yws = _mm256_add_epi16(_mm256_slli_epi16(yw, 4), y_bias);
+         __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+         __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+         __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+         __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+         __m256i rws = _mm256_add_epi16(cr0, yws);
+         __m256i gwt = _mm256_add_epi16(cb0, yws);
+         __m256i bws = _mm256_add_epi16(yws, cb1);
+         __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+         // descale
+         __m256i rw = _mm256_srai_epi16(rws, 4);
+         __m256i bw = _mm256_srai_epi16(bws, 4);
+         __m256i gw = _mm256_srai_epi16(gws, 4);
+
+         // back to byte and interleave. the low lane holds pixels 0..7, the high lane 8..15.
+         if (step == 4) {
+            __m256i brb = _mm256_packus_epi16(rw, bw);
+            __m256i gxb = _mm256_packus_epi16(gw, xw);
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1); // pixels 0..3, 8..11
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1); // pixels 4..7, 12..15
+            _mm256_storeu_si256((__m256i *) (out + 0), _mm256_permute2x128_si256(o0, o1, 0x20));
+            _mm256_storeu_si256((__m256i *) (out + 32), _mm256_permute2x128_si256(o0, o1, 0x31));
+            out += 64;
+         } else {
+            __m256i rg = _mm256_packus_epi16(rw, gw);
+            __m256i bb = _mm256_packus_epi16(bw, bw);
+            __m256i o0 = _mm256_or_si256(_mm256_shuffle_epi8(rg, rg_lo), _mm256_shuffle_epi8(bb, b_lo)); // bytes 0..15 of 8 pixels
+            __m256i o1 = _mm256_or_si256(_mm256_shuffle_epi8(rg, rg_hi), _mm256_shuffle_epi8(bb, b_hi)); // bytes 16..23
+            _mm_storeu_si128((__m128i *) (out + 0), _mm256_castsi256_si128(o0));
+            _mm_storel_epi64((__m128i *) (out + 16), _mm256_castsi256_si128(o1));
+            _mm_storeu_si128((__m128i *) (out + 24), _mm256_extracti128_si256(o0, 1));
+            _mm_storel_epi64((__m128i *) (out + 40), _mm256_extracti128_si256(o1, 1));
+            out += 48;
+         }
+      }
+   }
+
+   for (; i < count; ++i) {
+      int y_fixed = (y[i] << 20) + (1<<19); // rounding
+      int r,g,b;
+      int cr = pcr[i] - 128;
+      int cb = pcb[i] - 128;
+      r = y_fixed + cr* stbi__float2fixed(1.40200f);
+      g = y_fixed + cr*-stbi__float2fixed(0.71414f) + ((cb*-stbi__float2fixed(0.34414f)) & 0xffff0000);
+      b = y_fixed                                   +   cb* stbi__float2fixed(1.77200f);
+      r >>= 20;
+      g >>= 20;
+      b >>= 20;
+      if ((unsigned) r > 255) { if (r < 0) r = 0; else r = 255; }
+      if ((unsigned) g > 255) { if (g < 0) g = 0; else g = 255; }
+      if ((unsigned) b > 255) { if (b < 0) b = 0; else b = 255; }
+      out[0] = (stbi_uc)r;
+      out[1] = (stbi_uc)g;
+      out[2] = (stbi_uc)b;
+      out[3] = 255;
+      out += step;
+   }
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
@@ -3822,18 +4409,22 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
-#ifdef STBI_SSE2
-   if (stbi__sse2_available()) {
-      j->idct_block_kernel = stbi__idct_simd;
-      j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-      j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
-   }
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+   {
+      int level = stbi__simd_level();
+      if (level >= STBI_SIMD_SSE2) {
+         j->idct_block_kernel = stbi__idct_simd;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+      }
+#ifdef STBI_AVX2
+      if (level >= STBI_SIMD_AVX2) {
+         j->idct_block_kernel = stbi__idct_avx2;
+         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+      }
 #endif
-
-#ifdef STBI_NEON
-   j->idct_block_kernel = stbi__idct_simd;
-   j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
-   j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+   }
 #endif
 }
 
@@ -3889,7 +4480,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    {
       int k;
       unsigned int i,j;
-      stbi_uc *output;
+      stbi_uc *output, *line = NULL;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
@@ -3917,12 +4508,24 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       }
 
       // can't error after this so, this is safe
-      output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-      if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      if (z->s->into) {
+         // rows go straight to the caller's output of stbi_load_*_into
+         if (!stbi__into_fits(z->s, z->s->img_x, z->s->img_y, n)) { stbi__cleanup_jpeg(z); return NULL; }
+         output = z->s->into;
+         // 3-channel rows are written 4 bytes per pixel, one byte past their end:
+         // convert them in a line buffer, the caller's row has no byte to spare
+         if (n == 3) {
+            line = (stbi_uc *) stbi__malloc_mad2(n, z->s->img_x, 1);
+            if (!line) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         }
+      } else {
+         output = (stbi_uc *) stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+      }
 
       // now go ahead and resample
       for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
+         stbi_uc *out = line ? line : z->s->into ? stbi__into_row(z->s, z->s->img_y, j) : output + n * z->s->img_x * j;
          for (k=0; k < decode_n; ++k) {
             stbi__resample *r = &res_comp[k];
             int y_bot = r->ystep >= (r->vs >> 1);
@@ -4014,7 +4617,10 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
             }
          }
+         if (line)
+            memcpy(stbi__into_row(z->s, z->s->img_y, j), line, n * z->s->img_x);
       }
+      STBI_FREE(line);
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
       *out_y = z->s->img_y;
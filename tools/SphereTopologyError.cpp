@@ -0,0 +1,101 @@
+// Reports the vertex and triangle count each sphere topology needs to stay within
+// a maximum geometric error of the analytic unit sphere.
+//
+// Usage: SphereTopologyError [maxError...]   (default: 0.01 0.001 0.0001)
+#include <SphereMesh.h>
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct TopologyResult
+{
+    std::string parameter;
+    std::size_t vertexCount = 0;
+    std::size_t triangleCount = 0;
+    float error = 0.0f;
+};
+
+// Smallest parameter in [minimum, maximum] whose mesh meets the error, the error shrinks as the parameter grows
+TopologyResult findSmallest(int minimum, int maximum, float maxError, std::function<Mesh(int)> const &generate, std::function<std::string(int)> const &describe)
+{
+    // Grow geometrically until the error is met, then binary search the last interval
+    int low = minimum, high = minimum;
+    while (high < maximum && measureSphereError(generate(high), 1.0f) > maxError)
+    {
+        low = high + 1;
+        high = std::min(maximum, std::max(high * 2, high + 1));
+    }
+    while (low < high)
+    {
+        int middle = low + (high - low) / 2;
+        if (measureSphereError(generate(middle), 1.0f) > maxError)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    Mesh mesh = generate(high);
+    TopologyResult result;
+    result.parameter = describe(high);
+    result.vertexCount = mesh.vertices.size();
+    result.triangleCount = mesh.indexCount() / 3;
+    result.error = measureSphereError(mesh, 1.0f);
+    return result;
+}
+
+void print(std::string const &topology, TopologyResult const &result)
+{
+    std::cout << std::setw(12) << topology << std::setw(16) << result.parameter << std::setw(12) << result.vertexCount
+              << std::setw(12) << result.triangleCount << std::setw(14) << std::scientific << std::setprecision(3)
+              << result.error << std::defaultfloat << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<float> maxErrors;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        float maxError = std::strtof(argv[arg], nullptr);
+        if (maxError <= 0.0f)
+        {
+            std::cerr << "Invalid maximum error: " << argv[arg] << std::endl;
+            return 1;
+        }
+        maxErrors.push_back(maxError);
+    }
+    if (maxErrors.empty())
+    {
+        maxErrors = {0.01f, 0.001f, 0.0001f};
+    }
+
+    for (auto maxError : maxErrors)
+    {
+        std::cout << "Maximum error " << maxError << " (unit sphere)" << std::endl;
+        std::cout << std::setw(12) << "topology" << std::setw(16) << "parameter" << std::setw(12) << "vertices"
+                  << std::setw(12) << "triangles" << std::setw(14) << "error" << std::endl;
+
+        // The UV sphere spans twice the angle around as from pole to pole, so use twice the segments
+        print("UV", findSmallest(2, 4096, maxError, [](int segments)
+                                 { return createSphere(1.0f, 2 * segments, segments); },
+                                 [](int segments)
+                                 { return std::to_string(2 * segments) + "x" + std::to_string(segments); }));
+        print("icosphere", findSmallest(0, 10, maxError, [](int subdivisions)
+                                        { return createIcoSphere(1.0f, subdivisions); },
+                                        [](int subdivisions)
+                                        { return "level " + std::to_string(subdivisions); }));
+        print("cube", findSmallest(1, 4096, maxError, [](int segments)
+                                   { return createCubeSphere(1.0f, segments); },
+                                   [](int segments)
+                                   { return std::to_string(segments) + " per face"; }));
+        std::cout << std::endl;
+    }
+    return 0;
+}
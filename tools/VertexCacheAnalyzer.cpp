@@ -0,0 +1,75 @@
+// Offline post-transform cache analysis of the generated sphere index buffers.
+// Simulates FIFO and LRU caches on the CPU and reports ACMR/ATVR for the original
+// order, after the vertex cache pass and after the overdraw pass.
+//
+// Usage: VertexCacheAnalyzer [cacheSize...]   (default: 8 16 32)
+#include <SphereMesh.h>
+#include <MeshOptimizer.h>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void report(std::string const &name, Mesh const &mesh, std::vector<std::size_t> const &cacheSizes)
+{
+    for (auto cacheSize : cacheSizes)
+    {
+        for (auto model : {VertexCacheModel::Fifo, VertexCacheModel::Lru})
+        {
+            VertexCacheStatistics statistics;
+            visitIndices(mesh, [&](auto const &indices)
+                         { statistics = analyzeVertexCache(indices, mesh.vertices.size(), cacheSize, model); });
+            std::cout << std::setw(18) << name << std::setw(6) << (VertexCacheModel::Fifo == model ? "FIFO" : "LRU")
+                      << std::setw(6) << cacheSize << std::fixed << std::setprecision(3)
+                      << std::setw(10) << statistics.acmr() << std::setw(10) << statistics.atvr() << std::endl;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::size_t> cacheSizes;
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        auto cacheSize = std::strtoul(argv[arg], nullptr, 10);
+        if (0 == cacheSize)
+        {
+            std::cerr << "Invalid cache size: " << argv[arg] << std::endl;
+            return 1;
+        }
+        cacheSizes.push_back(cacheSize);
+    }
+    if (cacheSizes.empty())
+    {
+        cacheSizes = {8, 16, 32};
+    }
+
+    for (int segments : {20, 64, 256})
+    {
+        Mesh mesh = createSphere(2.0f, segments, segments);
+        std::cout << "Sphere " << segments << "x" << segments << ": " << mesh.vertices.size() << " vertices, "
+                  << mesh.indexCount() / 3 << " triangles" << std::endl;
+        std::cout << std::setw(18) << "order" << std::setw(6) << "cache" << std::setw(6) << "size"
+                  << std::setw(10) << "ACMR" << std::setw(10) << "ATVR" << std::endl;
+        report("original", mesh, cacheSizes);
+
+        auto start = std::chrono::steady_clock::now();
+        visitIndices(mesh, [&](auto &indices)
+                     { optimizeVertexCache(indices, mesh.vertices.size()); });
+        std::chrono::duration<double, std::milli> vertexCacheTime = std::chrono::steady_clock::now() - start;
+        report("vertex cache", mesh, cacheSizes);
+
+        start = std::chrono::steady_clock::now();
+        visitIndices(mesh, [&](auto &indices)
+                     { optimizeOverdraw(indices, mesh.vertices); });
+        std::chrono::duration<double, std::milli> overdrawTime = std::chrono::steady_clock::now() - start;
+        report("+ overdraw", mesh, cacheSizes);
+
+        std::cout << "Optimization time: vertex cache " << vertexCacheTime.count() << " ms, overdraw "
+                  << overdrawTime.count() << " ms" << std::endl
+                  << std::endl;
+    }
+    return 0;
+}